@@ -13,8 +13,12 @@
 
 
 #include <stdbool.h>
+#include <stddef.h> /* for size_t */
 
+#include "checkpoint.h"
+#include "control.h"
 #include "gridwindow.h"
+#include "stats_writer.h"
 
 
 
@@ -24,6 +28,45 @@
 #define VERSION_STRING "1.0"
 
 
+/**
+ * The settings of the run of the simulation.
+ */
+struct run_options {
+	/** Whether to run the simulation without opening a window. */
+	bool headless;
+	/** The number of generations to compute in headless mode, or \c 0 to run
+	    until interrupted. */
+	unsigned long generations;
+	/** Whether to restore the grid from the latest checkpoint. */
+	bool resume;
+	/** The settings of the periodic checkpoints. */
+	struct checkpoint_params checkpoint;
+	/** The number of threads updating the grid, or \c 0. */
+	unsigned int threads;
+	/** Whether to report the speed of the headless run. */
+	bool benchmark;
+	/** The memory budget of the generations kept to step backwards in the
+	    window, in mebibytes, or \c 0 to keep none. */
+	unsigned int history;
+	/** The path to the file to write the trace of the run to, or \c NULL to
+	    record none. */
+	const char *trace;
+	/** The path to the file to write the statistics of the generations to in
+	    headless mode, or \c NULL to write none. */
+	const char *stats;
+	/** The number of generations between two recorded statistics. */
+	unsigned long stats_every;
+	/** The path to the file to write the metrics of the run to, or \c NULL
+	    to write none. */
+	const char *metrics;
+	/** The number of seconds between two writes of the metrics. */
+	unsigned int metrics_interval;
+	/** The path to the file to read the commands driving the run from, or
+	    \c NULL to read none. */
+	const char *control;
+};
+
+
 /**
  * Initialize the context of the application.
  *
@@ -60,6 +103,7 @@ int init_app(void);
  * \param[out] in_file      The path to the file from which to read
  * \param[out] out_file     The pat to the file where to write
  * \param[out] format       The grid representation format in the input file
+ * \param[out] options      The settings of the run
  *
  * \return \c 0 on success
  */
@@ -67,7 +111,8 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
                   unsigned int *grid_height, bool *wrap, const char **game_rule,
                   unsigned int *cell_pixels, unsigned int *border_width,
                   unsigned int *update_rate, const char **in_file,
-                  const char **out_file, enum grid_format *format);
+                  const char **out_file, enum grid_format *format,
+                  struct run_options *options);
 
 
 /**
@@ -75,14 +120,66 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
  *
  * \param[in] gridwindow      The application's gridwindow to run
  * \param[in] update_rate     The number of times the grid evolves per second
- * \param[in] repr            A representation of the initial state to reset to
- * \param[in] format          The format of the \p repr, RLE or plain text
+ * \param[in] initial         A copy of the initial grid to reset to, or \c NULL
+ * \param[in] history_budget  The memory budget in bytes of the generations
+ *                            kept to step backwards, or \c 0 to keep none
  * \param[in] out_file        The path to the file where to write the grid state
  * \param[in] out_file_format The format of the output file
+ * \param[in] checkpointer    The checkpointer of the grid, or \c NULL
+ * \param[in] control         The control reading the commands driving the
+ *                            grid, or \c NULL; the generations of its \c step
+ *                            commands are advanced through by one step of
+ *                            the speed per frame
  */
 void run_app(struct grid_window *gridwindow, unsigned int update_rate,
-             const char *repr, enum grid_format format, const char *out_file,
-             enum grid_format out_file_format);
+             const struct grid *initial, size_t history_budget,
+             const char *out_file,
+             enum grid_format out_file_format,
+             struct checkpointer *checkpointer, struct control *control);
+
+
+/**
+ * Evolve the grid without displaying it, as fast as possible.
+ *
+ * The run stops after the given number of generations, or when the program is
+ * interrupted (\c SIGINT or \c SIGTERM); in the latter case a last checkpoint
+ * is written.
+ *
+ * The grid is evolved by steps of several generations (see
+ * \c update_grid_generations), which stop at the generations of the
+ * checkpoints.
+ *
+ * With a control, the grid starts paused and evolves on its commands only,
+ * which are applied between the steps; the run also stops on the \c quit
+ * command, or when the input of the commands ends while the grid is paused.
+ *
+ * \param[in,out] grid         The grid to evolve
+ * \param[in]     generations  The number of generations to compute, or \c 0
+ *                             to run until interrupted
+ * \param[in]     checkpointer The checkpointer of the grid, or \c NULL
+ * \param[in]     stats        The writer of the statistics of the
+ *                             generations, or \c NULL
+ * \param[in]     control      The control reading the commands driving the
+ *                             grid, or \c NULL
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int run_headless(struct grid *grid, unsigned long generations,
+                 struct checkpointer *checkpointer,
+                 struct stats_writer *stats, struct control *control);
+
+
+/**
+ * Evolve the grid without displaying it, and report the speed of the run on
+ * the standard error stream, followed by the bandwidth between the processors
+ * and the memory of each node (see \c benchmark_numa).
+ *
+ * \param[in,out] grid        The grid to evolve
+ * \param[in]     generations The number of generations to compute
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int run_benchmark(struct grid *grid, unsigned long generations);
 
 
 /**
@@ -12,8 +12,13 @@
 #define BITS_H
 
 
+#include <stdbool.h>
 #include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint64_t */
 #include <stdio.h> /* for FILE */
+#ifdef _MSC_VER
+# include <intrin.h> /* for _BitScanReverse64, _BitScanForward64 */
+#endif
 
 
 
@@ -68,6 +73,104 @@ inline void toggle_bit(char *bits, size_t index) {
 	bits[index / 8] ^= 1 << (7 - index % 8);
 }
 
+/**
+ * Read the 64 bits starting at the given octet of the bit array as a word.
+ *
+ * The first bit of the array is the most significant bit of the word, so that
+ * the bit at index \c i of the array is the bit \c 63-i%64 of the word.
+ *
+ * \param[in] bits  The bit array
+ * \param[in] octet The index of the first octet to read, at least 8 octets
+ *                  before the end of the array
+ *
+ * \return The word made of the 64 bits
+ */
+inline uint64_t load_word(const char *bits, size_t octet) {
+	const unsigned char *octets = (const unsigned char *) &bits[octet];
+	uint64_t word = 0;
+	for (int i = 0; i < 8; ++i) {
+		word = word << 8 | octets[i];
+	}
+	return word;
+}
+
+/**
+ * Give the number of zero bits before the most significant set bit of the
+ * word, i.e. the index in the bit array of the first set bit of a word read
+ * with \c load_word.
+ *
+ * \param[in] word The word, not zero
+ *
+ * \return The number of leading zero bits
+ */
+inline unsigned int count_leading_zeros(uint64_t word) {
+#if defined(__GNUC__)
+	return (unsigned int) __builtin_clzll(word);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, word);
+	return 63 - index;
+#else
+	unsigned int count = 0;
+	for (unsigned int shift = 32; shift > 0; shift /= 2) {
+		if (word >> (64 - shift) == 0) {
+			count += shift;
+			word <<= shift;
+		}
+	}
+	return count;
+#endif
+}
+
+/**
+ * Give the number of zero bits after the least significant set bit of the
+ * word, i.e. the distance from the last set bit of a word read with
+ * \c load_word to the end of the word.
+ *
+ * \param[in] word The word, not zero
+ *
+ * \return The number of trailing zero bits
+ */
+inline unsigned int count_trailing_zeros(uint64_t word) {
+#if defined(__GNUC__)
+	return (unsigned int) __builtin_ctzll(word);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return index;
+#else
+	unsigned int count = 0;
+	for (unsigned int shift = 32; shift > 0; shift /= 2) {
+		if (word << (64 - shift) == 0) {
+			count += shift;
+			word >>= shift;
+		}
+	}
+	return count;
+#endif
+}
+
+/**
+ * Give the number of set bits in the word.
+ *
+ * \param[in] word The word
+ *
+ * \return The number of set bits
+ */
+inline unsigned int count_set_bits(uint64_t word) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+	return (unsigned int) __builtin_popcountll(word);
+#else
+	/* Without the instruction, the builtin is a call to a library function,
+	   slower than counting the bits by pairs, nibbles then bytes inline */
+	word -= (word >> 1) & UINT64_C(0x5555555555555555);
+	word = (word & UINT64_C(0x3333333333333333))
+	       + ((word >> 2) & UINT64_C(0x3333333333333333));
+	word = (word + (word >> 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+	return (unsigned int) ((word * UINT64_C(0x0101010101010101)) >> 56);
+#endif
+}
+
 
 /**
  * Copy a range of bits.
@@ -113,4 +216,51 @@ int bits_equal(const char *bits1, size_t offset1, const char *bits2,
                size_t offset2, size_t length);
 
 
+
+/**
+ * Check whether all the bits of an array are zero.
+ *
+ * \param[in] data The array
+ * \param[in] size The size of the array, in bytes
+ *
+ * \return \c true iff no bit is set in the \p size bytes of \p data
+ */
+bool is_blank(const char *data, size_t size);
+
+
+/**
+ * The highest size of the output of \c pack_bits for the given size of input.
+ */
+#define PACKED_SIZE_MAX(size) ((size) + ((size) + 127) / 128)
+
+/**
+ * Compress an array of bytes as a sequence of runs of a repeated byte and of
+ * literal sequences, each preceded by a control byte: a value up to 127
+ * introduces the given number plus one of literal bytes, a value n above 128
+ * introduces a byte repeated 257 - n times.
+ *
+ * \param[in]  src  The bytes to compress
+ * \param[in]  size The number of bytes to compress
+ * \param[out] dest The array receiving the compressed bytes, of at least
+ *                  <tt>PACKED_SIZE_MAX(size)</tt> bytes
+ *
+ * \return The number of bytes written in \p dest
+ */
+size_t pack_bits(const unsigned char *src, size_t size, unsigned char *dest);
+
+/**
+ * Decompress the bytes produced by \c pack_bits.
+ *
+ * \param[in]  src       The compressed bytes
+ * \param[in]  size      The number of compressed bytes
+ * \param[out] dest      The array receiving the decompressed bytes
+ * \param[in]  dest_size The number of bytes expected in \p dest
+ *
+ * \return \c 0 on success, a negative value if the compressed bytes are
+ *         invalid or do not decompress to exactly \p dest_size bytes
+ */
+int unpack_bits(const unsigned char *src, size_t size, unsigned char *dest,
+                size_t dest_size);
+
+
 #endif /* BITS_H */
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "bookmarks.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the named bookmarks of the states of a grid, to
+ *        jump back to.
+ *
+ * A bookmark holds a copy of the bit planes of the grid and of its metadata,
+ * so that going back to it is a plain memory copy: nothing is read or parsed
+ * again.
+ */
+#ifndef BOOKMARKS_H
+#define BOOKMARKS_H
+
+
+#include <stddef.h> /* for size_t */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The largest length of the name of a bookmark.
+ */
+#define MAX_BOOKMARK_NAME 31
+
+
+/**
+ * \brief A state of a grid saved under a name.
+ */
+struct bookmark {
+	char name[MAX_BOOKMARK_NAME + 1]; /**< The name of the bookmark */
+	struct grid grid; /**< The copy of the grid */
+};
+
+/**
+ * \brief The type holding the bookmarks of a grid.
+ */
+struct bookmarks {
+	struct bookmark *items; /**< The bookmarks, in the order of creation */
+	size_t count; /**< The number of bookmarks */
+};
+
+
+/**
+ * \brief Initialize an empty set of bookmarks.
+ *
+ * \param[out] bookmarks The bookmarks to initialize
+ */
+void init_bookmarks(struct bookmarks *bookmarks);
+
+
+/**
+ * \brief Save the state of a grid under a name.
+ *
+ * A bookmark of the same name is replaced, its memory being reused if the
+ * grid has kept its dimensions.
+ *
+ * \param[in,out] bookmarks The bookmarks
+ * \param[in]     name      The name of the bookmark
+ * \param[in]     grid      The grid to save
+ *
+ * \return \c 0 on success, a negative value if the name is too long or on
+ *         allocation error
+ */
+int set_bookmark(struct bookmarks *bookmarks, const char *name,
+                 const struct grid *grid);
+
+
+/**
+ * \brief Restore a grid to the state saved under a name.
+ *
+ * \param[in]     bookmarks The bookmarks
+ * \param[in]     name      The name of the bookmark
+ * \param[in,out] grid      The grid to restore (see \c restore_grid)
+ *
+ * \return \c 0 on success, \c 1 if there is no bookmark of this name, a
+ *         negative value on allocation error
+ */
+int goto_bookmark(const struct bookmarks *bookmarks, const char *name,
+                  struct grid *grid);
+
+
+/**
+ * \brief Free the bookmarks.
+ *
+ * \param[in,out] bookmarks The bookmarks to free
+ */
+void free_bookmarks(struct bookmarks *bookmarks);
+
+#endif /* BOOKMARKS_H */
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "checkpoint.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file defines a structure that periodically saves the state of a
+ *        grid in checkpoint files, to recover long runs after a crash.
+ *
+ * The checkpoints are written in rotation in a bounded set of files, named
+ * after a base path suffixed with a dot and the index of the file in the
+ * rotation (e.g. \c run.cyckpt.0, \c run.cyckpt.1, etc.). The files are
+ * written in the background by a grid saver: the only cost for the simulation
+ * is the copy of the grid cells.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+
+#include <stdint.h> /* for uint64_t */
+#include <time.h> /* for time_t */
+
+#include "grid.h"
+#include "grid_saver.h"
+
+
+
+/**
+ * \brief The default number of checkpoint files kept in rotation.
+ */
+#define DEFAULT_CHECKPOINT_KEEP 3
+
+/**
+ * \brief The default delay between two checkpoints, in seconds, when no
+ *        frequency is specified.
+ */
+#define DEFAULT_CHECKPOINT_INTERVAL 300
+
+
+/**
+ * \brief The settings of the checkpoints of a run.
+ */
+struct checkpoint_params {
+	/** The base path of the checkpoint files, or \c NULL to disable the
+	    checkpoints. */
+	const char *path;
+	/** The number of generations between two checkpoints, or \c 0. */
+	unsigned long every;
+	/** The number of seconds between two checkpoints, or \c 0. */
+	unsigned int interval;
+	/** The number of checkpoint files kept in rotation. */
+	unsigned int keep;
+};
+
+
+/**
+ * \brief The type handling the periodic checkpoints of a grid.
+ */
+struct checkpointer {
+	/** The settings of the checkpoints. */
+	struct checkpoint_params params;
+	/** The paths of the files in rotation. */
+	char **paths;
+	/** The index in the rotation of the next file to write. */
+	unsigned int next;
+	/** The generation of the grid at the last checkpoint. */
+	uint64_t last_generation;
+	/** The time of the last checkpoint. */
+	time_t last_time;
+	/** The saver writing the checkpoints in the background. */
+	struct grid_saver saver;
+};
+
+
+/**
+ * \brief Initialize a checkpointer.
+ *
+ * If checkpoint files already exist, the rotation resumes after the most
+ * recent one.
+ *
+ * \param[out] checkpointer The checkpointer to initialize
+ * \param[in]  params       The settings of the checkpoints
+ * \param[in]  grid         The grid that will be checkpointed
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int init_checkpointer(struct checkpointer *checkpointer,
+                      const struct checkpoint_params *params,
+                      const struct grid *grid);
+
+
+/**
+ * \brief Write a checkpoint of the grid in the background if one is due.
+ *
+ * This function is meant to be called after each generation; it does nothing
+ * until the number of generations or the delay specified in the settings has
+ * elapsed since the last checkpoint. If the previous checkpoint is still being
+ * written, the new one is postponed.
+ *
+ * \param[in,out] checkpointer The checkpointer
+ * \param[in]     grid         The grid to checkpoint
+ *
+ * \return \c 1 if a checkpoint was started, \c 0 if none was, or a negative
+ *         value on error
+ */
+int update_checkpointer(struct checkpointer *checkpointer,
+                        const struct grid *grid);
+
+
+/**
+ * \brief Write a checkpoint of the grid immediately, whether one is due or
+ *        not, and wait for its completion.
+ *
+ * \param[in,out] checkpointer The checkpointer
+ * \param[in]     grid         The grid to checkpoint
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int flush_checkpointer(struct checkpointer *checkpointer,
+                       const struct grid *grid);
+
+
+/**
+ * \brief Wait for the checkpoint being written, if any, and release the
+ *        resources of the checkpointer.
+ *
+ * \param[in,out] checkpointer The checkpointer to free
+ */
+void free_checkpointer(struct checkpointer *checkpointer);
+
+
+/**
+ * \brief Initialize the grid from the most recent valid checkpoint file.
+ *
+ * The checkpoint files in rotation are examined and the one with the highest
+ * generation number that can be loaded is used.
+ *
+ * \param[out] grid   The grid to initialize
+ * \param[in]  params The settings of the checkpoints
+ *
+ * \return \c 0 if a checkpoint was loaded, a positive value if none could be
+ *         found, or a negative value on error
+ */
+int resume_from_checkpoint(struct grid *grid,
+                           const struct checkpoint_params *params);
+
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "control.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file defines a structure that reads commands driving a running
+ *        grid from a file, the standard input stream or a named pipe, and
+ *        applies them between two generations.
+ *
+ * The commands are read one per line by a thread of their own, and queued
+ * until the loop running the grid applies them, all those received at once,
+ * between two updates: the grid is never modified while it is updated. Each
+ * command is answered by a line starting with \c ok or \c error:
+ *  - \c step \c [N]: advance through \c N generations, \c 1 by default, the
+ *    following commands being applied after them
+ *  - \c pause, \c resume: stop or resume the evolution of the grid
+ *  - \c set \c X \c Y \c [X \c Y...], \c unset \c X \c Y \c [X \c Y...]:
+ *    bring the cells of the coordinates to life, or kill them
+ *  - \c rle \c X \c Y \c [or|xor|copy]: combine the cells of the RLE
+ *    pattern given on the following lines, up to its final \c !, with those
+ *    of the grid, its top left corner at the coordinates, as by \c blit_grid;
+ *    the header line of the pattern is optional, and the mode is \c or by
+ *    default
+ *  - \c query \c X \c Y \c W \c H: answer <tt>ok W H</tt> followed by \c H
+ *    lines of \c W cells of the rectangle, as in the plain text format
+ *  - \c count \c X \c Y \c W \c H: answer <tt>ok N</tt>, \c N being the
+ *    number of live cells in the rectangle
+ *  - \c save \c PATH: write the grid to the file, in the format of its
+ *    extension
+ *  - \c status: answer <tt>ok generation G population P paused</tt> (or
+ *    \c running)
+ *  - \c clear: kill all the cells
+ *  - \c quit: stop the run
+ *
+ * The coordinates of a cell are those of its column and row, from the top left
+ * corner of the grid, and must be in the grid. The patterns and the rectangles
+ * wrap around a toroidal grid; otherwise, the patterns are cut by the walls,
+ * and the rectangles must fit within them.
+ */
+#ifndef CONTROL_H
+#define CONTROL_H
+
+
+#include <stdbool.h>
+#include <stdio.h> /* for FILE */
+#include <threads.h> /* for thrd_t */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The course of the run, as changed by the commands.
+ */
+struct control_state {
+	/** Whether the grid evolves on its own. */
+	bool play;
+	/** The number of generations to advance through before applying the
+	    next commands. */
+	unsigned long steps;
+	/** Whether the run is to stop. */
+	bool quit;
+};
+
+
+/**
+ * \brief The queue of the commands read, shared with the reading thread.
+ */
+struct control_queue;
+
+
+/**
+ * \brief The type reading and applying the commands.
+ */
+struct control {
+	/** The commands read and not applied yet. */
+	struct control_queue *queue;
+	/** The thread reading the commands. */
+	thrd_t reader;
+	/** The stream the answers are written to. */
+	FILE *replies;
+};
+
+
+/**
+ * \brief Start reading the commands from a file.
+ *
+ * The file is opened by the reading thread, so that opening a named pipe does
+ * not wait for a writer.
+ *
+ * \param[out] control The control to initialize
+ * \param[in]  path    The path to the file to read the commands from, or
+ *                     \c - for the standard input stream; it must stay valid
+ *                     until \c close_control is called
+ * \param[in]  replies The stream to write the answers to
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int open_control(struct control *control, const char *path, FILE *replies);
+
+
+/**
+ * \brief Apply the commands received, in order.
+ *
+ * The application stops after a \c step command, so that the generations are
+ * advanced through before the next commands are applied. The commands after
+ * a \c quit command are not applied.
+ *
+ * \param[in,out] control The control
+ * \param[in,out] grid    The grid to apply the commands to
+ * \param[in,out] state   The course of the run
+ *
+ * \return \c 0 if all the commands received were applied, a positive value if
+ *         some are left after a \c step command, or a negative value on
+ *         allocation error; the errors of the commands themselves are only
+ *         answered
+ */
+int apply_control(struct control *control, struct grid *grid,
+                  struct control_state *state);
+
+
+/**
+ * \brief Wait for commands to be received, for a given time at most.
+ *
+ * \param[in,out] control      The control
+ * \param[in]     milliseconds The longest time to wait
+ *
+ * \return \c false if no command is left to apply and the input has ended,
+ *         \c true otherwise
+ */
+bool wait_control(struct control *control, unsigned int milliseconds);
+
+
+/**
+ * \brief Stop reading the commands and release the resources of the control.
+ *
+ * If the reading thread is still waiting for a line, it is left to end with
+ * the input, and releases the queue itself.
+ *
+ * \param[in,out] control The control to close
+ */
+void close_control(struct control *control);
+
+
+#endif /* CONTROL_H */
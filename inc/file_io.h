@@ -13,6 +13,7 @@
 
 
 #include <stdbool.h>
+#include <stddef.h> /* for size_t */
 
 
 
@@ -34,6 +35,21 @@
 char *read_file(const char *path);
 
 
+/**
+ * \brief Read the full content of the file of given path as binary data.
+ *
+ * Contrary to \c read_file, the content is returned verbatim.
+ *
+ * \note The returned value is allocated on the heap and needs to be freed.
+ *
+ * \param[in]  path The path to the source file
+ * \param[out] size The number of bytes read
+ *
+ * \return The content of the file, or \c NULL if an error occurred
+ */
+void *read_binary_file(const char *path, size_t *size);
+
+
 /**
  * \brief Write the given text to the file of given path.
  *
@@ -43,6 +59,10 @@ char *read_file(const char *path);
  * \note If the file does not exist, it will be created, otherwise its content
  *       will be overwritten.
  *
+ * The text is first written to a temporary file next to the destination,
+ * which is then renamed over it: readers of the file only ever see either its
+ * previous or its new content, never a partially written one.
+ *
  * \param[in] path The path to the destination file, or \c "-"
  * \param[in] text The value to write in the file
  *
@@ -51,6 +71,35 @@ char *read_file(const char *path);
 int write_file(const char *path, const char *text);
 
 
+/**
+ * \brief A contiguous block of bytes to write to a file.
+ */
+struct file_chunk {
+	const void *data; /**< The address of the first byte to write */
+	size_t size; /**< The number of bytes to write */
+};
+
+
+/**
+ * \brief Write the given blocks of binary data, in order, to the file of given
+ *        path.
+ *
+ * If the input path is simply \c "-", the data will be written to the
+ * standard output stream.
+ *
+ * \note Like \c write_file, the data is written to a temporary file that
+ *       replaces the destination only once it is complete.
+ *
+ * \param[in] path      The path to the destination file, or \c "-"
+ * \param[in] chunks    The blocks of data to write
+ * \param[in] nb_chunks The number of blocks
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int write_binary_file(const char *path, const struct file_chunk *chunks,
+                      size_t nb_chunks);
+
+
 /**
  * \brief Determines whether the given path is a regular file or not.
  *
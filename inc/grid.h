@@ -13,7 +13,10 @@
 #define GRID_H
 
 
+#include <limits.h> /* for INT_MAX */
 #include <stdbool.h>
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint64_t */
 
 
 /**
@@ -33,18 +36,81 @@
 #define DEFAULT_GRID_RULE "B3/S23"
 
 
+/**
+ * \brief The largest number of cells in a row or in a column of the grid, the
+ *        coordinates of the cells being \c int.
+ *
+ * The cells themselves are indexed on 64 bits, so that the number of cells of
+ * a grid is only bounded by the memory.
+ */
+#define MAX_GRID_SIZE INT_MAX
+
+/**
+ * \brief The alignment of the rows of the grid in the bit planes, in bits:
+ *        the size of a cache line.
+ */
+#define GRID_ROW_ALIGNMENT 512
+
+/**
+ * \brief The size in bytes from which the cells of a grid are backed by huge
+ *        pages, where the system supports them.
+ */
+#define GRID_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+
+/**
+ * \brief The threads updating a grid in parallel (see \c set_grid_workers).
+ */
+struct grid_workers;
+
+
 /**
  * \brief The type representing the grid of the game.
  */
 struct grid {
 	unsigned int width; /**< The width of the grid. */
 	unsigned int height; /**< The height of the grid. */
-	char *cells; /**< The data of the grid cells. */
+	/** The number of bits between the starts of two consecutive rows in the
+	    bit planes: the width rounded up to \c GRID_ROW_ALIGNMENT bits, so that
+	    each row starts on a cache line. The bits after the last cell of a row
+	    are always blank. */
+	size_t stride;
+	/** The data of the grid cells: the bit plane of the live cells, followed
+	    by the bit planes of the dying cells under a Generations rule (see
+	    \c get_state_planes). */
+	char *cells;
 	/** The rulestring determining the evolution of the game. */
-	char rule[22];
+	char rule[64];
+	/** The number of states of the cells under the rule, \c 2 unless the rule
+	    is a Generations one. */
+	unsigned int states;
+	/** Whether the bit plane of the live cells holds the complement of their
+	    states, which happens under the rules where the dead cells with no live
+	    neighbor are born (see \c invert_rule). The functions of this file
+	    take it into account. */
+	bool inverted;
+	/** Whether the grid is updated with the generic kernel even when its rule
+	    has a kernel of its own (see \c update_grid), mostly to check them
+	    against each other. */
+	bool generic;
+	/** The number of threads updating the grid in parallel, each one a stripe
+	    of rows, or \c 0 or \c 1 to update it in the calling thread (see
+	    \c set_grid_workers). */
+	unsigned int workers;
+	/** The threads updating the stripes, started by \c set_grid_workers and
+	    ended by \c free_grid, or \c NULL if the grid is updated in the
+	    calling thread. */
+	struct grid_workers *pool;
 	/** A flag indicating whether the state on one side of the grid affects the
 	    opposite side. */
 	bool wrap;
+	/** The number of generations the grid has evolved through. */
+	uint64_t generation;
+	/** The base address of the memory mapping holding the cells, that of a
+	    snapshot file or of anonymous huge pages, or \c NULL if the cells are
+	    allocated on the heap. */
+	void *mapping;
+	size_t mapping_size; /**< The size in bytes of the mapping */
 };
 
 
@@ -57,6 +123,27 @@ enum cell_state {
 };
 
 
+/**
+ * \brief The statistics of a generation of a grid, as given by
+ *        \c update_grid_with_stats.
+ *
+ * Under a Generations rule, only the live cells are counted, not the dying
+ * ones.
+ */
+struct grid_stats {
+	uint64_t generation; /**< The generation reached by the update */
+	uint64_t population; /**< The number of live cells */
+	uint64_t births; /**< The number of cells that came to life */
+	uint64_t deaths; /**< The number of live cells that stopped living */
+	/** The bounds of the live cells, inclusive, all \c 0 if there is none. */
+	unsigned int min_x;
+	unsigned int min_y; /**< See \c min_x */
+	unsigned int max_x; /**< See \c min_x */
+	unsigned int max_y; /**< See \c min_x */
+	uint64_t duration; /**< The duration of the update, in nanoseconds */
+};
+
+
 /**
  * \brief Initialize an uninitialized grid with custom parameters.
  *
@@ -65,22 +152,153 @@ enum cell_state {
  * \param[in]  height The number of cells in one column
  * \param[in]  wrap   If \c true, set up the grid as toroidal
  *
- * \return \c 0 iff the grid was correctly initialized, a negative value
- *         otherwise
+ * \return \c 0 iff the grid was correctly initialized, a negative value if
+ *         a dimension is above \c MAX_GRID_SIZE or if the cells cannot be
+ *         allocated
  */
 int init_grid(struct grid *grid, unsigned int width, unsigned int height,
               bool wrap);
 
 
+/**
+ * \brief Allocate the cells of a grid, all dead.
+ *
+ * The dimensions, stride and number of states of the grid must be set; the
+ * previous cells, if any, are not freed. The cells are aligned on a cache
+ * line. When they take at least \c GRID_HUGE_PAGE_SIZE bytes, they are mapped
+ * on huge pages on Linux, reserved ones if there are, or else transparent
+ * ones, to spare the misses of the translation lookaside buffer over large
+ * grids.
+ *
+ * \param[in,out] grid The grid
+ *
+ * \return \c 0 on success, a negative value on allocation error or if the
+ *         size of the cells overflows the address space
+ */
+int allocate_grid_cells(struct grid *grid);
+
+
+/**
+ * \brief Initialize an uninitialized grid as a copy of another grid.
+ *
+ * The cells of the source grid are duplicated in a newly allocated buffer, so
+ * that both grids can then evolve independently; this is a plain memory copy
+ * and does not depend on the population of the grid. The copy has no workers
+ * of its own: it is updated in the calling thread.
+ *
+ * \param[out] dest The grid to initialize
+ * \param[in]  src  The grid to copy
+ *
+ * \return \c 0 iff the grid was correctly copied, a negative value otherwise
+ */
+int copy_grid(struct grid *dest, const struct grid *src);
+
+
+/**
+ * \brief Set a grid to the state of another one, such as a copy saved
+ *        earlier.
+ *
+ * The cells, rule, generation and flags of the saved grid are copied; the
+ * workers of the grid are kept. When both grids have the same dimensions and
+ * number of states, the cells are copied in place, which keeps their memory
+ * and its placement on the nodes, otherwise they are reallocated.
+ *
+ * \param[in,out] grid  The grid to restore
+ * \param[in]     saved The grid to restore it to
+ *
+ * \return \c 0 on success, a negative value on allocation error, in which
+ *         case the grid is left untouched
+ */
+int restore_grid(struct grid *grid, const struct grid *saved);
+
+
+/**
+ * \brief Set the rule of evolution of the grid.
+ *
+ * If the number of states of the rule differs from the current one, the bit
+ * planes of the dying cells are resized, and all the dying cells are cleared.
+ *
+ * \param[in,out] grid The grid
+ * \param[in]     rule The rulestring (see \c parse_rule)
+ *
+ * \return \c 0 on success, a negative value if the rulestring is invalid or on
+ *         allocation error
+ */
+int set_grid_rule(struct grid *grid, const char *rule);
+
+
+/**
+ * \brief Set the number of threads updating the grid in parallel.
+ *
+ * Each worker thread updates a stripe of rows of the grid. The threads are
+ * started here, once, each pinned to its processor, then woken at each
+ * generation and waited for, until the grid is freed; the buffers of the rows
+ * of a worker are allocated by the worker itself and kept from a generation to
+ * the next. The workers are spread over the nodes of the machine when its
+ * memory is split between its processors (NUMA). The cells are then moved so
+ * that the stripe of each worker is in the memory of its node, having been
+ * first written by the worker itself.
+ *
+ * On a machine with a single node, the cells are left where they are; if the
+ * threads cannot be pinned to the processors, they run wherever the system
+ * puts them. The previous workers of the grid, if any, are ended.
+ *
+ * \param[in,out] grid    The grid
+ * \param[in]     workers The number of worker threads, \c 0 or \c 1 to
+ *                        update the grid in the calling thread
+ *
+ * \return \c 0 on success, a negative value on allocation error or if the
+ *         threads cannot be started, in which case the grid is updated in the
+ *         calling thread
+ */
+int set_grid_workers(struct grid *grid, unsigned int workers);
+
+
+/**
+ * \brief Give the size in bytes of the data of the grid cells, all bit planes
+ *        included.
+ *
+ * \param[in] grid The grid
+ *
+ * \return The size of the data pointed to by the \c cells field of the grid
+ */
+size_t get_grid_data_size(const struct grid *grid);
+
+
+/**
+ * \brief Give the number of live cells of the grid.
+ *
+ * The bit plane of the live cells is read whole, by words: the cost does not
+ * depend on the population.
+ *
+ * \param[in] grid The grid
+ *
+ * \return The number of live cells
+ */
+uint64_t get_grid_population(const struct grid *grid);
+
+
 /**
  * \brief Flags to specify the format of a grid representation: plain text,
- *        run length-encoded, or unknown.
+ *        run length-encoded, Macrocell, coordinates list, binary, or
+ *        unknown.
  */
 enum grid_format {
 	GRID_FORMAT_UNKNOWN, /**< Unknown grid representation format */
 	GRID_FORMAT_PLAIN, /**< 1:1 textual representation of the grid */
 	/** The grid is encoded by compressing runs of identical cells */
-	GRID_FORMAT_RLE
+	GRID_FORMAT_RLE,
+	/** Binary image of the cells in memory, preceded by a header (see
+	    \c load_grid_snapshot) */
+	GRID_FORMAT_SNAPSHOT,
+	/** Compressed snapshot, including the generation number (see
+	    \c load_grid_checkpoint) */
+	GRID_FORMAT_CHECKPOINT,
+	/** Quadtree whose identical subtrees are stored once (see
+	    \c load_grid_macrocell) */
+	GRID_FORMAT_MACROCELL,
+	/** List of the coordinates of the live cells, one per line */
+	GRID_FORMAT_LIFE106
 };
 
 
@@ -92,6 +310,10 @@ enum grid_format {
  * must be of the same length, which is interpreted as the grid width, and the
  * number of lines gives the grid height.
  *
+ * \note If the format is \c GRID_FORMAT_UNKNOWN, the representation is
+ *       interpreted as Macrocell, Life 1.06, RLE, then plain text, whichever
+ *       matches first.
+ *
  * \note This function resets the grid, so callers must pass either an
  *       unititialized grid or a grid that has been passed to \c free_grid
  *       beforehand to avoid leaking memory.
@@ -109,7 +331,7 @@ int load_grid(struct grid *grid, const char *repr, enum grid_format format,
 
 
 /**
- * \brief Deallocate memory used by a grid.
+ * \brief Deallocate memory used by a grid, and end its workers.
  *
  * \param[in,out] grid The grid to free
  */
@@ -124,14 +346,48 @@ void free_grid(struct grid *grid);
  * \param[in] col   The column to get
  *
  * \return \c ALIVE if the cell at (row, col) is alive, or \c DEAD if the cell
- *         is dead or coordinates are invalid.
+ *         is dead, dying, or coordinates are invalid.
  */
 enum cell_state get_grid_cell(const struct grid *grid, int row, int col);
 
 
+/**
+ * \brief Get the state of a cell from the grid, including the dying states of
+ *        a Generations rule.
+ *
+ * \param[in] grid The game grid
+ * \param[in] row  The row to get
+ * \param[in] col  The column to get
+ *
+ * \return The state of the cell at (row, col), between \c 0 (dead) and the
+ *         number of states of the grid (exclusive), \c 1 being the live state,
+ *         or \c 0 if the coordinates are invalid.
+ */
+unsigned int get_grid_cell_state(const struct grid *grid, int row, int col);
+
+
+/**
+ * \brief Set the state of a cell, including the dying states of a Generations
+ *        rule.
+ *
+ * \param[in,out] grid  The grid
+ * \param[in]     row   The row of the cell to set
+ * \param[in]     col   The column of the cell
+ * \param[in]     state The new state, less than the number of states of the
+ *                      grid
+ *
+ * \return \c 0 on success, a negative value if the coordinates or the state
+ *         are invalid
+ */
+int set_grid_cell_state(struct grid *grid, int row, int col,
+                        unsigned int state);
+
+
 /**
  * \brief Invert the state of a cell.
  *
+ * A dying cell is considered dead: it is brought back to life.
+ *
  * \param[in,out] grid The grid
  * \param[in]     row  The row of the cell to toggle
  * \param[in]     col  The column of the cell
@@ -145,15 +401,88 @@ enum cell_state toggle_cell(struct grid *grid, int row, int col);
  * \brief Update the grid to the next generation.
  *
  * The grid is iterated, and each cell is updated according to the rule
- * determining the grid.
+ * determining the grid. The generation counter of the grid is incremented.
+ *
+ * The cells are not updated one at a time: the rows are processed by words of
+ * 64 cells, whose neighbor counts are computed with bitwise operations, each
+ * bit of the count of the 64 cells in its own word. The rule is then applied
+ * to these counts, and the states of the dying cells are advanced, with
+ * bitwise operations as well, so that the cost of an update does not depend on
+ * the contents of the grid.
+ *
+ * The von Neumann and hexagonal neighborhoods have their own adders. The
+ * Larger than Life rules are counted instead with sums slid along the rows and
+ * columns, so that the cost per cell does not depend on the range; the rows
+ * are updated in place as well, the previous states of those still within the
+ * range being kept aside.
+ *
+ * The most common rules (Life, HighLife, Seeds, Day & Night and Life without
+ * Death) have kernels of their own, generated at compile time, where the
+ * transitions are reduced to a few bitwise operations on the counts. They are
+ * used unless the \c generic field of the grid is set.
+ *
+ * With several workers (see \c set_grid_workers), the stripes of rows are
+ * updated in parallel under any rule, the rows around each stripe being loaded
+ * beforehand: as many as the range under a Larger than Life rule.
  *
  * \param[in,out] grid The grid to update
  *
- * \return \c 0 if no error occurred (memory allocation, iteration)
+ * \return \c 0 if no error occurred (memory allocation, invalid rule)
  */
 int update_grid(struct grid *grid);
 
 
+/**
+ * \brief Update the grid through one generation, and give its statistics.
+ *
+ * The cells are counted by the update itself, with the counts of bits of the
+ * words of each row before and after their update, rather than by another
+ * pass over the grid.
+ *
+ * \param[in,out] grid  The grid to update (see \c update_grid)
+ * \param[out]    stats The statistics of the generation reached
+ *
+ * \return \c 0 if no error occurred (memory allocation, invalid rule)
+ */
+int update_grid_with_stats(struct grid *grid, struct grid_stats *stats);
+
+
+/**
+ * \brief Update the grid through several generations.
+ *
+ * The result is that of as many calls to \c update_grid, but on the grids
+ * larger than the cache, the rows are processed by bands advanced through up
+ * to 8 generations at once, so that the cells are read from and written to
+ * the memory once for all these generations instead of once per generation.
+ * A band is loaded with as many rows above and below it as generations, the
+ * neighbors of its rows being needed up to that distance; these halos are
+ * computed twice, with the neighboring bands.
+ *
+ * The Generations and Larger than Life rules, as well as the grids too wide
+ * for a band to fit in the cache, are updated one generation at a time.
+ *
+ * \param[in,out] grid        The grid to update
+ * \param[in]     generations The number of generations to advance through
+ *
+ * \return \c 0 if no error occurred (memory allocation, invalid rule)
+ */
+int update_grid_generations(struct grid *grid, unsigned long generations);
+
+
+/**
+ * \brief Store the live cells of the grid as is or as their complement.
+ *
+ * The states of the cells are unchanged; only the way they are stored in the
+ * bit plane of the live cells is. This is meant for the functions that read
+ * the bit plane directly, which can thus avoid handling the complement.
+ *
+ * \param[in,out] grid     The grid
+ * \param[in]     inverted Whether the live cells are to be stored as their
+ *                         complement
+ */
+void set_grid_inverted(struct grid *grid, bool inverted);
+
+
 /**
  * \brief Clear the grid.
  *
@@ -164,6 +493,104 @@ int update_grid(struct grid *grid);
 void clear_grid(struct grid *grid);
 
 
+/**
+ * \brief The ways the cells of a pattern are combined with those of a grid
+ *        by \c blit_grid.
+ */
+enum blit_mode {
+	BLIT_COPY, /**< The cells take the state of those of the pattern */
+	BLIT_OR, /**< The live cells of the pattern are brought to life */
+	BLIT_XOR /**< The cells under the live cells of the pattern are toggled */
+};
+
+
+/**
+ * \brief Combine the cells of a pattern with those of a rectangle of the grid.
+ *
+ * The rows are combined by words of 64 cells, shifted to the column of the
+ * rectangle, rather than one cell at a time. The dying cells of the pattern
+ * count as dead; the cells of the grid brought to life, or overwritten by
+ * \c BLIT_COPY, lose their dying state.
+ *
+ * The rectangle wraps around a toroidal grid, being cut to the size of the
+ * grid; otherwise, the cells of the pattern beyond the walls are left out.
+ *
+ * \param[in,out] grid    The grid
+ * \param[in]     pattern The grid of the cells to combine
+ * \param[in]     row     The row of the top left cell of the pattern in the
+ *                        grid, which may be negative
+ * \param[in]     col     The column of the top left cell of the pattern
+ * \param[in]     mode    The way the cells are combined
+ */
+void blit_grid(struct grid *grid, const struct grid *pattern, long long row,
+               long long col, enum blit_mode mode);
+
+
+/**
+ * \brief Combine the cells of an RLE pattern with those of the grid.
+ *
+ * The pattern is read as by \c load_grid, its header line being optional: a
+ * fragment of the cells of a pattern is read as the smallest rectangle that
+ * holds them. It is then combined with the grid by \c blit_grid.
+ *
+ * \param[in,out] grid The grid
+ * \param[in]     rle  The pattern, in the RLE format
+ * \param[in]     row  The row of the top left cell of the pattern in the grid
+ * \param[in]     col  The column of the top left cell of the pattern
+ * \param[in]     mode The way the cells are combined
+ *
+ * \return \c 0 on success, a negative value if the pattern is invalid or on
+ *         allocation error
+ */
+int blit_grid_rle(struct grid *grid, const char *rle, long long row,
+                  long long col, enum blit_mode mode);
+
+
+/**
+ * \brief Copy the states of the cells of a rectangle of the grid in a buffer,
+ *        one bit per cell.
+ *
+ * The rows of the rectangle follow each other in the buffer, without padding:
+ * the cell at (\c r, \c c) of the rectangle is the bit <tt>r * width + c</tt>,
+ * as read by \c get_bit, set if the cell is alive. The rows are copied by
+ * words of 64 cells.
+ *
+ * The rectangle wraps around a toroidal grid; otherwise, the cells beyond the
+ * walls are dead.
+ *
+ * \param[in]  grid   The grid
+ * \param[in]  row    The top row of the rectangle, which may be negative
+ * \param[in]  col    The left column of the rectangle
+ * \param[in]  width  The number of columns of the rectangle
+ * \param[in]  height The number of rows of the rectangle
+ * \param[out] bits   The buffer of the cells, of <tt>num_octets(width *
+ *                    height)</tt> octets
+ */
+void extract_grid_region(const struct grid *grid, long long row,
+                         long long col, unsigned int width,
+                         unsigned int height, char *bits);
+
+
+/**
+ * \brief Give the number of live cells in a rectangle of the grid.
+ *
+ * The cells are counted by words of 64 cells. The rectangle wraps around a
+ * toroidal grid, being cut to the size of the grid, so that no cell is
+ * counted twice; otherwise, the cells beyond the walls are not counted.
+ *
+ * \param[in] grid   The grid
+ * \param[in] row    The top row of the rectangle, which may be negative
+ * \param[in] col    The left column of the rectangle
+ * \param[in] width  The number of columns of the rectangle
+ * \param[in] height The number of rows of the rectangle
+ *
+ * \return The number of live cells in the rectangle
+ */
+uint64_t count_grid_region(const struct grid *grid, long long row,
+                           long long col, unsigned int width,
+                           unsigned int height);
+
+
 /**
  * \brief Return a representation of the current state of the grid in the
  *        specified format.
@@ -172,7 +599,10 @@ void clear_grid(struct grid *grid);
  * freeing it after use.
  *
  * \note If the given format is \c GRID_FORMAT_UNKNOWN, the returned
- *       representation defaults to plain-text.
+ *       representation defaults to plain-text. Being binary, the
+ *       \c GRID_FORMAT_SNAPSHOT and \c GRID_FORMAT_CHECKPOINT formats cannot
+ *       be represented as a string and also fall back to plain text; use
+ *       \c save_grid_snapshot or \c save_grid_checkpoint instead.
  *
  * \param[in] grid   The grid
  * \param[in] format The format of the representation to generate
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "grid_saver.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file defines a structure that writes the state of a grid to a
+ *        file in the background, without blocking the caller.
+ *
+ * The grid is copied when the save is requested, and the copy is then
+ * serialized and written by a worker thread, so that the original grid can
+ * keep evolving in the meantime.
+ */
+#ifndef GRID_SAVER_H
+#define GRID_SAVER_H
+
+
+#include <stdatomic.h> /* for atomic_int */
+#include <stdbool.h>
+#include <threads.h> /* for thrd_t */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The state of the last save operation of a grid saver.
+ */
+enum save_status {
+	SAVE_IDLE, /**< No save has been requested since the last poll */
+	SAVE_RUNNING, /**< A save is being performed in the background */
+	SAVE_DONE, /**< The last save completed successfully */
+	SAVE_FAILED /**< The last save could not be completed */
+};
+
+
+/**
+ * \brief The type handling the background saves of a grid.
+ */
+struct grid_saver {
+	/** The copy of the grid being written. */
+	struct grid snapshot;
+	/** The path to the file to write. */
+	const char *path;
+	/** The format to write the grid in. */
+	enum grid_format format;
+	/** The worker thread performing the save. */
+	thrd_t worker;
+	/** Whether the worker thread has been started and not joined yet. */
+	bool started;
+	/** The state of the save, shared with the worker thread. */
+	atomic_int status;
+};
+
+
+/**
+ * \brief Guess the format of a grid file from the extension of its path.
+ *
+ * \param[in] path The path to the file
+ *
+ * \return The format of the extension, or \c GRID_FORMAT_UNKNOWN if it is not
+ *         recognized
+ */
+enum grid_format guess_grid_format(const char *path);
+
+
+/**
+ * \brief Write the state of the grid to a file in the given format, in the
+ *        calling thread.
+ *
+ * This is the operation performed in the background by a grid saver.
+ *
+ * \param[in] grid   The grid to write
+ * \param[in] path   The path to the file to write, or \c "-"
+ * \param[in] format The format of the grid representation to write
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int write_grid_file(const struct grid *grid, const char *path,
+                    enum grid_format format);
+
+
+/**
+ * \brief Initialize a grid saver.
+ *
+ * \param[out] saver The saver to initialize
+ */
+void init_grid_saver(struct grid_saver *saver);
+
+
+/**
+ * \brief Request the state of the grid to be written to a file.
+ *
+ * The grid is copied before this function returns, and can be modified freely
+ * afterwards; the copy is written to the file in a background thread.
+ *
+ * \note Only one save can be performed at a time: if the previous save is not
+ *       finished yet, the request is rejected.
+ *
+ * \param[in,out] saver  The grid saver
+ * \param[in]     grid   The grid to write
+ * \param[in]     path   The path to the file to write, or \c "-"
+ * \param[in]     format The format of the grid representation to write
+ *
+ * \return \c 0 if the save was started, a positive value if a save is already
+ *         running, or a negative value on error
+ */
+int start_grid_save(struct grid_saver *saver, const struct grid *grid,
+                    const char *path, enum grid_format format);
+
+
+/**
+ * \brief Retrieve the state of the last save requested.
+ *
+ * \c SAVE_DONE and \c SAVE_FAILED are only reported once: subsequent calls
+ * report \c SAVE_IDLE until another save is requested.
+ *
+ * \param[in,out] saver The grid saver
+ *
+ * \return The state of the last save
+ */
+enum save_status poll_grid_save(struct grid_saver *saver);
+
+
+/**
+ * \brief Wait for the completion of the running save, if any, and release the
+ *        resources of the saver.
+ *
+ * \param[in,out] saver The grid saver to free
+ *
+ * \return The final state of the last save
+ */
+enum save_status free_grid_saver(struct grid_saver *saver);
+
+
+#endif /* GRID_SAVER_H */
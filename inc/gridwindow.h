@@ -67,6 +67,12 @@ struct grid_window {
 	unsigned int border_width;
 	int sel_col; /**< The \c column number of the currently selected cell. */
 	int sel_row; /**< The \c row number of the currently selected cell. */
+	const char *title; /**< The base title of the window */
+#ifdef USE_TIMING
+	/** Whether the durations of the phases of the program are displayed over
+	    the grid (see \c timing.h). */
+	bool show_timers;
+#endif
 	char error_msg[64]; /**< The error message if an operation fails */
 };
 
@@ -96,6 +102,17 @@ int init_grid_window(struct grid_window *grid_win, struct grid *grid,
 void free_grid_window(struct grid_window *grid_win);
 
 
+/**
+ * \brief Display a short status message in the title bar of the window.
+ *
+ * \param[in] grid_win The grid window
+ * \param[in] status   The message to append to the window title, or \c NULL to
+ *                     restore the original title
+ */
+void set_grid_window_status(const struct grid_window *grid_win,
+                            const char *status);
+
+
 /**
  * \brief Render, on display, the grid window.
  *
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "history.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file defines the history of the states of a grid, to step
+ *        backwards through the generations within a memory budget.
+ *
+ * Each recorded state is kept as the difference (exclusive or) of its bit
+ * planes with those of the previous state, split in tiles: the unchanged tiles
+ * are skipped, the others are compressed. Since the difference of two states
+ * goes both ways, the history holds a copy of the latest state only, from
+ * which the older ones are rebuilt by applying the differences backwards.
+ * Every few states, a keyframe holding the whole state, compressed likewise,
+ * bounds the number of differences to apply to reach any state.
+ *
+ * When the budget is exceeded, the oldest states are dropped. The history
+ * starts over when the dimensions or the rule of the grid change.
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+
+#include <stdbool.h>
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint64_t */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The default memory budget of the history, in mebibytes.
+ */
+#define DEFAULT_HISTORY_BUDGET 64
+
+/**
+ * \brief The size in bytes of the tiles the bit planes are split in.
+ */
+#define HISTORY_TILE_SIZE 4096
+
+/**
+ * \brief The number of states recorded between two keyframes.
+ */
+#define HISTORY_KEYFRAME_INTERVAL 64
+
+
+/**
+ * \brief A state of a grid in the history.
+ */
+struct history_entry {
+	uint64_t generation; /**< The generation of the grid in this state */
+	/** Whether the live cells of this state are stored inverted, as the B0
+	    rules alternate between both ways. */
+	bool inverted;
+	/** The compressed tiles of the difference with the previous state, or
+	    \c NULL if there is none or for the oldest state. */
+	unsigned char *delta;
+	size_t delta_size; /**< The size in bytes of the difference */
+	/** Whether the state itself is kept as well, as a keyframe. */
+	bool keyframe;
+	/** The compressed tiles of the state if it is a keyframe, or \c NULL if
+	    it is not or if the grid is blank. */
+	unsigned char *state;
+	size_t state_size; /**< The size in bytes of the state */
+};
+
+/**
+ * \brief The type holding the history of a grid.
+ */
+struct history {
+	/** The highest number of bytes taken by the recorded states, \c 0 if the
+	    history is disabled. */
+	size_t budget;
+	size_t used; /**< The number of bytes taken by the recorded states */
+	/** A copy of the latest recorded state, valid if \c count is not \c 0. */
+	struct grid latest;
+	/** The recorded states, from the oldest, in a ring of \c capacity
+	    entries starting at index \c first. */
+	struct history_entry *entries;
+	size_t capacity; /**< The number of entries allocated */
+	size_t first; /**< The index of the oldest state in the ring */
+	size_t count; /**< The number of recorded states */
+	/** The index of the state the grid was last brought to, from the oldest
+	    one: \c count-1 unless stepped backwards. */
+	size_t position;
+	/** The number of states recorded since the history started, to place the
+	    keyframes. */
+	uint64_t recorded;
+};
+
+
+/**
+ * \brief Initialize an empty history.
+ *
+ * \param[out] history The history to initialize
+ * \param[in]  budget  The highest number of bytes taken by the recorded
+ *                     states, besides the copy of the latest one, or \c 0 to
+ *                     disable the history
+ */
+void init_history(struct history *history, size_t budget);
+
+
+/**
+ * \brief Record the state of a grid as the latest one of the history.
+ *
+ * If the grid was brought back to an older state, the states after it are
+ * dropped first.
+ *
+ * \param[in,out] history The history
+ * \param[in]     grid    The grid to record
+ *
+ * \return \c 0 on success, a negative value on allocation error, in which case
+ *         the history is emptied
+ */
+int record_history(struct history *history, const struct grid *grid);
+
+
+/**
+ * \brief Bring a grid to another recorded state.
+ *
+ * The number of states moved through is clamped to those recorded. The states
+ * after the new one are kept until another state is recorded, so that the
+ * grid can be brought forward again.
+ *
+ * \param[in,out] history The history
+ * \param[in]     offset  The number of states to move through, negative to
+ *                        go backwards
+ * \param[in,out] grid    The grid to bring to the state (see
+ *                        \c restore_grid)
+ *
+ * \return \c 0 on success, \c 1 if there is no recorded state in the
+ *         direction of \p offset, a negative value on error
+ */
+int seek_history(struct history *history, long offset, struct grid *grid);
+
+
+/**
+ * \brief Free the history.
+ *
+ * \param[in,out] history The history to free
+ */
+void free_history(struct history *history);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "macrocell.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the functions reading and writing grids in the
+ *        Macrocell format.
+ *
+ * The Macrocell format, introduced by Golly, describes a pattern as a quadtree
+ * whose identical subtrees are stored only once. A square of \c 2^k cells on
+ * each side (a node of level \c k) is made of four squares of level \c k-1,
+ * down to the squares of \c 8 cells by \c 8 (level \c 3), the leaves. Since
+ * repeated structures share their nodes, huge patterns with a regular
+ * structure fit in small files.
+ *
+ * The first line of the file is \c "[M2]", optionally followed by text. The
+ * lines starting with a \c # are comments, except \c "#R" which gives the
+ * rulestring and \c "#G" the generation number. Each of the other lines
+ * defines a node, numbered from \c 1 in their order of appearance:
+ * - a leaf is given as its rows, top to bottom, each terminated by a \c $, with
+ *   \c . for dead cells and \c * for live ones. The dead cells at the end of a
+ *   row and the empty rows at the end of the leaf may be omitted;
+ * - a node of level \c k is given as \c k followed by the numbers of its
+ *   north-west, north-east, south-west and south-east children, \c 0 standing
+ *   for an empty child.
+ *
+ * The last node defined is the root of the pattern.
+ *
+ * Example: a glider
+ * \code
+ * [M2] (cyano)
+ * #R B3/S23
+ * .*$..*$***$
+ * \endcode
+ */
+#ifndef MACROCELL_H
+#define MACROCELL_H
+
+
+#include <stdbool.h>
+
+#include "grid.h"
+
+
+
+/**
+ * \brief Initialize the grid from the given Macrocell representation.
+ *
+ * The nodes are hash-consed as they are read: identical subtrees are merged
+ * even if they are defined several times in the file, and the bounding box of
+ * the pattern is computed once per distinct node, so that its cost does not
+ * depend on the size of the pattern. The grid is sized to the bounding box of
+ * the live cells.
+ *
+ * \param[out] grid The grid to initialize
+ * \param[in]  repr The Macrocell representation of the pattern
+ * \param[in]  wrap If \c true, set up the grid as toroidal
+ *
+ * \return \c 0 iff the grid was correctly initialized, a positive value if the
+ *         representation is not in the Macrocell format, a negative value on
+ *         error (notably if the pattern is too large to fit in a grid)
+ */
+int load_grid_macrocell(struct grid *grid, const char *repr, bool wrap);
+
+
+/**
+ * \brief Build the Macrocell representation of the grid.
+ *
+ * The quadtree of the grid is built bottom-up and its nodes are hash-consed,
+ * so that each distinct subtree, notably the blank ones, is written once.
+ *
+ * \param[in] grid The grid to represent
+ *
+ * \return The Macrocell representation of the grid, to be freed by the
+ *         caller, or \c NULL on error
+ */
+char *get_grid_macrocell(const struct grid *grid);
+
+
+#endif /* MACROCELL_H */
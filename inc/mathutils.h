@@ -10,6 +10,11 @@
 #define MATHUTILS_H
 
 
+#include <stdbool.h>
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for SIZE_MAX */
+
+
 
 /**
  * Return the arithmetic (positive) modulo of \p a and \p b.
@@ -26,13 +31,31 @@ inline unsigned int pos_mod(int a, int b) {
 	while (a < 0) {
 		a += b;
 	}
-	while (a > b) {
+	while (a >= b) {
 		a -= b;
 	}
 	return a;
 }
 
 
+/**
+ * Multiply two sizes, checking that the product does not overflow.
+ *
+ * \param[in]  a,b     The two values
+ * \param[out] product The product of \p a and \p b, left untouched if it
+ *                     overflows
+ *
+ * \return \c true iff the product can be held in a \c size_t
+ */
+inline bool mul_size(size_t a, size_t b, size_t *product) {
+	if (a != 0 && b > SIZE_MAX / a) {
+		return false;
+	}
+	*product = a * b;
+	return true;
+}
+
+
 /**
  * Return the lesser of the two values.
  *
@@ -45,5 +68,17 @@ inline unsigned int pos_mod(int a, int b) {
  */
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/**
+ * Return the greater of the two values.
+ *
+ * Defined as a macro to work with all integer types in a single declaration,
+ * however all the usual macro caveats apply.
+ *
+ * @param a,b The two values to compare
+ *
+ * @return \p a if it is greater than \p b, otherwise \p b
+ */
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
 
 #endif /* MATHUTILS_H */
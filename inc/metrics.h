@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "metrics.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the metrics of a run, written periodically to a
+ *        text file in the exposition format of Prometheus, for its node
+ *        exporter to collect (\c --collector.textfile.directory).
+ *
+ * The counters are kept by the update of the grid and by the loop of the
+ * window with atomic additions, without locking. The population is counted
+ * by the update preceding a write, while it computes the cells, rather than
+ * by going through the grid again. The other gauges (the generation and
+ * memory of the grid) are read when the file is written, by the thread
+ * running the grid, between two updates.
+ *
+ * The file is written anew under a temporary name then renamed, so that it is
+ * never read half written.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+
+#include <stdbool.h>
+#include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint64_t */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The default number of seconds between two writes of the metrics.
+ */
+#define DEFAULT_METRICS_INTERVAL 15
+
+
+/**
+ * \brief Start keeping the metrics.
+ *
+ * \param[in] path     The path to the file to write the metrics to, which must
+ *                     stay valid until \c stop_metrics is called
+ * \param[in] interval The number of seconds between two writes of the file
+ *
+ * \return \c 0 on success, a negative value on allocation error
+ */
+int start_metrics(const char *path, unsigned int interval);
+
+
+/**
+ * \brief Count the generations of an update of a grid.
+ *
+ * Nothing is counted if the metrics were not started.
+ *
+ * \param[in] generations The number of generations of the update
+ * \param[in] start       The time the update started at, as given by
+ *                        \c read_timer
+ */
+void count_update(unsigned long generations, uint64_t start);
+
+
+/**
+ * \brief Tell whether the next update of a grid is to count its population,
+ *        as the metrics are due to be written.
+ *
+ * \return \c true if the metrics were started and their interval has elapsed
+ *         since the last write, or if they were never written
+ */
+bool needs_population(void);
+
+
+/**
+ * \brief Publish the population of a grid, counted by its update.
+ *
+ * Nothing is published if the metrics were not started.
+ *
+ * It is written as the population of the grid as long as the grid is at the
+ * same generation; the cells set or cleared by hand meanwhile are only seen
+ * once another update counts them. Otherwise, as when the metrics are written
+ * on exit or after going through the history, the cells of the grid are
+ * counted when writing them.
+ *
+ * \param[in] generation The generation of the grid counted
+ * \param[in] count      The number of live cells of the grid
+ */
+void count_population(uint64_t generation, uint64_t count);
+
+
+/**
+ * \brief Count a frame displayed in the window.
+ *
+ * Nothing is counted if the metrics were not started.
+ */
+void count_frame(void);
+
+
+/**
+ * \brief Write the metrics to their file at once.
+ *
+ * \param[in] grid          The grid whose gauges to write
+ * \param[in] history_bytes The number of bytes taken by the history of the
+ *                          grid, if any
+ *
+ * \return \c 0 on success or if the metrics were not started, a negative
+ *         value on write error
+ */
+int write_metrics(const struct grid *grid, size_t history_bytes);
+
+
+/**
+ * \brief Write the metrics to their file if the interval has elapsed since
+ *        the last write, or if they were never written.
+ *
+ * \param[in] grid          The grid whose gauges to write
+ * \param[in] history_bytes The number of bytes taken by the history of the
+ *                          grid, if any
+ *
+ * \return \c 0 on success or if the metrics are not due, a negative value on
+ *         write error
+ */
+int poll_metrics(const struct grid *grid, size_t history_bytes);
+
+
+/**
+ * \brief Stop keeping the metrics.
+ *
+ * The file is left with the last metrics written.
+ */
+void stop_metrics(void);
+
+#endif /* METRICS_H */
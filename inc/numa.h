@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "numa.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the functions placing the worker threads on the
+ *        nodes of a NUMA machine, where each processor has its own memory.
+ *
+ * The topology of the machine is read from \c /sys/devices/system/node on
+ * Linux. Elsewhere, or when it cannot be read, the machine is considered to
+ * have a single node, and the threads are left where the system puts them.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+
+#include <stddef.h> /* for size_t */
+#include <stdio.h> /* for FILE */
+
+
+
+/**
+ * \brief Give the number of memory nodes of the machine.
+ *
+ * \return The number of nodes, \c 1 if the topology is unknown
+ */
+unsigned int get_numa_nodes(void);
+
+
+/**
+ * \brief Give the processor a worker thread is to run on.
+ *
+ * The workers are spread evenly across the nodes, the first ones on the first
+ * node, and over the processors of their node, so that a worker always runs
+ * on the same processor, and touches the same memory, for a given number of
+ * workers.
+ *
+ * \param[in]  worker  The index of the worker
+ * \param[in]  workers The number of workers
+ * \param[out] node    The node of the processor, \c 0 if unknown (may be
+ *                     \c NULL)
+ *
+ * \return The index of the processor, or \c -1 if the topology is unknown
+ */
+int get_worker_cpu(unsigned int worker, unsigned int workers,
+                   unsigned int *node);
+
+
+/**
+ * \brief Restrict the calling thread to the given processor.
+ *
+ * \param[in] cpu The index of the processor, as given by \c get_worker_cpu
+ *
+ * \return \c 0 on success, a negative value if the processor is invalid or if
+ *         the threads cannot be pinned on this system
+ */
+int pin_thread(int cpu);
+
+
+/**
+ * \brief Measure the bandwidth between the processors and the memory of each
+ *        node, and print it as a table.
+ *
+ * A buffer is allocated on each node, by a thread running on it, and read then
+ * written back by the threads of all the processors of each node in turn, one
+ * per processor, each one through its share of the buffer. The buffers are at
+ * least 4 times as large as the largest cache, so that the memory is measured
+ * rather than the cache. On a single node, the only figure is the bandwidth of
+ * the memory.
+ *
+ * \param[in] size The size in bytes of the buffer of each node, if it is
+ *                 larger than that
+ * \param[in] out  The stream to print the table to
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int benchmark_numa(size_t size, FILE *out);
+
+#endif /* NUMA_H */
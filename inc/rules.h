@@ -5,22 +5,265 @@
  *
  * \version 1.0
  *
- * \brief This file defines a single function that converts a rule name to the
- *        corresponding rulestring.
+ * \brief This file defines the compiled form of a rule of evolution, and the
+ *        functions that convert a rule name or a rulestring to it.
+ *
+ * The rules are kept in a registry, made of two hash tables: one maps the
+ * rule names, built-in or loaded from a rules file, to their rulestrings, the
+ * other caches the compiled form of the rulestrings already met, so that a
+ * rule is compiled only once however many grids use it. The registry is not
+ * thread-safe.
  */
 #ifndef RULES_H
 #define RULES_H
 
 
+#include <stdbool.h>
+#include <stdint.h> /* for uint8_t, uint16_t, uint32_t */
+
+
+/**
+ * \brief The maximum number of states of the cells in a Generations rule.
+ */
+#define MAX_RULE_STATES 256
+
+
+/**
+ * \brief The number of configurations of the neighborhood of a cell, the cell
+ *        included.
+ */
+#define RULE_TABLE_SIZE 512
+
+
+/**
+ * \brief The maximum range of the neighborhood of a Larger than Life rule.
+ */
+#define MAX_RULE_RANGE 500
+
+
+/**
+ * \brief The families of rules, that the update of the grid applies
+ *        differently.
+ */
+enum rule_family {
+	/** The rules over the eight nearest neighbors of the cells, in B/S
+	    notation. */
+	RULE_FAMILY_LIFE_LIKE,
+	/** The Larger than Life rules, over the square of cells up to a given
+	    distance. */
+	RULE_FAMILY_LARGER_THAN_LIFE
+};
+
+
+/**
+ * \brief The neighborhoods of the Life-like rules.
+ */
+enum rule_neighborhood {
+	/** The eight nearest cells. */
+	RULE_NEIGHBORHOOD_MOORE,
+	/** The four orthogonally adjacent cells. */
+	RULE_NEIGHBORHOOD_VON_NEUMANN,
+	/** The six cells around the cell on a hexagonal grid, emulated as the
+	    Moore neighborhood without its north-east and south-west cells. */
+	RULE_NEIGHBORHOOD_HEXAGONAL
+};
+
+
+/**
+ * \brief A rule of evolution, in a form that the update of the grid can apply
+ *        without parsing its rulestring.
+ *
+ * The transitions of an outer-totalistic rule only depend on the number of live
+ * neighbors of a cell, and are given as masks of these numbers. Those of an
+ * isotropic non-totalistic rule also depend on the arrangement of the
+ * neighbors, and are given as a table of the next state of a cell for each
+ * configuration of its neighborhood.
+ *
+ * Under a \e Generations rule, with more than two states, a live cell that does
+ * not survive is not dead yet: it goes through the states \c 2 to
+ * \c states-1, one per generation, before dying. Only the live cells (in state
+ * \c 1) count as neighbors, and the dying cells cannot be born again.
+ *
+ * The transitions of a Larger than Life rule are given as ranges of numbers of
+ * live cells in the neighborhood, which may include the cell itself.
+ */
+struct rule {
+	/** The family of the rule, which tells the fields that apply. */
+	enum rule_family family;
+	/** The neighborhood of the cells under a Life-like rule. */
+	enum rule_neighborhood neighborhood;
+	/** The bit \c n is set iff a dead cell with \c n live neighbors is born. */
+	uint16_t birth;
+	/** The bit \c n is set iff a live cell with \c n live neighbors
+	    survives. */
+	uint16_t survival;
+	/** The number of states of the cells, \c 2 for a Life-like rule. */
+	unsigned int states;
+	/** Whether the transitions only depend on the number of live neighbors,
+	    in which case the masks above are exact. Only the rules over the
+	    Moore neighborhood may be non-totalistic. */
+	bool totalistic;
+	/** For each configuration of the neighborhood, \c 1 iff the cell is
+	    alive at the next generation. The configuration is given by the cells
+	    in reading order, from the most significant bit (north-west) to the
+	    least significant one (south-east), the cell itself being bit 4. */
+	uint8_t table[RULE_TABLE_SIZE];
+	/** The range of the neighborhood of a Larger than Life rule: the square
+	    of side \c 2*range+1 centered on the cell. */
+	unsigned int range;
+	/** Whether the cell itself is counted in its neighborhood. */
+	bool middle;
+	/** The minimum number of live cells in the neighborhood of a dead cell
+	    for it to be born. */
+	uint32_t birth_min;
+	/** The maximum number of live cells for a birth. */
+	uint32_t birth_max;
+	/** The minimum number of live cells in the neighborhood of a live cell
+	    for it to survive. */
+	uint32_t survival_min;
+	/** The maximum number of live cells for a survival. */
+	uint32_t survival_max;
+};
+
 
 /**
  * Retrieve a rulestring from its corresponding rule name.
  *
  * \param[in] name The name of the rule
  *
- * \return The rulestring of given name, or \c NULL if not found.
+ * \return The rulestring of given name, owned by the registry, or \c NULL if
+ *         not found.
  */
 const char *get_rule_from_name(const char *name);
 
 
+/**
+ * Give a name to a rule, in addition to the built-in names. A built-in name
+ * may be given another rulestring.
+ *
+ * \param[in] name       The name of the rule, not empty
+ * \param[in] rulestring The rulestring of the rule, which must be valid
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int register_rule(const char *name, const char *rulestring);
+
+
+/**
+ * Register the rules named in a rules file.
+ *
+ * Each line of the file gives a name and a rulestring, separated by an equals
+ * sign (e.g. \c "Bugs = R5,C0,M1,S34..58,B34..45,NM"); the whitespace around
+ * them is ignored. The blank lines, and those starting with a \c #, are
+ * skipped.
+ *
+ * \param[in] path The path of the file
+ *
+ * \return \c 0 on success, the number of the first invalid line (the rules
+ *         before it being registered), or a negative value if the file could
+ *         not be read
+ */
+int load_rules_file(const char *path);
+
+
+/**
+ * Release the memory of the registry.
+ *
+ * The built-in names are registered again on the next use of the registry,
+ * but those loaded from a file are lost.
+ */
+void free_rules(void);
+
+
+/**
+ * Compile a rulestring in B/S notation, optionally followed by the number of
+ * states of a Generations rule (e.g. \c B3/S23 or \c B2/S/C3).
+ *
+ * The digits of each transition must be in ascending order. The slashes, and
+ * the letters of the birth and survival transitions, may be omitted.
+ *
+ * Each digit may be followed by letters of the Hensel notation, to restrict
+ * the transition to the given arrangements of the neighbors (e.g. \c 2ak), or
+ * by a \c - and letters, to exclude them (e.g. \c B2-a/S12): the rule is then
+ * isotropic non-totalistic.
+ *
+ * The rulestring may end with \c V for the von Neumann neighborhood (e.g.
+ * \c B1/S1V) or \c H for the hexagonal one (e.g. \c B2/S34H), instead of the
+ * Moore neighborhood. The Hensel letters are then not allowed, and the numbers
+ * of neighbors are limited to those of the neighborhood.
+ *
+ * A Larger than Life rule is given in the notation of Golly, as
+ * \c Rr,Cc,Mm,Smin..max,Bmin..max,NM (e.g. \c R5,C0,M1,S34..58,B34..45,NM):
+ * the range of the neighborhood, the number of states (\c 0 or \c 1 standing
+ * for \c 2), whether the cell counts in its neighborhood, the ranges of the
+ * survival and birth transitions and the shape of the neighborhood, which
+ * must be \c M (the square, or Moore neighborhood).
+ *
+ * \param[in]  rulestring The rulestring
+ * \param[out] rule       The compiled rule
+ *
+ * \return \c 0 iff the rulestring is valid, a negative value otherwise
+ */
+int parse_rule(const char *rulestring, struct rule *rule);
+
+
+/**
+ * Give the compiled form of a rulestring, compiling it on the first call only.
+ *
+ * \param[in] rulestring The rulestring (see \c parse_rule)
+ *
+ * \return The compiled rule, owned by the registry, or \c NULL if the
+ *         rulestring is invalid or on error
+ */
+const struct rule *get_compiled_rule(const char *rulestring);
+
+
+/**
+ * Give the number of bit planes needed, besides the one of the live cells, to
+ * store the states of the cells under a rule with the given number of states.
+ *
+ * The planes hold, for each dying cell, its state minus one in binary; they
+ * are all blank for a dead or a live cell.
+ *
+ * \param[in] states The number of states of the cells
+ *
+ * \return The number of additional bit planes, \c 0 for a two-state rule
+ */
+unsigned int get_state_planes(unsigned int states);
+
+
+/**
+ * Tell whether a rule can be applied to cells stored as their complement (see
+ * \c invert_rule), which is the case of the two-state Life-like rules.
+ *
+ * \param[in] rule The rule
+ *
+ * \return \c true iff \c invert_rule supports the rule
+ */
+bool can_invert_rule(const struct rule *rule);
+
+
+/**
+ * Convert a rule into the one that evolves the cells as stored in memory,
+ * given whether they are stored as is or as their complement, to the cells of
+ * the next generation stored as is or as their complement.
+ *
+ * The storage of the next generation is chosen so that a cell whose
+ * neighborhood is blank in memory stays blank. Under a rule where the dead
+ * cells with no live neighbor are born (\c B0), the live cells are thus
+ * stored as is and as their complement on alternate generations, or stored as
+ * their complement from the first generation on if the cells with all their
+ * neighbors alive survive. Either way, the cells far from the pattern are
+ * never written in memory.
+ *
+ * \param[in,out] rule     The rule to convert, which must be supported by
+ *                         \c can_invert_rule
+ * \param[in]     inverted Whether the cells are stored as their complement
+ *
+ * \return Whether the cells of the next generation are to be stored as their
+ *         complement
+ */
+bool invert_rule(struct rule *rule, bool inverted);
+
+
 #endif /* RULES_H */
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "snapshot.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the functions reading and writing grids in the
+ *        binary snapshot and checkpoint formats.
+ *
+ * A snapshot is a verbatim copy of the cells of a grid in memory, preceded by
+ * a fixed-size header describing the grid. Since it needs no parsing, the file
+ * can be mapped in memory and used in place as the storage of the grid cells,
+ * which makes it the format of choice to store and restore very large grids.
+ *
+ * The header is \c SNAPSHOT_HEADER_SIZE bytes long, all integers are stored
+ * little-endian:
+ * - 8 bytes: the magic string \c "CYANOGRD"
+ * - 4 bytes: the version of the format (currently \c 1)
+ * - 4 bytes: the size of the header, i.e. the offset of the cells data
+ * - 8 bytes: the width of the grid
+ * - 8 bytes: the height of the grid
+ * - 8 bytes: the number of bits between the starts of two consecutive rows,
+ *   at least the width (the stride of the grid, see \c GRID_ROW_ALIGNMENT)
+ * - 8 bytes: the generation number of the grid
+ * - 4 bytes: flags; bit 0 is set if the grid wraps, bit 1 if the live cells
+ *   are stored as their complement (see \c invert_rule)
+ * - 4 bytes: reserved, zero (the tile size in a checkpoint, see below)
+ * - 64 bytes: the rulestring, padded with NUL bytes
+ * - 8 bytes: reserved, zero
+ *
+ * The header size being a multiple of the cache line size, the cells data is
+ * aligned in memory when the file is mapped, and so is each row, the rows
+ * being padded to whole cache lines. It is the bit plane of the live cells,
+ * followed, if the rule is a Generations one, by the bit planes of the dying
+ * cells, as stored in a grid. The files with unpadded rows, as written by the
+ * previous versions, are still read.
+ *
+ * A checkpoint is a compressed snapshot, meant to be written periodically
+ * during long runs. Its header is that of a snapshot, with the magic string
+ * \c "CYANOCKP" and the size of a tile in bytes in the field reserved above.
+ * The cells data is divided into tiles of this size; the header is followed by
+ * a bitmap of the tiles with at least one live cell, then, for each of these
+ * tiles, the 4-byte size of its compressed data and the data itself. Blank
+ * tiles are not stored. The compression is a simple run-length encoding of the
+ * bytes: it is fast enough not to hinder the simulation, and the areas of dead
+ * cells compress well.
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+
+#include <stdint.h> /* for uint64_t */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The size of the header of a snapshot, in bytes.
+ */
+#define SNAPSHOT_HEADER_SIZE 128
+
+
+/**
+ * \brief Initialize the grid from the snapshot file of given path.
+ *
+ * Where supported, the file is mapped in memory privately and the mapping is
+ * directly used to hold the cells of the grid: loading costs nothing beyond
+ * the page faults when the cells are accessed, and the changes to the grid
+ * are never written back to the file. Otherwise, the cells are read from the
+ * file into memory.
+ *
+ * \note Since the file is mapped, the path cannot be \c "-".
+ *
+ * \param[out] grid The grid to initialize
+ * \param[in]  path The path to the snapshot file
+ *
+ * \return \c 0 iff the grid was correctly initialized, a negative value
+ *         otherwise
+ */
+int load_grid_snapshot(struct grid *grid, const char *path);
+
+
+/**
+ * \brief Write the current state of the grid in a snapshot file.
+ *
+ * \param[in] grid The grid to write
+ * \param[in] path The path to the destination file, or \c "-"
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int save_grid_snapshot(const struct grid *grid, const char *path);
+
+
+/**
+ * \brief Initialize the grid from the checkpoint file of given path.
+ *
+ * \param[out] grid The grid to initialize
+ * \param[in]  path The path to the checkpoint file
+ *
+ * \return \c 0 iff the grid was correctly initialized, a negative value
+ *         otherwise
+ */
+int load_grid_checkpoint(struct grid *grid, const char *path);
+
+
+/**
+ * \brief Write the current state of the grid, including its generation
+ *        number, in a checkpoint file.
+ *
+ * \param[in] grid The grid to write
+ * \param[in] path The path to the destination file, or \c "-"
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int save_grid_checkpoint(const struct grid *grid, const char *path);
+
+
+/**
+ * \brief Read the generation number stored in a checkpoint file, without
+ *        loading the grid.
+ *
+ * \param[in]  path       The path to the checkpoint file
+ * \param[out] generation The generation number of the checkpoint
+ *
+ * \return \c 0 on success, a negative value if the file is not a checkpoint
+ */
+int get_checkpoint_generation(const char *path, uint64_t *generation);
+
+
+#endif /* SNAPSHOT_H */
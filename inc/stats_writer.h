@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "stats_writer.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file defines a structure that writes the statistics of the
+ *        generations of a grid to a CSV file as it evolves.
+ *
+ * The file starts with a header line naming the columns:
+ * \code
+ * generation,population,births,deaths,min_x,min_y,max_x,max_y,nanoseconds
+ * \endcode
+ * followed by a line per recorded generation. The bounds of the live cells are
+ * left empty when there is none. The lines are formatted by hand in a buffer
+ * written out when it is full, so that recording every generation costs
+ * little even when there are millions of them per second.
+ */
+#ifndef STATS_WRITER_H
+#define STATS_WRITER_H
+
+
+#include <stdio.h> /* for FILE */
+
+#include "grid.h"
+
+
+
+/**
+ * \brief The size in bytes of the buffer of the lines of the statistics.
+ */
+#define STATS_BUFFER_SIZE 65536
+
+
+/**
+ * \brief The default number of generations between two recorded ones.
+ *
+ * Every generation is recorded by default; the generations in between two
+ * recorded ones are not counted at all.
+ */
+#define DEFAULT_STATS_EVERY 1
+
+
+/**
+ * \brief The type writing the statistics of a grid.
+ */
+struct stats_writer {
+	/** The file written to. */
+	FILE *file;
+	/** The number of generations between two recorded ones: the generations
+	    recorded are the multiples of it. */
+	unsigned long every;
+	/** The lines not written to the file yet. */
+	char *buffer;
+	size_t used; /**< The number of bytes in the buffer */
+};
+
+
+/**
+ * \brief Open the file of the statistics and write its header line.
+ *
+ * \param[out] writer The writer to initialize
+ * \param[in]  path   The path to the file to write, or \c - for the standard
+ *                    output stream
+ * \param[in]  every  The number of generations between two recorded ones, not
+ *                    \c 0
+ *
+ * \return \c 0 on success, a negative value if the file cannot be opened or on
+ *         allocation error
+ */
+int open_stats_writer(struct stats_writer *writer, const char *path,
+                      unsigned long every);
+
+
+/**
+ * \brief Add the statistics of a generation to the file.
+ *
+ * \param[in,out] writer The writer
+ * \param[in]     stats  The statistics of the generation
+ *
+ * \return \c 0 on success, a negative value on write error
+ */
+int write_grid_stats(struct stats_writer *writer,
+                     const struct grid_stats *stats);
+
+
+/**
+ * \brief Update the grid through several generations, recording the
+ *        statistics of those that are due.
+ *
+ * The generations that are not recorded are updated with
+ * \c update_grid_generations, so that they are not slowed down.
+ *
+ * \param[in,out] writer      The writer, or \c NULL to record nothing
+ * \param[in,out] grid        The grid to update
+ * \param[in]     generations The number of generations to advance through
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int update_grid_recording(struct stats_writer *writer, struct grid *grid,
+                          unsigned long generations);
+
+
+/**
+ * \brief Write the pending statistics and close the file.
+ *
+ * \param[in,out] writer The writer to close
+ *
+ * \return \c 0 on success, a negative value on write error
+ */
+int close_stats_writer(struct stats_writer *writer);
+
+#endif /* STATS_WRITER_H */
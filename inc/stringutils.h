@@ -13,6 +13,7 @@
 
 
 #include <stdbool.h>
+#include <stddef.h> /* for size_t */
 
 
 
@@ -27,4 +28,37 @@
 bool endswith(const char *string, const char *suffix);
 
 
+/**
+ * \brief A string that grows as text is appended to it.
+ */
+struct string_builder {
+	char *data; /**< The NUL-terminated string built so far. */
+	size_t size; /**< The length of the string. */
+	size_t capacity; /**< The allocated size of the data. */
+};
+
+
+/**
+ * \brief Initialize an empty string builder.
+ *
+ * \param[out] builder  The string builder to initialize
+ * \param[in]  capacity The initial allocated size
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int init_string_builder(struct string_builder *builder, size_t capacity);
+
+
+/**
+ * \brief Append formatted text to the string, as \c printf would print it.
+ *
+ * \param[in,out] builder The string builder
+ * \param[in]     format  The format string
+ * \param[in]     ...     The values to format
+ *
+ * \return \c 0 on success, a negative value on error
+ */
+int append_format(struct string_builder *builder, const char *format, ...);
+
+
 #endif /* STRINGUTILS_H */
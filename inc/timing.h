@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "timing.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the timers of the phases of the program: the
+ *        update of the grid, its rendering, the handling of the events, and
+ *        the loading and saving of the files.
+ *
+ * The durations of each phase are kept as a histogram of the latest ones, from
+ * which their median and 99th percentile are read, besides the number, total
+ * and maximum of all of them.
+ *
+ * The timers are only compiled in if \c USE_TIMING is defined (\c TIMING=y in
+ * the makefiles): otherwise the macros \c START_TIMER, \c STOP_TIMER and
+ * \c PRINT_TIMERS expand to nothing.
+ */
+#ifndef TIMING_H
+#define TIMING_H
+
+
+#include <stdint.h> /* for uint64_t */
+#include <stdio.h> /* for FILE */
+
+
+
+/**
+ * \brief The number of latest durations of each phase the percentiles are
+ *        computed over.
+ */
+#define TIMING_WINDOW 1024
+
+
+/**
+ * \brief The phases of the program that are timed.
+ */
+enum timing_phase {
+	PHASE_UPDATE, /**< The update of the grid by a step */
+	PHASE_RENDER, /**< The rendering of the grid in the window */
+	PHASE_EVENTS, /**< The handling of the pending events of the window */
+	PHASE_LOAD, /**< The loading of the input file */
+	PHASE_SAVE, /**< The writing of a grid file */
+	NB_PHASES
+};
+
+/**
+ * \brief The statistics of the durations of a phase, in nanoseconds.
+ */
+struct phase_stats {
+	uint64_t count; /**< The number of times the phase was run */
+	uint64_t total; /**< The total duration of the phase */
+	uint64_t max; /**< The longest duration of the phase */
+	uint64_t p50; /**< The median of the latest durations */
+	uint64_t p99; /**< The 99th percentile of the latest durations */
+};
+
+
+/**
+ * \brief Read the time of a high-resolution clock.
+ *
+ * \return The time, in nanoseconds from an unspecified origin
+ */
+uint64_t read_timer(void);
+
+
+/**
+ * \brief Record a duration of a phase.
+ *
+ * The function can be called from any thread.
+ *
+ * \param[in] phase The phase
+ * \param[in] start The time the phase started at, as given by \c read_timer
+ */
+void record_phase(enum timing_phase phase, uint64_t start);
+
+
+/**
+ * \brief Give the statistics of the durations of a phase.
+ *
+ * The percentiles are approximated within an eighth of their value.
+ *
+ * \param[in]  phase The phase
+ * \param[out] stats The statistics of the phase, all \c 0 if it never ran
+ */
+void get_phase_stats(enum timing_phase phase, struct phase_stats *stats);
+
+
+/**
+ * \brief Give the name of a phase.
+ *
+ * \param[in] phase The phase
+ *
+ * \return The name of the phase, in lowercase
+ */
+const char *get_phase_name(enum timing_phase phase);
+
+
+/**
+ * \brief Print the statistics of the phases that ran, as a table.
+ *
+ * \param[in] file The file or stream to print to
+ */
+void print_phase_stats(FILE *file);
+
+
+#ifdef USE_TIMING
+/**
+ * \brief Start a timer, declared as a variable of the given name.
+ */
+# define START_TIMER(timer) uint64_t timer = read_timer()
+/**
+ * \brief Record the time elapsed since the start of the timer as a duration
+ *        of the phase.
+ */
+# define STOP_TIMER(timer, phase) record_phase(phase, timer)
+/**
+ * \brief Print the statistics of the phases to the file or stream.
+ */
+# define PRINT_TIMERS(file) print_phase_stats(file)
+#else
+# define START_TIMER(timer) ((void) 0)
+# define STOP_TIMER(timer, phase) ((void) 0)
+# define PRINT_TIMERS(file) ((void) 0)
+#endif
+
+#endif /* TIMING_H */
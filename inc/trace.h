@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+/**
+ * \file "trace.h"
+ * \author Joachim "Moonstroke" MARIE
+ *
+ * \version 1.0
+ *
+ * \brief This file declares the recorder of the trace of a run: the beginning
+ *        and end of the generations, of the tasks of the workers, of the
+ *        renderings and of the loading and saving of the files, written as a
+ *        Chrome trace file to view in \c chrome://tracing or Perfetto.
+ *
+ * Each thread records its events in a buffer of its own, without locking: the
+ * buffer is a ring keeping the latest \c TRACE_BUFFER_EVENTS events. The
+ * buffers are given to the threads as they record their first event, and
+ * handed over to the following threads when theirs end, so that the workers
+ * started at each generation share a handful of buffers: each buffer is shown
+ * as a thread in the trace.
+ *
+ * The recorder is disabled until \c start_trace is called, and its events then
+ * cost only a check of a flag.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+
+
+/**
+ * \brief The number of latest events kept by each thread.
+ */
+#define TRACE_BUFFER_EVENTS 32768
+
+
+/**
+ * \brief Start recording the events.
+ *
+ * On POSIX systems, the trace is also written when the program receives the
+ * \c SIGUSR1 signal, at the next call to \c poll_trace.
+ *
+ * \param[in] path The path to the file to write the trace to, which must stay
+ *                 valid until \c stop_trace is called
+ *
+ * \return \c 0 on success, a negative value if the trace is already being
+ *         recorded or on allocation error
+ */
+int start_trace(const char *path);
+
+
+/**
+ * \brief Record the beginning of an event in the trace of the calling thread.
+ *
+ * Nothing is recorded if the trace was not started.
+ *
+ * \param[in] name The name of the event, a string literal that needs no
+ *                 escaping in JSON
+ */
+void trace_begin(const char *name);
+
+
+/**
+ * \brief Record the end of an event in the trace of the calling thread.
+ *
+ * Nothing is recorded if the trace was not started.
+ *
+ * \param[in] name The name of the event, the same as given to \c trace_begin
+ */
+void trace_end(const char *name);
+
+
+/**
+ * \brief Write the events recorded so far to the file of the trace.
+ *
+ * The events of the other threads may be recorded meanwhile: those that they
+ * overwrite while they are read are left out. The ends of the events whose
+ * beginning was overwritten are left out as well, and the events not ended
+ * yet last until the end of the trace.
+ *
+ * \return \c 0 on success, \c 1 if the trace was not started, a negative value
+ *         on error
+ */
+int write_trace(void);
+
+
+/**
+ * \brief Write the trace if it was requested by a signal since the last call.
+ *
+ * The function is meant to be called periodically by the main loops, out of
+ * the signal handler where the file cannot be written safely.
+ *
+ * \return \c 0 on success or if no trace was requested, a negative value on
+ *         error
+ */
+int poll_trace(void);
+
+
+/**
+ * \brief Write the trace and stop recording the events.
+ *
+ * The function must be called once the other threads that recorded events
+ * have ended.
+ *
+ * \return \c 0 on success, \c 1 if the trace was not started, a negative value
+ *         on error, in which case the recording is stopped all the same
+ */
+int stop_trace(void);
+
+#endif /* TRACE_H */
@@ -39,3 +39,8 @@ STATIC = n
 # The optimization level for the compilation
 # 0..3/s
 OPTIM_LVL = 0
+
+# Enables the timers of the phases of the program, displayed over the grid and
+# printed on exit
+# y/n
+TIMING = n
@@ -1,16 +1,53 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
 #include "app.h"
 
-#include <limits.h> /* for INT_MIN */
+#include <limits.h> /* for INT_MIN, LONG_MAX */
 #include <SDL2/SDL.h>
-#include <stdio.h> /* for fprintf, stderr, fputs */
+#include <signal.h> /* for signal, sig_atomic_t, SIGINT, SIGTERM */
+#include <stdio.h> /* for fprintf, snprintf, stderr, fputs */
+#include <string.h> /* for memcpy */
+#include <time.h> /* for timespec_get */
 
+#include "bookmarks.h"
+#include "checkpoint.h"
+#include "control.h"
 #include "grid.h"
 #include "gridwindow.h"
-#include "file_io.h" /* for write_file */
-#include "utils.h" /* for CHECK_NULL */
+#include "grid_saver.h"
+#include "history.h"
+#include "mathutils.h" /* for MIN */
+#include "metrics.h" /* for count_frame, poll_metrics, write_metrics */
+#include "numa.h" /* for get_numa_nodes, benchmark_numa */
+#include "stats_writer.h" /* for update_grid_recording */
+#include "timing.h" /* for START_TIMER, STOP_TIMER */
+#include "trace.h" /* for trace_begin, trace_end, poll_trace */
+#include "utils.h" /* for CHECK_RC */
 
 
+/* The number of generations between two checks for an interruption or a
+   checkpoint in headless mode, advanced through at once */
+#define HEADLESS_STEP 64
+
+/* The highest exponent of the number of generations advanced through per
+   frame in the window */
+#define MAX_STEP_EXPONENT 20
+
+/* The number of frames displayed per second when running as fast as
+   possible */
+#define UNTHROTTLED_FRAME_RATE 30
+
+/* The number of late frames from which the updates missed are dropped, after
+   the program was stalled */
+#define MAX_LATE_FRAMES 4
+
+/* The number of recorded steps moved through at once in the history with the
+   Page Up and Page Down keys */
+#define HISTORY_PAGE_STEPS 100
+
+/* The number of milliseconds a paused headless run waits for commands before
+   checking for an interruption */
+#define CONTROL_WAIT 100
+
 
 static const char UI_HELP[] = "Interface usage:\n"
 	" - Using the mouse\n"
@@ -23,12 +60,23 @@ static const char UI_HELP[] = "Interface usage:\n"
 	"     H     Display this message\n"
 	" Ctrl + Q  Quit the program\n"
 	"     R     Reset the grid to the input file\n"
+	"    1-9    Go back to the bookmark of the digit\n"
+	"Ctrl + 1-9 Save the grid under the bookmark of the digit\n"
 	"     T     Toggle the state of the highlighted cell\n"
-	"     W     Write the state of the grid to the output file in plain text\n"
+	"     W     Write the state of the grid to the output file in the background\n"
 	" Ctrl + W  Quit the program\n"
 	"   Space   Toggle pause mode\n"
-	"   Enter   When paused, evolve the grid by one generation\n"
+	"   Enter   When paused, evolve the grid by one step\n"
+	" Backspace Go back by one step, pausing the grid\n"
+	"Shift + Backspace Go forward again by one step\n"
+	"PgUp/PgDn  Go back or forward by 100 steps\n"
+	"Home/End   Go back to the oldest step kept, or forward to the latest\n"
+	"    +/-    Double or halve the number of generations per step\n"
+	"     F     Toggle running as fast as possible\n"
 	"    Esc    Quit the program\n"
+#ifdef USE_TIMING
+	"     P     Toggle the display of the durations of the phases\n"
+#endif
 	"Arrow keys Move the highlight by one cell in the key's direction\n";
 
 
@@ -42,6 +90,134 @@ int init_app(void) {
 }
 
 
+/* How fast the grid evolves in the window: by steps of 2^exponent
+   generations, at the update rate or as fast as possible */
+struct _speed {
+	unsigned int exponent;
+	bool unthrottled;
+};
+
+/* Show the speed in the window title, unless it is the default one */
+static void _show_speed(const struct grid_window *gw,
+                        const struct _speed *speed) {
+	char status[64];
+	if (speed->unthrottled) {
+		snprintf(status, sizeof status, "max speed, %lu gen/step",
+		         1UL << speed->exponent);
+	} else if (speed->exponent > 0) {
+		snprintf(status, sizeof status, "%lu gen/step", 1UL << speed->exponent);
+	} else {
+		set_grid_window_status(gw, NULL);
+		return;
+	}
+	set_grid_window_status(gw, status);
+}
+
+/* Give the number of generations to run through before the next check for an
+   interruption or a checkpoint, remaining being 0 for an endless run */
+static unsigned long _get_step(const struct grid *grid,
+                               unsigned long remaining,
+                               const struct checkpointer *checkpointer) {
+	unsigned long step = HEADLESS_STEP;
+	if (remaining > 0 && remaining < step) {
+		step = remaining;
+	}
+	if (checkpointer != NULL && checkpointer->params.every > 0) {
+		/* Stop at the generation of the next checkpoint */
+		uint64_t elapsed = grid->generation - checkpointer->last_generation;
+		if (elapsed < checkpointer->params.every
+		    && checkpointer->params.every - elapsed < step) {
+			step = (unsigned long) (checkpointer->params.every - elapsed);
+		}
+	}
+	return step;
+}
+
+/* Record the state of the grid in the history */
+static void _record_grid(struct history *history, const struct grid *grid) {
+	if (record_history(history, grid) < 0) {
+		fputs("Not enough memory to keep the history, it starts over\n",
+		      stderr);
+	}
+}
+
+/* Advance the grid through the generations, stopping at the checkpoints */
+static int _advance_grid_by(struct grid *grid, unsigned long generations,
+                            struct checkpointer *checkpointer) {
+	for (unsigned long remaining = generations; remaining > 0;) {
+		unsigned long step = _get_step(grid, remaining, checkpointer);
+		CHECK_RC(update_grid_generations(grid, step));
+		remaining -= step;
+		if (checkpointer != NULL) {
+			CHECK_RC(update_checkpointer(checkpointer, grid));
+		}
+	}
+	return 0;
+}
+
+/* Advance the grid through a step of the given speed, and record it */
+static int _advance_grid(struct grid *grid, const struct _speed *speed,
+                         struct checkpointer *checkpointer,
+                         struct history *history) {
+	int rc = _advance_grid_by(grid, 1UL << speed->exponent, checkpointer);
+	/* The generations advanced through before an error are kept */
+	_record_grid(history, grid);
+	return rc;
+}
+
+/* Report an error while advancing the grid, and pause it so that the error is
+   not met again at each frame */
+static void _stop_advancing(bool *play) {
+	fputs("Error while updating the grid\n", stderr);
+	*play = false;
+}
+
+/* Apply the commands received, unless the generations of a step command are
+   left to advance through: they are advanced through by one step of the speed
+   per frame, so that the window is still displayed and handled meanwhile */
+static void _apply_control(struct grid *grid, struct control *control,
+                           struct control_state *state,
+                           const struct _speed *speed, bool *play, bool *loop,
+                           struct checkpointer *checkpointer,
+                           struct history *history) {
+	if (state->steps == 0) {
+		/* The grid may have been paused or resumed with the keyboard */
+		state->play = *play;
+		if (apply_control(control, grid, state) < 0) {
+			fputs("Error while applying the commands\n", stderr);
+		}
+		*play = state->play;
+		if (state->quit) {
+			*loop = false;
+			return;
+		}
+	}
+	if (state->steps > 0) {
+		unsigned long step = MIN(state->steps, 1UL << speed->exponent);
+		int rc = _advance_grid_by(grid, step, checkpointer);
+		_record_grid(history, grid);
+		state->steps -= step;
+		if (rc < 0) {
+			/* The generations left of the step command are dropped */
+			state->steps = 0;
+			_stop_advancing(play);
+		}
+	}
+}
+
+/* Bring the grid to another step of the history, pausing it */
+static void _seek_grid(struct grid *grid, struct history *history,
+                       long offset, bool *play) {
+	*play = false;
+	int rc = seek_history(history, offset, grid);
+	if (rc < 0) {
+		fputs("Error while going through the history\n", stderr);
+	} else if (rc > 0) {
+		fputs(offset < 0 ? "No older step in the history\n"
+		                 : "No newer step in the history\n", stderr);
+	}
+}
+
 static void _handle_mouse_on_cell(struct grid_window *gw, int *last_x,
                                   int *last_y) {
 	if (gw->sel_col >= 0 && gw->sel_row >= 0) {
@@ -51,29 +227,94 @@ static void _handle_mouse_on_cell(struct grid_window *gw, int *last_x,
 	}
 }
 
-static inline void _reset_grid(struct grid *grid, const char *repr,
-                               enum grid_format format, bool *play,
+static inline void _reset_grid(struct grid *grid, const struct grid *initial,
+                               struct history *history, bool *play,
                                bool *loop) {
-	if (repr != NULL) {
+	if (initial != NULL) {
 		if (*play) {
 			*play = false;
 		}
-		bool wrap = grid->wrap;
-		free_grid(grid);
-		if (load_grid(grid, repr, format, wrap) < 0) {
+		/* Keep the rule in effect, which may not be that of the file */
+		char rule[sizeof grid->rule];
+		memcpy(rule, grid->rule, sizeof rule);
+		if (restore_grid(grid, initial) < 0
+		    || set_grid_rule(grid, rule) < 0) {
 			fputs("Error while resetting the grid\n", stderr);
 			*loop = false;
+		} else {
+			_record_grid(history, grid);
 		}
 	}
 }
 
-static inline int _output_grid(const struct grid *grid, const char *out_file,
-                               enum grid_format out_file_format) {
-	char *repr = get_grid_repr(grid, out_file_format);
-	CHECK_NULL(repr);
-	int rc = write_file(out_file, repr);
-	free(repr);
-	return rc;
+/* Save the grid under the bookmark of a digit key, or jump back to it */
+static void _handle_bookmark(struct grid *grid, struct bookmarks *bookmarks,
+                             struct history *history, SDL_Keycode key,
+                             bool save) {
+	char name[2] = {(char) ('0' + (key - SDLK_0)), '\0'};
+	if (save) {
+		if (set_bookmark(bookmarks, name, grid) < 0) {
+			fputs("Error while saving the bookmark\n", stderr);
+		} else {
+			fprintf(stderr, "Bookmark %s set at generation %llu\n", name,
+			        (unsigned long long) grid->generation);
+		}
+		return;
+	}
+	int rc = goto_bookmark(bookmarks, name, grid);
+	if (rc < 0) {
+		fputs("Error while going back to the bookmark\n", stderr);
+	} else if (rc > 0) {
+		fprintf(stderr, "No bookmark %s, set it with Ctrl + %s\n", name,
+		        name);
+	} else {
+		_record_grid(history, grid);
+	}
+}
+
+static inline void _output_grid(const struct grid_window *gw,
+                                struct grid_saver *saver, const char *out_file,
+                                enum grid_format out_file_format) {
+	if (out_file == NULL) {
+		return;
+	}
+	int rc = start_grid_save(saver, gw->grid, out_file, out_file_format);
+	if (rc > 0) {
+		fputs("A save is already in progress\n", stderr);
+	} else if (rc < 0) {
+		fputs("Error while saving the grid\n", stderr);
+	} else {
+		set_grid_window_status(gw, "saving...");
+	}
+}
+
+/* The number of milliseconds a save status stays displayed */
+#define SAVE_STATUS_DURATION 3000
+
+static void _report_save_status(const struct grid_window *gw,
+                                struct grid_saver *saver,
+                                const struct _speed *speed,
+                                Uint32 *status_time) {
+	switch (poll_grid_save(saver)) {
+		case SAVE_DONE:
+			fprintf(stderr, "Grid written to \"%s\"\n", saver->path);
+			set_grid_window_status(gw, "saved");
+			*status_time = SDL_GetTicks();
+			break;
+		case SAVE_FAILED:
+			fprintf(stderr, "Could not write the grid to \"%s\"\n",
+			        saver->path);
+			set_grid_window_status(gw, "save failed");
+			*status_time = SDL_GetTicks();
+			break;
+		default:
+			if (*status_time != 0
+			    && SDL_GetTicks() - *status_time >= SAVE_STATUS_DURATION) {
+				_show_speed(gw, speed);
+				*status_time = 0;
+			}
+			break;
+	}
 }
 
 static inline void _print_help(void) {
@@ -82,19 +323,59 @@ static inline void _print_help(void) {
 
 static void _handle_key_event(const SDL_KeyboardEvent *event,
                               struct grid_window *gw, bool *loop,
-                              bool *play, const char *repr,
-                              enum grid_format repr_format,
+                              bool *play, struct _speed *speed,
+                              struct checkpointer *checkpointer,
+                              const struct grid *initial,
+                              struct bookmarks *bookmarks,
+                              struct history *history,
                               const char *out_file,
-                              enum grid_format out_file_format) {
+                              enum grid_format out_file_format,
+                              struct grid_saver *saver) {
 	switch (event->keysym.sym) {
 		case SDLK_SPACE:
 			*play = !*play;
 			break;
 		case SDLK_RETURN:
-			if (!*play) {
-				update_grid(gw->grid);
+			if (!*play
+			    && _advance_grid(gw->grid, speed, checkpointer, history) < 0) {
+				_stop_advancing(play);
 			}
 			break;
+		case SDLK_BACKSPACE:
+			_seek_grid(gw->grid, history,
+			           (event->keysym.mod & KMOD_SHIFT) != 0 ? 1 : -1, play);
+			break;
+		case SDLK_PAGEUP:
+			_seek_grid(gw->grid, history, -HISTORY_PAGE_STEPS, play);
+			break;
+		case SDLK_PAGEDOWN:
+			_seek_grid(gw->grid, history, HISTORY_PAGE_STEPS, play);
+			break;
+		case SDLK_HOME:
+			_seek_grid(gw->grid, history, -LONG_MAX, play);
+			break;
+		case SDLK_END:
+			_seek_grid(gw->grid, history, LONG_MAX, play);
+			break;
+		case SDLK_PLUS:
+		case SDLK_EQUALS: /* + without Shift on most layouts */
+		case SDLK_KP_PLUS:
+			if (speed->exponent < MAX_STEP_EXPONENT) {
+				++speed->exponent;
+				_show_speed(gw, speed);
+			}
+			break;
+		case SDLK_MINUS:
+		case SDLK_KP_MINUS:
+			if (speed->exponent > 0) {
+				--speed->exponent;
+				_show_speed(gw, speed);
+			}
+			break;
+		case SDLK_f:
+			speed->unthrottled = !speed->unthrottled;
+			_show_speed(gw, speed);
+			break;
 		case SDLK_UP:
 			if (--gw->sel_row < 0) {
 				gw->sel_row = gw->grid->wrap ? gw->grid->height - 1 : 0;
@@ -119,7 +400,19 @@ static void _handle_key_event(const SDL_KeyboardEvent *event,
 			toggle_cell(gw->grid, gw->sel_row, gw->sel_col);
 			break;
 		case SDLK_r:
-			_reset_grid(gw->grid, repr, repr_format, play, loop);
+			_reset_grid(gw->grid, initial, history, play, loop);
+			break;
+		case SDLK_1:
+		case SDLK_2:
+		case SDLK_3:
+		case SDLK_4:
+		case SDLK_5:
+		case SDLK_6:
+		case SDLK_7:
+		case SDLK_8:
+		case SDLK_9:
+			_handle_bookmark(gw->grid, bookmarks, history, event->keysym.sym,
+			                 (event->keysym.mod & KMOD_CTRL) != 0);
 			break;
 		/* The window can be closed with ESC, CTRL+q or CTRL+w; a single w
 		   writes the grid state */
@@ -127,7 +420,7 @@ static void _handle_key_event(const SDL_KeyboardEvent *event,
 			if ((event->keysym.mod & KMOD_CTRL) != 0) {
 				*loop = false;
 			} else {
-				_output_grid(gw->grid, out_file, out_file_format);
+				_output_grid(gw, saver, out_file, out_file_format);
 			}
 			break;
 		case SDLK_q:
@@ -143,13 +436,22 @@ static void _handle_key_event(const SDL_KeyboardEvent *event,
 		case SDLK_h:
 			_print_help();
 			break;
+#ifdef USE_TIMING
+		case SDLK_p:
+			gw->show_timers = !gw->show_timers;
+			break;
+#endif
 	}
 }
 static void _handle_event(const SDL_Event *event, struct grid_window *gw,
                          bool *loop, bool *mdown, bool *play,
-                         int *last_x, int *last_y, const char *repr,
-                         enum grid_format repr_format, const char *out_file,
-                         enum grid_format out_file_format) {
+                         struct _speed *speed,
+                         struct checkpointer *checkpointer,
+                         int *last_x, int *last_y, const struct grid *initial,
+                         struct bookmarks *bookmarks, struct history *history,
+                         const char *out_file,
+                         enum grid_format out_file_format,
+                         struct grid_saver *saver) {
 	switch (event->type) {
 	case SDL_MOUSEBUTTONDOWN:
 		if (event->button.button == SDL_BUTTON_LEFT) {
@@ -172,8 +474,9 @@ static void _handle_event(const SDL_Event *event, struct grid_window *gw,
 		}
 		break;
 	case SDL_KEYDOWN:
-		_handle_key_event(&event->key, gw, loop, play, repr, repr_format,
-		                  out_file, out_file_format);
+		_handle_key_event(&event->key, gw, loop, play, speed, checkpointer,
+		                  initial, bookmarks, history, out_file,
+		                  out_file_format, saver);
 		break;
 	case SDL_QUIT:
 		*loop = false;
@@ -182,34 +485,193 @@ static void _handle_event(const SDL_Event *event, struct grid_window *gw,
 }
 
 void run_app(struct grid_window *gw, unsigned int update_rate,
-             const char *repr, enum grid_format repr_format,
-             const char *out_file, enum grid_format out_file_format) {
+             const struct grid *initial, size_t history_budget,
+             const char *out_file,
+             enum grid_format out_file_format,
+             struct checkpointer *checkpointer, struct control *control) {
 	Uint64 frame_start = SDL_GetPerformanceCounter();
 	Uint64 frame_duration = SDL_GetPerformanceFrequency() / update_rate;
+	Uint64 unthrottled_frame_duration = SDL_GetPerformanceFrequency()
+	                                    / UNTHROTTLED_FRAME_RATE;
 
 	bool loop = true;
 	bool mdown = false;
 	bool play = false;
+	struct _speed speed = {0, false};
 	int last_x = INT_MIN;
 	int last_y = INT_MIN;
+	struct grid_saver saver;
+	Uint32 save_status_time = 0;
+	init_grid_saver(&saver);
+	struct bookmarks bookmarks;
+	init_bookmarks(&bookmarks);
+	struct history history;
+	init_history(&history, history_budget);
+	_record_grid(&history, gw->grid);
+	struct control_state control_state = {false, 0, false};
 	while (loop) {
+		START_TIMER(render_timer);
+		trace_begin("render");
 		render_grid_window(gw);
+		trace_end("render");
+		count_frame();
+		STOP_TIMER(render_timer, PHASE_RENDER);
+		START_TIMER(events_timer);
+		trace_begin("events");
 		SDL_Event event;
 		while (SDL_PollEvent(&event) != 0) {
-			_handle_event(&event, gw, &loop, &mdown, &play, &last_x, &last_y,
-			            repr, repr_format, out_file, out_file_format);
+			_handle_event(&event, gw, &loop, &mdown, &play, &speed,
+			              checkpointer, &last_x, &last_y, initial, &bookmarks,
+			              &history, out_file, out_file_format, &saver);
+		}
+		if (control != NULL) {
+			_apply_control(gw->grid, control, &control_state, &speed, &play,
+			               &loop, checkpointer, &history);
+		}
+		trace_end("events");
+		STOP_TIMER(events_timer, PHASE_EVENTS);
+		if (poll_trace() < 0) {
+			fputs("Could not write the trace\n", stderr);
 		}
+		if (poll_metrics(gw->grid, history.used) < 0) {
+			fputs("Could not write the metrics\n", stderr);
+		}
+		_report_save_status(gw, &saver, &speed, &save_status_time);
 
-		while (frame_start + frame_duration <= SDL_GetPerformanceCounter()) {
+		Uint64 now = SDL_GetPerformanceCounter();
+		if (play && speed.unthrottled) {
+			/* Evolve until the next frame is due: only the latest generation
+			   is displayed, however many were computed, and recorded */
+			Uint64 frame_end = now + unthrottled_frame_duration;
+			do {
+				if (_advance_grid_by(gw->grid, 1UL << speed.exponent,
+				                     checkpointer) < 0) {
+					_stop_advancing(&play);
+					break;
+				}
+			} while (SDL_GetPerformanceCounter() < frame_end);
+			_record_grid(&history, gw->grid);
+			frame_start = SDL_GetPerformanceCounter();
+			continue;
+		}
+		if (now - frame_start > MAX_LATE_FRAMES * frame_duration) {
+			/* After a stall, drop the updates missed rather than running
+			   them all before the next display */
+			frame_start = now - frame_duration;
+		}
+		bool advanced = false;
+		while (frame_start + frame_duration <= now) {
 			if (play) {
-				update_grid(gw->grid);
+				if (_advance_grid_by(gw->grid, 1UL << speed.exponent,
+				                     checkpointer) < 0) {
+					_stop_advancing(&play);
+				}
+				advanced = true;
 			}
 			frame_start += frame_duration;
 		}
+		/* Only the step displayed is recorded, when several are caught up
+		   with */
+		if (advanced) {
+			_record_grid(&history, gw->grid);
+		}
+	}
+	if (write_metrics(gw->grid, history.used) < 0) {
+		fputs("Could not write the metrics\n", stderr);
+	}
+	free_history(&history);
+	free_bookmarks(&bookmarks);
+	/* Do not exit before a pending save is complete */
+	if (free_grid_saver(&saver) == SAVE_FAILED) {
+		fprintf(stderr, "Could not write the grid to \"%s\"\n", saver.path);
 	}
 }
 
 
+static volatile sig_atomic_t interrupted = 0;
+
+static void _handle_signal(int sig) {
+	(void) sig;
+	interrupted = 1;
+}
+
+int run_headless(struct grid *grid, unsigned long generations,
+                 struct checkpointer *checkpointer,
+                 struct stats_writer *stats, struct control *control) {
+	signal(SIGINT, _handle_signal);
+	signal(SIGTERM, _handle_signal);
+	/* The grid only evolves on the commands, if any */
+	struct control_state state = {control == NULL, 0, false};
+	for (unsigned long i = 0; !interrupted && (generations == 0
+	                                           || i < generations);) {
+		if (control != NULL && state.steps == 0) {
+			CHECK_RC(apply_control(control, grid, &state));
+		}
+		if (state.quit) {
+			break;
+		}
+		if (state.play || state.steps > 0) {
+			unsigned long remaining = generations == 0 ? 0 : generations - i;
+			unsigned long step = _get_step(grid, remaining, checkpointer);
+			if (state.steps > 0) {
+				step = MIN(step, state.steps);
+				state.steps -= step;
+			}
+			CHECK_RC(update_grid_recording(stats, grid, step));
+			i += step;
+			if (checkpointer != NULL) {
+				CHECK_RC(update_checkpointer(checkpointer, grid));
+			}
+		} else if (!wait_control(control, CONTROL_WAIT)) {
+			/* No command can resume the grid any more */
+			break;
+		}
+		if (poll_trace() < 0) {
+			fputs("Could not write the trace\n", stderr);
+		}
+		if (poll_metrics(grid, 0) < 0) {
+			fputs("Could not write the metrics\n", stderr);
+		}
+	}
+	if (write_metrics(grid, 0) < 0) {
+		fputs("Could not write the metrics\n", stderr);
+	}
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	if (interrupted) {
+		fprintf(stderr, "Interrupted at generation %llu\n",
+		        (unsigned long long) grid->generation);
+		/* Do not lose the progress since the last checkpoint */
+		if (checkpointer != NULL) {
+			CHECK_RC(flush_checkpointer(checkpointer, grid));
+		}
+	}
+	return 0;
+}
+
+
+static double _get_time(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int run_benchmark(struct grid *grid, unsigned long generations) {
+	double start = _get_time();
+	CHECK_RC(update_grid_generations(grid, generations));
+	double seconds = _get_time() - start;
+	double cells = (double) grid->width * grid->height * generations;
+	/* The cells are read and written at each generation */
+	double bytes = 2.0 * (double) get_grid_data_size(grid) * generations;
+	unsigned int nodes = get_numa_nodes();
+	fprintf(stderr, "%lu generations in %.3f s, with %u thread(s) on %u "
+	        "node(s):\n%.3g cells/s, %.0f MB/s of cells\n", generations,
+	        seconds, grid->workers > 1 ? grid->workers : 1, nodes,
+	        cells / seconds, bytes / seconds / 1e6);
+	/* The share of the cells of each node */
+	return benchmark_numa(get_grid_data_size(grid) / nodes, stderr);
+}
+
 void terminate_app(void) {
 	SDL_Quit();
 }
@@ -1,7 +1,7 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
 #include "bits.h"
 
-#include <string.h> /* for memcpy */
+#include <string.h> /* for memcpy, memmove, memset */
 
 #include "mathutils.h" /* for MIN */
 
@@ -16,6 +16,14 @@ extern void set_bit(char*, size_t, int);
 
 extern void toggle_bit(char*, size_t);
 
+extern uint64_t load_word(const char*, size_t);
+
+extern unsigned int count_leading_zeros(uint64_t);
+
+extern unsigned int count_trailing_zeros(uint64_t);
+
+extern unsigned int count_set_bits(uint64_t);
+
 
 void copy_bits(const char *src, size_t src_offset, char *dest,
                size_t dest_offset, size_t length) {
@@ -80,3 +88,70 @@ int bits_equal(const char *bits1, size_t offset1, const char *bits2,
 	}
 	return 1;
 }
+
+
+bool is_blank(const char *data, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		if (data[i] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+size_t pack_bits(const unsigned char *src, size_t size, unsigned char *dest) {
+	size_t written = 0;
+	size_t i = 0;
+	while (i < size) {
+		size_t run = 1;
+		while (i + run < size && run < 128 && src[i + run] == src[i]) {
+			++run;
+		}
+		/* A run of two bytes is left in a literal sequence, which would
+		   otherwise be split for no gain */
+		if (run > 2) {
+			dest[written++] = (unsigned char) (257 - run);
+			dest[written++] = src[i];
+			i += run;
+			continue;
+		}
+		/* Extend the literal sequence up to the start of the next run */
+		size_t start = i++;
+		while (i < size && i - start < 128
+		       && !(i + 2 < size && src[i] == src[i + 1]
+		            && src[i] == src[i + 2])) {
+			++i;
+		}
+		dest[written++] = (unsigned char) (i - start - 1);
+		memcpy(&dest[written], &src[start], i - start);
+		written += i - start;
+	}
+	return written;
+}
+
+
+int unpack_bits(const unsigned char *src, size_t size, unsigned char *dest,
+                size_t dest_size) {
+	size_t written = 0;
+	for (size_t i = 0; i < size;) {
+		unsigned int control = src[i++];
+		if (control < 128) {
+			size_t length = control + 1;
+			if (i + length > size || written + length > dest_size) {
+				return -__LINE__;
+			}
+			memcpy(&dest[written], &src[i], length);
+			i += length;
+			written += length;
+		} else if (control > 128) {
+			size_t length = 257 - control;
+			if (i >= size || written + length > dest_size) {
+				return -__LINE__;
+			}
+			memset(&dest[written], src[i++], length);
+			written += length;
+		}
+	}
+	return written == dest_size ? 0 : -__LINE__;
+}
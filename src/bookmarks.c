@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "bookmarks.h"
+
+#include <stdlib.h> /* for realloc, free */
+#include <string.h> /* for strcmp, strlen, memcpy */
+
+#include "utils.h" /* for CHECK_NULL, CHECK_RC */
+
+
+
+void init_bookmarks(struct bookmarks *bookmarks) {
+	bookmarks->items = NULL;
+	bookmarks->count = 0;
+}
+
+
+static struct bookmark *_find_bookmark(const struct bookmarks *bookmarks,
+                                       const char *name) {
+	for (size_t i = 0; i < bookmarks->count; ++i) {
+		if (strcmp(bookmarks->items[i].name, name) == 0) {
+			return &bookmarks->items[i];
+		}
+	}
+	return NULL;
+}
+
+int set_bookmark(struct bookmarks *bookmarks, const char *name,
+                 const struct grid *grid) {
+	size_t length = strlen(name);
+	if (length > MAX_BOOKMARK_NAME) {
+		return -__LINE__;
+	}
+	struct bookmark *bookmark = _find_bookmark(bookmarks, name);
+	if (bookmark != NULL) {
+		return restore_grid(&bookmark->grid, grid);
+	}
+	struct bookmark *items = realloc(bookmarks->items,
+	                                 (bookmarks->count + 1) * sizeof *items);
+	CHECK_NULL(items);
+	bookmarks->items = items;
+	bookmark = &items[bookmarks->count];
+	CHECK_RC(copy_grid(&bookmark->grid, grid));
+	/* The copy is never updated */
+	bookmark->grid.workers = 0;
+	memcpy(bookmark->name, name, length + 1);
+	++bookmarks->count;
+	return 0;
+}
+
+
+int goto_bookmark(const struct bookmarks *bookmarks, const char *name,
+                  struct grid *grid) {
+	const struct bookmark *bookmark = _find_bookmark(bookmarks, name);
+	if (bookmark == NULL) {
+		return 1;
+	}
+	return restore_grid(grid, &bookmark->grid);
+}
+
+
+void free_bookmarks(struct bookmarks *bookmarks) {
+	for (size_t i = 0; i < bookmarks->count; ++i) {
+		free_grid(&bookmarks->items[i].grid);
+	}
+	free(bookmarks->items);
+	bookmarks->items = NULL;
+	bookmarks->count = 0;
+}
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "checkpoint.h"
+
+#include <stdio.h> /* for snprintf, fprintf, stderr */
+#include <stdlib.h> /* for malloc, calloc, free */
+#include <string.h> /* for strlen */
+
+#include "snapshot.h" /* for load_grid_checkpoint, get_checkpoint_generation */
+#include "utils.h" /* for CHECK_NULL */
+
+
+
+static void _free_paths(char **paths, unsigned int count) {
+	for (unsigned int i = 0; i < count; ++i) {
+		free(paths[i]);
+	}
+	free(paths);
+}
+
+static char **_get_paths(const struct checkpoint_params *params) {
+	char **paths = calloc(params->keep, sizeof *paths);
+	if (paths == NULL) {
+		return NULL;
+	}
+	/* Room for the dot, the index and the terminator */
+	size_t size = strlen(params->path) + 12;
+	for (unsigned int i = 0; i < params->keep; ++i) {
+		paths[i] = malloc(size);
+		if (paths[i] == NULL) {
+			_free_paths(paths, i);
+			return NULL;
+		}
+		snprintf(paths[i], size, "%s.%u", params->path, i);
+	}
+	return paths;
+}
+
+/* Find the index in the rotation of the checkpoint file with the highest
+   generation, or -1 if there is none */
+static int _find_latest(char *const *paths, unsigned int count,
+                        uint64_t *latest_generation) {
+	int latest = -1;
+	for (unsigned int i = 0; i < count; ++i) {
+		uint64_t generation;
+		if (paths[i] != NULL
+		    && get_checkpoint_generation(paths[i], &generation) == 0
+		    && (latest < 0 || generation > *latest_generation)) {
+			latest = (int) i;
+			*latest_generation = generation;
+		}
+	}
+	return latest;
+}
+
+
+int init_checkpointer(struct checkpointer *checkpointer,
+                      const struct checkpoint_params *params,
+                      const struct grid *grid) {
+	checkpointer->params = *params;
+	if (checkpointer->params.keep == 0) {
+		checkpointer->params.keep = DEFAULT_CHECKPOINT_KEEP;
+	}
+	if (params->every == 0 && params->interval == 0) {
+		checkpointer->params.interval = DEFAULT_CHECKPOINT_INTERVAL;
+	}
+	checkpointer->paths = _get_paths(&checkpointer->params);
+	CHECK_NULL(checkpointer->paths);
+	/* Overwrite the oldest file first, i.e. the one after the latest */
+	uint64_t generation;
+	int latest = _find_latest(checkpointer->paths, checkpointer->params.keep,
+	                          &generation);
+	checkpointer->next = (latest + 1) % checkpointer->params.keep;
+	checkpointer->last_generation = grid->generation;
+	checkpointer->last_time = time(NULL);
+	init_grid_saver(&checkpointer->saver);
+	return 0;
+}
+
+
+static void _report_status(const struct checkpointer *checkpointer,
+                           enum save_status status) {
+	if (status == SAVE_FAILED) {
+		fprintf(stderr, "Warning: could not write checkpoint \"%s\"\n",
+		        checkpointer->saver.path);
+	}
+}
+
+static int _start_checkpoint(struct checkpointer *checkpointer,
+                             const struct grid *grid) {
+	int rc = start_grid_save(&checkpointer->saver, grid,
+	                         checkpointer->paths[checkpointer->next],
+	                         GRID_FORMAT_CHECKPOINT);
+	if (rc != 0) {
+		/* Still writing the previous checkpoint, or error */
+		return rc > 0 ? 0 : rc;
+	}
+	checkpointer->next = (checkpointer->next + 1) % checkpointer->params.keep;
+	checkpointer->last_generation = grid->generation;
+	checkpointer->last_time = time(NULL);
+	return 1;
+}
+
+int update_checkpointer(struct checkpointer *checkpointer,
+                        const struct grid *grid) {
+	_report_status(checkpointer, poll_grid_save(&checkpointer->saver));
+	const struct checkpoint_params *params = &checkpointer->params;
+	bool due = params->every > 0
+	           && grid->generation - checkpointer->last_generation
+	              >= params->every;
+	if (!due && params->interval > 0) {
+		due = difftime(time(NULL), checkpointer->last_time)
+		      >= params->interval;
+	}
+	return due ? _start_checkpoint(checkpointer, grid) : 0;
+}
+
+
+int flush_checkpointer(struct checkpointer *checkpointer,
+                       const struct grid *grid) {
+	/* Wait for the running checkpoint, if any */
+	_report_status(checkpointer, free_grid_saver(&checkpointer->saver));
+	int rc = _start_checkpoint(checkpointer, grid);
+	if (rc < 0) {
+		return rc;
+	}
+	enum save_status status = free_grid_saver(&checkpointer->saver);
+	_report_status(checkpointer, status);
+	return status == SAVE_FAILED ? -__LINE__ : 0;
+}
+
+
+void free_checkpointer(struct checkpointer *checkpointer) {
+	_report_status(checkpointer, free_grid_saver(&checkpointer->saver));
+	_free_paths(checkpointer->paths, checkpointer->params.keep);
+}
+
+
+int resume_from_checkpoint(struct grid *grid,
+                           const struct checkpoint_params *params) {
+	unsigned int keep = params->keep > 0 ? params->keep
+	                                     : DEFAULT_CHECKPOINT_KEEP;
+	struct checkpoint_params actual_params = *params;
+	actual_params.keep = keep;
+	char **paths = _get_paths(&actual_params);
+	CHECK_NULL(paths);
+	/* Try the files from the most recent; skip those that cannot be loaded
+	   (e.g. corrupted) */
+	int rc = 1;
+	uint64_t generation;
+	int latest;
+	while (rc != 0 && (latest = _find_latest(paths, keep, &generation)) >= 0) {
+		if (load_grid_checkpoint(grid, paths[latest]) == 0) {
+			fprintf(stderr, "Resuming from checkpoint \"%s\", generation "
+			                "%llu\n", paths[latest],
+			        (unsigned long long) generation);
+			rc = 0;
+		} else {
+			fprintf(stderr, "Warning: invalid checkpoint \"%s\"\n",
+			        paths[latest]);
+			/* Exclude it from the next search */
+			free(paths[latest]);
+			paths[latest] = NULL;
+		}
+	}
+	_free_paths(paths, keep);
+	return rc;
+}
@@ -27,9 +27,9 @@ int getopt_long(int argc, char *const argv[], const char *optstring,
                 const struct option *longopts, int *longindex);
 #endif
 #include <stdio.h> /* for printf, puts, fprintf, stderr, sscanf, fputs */
-#include <string.h> /* for strcasecmp / _stricmp */
+#include <string.h> /* for strcasecmp / _stricmp, strcmp */
 
-#include "rules.h"
+#include "rules.h" /* for get_rule_from_name, load_rules_file */
 #include "utils.h" /* for CHECK_RC */
 
 
@@ -55,6 +55,9 @@ static const char USAGE[] = "where OPTION is any of the following:\n"
 	"\t-R GAME_RULE, --game-rule=GAME_RULE\n"
 	"\t\tSpecify the rulestring or name of the variant to run (string arg, "
 	"default \"B3/S23\")\n"
+	"\t--rules=FILE\n"
+	"\t\tSpecify a file of rule names, one \"NAME = RULESTRING\" per line, "
+	"usable with --game-rule (string arg, default none)\n"
 	"\t-r UPDATE_RATE, --update-rate=UPDATE_RATE\n"
 	"\t\tSpecify the number of generations to compute per second (integer arg, "
 	"default 25)\n"
@@ -68,8 +71,59 @@ static const char USAGE[] = "where OPTION is any of the following:\n"
 	"\t\tSpecify the file for output (string argument, default none)\n"
 	"\t-F FORMAT, --format=FORMAT\n"
 	"\t\tSpecify the grid representation format in the input file: one of "
-	"\"plain\", \"plaintext\" or \"RLE\" case not significant (string argument,"
-	" default none)\n"
+	"\"plain\", \"plaintext\", \"RLE\", \"macrocell\", \"mc\", \"life106\", "
+	"\"lif\", \"snapshot\" or \"checkpoint\" case not significant (string "
+	"argument, default none)\n"
+	"\t-H, --headless\n"
+	"\t\tRun the simulation without opening a window\n"
+	"\t-g GENERATIONS, --generations=GENERATIONS\n"
+	"\t\tSpecify the number of generations to compute in headless mode "
+	"(integer arg, default 0: until interrupted)\n"
+	"\t--checkpoint=PATH\n"
+	"\t\tSpecify the base path of the checkpoint files, and enable the "
+	"checkpoints (string arg, default none)\n"
+	"\t--checkpoint-every=GENERATIONS\n"
+	"\t\tSpecify the number of generations between two checkpoints (integer "
+	"arg, default none)\n"
+	"\t--checkpoint-interval=SECONDS\n"
+	"\t\tSpecify the number of seconds between two checkpoints (integer arg, "
+	"default 300 if no frequency is given)\n"
+	"\t--checkpoint-keep=COUNT\n"
+	"\t\tSpecify the number of checkpoint files kept in rotation (integer "
+	"arg, default 3)\n"
+	"\t--resume\n"
+	"\t\tRestore the grid from the latest checkpoint, if any\n"
+	"\t--threads=COUNT\n"
+	"\t\tSpecify the number of threads updating the grid, spread over the "
+	"nodes of the machine (integer arg, default 1)\n"
+	"\t--benchmark\n"
+	"\t\tIn headless mode, report the speed of the run and the bandwidth of "
+	"the memory of each node, on the standard error stream\n"
+	"\t--history=MEBIBYTES\n"
+	"\t\tSpecify the memory budget of the generations kept to step backwards "
+	"in the window, 0 to keep none (integer arg, default 64)\n"
+	"\t--trace=FILE\n"
+	"\t\tRecord the generations, the tasks of the workers, the renderings and "
+	"the files loaded and saved, and write them as a Chrome trace to the file "
+	"at exit or on SIGUSR1 (string arg, default none)\n"
+	"\t--stats=FILE\n"
+	"\t\tIn headless mode, write the population, births, deaths, bounds of "
+	"the live cells and duration of the update of the generations to the file, "
+	"as CSV (string arg, default none)\n"
+	"\t--stats-every=GENERATIONS\n"
+	"\t\tSpecify the number of generations between two lines of statistics "
+	"(integer arg, default 1)\n"
+	"\t--metrics=FILE\n"
+	"\t\tWrite the metrics of the run to the file periodically, in the "
+	"format of Prometheus (string arg, default none)\n"
+	"\t--metrics-interval=SECONDS\n"
+	"\t\tSpecify the number of seconds between two writes of the metrics "
+	"(integer arg, default 15)\n"
+	"\t--control=FILE\n"
+	"\t\tRead the commands driving the run from the file or named pipe, - "
+	"for the standard input stream, and answer them on the standard output "
+	"stream; in headless mode, the grid then evolves on the commands only "
+	"(string arg, default none)\n"
 	"\t--help, --usage\n"
 	"\t\tPrint this message and exit\n"
 	"\t--version\n"
@@ -86,7 +140,7 @@ static const char NOTICE[] = "cyano " VERSION_STRING "\n"
 	"This software comes with NO WARRANTY beyond the minimal clauses required"
 	" by\nFrench law.";
 
-static const char OPTSTRING[] = ":b:c:F:f:h:i:no:R:r:S:Ww:";
+static const char OPTSTRING[] = ":b:c:F:f:g:Hh:i:no:R:r:S:Ww:";
 
 /**
  * The long options array.
@@ -96,6 +150,8 @@ static const struct option LONGOPTS[] = {
 	{"cell-size",   required_argument, NULL, 'c'},
 	{"format",      required_argument, NULL, 'F'},
 	{"file",        required_argument, NULL, 'f'},
+	{"generations", required_argument, NULL, 'g'},
+	{"headless",    no_argument,       NULL, 'H'},
 	{"grid-height", required_argument, NULL, 'h'},
 	{"input-file",  required_argument, NULL, 'i'},
 	{"no-border",   no_argument,       NULL, 'n'},
@@ -108,6 +164,22 @@ static const struct option LONGOPTS[] = {
 	{"wrap",        no_argument      , NULL, 'W'},
 	{"grid-width",  required_argument, NULL, 'w'},
 	{"version",     no_argument      , NULL, 'v'},
+	/* Long options only: their values are not in OPTSTRING */
+	{"checkpoint",          required_argument, NULL, 'k'},
+	{"checkpoint-every",    required_argument, NULL, 'e'},
+	{"checkpoint-interval", required_argument, NULL, 't'},
+	{"checkpoint-keep",     required_argument, NULL, 'K'},
+	{"resume",              no_argument      , NULL, 'z'},
+	{"rules",               required_argument, NULL, 'L'},
+	{"threads",             required_argument, NULL, 'T'},
+	{"benchmark",           no_argument      , NULL, 'B'},
+	{"history",             required_argument, NULL, 'y'},
+	{"trace",               required_argument, NULL, 'X'},
+	{"stats",               required_argument, NULL, 'a'},
+	{"stats-every",         required_argument, NULL, 'E'},
+	{"metrics",             required_argument, NULL, 'm'},
+	{"metrics-interval",    required_argument, NULL, 'I'},
+	{"control",             required_argument, NULL, 'C'},
 	{"", 0, NULL, 0}
 };
 
@@ -121,50 +193,43 @@ static void _print_version(void) {
 	puts(NOTICE);
 }
 
+static int _load_rules(const char *path) {
+	int rc = load_rules_file(path);
+	if (rc < 0) {
+		fprintf(stderr, "Error: could not read the rules file \"%s\"\n", path);
+		return -__LINE__;
+	} else if (rc > 0) {
+		fprintf(stderr, "Error: invalid rule at line %d of \"%s\"\n", rc,
+		        path);
+		return -__LINE__;
+	}
+	return 0;
+}
+
 static int _set_rule(const char *arg, const char **dst) {
 	const char *rule = get_rule_from_name(arg);
 	if (rule != NULL) {
 		*dst = rule;
 		return 0;
 	}
-	if (arg[0] != 'B') {
-		goto err;
-	}
-	size_t i = 1;
-	/* Check that all chars until the slash are digits in ascending order */
-	for (; '0' <= arg[i] && arg[i] <= '8'; ++i) {
-		if (arg[i] >= arg[i + 1] && arg[i + 1] != '/' && arg[i + 1] != 'S') {
-			goto err;
-		}
-	}
-	if (arg[i] == '/') {
-		++i;
-	}
-	if (arg[i++] != 'S') {
-		goto err;
-	}
-	for (; '0' <= arg[i] && arg[i] <= '8'; ++i) {
-		if(arg[i + 1] != '\0' && arg[i] >= arg[i + 1]) {
-			goto err;
-		}
+	if (get_compiled_rule(arg) == NULL) {
+		fprintf(stderr, "Error: invalid rule: \"%s\"\n", arg);
+		return -__LINE__;
 	}
 	*dst = arg;
 	return 0;
-err:
-	fprintf(stderr, "Error: invalid rule: \"%s\"\n", arg);
-	return -__LINE__;
 }
 
-static int _get_uint_value(char opt, const char *arg, unsigned int *dst,
-                           unsigned int min) {
+static int _get_uint_value(const char *opt, const char *arg,
+                           unsigned int *dst, unsigned int min) {
 	unsigned int tmp;
 	if (sscanf(arg, "%u", &tmp) != 1) {
 		fprintf(stderr,
-		        "Error: option -%c needs an unsigned integer argument\n", opt);
+		        "Error: option %s needs an unsigned integer argument\n", opt);
 		return -__LINE__;
 	}
 	if (tmp < min) {
-		fprintf(stderr, "Error: value for option -%c cannot be less than %u\n",
+		fprintf(stderr, "Error: value for option %s cannot be less than %u\n",
 		        opt, min);
 		return -__LINE__;
 	}
@@ -172,6 +237,16 @@ static int _get_uint_value(char opt, const char *arg, unsigned int *dst,
 	return 0;
 }
 
+static int _get_ulong_value(const char *opt, const char *arg,
+                            unsigned long *dst) {
+	if (sscanf(arg, "%lu", dst) != 1) {
+		fprintf(stderr,
+		        "Error: option %s needs an unsigned integer argument\n", opt);
+		return -__LINE__;
+	}
+	return 0;
+}
+
 static void _parse_format(const char *arg, enum grid_format *format) {
 	int (*cmp_func)(const char*, const char*);
 #ifdef _MSC_VER
@@ -183,6 +258,14 @@ static void _parse_format(const char *arg, enum grid_format *format) {
 		*format = GRID_FORMAT_RLE;
 	} else if (cmp_func(arg, "plaintext") == 0 || cmp_func(arg, "plain") == 0) {
 		*format = GRID_FORMAT_PLAIN;
+	} else if (cmp_func(arg, "snapshot") == 0) {
+		*format = GRID_FORMAT_SNAPSHOT;
+	} else if (cmp_func(arg, "checkpoint") == 0) {
+		*format = GRID_FORMAT_CHECKPOINT;
+	} else if (cmp_func(arg, "macrocell") == 0 || cmp_func(arg, "mc") == 0) {
+		*format = GRID_FORMAT_MACROCELL;
+	} else if (cmp_func(arg, "life106") == 0 || cmp_func(arg, "lif") == 0) {
+		*format = GRID_FORMAT_LIFE106;
 	} else {
 		fprintf(stderr, "Warning: unrecognized grid representation format: "
 		                "\"%s\"\n", optarg);
@@ -194,15 +277,19 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
                   unsigned int *grid_height, bool *wrap, const char **game_rule,
                   unsigned int *cell_pixels, unsigned int *border_width,
                   unsigned int *update_rate, const char **in_file,
-                  const char **out_file, enum grid_format *format) {
+                  const char **out_file, enum grid_format *format,
+                  struct run_options *options) {
 	bool opt_b_met = false;
 	bool opt_f_met = false;
+	bool opt_g_met = false;
 	bool opt_h_met = false;
 	bool opt_i_met = false;
 	bool opt_n_met = false;
 	bool opt_o_met = false;
 	bool opt_S_met = false;
 	bool opt_w_met = false;
+	/* The names are resolved once the rules file, if any, is loaded */
+	const char *rule_arg = NULL;
 	int ch;
 	int idx;
 	optind = 1;
@@ -210,11 +297,11 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
 	while ((ch = getopt_long(argc, argv, OPTSTRING, LONGOPTS, &idx)) != -1) {
 		switch (ch) {
 			case 'b':
-				CHECK_RC(_get_uint_value('b', optarg, border_width, 0));
+				CHECK_RC(_get_uint_value("-b", optarg, border_width, 0));
 				opt_b_met = true;
 				break;
 			case 'c':
-				CHECK_RC(_get_uint_value('c', optarg, cell_pixels, 1));
+				CHECK_RC(_get_uint_value("-c", optarg, cell_pixels, 1));
 				break;
 			case 'F':
 				_parse_format(optarg, format);
@@ -223,8 +310,15 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
 				*in_file = *out_file = optarg;
 				opt_f_met = true;
 				break;
+			case 'g':
+				CHECK_RC(_get_ulong_value("-g", optarg, &options->generations));
+				opt_g_met = true;
+				break;
+			case 'H':
+				options->headless = true;
+				break;
 			case 'h':
-				CHECK_RC(_get_uint_value('h', optarg, grid_height, 3));
+				CHECK_RC(_get_uint_value("-h", optarg, grid_height, 3));
 				opt_h_met = true;
 				break;
 			case 'i':
@@ -240,13 +334,13 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
 				opt_o_met = true;
 				break;
 			case 'R':
-				CHECK_RC(_set_rule(optarg, game_rule));
+				rule_arg = optarg;
 				break;
 			case 'r':
-				CHECK_RC(_get_uint_value('r', optarg, update_rate, 1));
+				CHECK_RC(_get_uint_value("-r", optarg, update_rate, 1));
 				break;
 			case 'S':
-				_get_uint_value('S', optarg, grid_width, 3);
+				_get_uint_value("-S", optarg, grid_width, 3);
 				*grid_height = *grid_width;
 				opt_S_met = true;
 				break;
@@ -259,8 +353,65 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
 			case 'W':
 				*wrap = true;
 				break;
+			case 'k':
+				options->checkpoint.path = optarg;
+				break;
+			case 'e':
+				CHECK_RC(_get_ulong_value("--checkpoint-every", optarg,
+				                          &options->checkpoint.every));
+				break;
+			case 't':
+				CHECK_RC(_get_uint_value("--checkpoint-interval", optarg,
+				                         &options->checkpoint.interval, 1));
+				break;
+			case 'K':
+				CHECK_RC(_get_uint_value("--checkpoint-keep", optarg,
+				                         &options->checkpoint.keep, 1));
+				break;
+			case 'z':
+				options->resume = true;
+				break;
+			case 'L':
+				CHECK_RC(_load_rules(optarg));
+				break;
+			case 'T':
+				CHECK_RC(_get_uint_value("--threads", optarg, &options->threads,
+				                         1));
+				break;
+			case 'B':
+				options->benchmark = true;
+				break;
+			case 'y':
+				CHECK_RC(_get_uint_value("--history", optarg, &options->history,
+				                         0));
+				break;
+			case 'X':
+				options->trace = optarg;
+				break;
+			case 'a':
+				options->stats = optarg;
+				break;
+			case 'E':
+				CHECK_RC(_get_ulong_value("--stats-every", optarg,
+				                          &options->stats_every));
+				if (options->stats_every == 0) {
+					fputs("Error: option --stats-every needs a positive "
+					      "argument\n", stderr);
+					return -__LINE__;
+				}
+				break;
+			case 'm':
+				options->metrics = optarg;
+				break;
+			case 'I':
+				CHECK_RC(_get_uint_value("--metrics-interval", optarg,
+				                         &options->metrics_interval, 1));
+				break;
+			case 'C':
+				options->control = optarg;
+				break;
 			case 'w':
-				CHECK_RC(_get_uint_value('w', optarg, grid_width, 3));
+				CHECK_RC(_get_uint_value("-w", optarg, grid_width, 3));
 				opt_w_met = true;
 				break;
 			case '?':
@@ -295,6 +446,43 @@ int parse_cmdline(int argc, char **argv, unsigned int *grid_width,
 		      " --height", stderr);
 		return -__LINE__;
 	}
+	if (opt_g_met && !options->headless) {
+		fputs("Error: option --generations requires --headless\n", stderr);
+		return -__LINE__;
+	}
+	if (options->benchmark && !opt_g_met) {
+		fputs("Error: option --benchmark requires --generations\n", stderr);
+		return -__LINE__;
+	}
+	if (options->stats != NULL && (!options->headless || options->benchmark)) {
+		fputs("Error: option --stats requires --headless, without "
+		      "--benchmark\n", stderr);
+		return -__LINE__;
+	}
+	if (options->control != NULL && options->benchmark) {
+		fputs("Error: option --control is incompatible with --benchmark\n",
+		      stderr);
+		return -__LINE__;
+	}
+	if (options->control != NULL && strcmp(options->control, "-") == 0
+	    && *in_file != NULL && strcmp(*in_file, "-") == 0) {
+		fputs("Error: the commands and the input file cannot both be read "
+		      "from the standard input stream\n", stderr);
+		return -__LINE__;
+	}
+	if (options->control != NULL && options->stats != NULL
+	    && strcmp(options->stats, "-") == 0) {
+		fputs("Error: the answers to the commands and the statistics cannot "
+		      "both be written to the standard output stream\n", stderr);
+		return -__LINE__;
+	}
+	if (options->resume && options->checkpoint.path == NULL) {
+		fputs("Error: option --resume requires --checkpoint\n", stderr);
+		return -__LINE__;
+	}
+	if (rule_arg != NULL) {
+		CHECK_RC(_set_rule(rule_arg, game_rule));
+	}
 	for (int i = optind; i < argc; ++i) {
 		fprintf(stderr,
 		        "Warning: skipping unrecognized non-option argument \"%s\"\n",
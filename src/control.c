@@ -0,0 +1,489 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "control.h"
+
+#include <ctype.h> /* for isdigit, isspace */
+#include <errno.h> /* for errno */
+#include <limits.h> /* for ULONG_MAX */
+#include <stdlib.h> /* for malloc, free, strtoul */
+#include <string.h> /* for memcpy, strchr, strcmp, strlen, strncmp */
+#include <time.h> /* for struct timespec, timespec_get */
+
+#include "bits.h" /* for get_bit, num_octets */
+#include "grid_saver.h" /* for write_grid_file, guess_grid_format */
+#include "stringutils.h" /* for struct string_builder, append_format */
+#include "trace.h" /* for trace_begin, trace_end */
+#include "utils.h" /* for CHECK_NULL, CHECK_RC */
+
+
+
+/* The size of the chunks the lines are read by */
+#define LINE_CHUNK_SIZE 256
+
+/* The longest name of a command */
+#define MAX_COMMAND_NAME 8
+
+
+struct _command {
+	struct _command *next;
+	/* The line of the command, followed by those of its pattern, if any */
+	char text[];
+};
+
+struct control_queue {
+	mtx_t lock;
+	/* Signaled when a command is queued or the input ends */
+	cnd_t received;
+	struct _command *first;
+	/* The link to the next command queued */
+	struct _command **last;
+	const char *path;
+	/* Whether the reading thread is done with the input */
+	bool ended;
+	/* Whether the control was closed, the reading thread being left to free
+	   the queue */
+	bool closed;
+};
+
+
+static void _free_queue(struct control_queue *queue) {
+	while (queue->first != NULL) {
+		struct _command *next = queue->first->next;
+		free(queue->first);
+		queue->first = next;
+	}
+	cnd_destroy(&queue->received);
+	mtx_destroy(&queue->lock);
+	free(queue);
+}
+
+
+/* Read a line without its line feed, appended to the builder: give 0 at the
+   end of the input if nothing was read */
+static int _read_line(FILE *file, struct string_builder *line) {
+	char chunk[LINE_CHUNK_SIZE];
+	bool read = false;
+	while (fgets(chunk, sizeof chunk, file) != NULL) {
+		read = true;
+		size_t length = strlen(chunk);
+		bool complete = length > 0 && chunk[length - 1] == '\n';
+		if (complete) {
+			chunk[--length] = '\0';
+		}
+		CHECK_RC(append_format(line, "%s", chunk));
+		if (complete) {
+			break;
+		}
+	}
+	if (line->size > 0 && line->data[line->size - 1] == '\r') {
+		line->data[--line->size] = '\0';
+	}
+	return read ? 1 : 0;
+}
+
+/* Read a command, with the lines of its pattern up to the final ! for rle:
+   give 0 at the end of the input */
+static int _read_command(FILE *file, struct string_builder *command) {
+	command->size = 0;
+	command->data[0] = '\0';
+	int rc = _read_line(file, command);
+	const char *name = command->data;
+	while (isspace((unsigned char) *name)) {
+		++name;
+	}
+	if (rc <= 0 || strncmp(name, "rle", 3) != 0
+	    || (name[3] != '\0' && !isspace((unsigned char) name[3]))) {
+		return rc;
+	}
+	size_t start;
+	do {
+		CHECK_RC(append_format(command, "\n"));
+		start = command->size;
+		rc = _read_line(file, command);
+		/* The lines of comments may hold a ! */
+	} while (rc > 0 && (command->data[start] == '#'
+	                    || strchr(&command->data[start], '!') == NULL));
+	/* A pattern cut by the end of the input is still applied */
+	return rc < 0 ? rc : 1;
+}
+
+/* Add the command to the queue, or give false if the control was closed */
+static bool _queue_command(struct control_queue *queue,
+                           const struct string_builder *command) {
+	struct _command *queued = malloc(sizeof *queued + command->size + 1);
+	if (queued == NULL) {
+		return false;
+	}
+	queued->next = NULL;
+	memcpy(queued->text, command->data, command->size + 1);
+	mtx_lock(&queue->lock);
+	bool closed = queue->closed;
+	if (!closed) {
+		*queue->last = queued;
+		queue->last = &queued->next;
+		cnd_signal(&queue->received);
+	}
+	mtx_unlock(&queue->lock);
+	if (closed) {
+		free(queued);
+	}
+	return !closed;
+}
+
+static int _read_commands(void *arg) {
+	struct control_queue *queue = arg;
+	FILE *file = strcmp(queue->path, "-") == 0 ? stdin
+	                                           : fopen(queue->path, "r");
+	struct string_builder command;
+	int rc = -__LINE__;
+	if (file == NULL) {
+		fprintf(stderr, "Could not open the control file \"%s\"\n",
+		        queue->path);
+	} else if (init_string_builder(&command, LINE_CHUNK_SIZE) == 0) {
+		while ((rc = _read_command(file, &command)) > 0) {
+			const char *text = command.data;
+			while (isspace((unsigned char) *text)) {
+				++text;
+			}
+			/* The blank lines and comments are skipped */
+			if (text[0] != '\0' && text[0] != '#'
+			    && !_queue_command(queue, &command)) {
+				break;
+			}
+		}
+		free(command.data);
+	}
+	if (rc < 0 && file != NULL) {
+		fputs("Could not read the commands\n", stderr);
+	}
+	if (file != NULL && file != stdin) {
+		fclose(file);
+	}
+	mtx_lock(&queue->lock);
+	queue->ended = true;
+	bool closed = queue->closed;
+	cnd_broadcast(&queue->received);
+	mtx_unlock(&queue->lock);
+	if (closed) {
+		_free_queue(queue);
+	}
+	return rc;
+}
+
+
+int open_control(struct control *control, const char *path, FILE *replies) {
+	struct control_queue *queue = malloc(sizeof *queue);
+	CHECK_NULL(queue);
+	if (mtx_init(&queue->lock, mtx_plain) != thrd_success) {
+		free(queue);
+		return -__LINE__;
+	}
+	if (cnd_init(&queue->received) != thrd_success) {
+		mtx_destroy(&queue->lock);
+		free(queue);
+		return -__LINE__;
+	}
+	queue->first = NULL;
+	queue->last = &queue->first;
+	queue->path = path;
+	queue->ended = false;
+	queue->closed = false;
+	if (thrd_create(&control->reader, _read_commands, queue) != thrd_success) {
+		_free_queue(queue);
+		return -__LINE__;
+	}
+	control->queue = queue;
+	control->replies = replies;
+	return 0;
+}
+
+
+/* Skip the spaces, and give whether the arguments are all read */
+static bool _at_end(const char **args) {
+	while (isspace((unsigned char) **args)) {
+		++*args;
+	}
+	return **args == '\0';
+}
+
+/* Read an integer from the arguments, between 0 and the maximum (included) */
+static bool _read_uint(const char **args, unsigned long max,
+                       unsigned long *value) {
+	/* strtoul accepts and negates a minus sign */
+	if (_at_end(args) || !isdigit((unsigned char) **args)) {
+		return false;
+	}
+	char *end;
+	errno = 0;
+	*value = strtoul(*args, &end, 10);
+	if (errno != 0 || *value > max
+	    || (*end != '\0' && !isspace((unsigned char) *end))) {
+		return false;
+	}
+	*args = end;
+	return true;
+}
+
+/* Read the coordinates of a cell of the grid */
+static bool _read_cell(const char **args, const struct grid *grid,
+                       unsigned int *x, unsigned int *y) {
+	unsigned long value;
+	if (!_read_uint(args, grid->width - 1, &value)) {
+		return false;
+	}
+	*x = (unsigned int) value;
+	if (!_read_uint(args, grid->height - 1, &value)) {
+		return false;
+	}
+	*y = (unsigned int) value;
+	return true;
+}
+
+/* Read a rectangle of the grid, from the coordinates of its top left cell:
+   it wraps around a toroidal grid, but must fit within the walls of the
+   others */
+static bool _read_rectangle(const char **args, const struct grid *grid,
+                            unsigned int *x, unsigned int *y,
+                            unsigned long *width, unsigned long *height) {
+	return _read_cell(args, grid, x, y)
+	       && _read_uint(args, grid->width, width)
+	       && _read_uint(args, grid->height, height) && _at_end(args)
+	       && *width > 0 && *height > 0
+	       && (grid->wrap || (*width <= grid->width - *x
+	                          && *height <= grid->height - *y));
+}
+
+
+static void _reply(const struct control *control, const char *reply) {
+	fprintf(control->replies, "%s\n", reply);
+}
+
+static void _set_cells(const struct control *control, struct grid *grid,
+                       const char *args, unsigned int state) {
+	unsigned int x;
+	unsigned int y;
+	/* The coordinates are all checked before any cell is set */
+	const char *cells = args;
+	do {
+		if (!_read_cell(&cells, grid, &x, &y)) {
+			_reply(control, "error invalid coordinates");
+			return;
+		}
+	} while (!_at_end(&cells));
+	while (!_at_end(&args)) {
+		_read_cell(&args, grid, &x, &y);
+		set_grid_cell_state(grid, (int) y, (int) x, state);
+	}
+	_reply(control, "ok");
+}
+
+static void _add_pattern(const struct control *control, struct grid *grid,
+                         const char *args) {
+	unsigned int x;
+	unsigned int y;
+	const char *repr = strchr(args, '\n');
+	if (repr == NULL || !_read_cell(&args, grid, &x, &y) || args > repr) {
+		_reply(control, "error invalid coordinates");
+		return;
+	}
+	/* The mode is optional, and ends the line */
+	while (args < repr && isspace((unsigned char) *args)) {
+		++args;
+	}
+	const char *mode_end = args;
+	while (mode_end < repr && !isspace((unsigned char) *mode_end)) {
+		++mode_end;
+	}
+	size_t length = (size_t) (mode_end - args);
+	enum blit_mode mode = BLIT_OR;
+	if (length == 3 && strncmp(args, "xor", 3) == 0) {
+		mode = BLIT_XOR;
+	} else if (length == 4 && strncmp(args, "copy", 4) == 0) {
+		mode = BLIT_COPY;
+	} else if (length != 0 && (length != 2 || strncmp(args, "or", 2) != 0)) {
+		mode_end = NULL;
+	}
+	while (mode_end != NULL && mode_end < repr
+	       && isspace((unsigned char) *mode_end)) {
+		++mode_end;
+	}
+	if (mode_end != repr) {
+		_reply(control, "error invalid mode");
+	} else if (blit_grid_rle(grid, repr + 1, y, x, mode) < 0) {
+		_reply(control, "error invalid pattern");
+	} else {
+		_reply(control, "ok");
+	}
+}
+
+static int _query_cells(const struct control *control,
+                        const struct grid *grid, const char *args) {
+	unsigned int x;
+	unsigned int y;
+	unsigned long width;
+	unsigned long height;
+	if (!_read_rectangle(&args, grid, &x, &y, &width, &height)) {
+		_reply(control, "error invalid rectangle");
+		return 0;
+	}
+	/* The line of a row follows its cells */
+	size_t cells_size = num_octets((size_t) width * height);
+	char *cells = malloc(cells_size + width + 1);
+	CHECK_NULL(cells);
+	char *line = &cells[cells_size];
+	line[width] = '\0';
+	extract_grid_region(grid, y, x, (unsigned int) width,
+	                    (unsigned int) height, cells);
+	fprintf(control->replies, "ok %lu %lu\n", width, height);
+	for (size_t cell = 0, dy = 0; dy < height; ++dy) {
+		for (unsigned long dx = 0; dx < width; ++dx, ++cell) {
+			line[dx] = get_bit(cells, cell) ? '@' : '.';
+		}
+		_reply(control, line);
+	}
+	free(cells);
+	return 0;
+}
+
+static void _count_cells(const struct control *control,
+                         const struct grid *grid, const char *args) {
+	unsigned int x;
+	unsigned int y;
+	unsigned long width;
+	unsigned long height;
+	if (!_read_rectangle(&args, grid, &x, &y, &width, &height)) {
+		_reply(control, "error invalid rectangle");
+	} else {
+		fprintf(control->replies, "ok %llu\n", (unsigned long long)
+		        count_grid_region(grid, y, x, (unsigned int) width,
+		                          (unsigned int) height));
+	}
+}
+
+static void _save_grid(const struct control *control, const struct grid *grid,
+                       const char *args) {
+	if (_at_end(&args)) {
+		_reply(control, "error missing path");
+	} else if (write_grid_file(grid, args, guess_grid_format(args)) < 0) {
+		_reply(control, "error could not write the file");
+	} else {
+		_reply(control, "ok");
+	}
+}
+
+/* Apply a command, answering its errors: give a negative value on allocation
+   error only */
+static int _apply_command(const struct control *control, struct grid *grid,
+                          struct control_state *state, const char *text) {
+	char name[MAX_COMMAND_NAME + 1];
+	int length;
+	sscanf(text, " %8s%n", name, &length);
+	const char *args = &text[length];
+	unsigned long steps = 1;
+	if (strcmp(name, "step") == 0) {
+		if (!_at_end(&args) && (!_read_uint(&args, ULONG_MAX, &steps)
+		                        || steps == 0 || !_at_end(&args))) {
+			_reply(control, "error invalid number of generations");
+		} else {
+			state->steps = steps;
+			_reply(control, "ok");
+		}
+	} else if (strcmp(name, "pause") == 0 || strcmp(name, "resume") == 0) {
+		state->play = name[0] == 'r';
+		_reply(control, "ok");
+	} else if (strcmp(name, "set") == 0) {
+		_set_cells(control, grid, args, ALIVE);
+	} else if (strcmp(name, "unset") == 0) {
+		_set_cells(control, grid, args, DEAD);
+	} else if (strcmp(name, "rle") == 0) {
+		_add_pattern(control, grid, args);
+	} else if (strcmp(name, "query") == 0) {
+		return _query_cells(control, grid, args);
+	} else if (strcmp(name, "count") == 0) {
+		_count_cells(control, grid, args);
+	} else if (strcmp(name, "save") == 0) {
+		_save_grid(control, grid, args);
+	} else if (strcmp(name, "status") == 0) {
+		fprintf(control->replies, "ok generation %llu population %llu %s\n",
+		        (unsigned long long) grid->generation,
+		        (unsigned long long) get_grid_population(grid),
+		        state->play ? "running" : "paused");
+	} else if (strcmp(name, "clear") == 0) {
+		clear_grid(grid);
+		_reply(control, "ok");
+	} else if (strcmp(name, "quit") == 0) {
+		state->quit = true;
+		_reply(control, "ok");
+	} else {
+		fprintf(control->replies, "error unknown command %s\n", name);
+	}
+	return 0;
+}
+
+int apply_control(struct control *control, struct grid *grid,
+                  struct control_state *state) {
+	struct control_queue *queue = control->queue;
+	int rc = 0;
+	while (rc == 0) {
+		mtx_lock(&queue->lock);
+		struct _command *command = queue->first;
+		if (command != NULL) {
+			queue->first = command->next;
+			if (queue->first == NULL) {
+				queue->last = &queue->first;
+			}
+		}
+		mtx_unlock(&queue->lock);
+		if (command == NULL) {
+			break;
+		}
+		trace_begin("command");
+		rc = _apply_command(control, grid, state, command->text);
+		trace_end("command");
+		free(command);
+		if (state->quit) {
+			break;
+		}
+		if (rc == 0 && state->steps > 0) {
+			/* The next commands wait for the generations of the step */
+			rc = 1;
+		}
+	}
+	fflush(control->replies);
+	return rc;
+}
+
+
+bool wait_control(struct control *control, unsigned int milliseconds) {
+	struct control_queue *queue = control->queue;
+	struct timespec until;
+	timespec_get(&until, TIME_UTC);
+	until.tv_sec += milliseconds / 1000;
+	until.tv_nsec += (long) (milliseconds % 1000) * 1000000;
+	if (until.tv_nsec >= 1000000000) {
+		until.tv_nsec -= 1000000000;
+		++until.tv_sec;
+	}
+	mtx_lock(&queue->lock);
+	if (queue->first == NULL && !queue->ended) {
+		cnd_timedwait(&queue->received, &queue->lock, &until);
+	}
+	bool pending = queue->first != NULL || !queue->ended;
+	mtx_unlock(&queue->lock);
+	return pending;
+}
+
+
+void close_control(struct control *control) {
+	struct control_queue *queue = control->queue;
+	mtx_lock(&queue->lock);
+	bool ended = queue->ended;
+	queue->closed = true;
+	mtx_unlock(&queue->lock);
+	if (ended) {
+		thrd_join(control->reader, NULL);
+		_free_queue(queue);
+	} else {
+		/* Reading a line cannot be interrupted */
+		thrd_detach(control->reader);
+	}
+}
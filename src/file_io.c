@@ -1,13 +1,16 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
+#ifndef _MSC_VER
+# define _POSIX_C_SOURCE 200809L /* to enable fileno in stdio.h */
+#endif
 #include "file_io.h"
 
-#include <stdio.h> /* for FILE, f*, rewind */
-#include <stdlib.h> /* for NULL, realloc, free */
-#include <string.h> /* for strncpy, strcmp, strlen */
+#include <stdio.h> /* for FILE, f*, rewind, rename, remove */
+#include <stdlib.h> /* for NULL, malloc, realloc, free */
+#include <string.h> /* for strncpy, strcmp, strlen, memcpy */
 #ifdef _MSC_VER
-# include <io.h> /* for _access */
+# include <io.h> /* for _access, _commit */
 #else
-# include <unistd.h> /* for access */
+# include <unistd.h> /* for access, fsync */
 #endif
 
 #include "utils.h" /* for CHECK_NULL */
@@ -101,6 +104,29 @@ char *read_file(const char *path) {
 }
 
 
+void *read_binary_file(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+	long pos;
+	if (fseek(file, 0, SEEK_END) < 0 || (pos = ftell(file)) < 0) {
+		fclose(file);
+		return NULL;
+	}
+	rewind(file);
+	*size = (size_t) pos;
+	/* Allocate at least one byte, so that an empty file is not an error */
+	char *data = malloc(*size > 0 ? *size : 1);
+	if (data != NULL && fread(data, 1, *size, file) < *size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	return data;
+}
+
+
 static int _write_stdout(const char *text) {
 	size_t len = strlen(text);
 	if (fwrite(text, 1, len, stdout) < len) {
@@ -112,25 +138,105 @@ static int _write_stdout(const char *text) {
 	return 0;
 }
 
-int write_file(const char *path, const char *text) {
-	if (strcmp(path, "-") == 0) {
-		return _write_stdout(text);
+static int _sync_file(FILE *file) {
+	if (fflush(file) != 0) {
+		return -__LINE__;
 	}
-	FILE *file = fopen(path, "w");
-	CHECK_NULL(file);
+	/* Make sure the data reached the disk before the rename makes it visible,
+	   otherwise a crash could leave an empty file in place of the old one */
+#ifdef _MSC_VER
+	return _commit(_fileno(file)) == 0 ? 0 : -__LINE__;
+#else
+	return fsync(fileno(file)) == 0 ? 0 : -__LINE__;
+#endif
+}
+
+static int _write_text(FILE *file, const char *text) {
 	size_t len = strlen(text);
 	if (fwrite(text, 1, len, file) < len) {
-		fclose(file);
 		return -__LINE__;
 	}
 	if (text[len - 1] != '\n' && fputc('\n', file) != '\n') {
-		fclose(file);
 		return -__LINE__;
 	}
-	fclose(file);
 	return 0;
 }
 
+static int _write_chunks(FILE *file, const struct file_chunk *chunks,
+                         size_t nb_chunks) {
+	for (size_t i = 0; i < nb_chunks; ++i) {
+		if (fwrite(chunks[i].data, 1, chunks[i].size, file) < chunks[i].size) {
+			return -__LINE__;
+		}
+	}
+	return 0;
+}
+
+static FILE *_open_temp_file(const char *path, const char *mode,
+                             char **tmp_path) {
+	static const char TMP_SUFFIX[] = ".tmp";
+	size_t path_len = strlen(path);
+	*tmp_path = malloc(path_len + sizeof TMP_SUFFIX);
+	if (*tmp_path == NULL) {
+		return NULL;
+	}
+	memcpy(*tmp_path, path, path_len);
+	memcpy(*tmp_path + path_len, TMP_SUFFIX, sizeof TMP_SUFFIX);
+	FILE *file = fopen(*tmp_path, mode);
+	if (file == NULL) {
+		free(*tmp_path);
+	}
+	return file;
+}
+
+/* Close the temporary file and, if its content was written successfully (as
+   indicated by rc), move it over the destination; remove it otherwise */
+static int _commit_temp_file(FILE *file, char *tmp_path, const char *path,
+                             int rc) {
+	if (rc == 0) {
+		rc = _sync_file(file);
+	}
+	if (fclose(file) != 0 && rc == 0) {
+		rc = -__LINE__;
+	}
+	if (rc == 0) {
+#ifdef _MSC_VER
+		/* The MS CRT rename does not replace an existing destination */
+		remove(path);
+#endif
+		if (rename(tmp_path, path) != 0) {
+			rc = -__LINE__;
+		}
+	}
+	if (rc < 0) {
+		remove(tmp_path);
+	}
+	free(tmp_path);
+	return rc;
+}
+
+int write_file(const char *path, const char *text) {
+	if (strcmp(path, "-") == 0) {
+		return _write_stdout(text);
+	}
+	char *tmp_path;
+	FILE *file = _open_temp_file(path, "w", &tmp_path);
+	CHECK_NULL(file);
+	return _commit_temp_file(file, tmp_path, path, _write_text(file, text));
+}
+
+int write_binary_file(const char *path, const struct file_chunk *chunks,
+                      size_t nb_chunks) {
+	if (strcmp(path, "-") == 0) {
+		return _write_chunks(stdout, chunks, nb_chunks);
+	}
+	char *tmp_path;
+	FILE *file = _open_temp_file(path, "wb", &tmp_path);
+	CHECK_NULL(file);
+	return _commit_temp_file(file, tmp_path, path,
+	                         _write_chunks(file, chunks, nb_chunks));
+}
+
 bool is_file(const char *path) {
 #ifdef _MSC_VER
 	return _access(path, 0) == 0;
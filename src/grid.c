@@ -1,195 +1,2142 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
+#ifndef _MSC_VER
+# define _POSIX_C_SOURCE 200809L /* to enable mmap and munmap in sys/mman.h */
+#endif
+#ifdef __linux__
+# define _DEFAULT_SOURCE /* to enable MAP_ANONYMOUS, MAP_HUGETLB and madvise */
+#endif
 #include "grid.h"
 
 
-#include <stdlib.h> /* for calloc, NULL, free */
-#include <string.h> /* for strchr, memset */
+#include <stdlib.h> /* for aligned_alloc, calloc, malloc, NULL, free */
+#include <string.h> /* for memset, memcpy, memmove, strlen */
+#include <threads.h> /* for thrd_*, mtx_*, cnd_* */
+#ifdef _MSC_VER
+# include <malloc.h> /* for _aligned_malloc, _aligned_free */
+#else
+# include <sys/mman.h> /* for mmap, munmap, madvise */
+#endif
 
 #include "bits.h"
-#include "mathutils.h" /* for pos_mod */
-#include "utils.h" /* for CHECK_NULL */
+#include "mathutils.h" /* for pos_mod, mul_size, MIN, MAX */
+#include "metrics.h" /* for count_update, count_population, needs_population */
+#include "numa.h" /* for get_worker_cpu, pin_thread */
+#include "rules.h" /* for struct rule, get_compiled_rule, get_state_planes */
+#include "timing.h" /* for START_TIMER, STOP_TIMER, read_timer */
+#include "trace.h" /* for trace_begin, trace_end */
+#include "utils.h" /* for CHECK_NULL, CHECK_RC */
 
 
 
+/* The number of cells updated at once, one per bit of a word */
+#define WORD_BITS 64
+
+/* The maximum number of bit planes of the dying cells, for MAX_RULE_STATES */
+#define MAX_STATE_PLANES 8
+
+/* The number of generations a band of rows is advanced through at once by
+   update_grid_generations */
+#define MAX_BAND_GENERATIONS 8
+
+/* The size of the buffers of a band of rows, meant to fit in the cache */
+#define BAND_BYTES (256 * 1024)
+
+/* The number of words of the runs of cells of a rectangle processed at once
+   by blit_grid, extract_grid_region and count_grid_region */
+#define REGION_CHUNK_WORDS 16
+
+/* The functions computing a word of the next generation, called from several
+   loops over the rows and to be expanded in each of them */
+#if defined(__GNUC__)
+# define WORD_INLINE inline __attribute__((always_inline))
+#else
+# define WORD_INLINE inline
+#endif
+
+
+
+static size_t _get_plane_size(const struct grid *grid) {
+	return num_octets(grid->stride * grid->height);
+}
+
 int init_grid(struct grid *grid, unsigned int width, unsigned int height,
               bool wrap) {
+	if (width > MAX_GRID_SIZE || height > MAX_GRID_SIZE) {
+		return -1;
+	}
 	grid->width = width;
 	grid->height = height;
-
-	char *cells = calloc(num_octets(width * height), 1);
-	grid->cells = cells;
+	grid->stride = ((size_t) width + GRID_ROW_ALIGNMENT - 1)
+	               / GRID_ROW_ALIGNMENT * GRID_ROW_ALIGNMENT;
 	grid->wrap = wrap;
+	grid->generation = 0;
 	memset(grid->rule, 0, sizeof grid->rule);
-	return cells == NULL ? -1 : 0;
+	grid->states = 2;
+	grid->inverted = false;
+	grid->generic = false;
+	grid->workers = 0;
+	grid->pool = NULL;
+	return allocate_grid_cells(grid) < 0 ? -1 : 0;
 }
 
 
-void free_grid(struct grid *grid) {
+#ifdef __linux__
+/* Map blank huge pages for the cells, or return NULL */
+static void *_map_huge_pages(size_t size) {
+	void *mapping = MAP_FAILED;
+# ifdef MAP_HUGETLB
+	/* The pages reserved by the administrator, if any */
+	mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+# endif
+	if (mapping == MAP_FAILED) {
+		mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping == MAP_FAILED) {
+			return NULL;
+		}
+# ifdef MADV_HUGEPAGE
+		/* Otherwise transparent huge pages, if enabled: a mere hint */
+		madvise(mapping, size, MADV_HUGEPAGE);
+# endif
+	}
+	return mapping;
+}
+#endif
+
+int allocate_grid_cells(struct grid *grid) {
+	size_t plane_bits;
+	size_t size;
+	if (!mul_size(grid->stride, grid->height, &plane_bits)
+	    || !mul_size(num_octets(plane_bits),
+	                 1 + get_state_planes(grid->states), &size)
+	    || size > SIZE_MAX - GRID_HUGE_PAGE_SIZE) {
+		/* More cells than addresses */
+		return -__LINE__;
+	}
+	grid->mapping = NULL;
+	grid->mapping_size = 0;
+#ifdef __linux__
+	if (size >= GRID_HUGE_PAGE_SIZE) {
+		/* Left untouched, the pages are placed on the node of the first
+		   thread to write them (see set_grid_workers) */
+		size_t mapping_size = (size + GRID_HUGE_PAGE_SIZE - 1)
+		                      / GRID_HUGE_PAGE_SIZE * GRID_HUGE_PAGE_SIZE;
+		grid->mapping = _map_huge_pages(mapping_size);
+		if (grid->mapping != NULL) {
+			grid->cells = grid->mapping;
+			grid->mapping_size = mapping_size;
+			return 0;
+		}
+	}
+#endif
+	size_t alignment = GRID_ROW_ALIGNMENT / 8;
+	/* aligned_alloc requires a multiple of the alignment */
+	size_t aligned_size = (size + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+	grid->cells = _aligned_malloc(aligned_size, alignment);
+#else
+	grid->cells = aligned_alloc(alignment, aligned_size);
+#endif
+	CHECK_NULL(grid->cells);
+	memset(grid->cells, 0, aligned_size);
+	return 0;
+}
+
+
+/* Free the cells of the grid, its workers being kept */
+static void _free_grid_cells(struct grid *grid) {
+#ifdef _MSC_VER
+	_aligned_free(grid->cells);
+#else
+	if (grid->mapping != NULL) {
+		munmap(grid->mapping, grid->mapping_size);
+		return;
+	}
 	free(grid->cells);
+#endif
 }
 
 
-static enum cell_state _get_cell_walls(const struct grid *grid, int row,
-                                       int col) {
-	if (0 <= row && (unsigned) row < grid->height
-	    && 0 <= col && (unsigned) col < grid->width) {
-		return get_bit(grid->cells, grid->width * row + col);
+/* The memory used by a worker to update its rows, kept from a task to the
+   next */
+struct _scratch {
+	void *memory;
+	size_t size; /* The size in octets */
+};
+
+/* Give scratch memory of at least size octets, allocated anew, blank, only if
+   the previous one is too small, or return NULL on allocation error */
+static void *_get_scratch(struct _scratch *scratch, size_t size) {
+	if (size > scratch->size) {
+		free(scratch->memory);
+		scratch->memory = calloc(size, 1);
+		scratch->size = scratch->memory != NULL ? size : 0;
 	}
-	return DEAD;
+	return scratch->memory;
 }
 
-static enum cell_state _get_cell_wrap(const struct grid *grid, int row,
-                                      int col) {
-	unsigned int row_wrapped = pos_mod(row, grid->height);
-	unsigned int col_wrapped = pos_mod(col, grid->width);
-	return get_bit(grid->cells, grid->width * row_wrapped + col_wrapped);
+/* A thread of the workers of a grid, pinned to its processor from its start
+   to its end */
+struct _worker {
+	struct grid_workers *pool;
+	size_t index;
+	int cpu; /* The processor to run on, or -1 */
+	thrd_t thread;
+	/* Allocated by the worker itself, in the memory of its node */
+	struct _scratch scratch;
+};
+
+/* The task run by each worker on its own argument */
+typedef void (*_worker_task)(void *arg, struct _scratch *scratch);
+
+struct grid_workers {
+	mtx_t lock;
+	cnd_t wake; /* Signaled when a task is given to the workers */
+	cnd_t done; /* Signaled when the last worker is done with its task */
+	unsigned long round; /* The number of tasks given so far */
+	size_t pending; /* The number of workers still running the task */
+	bool stop; /* Whether the workers are to end */
+	_worker_task task;
+	/* The arguments of the task, one per worker from the first, the workers
+	   beyond them being left idle */
+	char *args;
+	size_t arg_size;
+	size_t nb_args;
+	size_t nb_workers;
+	struct _worker workers[];
+};
+
+static int _run_worker(void *arg) {
+	struct _worker *worker = arg;
+	struct grid_workers *pool = worker->pool;
+	if (worker->cpu >= 0) {
+		/* The worker stays where it is if it cannot be pinned */
+		pin_thread(worker->cpu);
+	}
+	unsigned long round = 0;
+	mtx_lock(&pool->lock);
+	for (;;) {
+		while (pool->round == round && !pool->stop) {
+			cnd_wait(&pool->wake, &pool->lock);
+		}
+		if (pool->stop) {
+			break;
+		}
+		round = pool->round;
+		mtx_unlock(&pool->lock);
+		if (worker->index < pool->nb_args) {
+			pool->task(&pool->args[worker->index * pool->arg_size],
+			           &worker->scratch);
+		}
+		mtx_lock(&pool->lock);
+		if (--pool->pending == 0) {
+			cnd_signal(&pool->done);
+		}
+	}
+	mtx_unlock(&pool->lock);
+	free(worker->scratch.memory);
+	return 0;
 }
 
-enum cell_state get_grid_cell(const struct grid *grid, int row, int col) {
-	return (grid->wrap ? &_get_cell_wrap : &_get_cell_walls)(grid, row, col);
+/* Run a task in the workers, on the nb_args arguments of arg_size octets from
+   args, and wait for them to be done */
+static void _run_workers(struct grid_workers *pool, _worker_task task,
+                         void *args, size_t arg_size, size_t nb_args) {
+	mtx_lock(&pool->lock);
+	pool->task = task;
+	pool->args = args;
+	pool->arg_size = arg_size;
+	pool->nb_args = nb_args;
+	pool->pending = pool->nb_workers;
+	++pool->round;
+	cnd_broadcast(&pool->wake);
+	while (pool->pending > 0) {
+		cnd_wait(&pool->done, &pool->lock);
+	}
+	mtx_unlock(&pool->lock);
 }
 
+/* End the workers and free them */
+static void _stop_workers(struct grid_workers *pool) {
+	mtx_lock(&pool->lock);
+	pool->stop = true;
+	cnd_broadcast(&pool->wake);
+	mtx_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->nb_workers; ++i) {
+		thrd_join(pool->workers[i].thread, NULL);
+	}
+	cnd_destroy(&pool->done);
+	cnd_destroy(&pool->wake);
+	mtx_destroy(&pool->lock);
+	free(pool);
+}
 
-enum cell_state _toggle_cell_wrap(struct grid *grid, int row, int col) {
-	unsigned int row_wrapped = pos_mod(row, grid->height);
-	unsigned int col_wrapped = pos_mod(col, grid->width);
-	toggle_bit(grid->cells, grid->width * row_wrapped + col_wrapped);
-	return get_bit(grid->cells, grid->width * row + col);
+/* Start the given number of workers, or return NULL if they cannot all be
+   started */
+static struct grid_workers *_start_workers(size_t nb_workers) {
+	struct grid_workers *pool = malloc(sizeof *pool
+	                                   + nb_workers * sizeof *pool->workers);
+	if (pool == NULL) {
+		return NULL;
+	}
+	if (mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+		free(pool);
+		return NULL;
+	}
+	if (cnd_init(&pool->wake) != thrd_success) {
+		mtx_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+	if (cnd_init(&pool->done) != thrd_success) {
+		cnd_destroy(&pool->wake);
+		mtx_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+	pool->round = 0;
+	pool->pending = 0;
+	pool->stop = false;
+	pool->nb_workers = nb_workers;
+	for (size_t i = 0; i < nb_workers; ++i) {
+		struct _worker *worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		worker->cpu = get_worker_cpu((unsigned int) i,
+		                             (unsigned int) nb_workers, NULL);
+		worker->scratch.memory = NULL;
+		worker->scratch.size = 0;
+		if (thrd_create(&worker->thread, _run_worker, worker)
+		    != thrd_success) {
+			/* Only the workers started are ended */
+			pool->nb_workers = i;
+			_stop_workers(pool);
+			return NULL;
+		}
+	}
+	return pool;
 }
 
-enum cell_state _toggle_cell_walls(struct grid *grid, int row, int col) {
-	if (0 <= row && (unsigned) row < grid->height
-	    && 0 <= col && (unsigned) col < grid->width) {
-		unsigned int cell_bit_index = grid->width * row + col;
-		toggle_bit(grid->cells, cell_bit_index);
-		return get_bit(grid->cells, cell_bit_index);
+
+size_t get_grid_data_size(const struct grid *grid) {
+	return (1 + get_state_planes(grid->states)) * _get_plane_size(grid);
+}
+
+uint64_t get_grid_population(const struct grid *grid) {
+	size_t size = _get_plane_size(grid);
+	uint64_t count = 0;
+	size_t octet = 0;
+	for (; octet + sizeof(uint64_t) <= size; octet += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, &grid->cells[octet], sizeof word);
+		count += count_set_bits(word);
+	}
+	for (; octet < size; ++octet) {
+		count += count_set_bits((unsigned char) grid->cells[octet]);
+	}
+	/* The bits past the ends of the rows are blank even when inverted */
+	return grid->inverted ? (uint64_t) grid->width * grid->height - count
+	                      : count;
+}
+
+
+int copy_grid(struct grid *dest, const struct grid *src) {
+	*dest = *src;
+	dest->workers = 0;
+	dest->pool = NULL;
+	/* The copy is never backed by the mapping of the source */
+	CHECK_RC(allocate_grid_cells(dest));
+	memcpy(dest->cells, src->cells, get_grid_data_size(src));
+	return 0;
+}
+
+
+int restore_grid(struct grid *grid, const struct grid *saved) {
+	struct grid restored = *saved;
+	restored.generic = grid->generic;
+	restored.workers = grid->workers;
+	restored.pool = grid->pool;
+	if (grid->width == saved->width && grid->height == saved->height
+	    && grid->stride == saved->stride && grid->states == saved->states) {
+		restored.cells = grid->cells;
+		restored.mapping = grid->mapping;
+		restored.mapping_size = grid->mapping_size;
+	} else {
+		CHECK_RC(allocate_grid_cells(&restored));
+		_free_grid_cells(grid);
+	}
+	memcpy(restored.cells, saved->cells, get_grid_data_size(saved));
+	*grid = restored;
+	return 0;
+}
+
+
+void free_grid(struct grid *grid) {
+	if (grid->pool != NULL) {
+		_stop_workers(grid->pool);
+		grid->pool = NULL;
+	}
+	_free_grid_cells(grid);
+}
+
+
+/* Reallocate the cells data for the given number of states, and clear the
+   dying cells */
+static int _set_grid_states(struct grid *grid, unsigned int states) {
+	struct grid resized = *grid;
+	resized.states = states;
+	CHECK_RC(allocate_grid_cells(&resized));
+	memcpy(resized.cells, grid->cells, _get_plane_size(grid));
+	_free_grid_cells(grid);
+	*grid = resized;
+	return 0;
+}
+
+int set_grid_rule(struct grid *grid, const char *rule) {
+	size_t length = strlen(rule);
+	const struct rule *compiled = get_compiled_rule(rule);
+	if (length >= sizeof grid->rule || compiled == NULL) {
+		return -__LINE__;
+	}
+	if (grid->inverted && !can_invert_rule(compiled)) {
+		set_grid_inverted(grid, false);
+	}
+	if (compiled->states != grid->states) {
+		CHECK_RC(_set_grid_states(grid, compiled->states));
+	}
+	/* The rulestring may be that of the grid itself */
+	memmove(grid->rule, rule, length + 1);
+	return 0;
+}
+
+
+/* Give the number of stripes of the grid for a number of workers. The stripes
+   are made of blocks of 8 rows so that no two of them share an octet */
+static size_t _count_stripes(const struct grid *grid, size_t workers) {
+	size_t blocks = (grid->height + 7) / 8;
+	return workers > blocks ? blocks : workers > 1 ? workers : 1;
+}
+
+/* Give the number of stripes of the grid, one per worker */
+static size_t _get_stripes(const struct grid *grid) {
+	return _count_stripes(grid, grid->pool != NULL ? grid->pool->nb_workers
+	                                               : 1);
+}
+
+/* Give the rows of the stripe of a worker */
+static void _get_stripe_rows(const struct grid *grid, size_t stripe,
+                             size_t stripes, size_t *first, size_t *end) {
+	size_t blocks = (grid->height + 7) / 8;
+	*first = stripe * blocks / stripes * 8;
+	*end = (stripe + 1) * blocks / stripes * 8;
+	if (*end > grid->height) {
+		*end = grid->height;
+	}
+}
+
+/* The octets of the bit planes of the stripe of a worker, copied from the
+   previous cells by the worker itself */
+struct _placement {
+	const struct grid *grid;
+	const char *from;
+	char *to;
+	size_t first; /* The first row */
+	size_t end; /* The row after the last one */
+};
+
+static void _place_stripe(void *arg, struct _scratch *scratch) {
+	(void) scratch;
+	struct _placement *placement = arg;
+	const struct grid *grid = placement->grid;
+	size_t plane_size = _get_plane_size(grid);
+	size_t start = placement->first * grid->stride / 8;
+	size_t end = placement->end == grid->height
+	             ? plane_size : placement->end * grid->stride / 8;
+	for (size_t plane = 0; plane <= get_state_planes(grid->states); ++plane) {
+		/* The first write to a page puts it on the node of the processor */
+		memcpy(&placement->to[plane * plane_size + start],
+		       &placement->from[plane * plane_size + start], end - start);
+	}
+}
+
+int set_grid_workers(struct grid *grid, unsigned int workers) {
+	if (grid->pool != NULL) {
+		_stop_workers(grid->pool);
+		grid->pool = NULL;
+	}
+	grid->workers = workers;
+	size_t stripes = _count_stripes(grid, workers);
+	if (stripes == 1) {
+		return 0;
+	}
+	grid->pool = _start_workers(stripes);
+	CHECK_NULL(grid->pool);
+	if (get_numa_nodes() == 1) {
+		/* The cells stay where they are */
+		return 0;
+	}
+	struct grid placed = *grid;
+	CHECK_RC(allocate_grid_cells(&placed));
+	struct _placement *placements = malloc(stripes * sizeof *placements);
+	if (placements == NULL) {
+		_free_grid_cells(&placed);
+		return -__LINE__;
+	}
+	for (size_t i = 0; i < stripes; ++i) {
+		struct _placement *placement = &placements[i];
+		placement->grid = grid;
+		placement->from = grid->cells;
+		placement->to = placed.cells;
+		_get_stripe_rows(grid, i, stripes, &placement->first,
+		                 &placement->end);
+	}
+	_run_workers(grid->pool, _place_stripe, placements, sizeof *placements,
+	             stripes);
+	free(placements);
+	_free_grid_cells(grid);
+	*grid = placed;
+	return 0;
+}
+
+
+/* Give the index of the cell in the bit planes, or return false if the
+   coordinates are outside of a grid with walls */
+static bool _get_cell_index(const struct grid *grid, int row, int col,
+                            size_t *index) {
+	if (grid->wrap) {
+		row = pos_mod(row, grid->height);
+		col = pos_mod(col, grid->width);
+	} else if (row < 0 || (unsigned) row >= grid->height
+	           || col < 0 || (unsigned) col >= grid->width) {
+		return false;
+	}
+	*index = grid->stride * row + col;
+	return true;
+}
+
+enum cell_state get_grid_cell(const struct grid *grid, int row, int col) {
+	size_t index;
+	if (_get_cell_index(grid, row, col, &index)) {
+		return get_bit(grid->cells, index) != grid->inverted;
 	}
 	return DEAD;
 }
 
+unsigned int get_grid_cell_state(const struct grid *grid, int row, int col) {
+	size_t index;
+	if (!_get_cell_index(grid, row, col, &index)) {
+		return DEAD;
+	}
+	if (get_bit(grid->cells, index) != grid->inverted) {
+		return ALIVE;
+	}
+	size_t plane_size = _get_plane_size(grid);
+	unsigned int age = 0;
+	for (unsigned int plane = get_state_planes(grid->states); plane > 0;
+	     --plane) {
+		age = age << 1 | get_bit(&grid->cells[plane * plane_size], index);
+	}
+	return age == 0 ? DEAD : age + 1;
+}
+
+
+static void _set_cell_state(struct grid *grid, size_t index,
+                            unsigned int state) {
+	set_bit(grid->cells, index, (state == ALIVE) != grid->inverted);
+	/* The planes of the dying cells hold their state minus one */
+	unsigned int age = state > ALIVE ? state - 1 : 0;
+	size_t plane_size = _get_plane_size(grid);
+	unsigned int planes = get_state_planes(grid->states);
+	for (unsigned int plane = 0; plane < planes; ++plane) {
+		set_bit(&grid->cells[(1 + plane) * plane_size], index,
+		        age >> plane & 1);
+	}
+}
+
+int set_grid_cell_state(struct grid *grid, int row, int col,
+                        unsigned int state) {
+	size_t index;
+	if (state >= grid->states || !_get_cell_index(grid, row, col, &index)) {
+		return -__LINE__;
+	}
+	_set_cell_state(grid, index, state);
+	return 0;
+}
+
 enum cell_state toggle_cell(struct grid *grid, int row, int col) {
-	return (grid->wrap ? &_toggle_cell_wrap : &_toggle_cell_walls)(grid, row,
-	                                                               col);
+	size_t index;
+	if (!_get_cell_index(grid, row, col, &index)) {
+		return DEAD;
+	}
+	enum cell_state state = get_bit(grid->cells, index) != grid->inverted
+	                        ? DEAD : ALIVE;
+	_set_cell_state(grid, index, state);
+	return state;
 }
 
 
-static inline bool _will_be_born(unsigned int num_neighbors,
-                                 const char *rulestring) {
-	char num_neighbors_char = (char) ('0' + num_neighbors);
-	rulestring = strchr(rulestring, 'B') + 1;
-	while (*rulestring != '\0' && *rulestring != '/' && *rulestring != 'S'
-	                           && *rulestring != num_neighbors_char) {
-		++rulestring;
+/* Read length bits of the plane from the bit start into words, the first bit
+   being the most significant of the first word. The bits after the last one
+   in the last word are cleared */
+static void _load_row(const char *plane, size_t plane_size, size_t start,
+                      size_t length, uint64_t *words) {
+	size_t octet = start / 8;
+	unsigned int shift = start % 8;
+	size_t nb_words = (length + WORD_BITS - 1) / WORD_BITS;
+	for (size_t i = 0; i < nb_words; ++i, octet += 8) {
+		uint64_t word = 0;
+		if (octet + 9 <= plane_size) {
+			word = load_word(plane, octet) << shift;
+			if (shift > 0) {
+				word |= (unsigned char) plane[octet + 8] >> (8 - shift);
+			}
+		} else { /* Do not read past the end of the plane */
+			for (size_t j = octet; j < octet + 8; ++j) {
+				unsigned int value = 0;
+				if (j < plane_size) {
+					value = (unsigned char) plane[j] << shift;
+				}
+				if (shift > 0 && j + 1 < plane_size) {
+					value |= (unsigned char) plane[j + 1] >> (8 - shift);
+				}
+				word = word << 8 | (value & 0xFF);
+			}
+		}
+		words[i] = word;
+	}
+	if (length % WORD_BITS != 0) {
+		words[nb_words - 1] &= ~(UINT64_MAX >> length % WORD_BITS);
 	}
-	return *rulestring == num_neighbors_char;
 }
 
-static inline bool _will_survive(unsigned int num_neighbors,
-                                 const char *rulestring) {
-	char num_neighbors_char = (char) ('0' + num_neighbors);
-	rulestring = strchr(rulestring, 'S') + 1;
-	while (*rulestring != '\0' && *rulestring != num_neighbors_char) {
-		++rulestring;
+/* Give the 8 bits from the given bit of an array of words, the word after the
+   one holding the bit being readable */
+static inline unsigned int _get_octet(const uint64_t *words, size_t bit) {
+	uint64_t word = words[bit / WORD_BITS] << bit % WORD_BITS;
+	if (bit % WORD_BITS > WORD_BITS - 8) {
+		word |= words[bit / WORD_BITS + 1]
+		        >> (WORD_BITS - bit % WORD_BITS);
 	}
-	return *rulestring == num_neighbors_char;
+	return (unsigned int) (word >> (WORD_BITS - 8));
 }
 
-static void _update_cell(struct grid *grid, size_t row_offset,
-                         const char *row_buffer, size_t cell_offset,
-                         unsigned int neighbors) {
-	bool (*will_be_alive)(unsigned int, const char*);
-	if (get_bit(row_buffer, grid->width + cell_offset) == 0) {
-		will_be_alive = _will_be_born;
-	} else {
-		will_be_alive = _will_survive;
+/* Write length bits of words, laid out as by _load_row, in the plane from the
+   bit start. The bits of the plane around the range are left untouched */
+static void _store_row(char *plane, size_t start, size_t length,
+                       const uint64_t *words) {
+	unsigned char *octets = (unsigned char*) &plane[start / 8];
+	unsigned int shift = start % 8;
+	size_t nb_octets = (shift + length + 7) / 8;
+	for (size_t i = 0; i < nb_octets; ++i) {
+		/* The octet holds the bits 8i-shift to 8i-shift+7 of the words */
+		unsigned int value;
+		unsigned int mask = 0xFF;
+		if (i == 0) {
+			value = _get_octet(words, 0) >> shift;
+			mask >>= shift;
+		} else {
+			value = _get_octet(words, 8 * i - shift);
+		}
+		if (i == nb_octets - 1 && (shift + length) % 8 != 0) {
+			mask &= 0xFF << (8 - (shift + length) % 8);
+		}
+		octets[i] = (unsigned char) ((octets[i] & ~mask) | (value & mask));
 	}
-	set_bit(grid->cells, row_offset + cell_offset,
-	        will_be_alive(neighbors, grid->rule));
 }
 
-static void _update_row(struct grid *grid, size_t row_offset,
-                        const char *row_buffer, const char *btm_row,
-                        size_t btm_row_offset) {
-	unsigned int neighbors = 0;
-	neighbors = get_bit(row_buffer, 0)
-	          + get_bit(row_buffer, 1)
-	          + get_bit(row_buffer, grid->width + 1)
-	          + get_bit(btm_row, btm_row_offset)
-	          + get_bit(btm_row, btm_row_offset + 1);
-	if (grid->wrap) {
-		neighbors += get_bit(row_buffer, grid->width - 1)
-		           + get_bit(row_buffer, grid->width * 2 - 1)
-		           + get_bit(btm_row, btm_row_offset + grid->width - 1);
-	}
-	_update_cell(grid, row_offset, row_buffer, 0, neighbors);
-	for (size_t col = 1; col < grid->width - 1; ++col) {
-		neighbors = get_bit(row_buffer, col - 1)
-		          + get_bit(row_buffer, col)
-		          + get_bit(row_buffer, col + 1)
-		          + get_bit(row_buffer, grid->width + col - 1)
-		          + get_bit(row_buffer, grid->width + col + 1)
-		          + get_bit(btm_row, btm_row_offset + col - 1)
-		          + get_bit(btm_row, btm_row_offset + col)
-		          + get_bit(btm_row, btm_row_offset + col + 1);
-		_update_cell(grid, row_offset, row_buffer, col, neighbors);
-	}
-	neighbors = get_bit(row_buffer, grid->width - 2)
-	          + get_bit(row_buffer, grid->width - 1)
-	          + get_bit(row_buffer, grid->width * 2 - 2)
-	          + get_bit(btm_row, btm_row_offset + grid->width - 2)
-	          + get_bit(btm_row, btm_row_offset + grid->width - 1);
+
+/* Put the neighbors of the cells at both ends of a row buffer around them, in
+   the least significant bit of the word at index 0 and in the bit following
+   the last cell, the bits after which are cleared. Beyond the walls, the cells
+   are dead, i.e. set in memory if the cells are stored inverted */
+static void _set_neighbor_cells(const struct grid *grid, bool inverted,
+                                size_t nb_words, uint64_t *buffer) {
+	size_t width = grid->width;
+	if (width % WORD_BITS != 0) {
+		buffer[nb_words] &= ~(UINT64_MAX >> width % WORD_BITS);
+	}
+	buffer[nb_words + 1] = 0;
+	uint64_t west = inverted;
+	uint64_t east = inverted;
 	if (grid->wrap) {
-		neighbors += get_bit(row_buffer, 0)
-		           + get_bit(row_buffer, grid->width)
-		           + get_bit(btm_row, btm_row_offset);
+		west = buffer[1 + (width - 1) / WORD_BITS]
+		       >> (WORD_BITS - 1 - (width - 1) % WORD_BITS) & 1;
+		east = buffer[1] >> (WORD_BITS - 1);
+	}
+	buffer[0] = west;
+	buffer[1 + width / WORD_BITS] |= east
+	                                 << (WORD_BITS - 1 - width % WORD_BITS);
+}
+
+/* Load the live cells of a row in a buffer for the update: the words of the
+   row start at index 1, surrounded by the neighbors of the cells at both
+   ends */
+static void _load_neighbor_row(const struct grid *grid, size_t row,
+                               size_t nb_words, uint64_t *buffer) {
+	_load_row(grid->cells, _get_plane_size(grid), row * grid->stride,
+	          grid->width, &buffer[1]);
+	_set_neighbor_cells(grid, grid->inverted, nb_words, buffer);
+}
+
+/* Fill a buffer with the row beyond the wall above or below the grid */
+static void _load_wall_row(const struct grid *grid, size_t row_words,
+                           uint64_t *buffer) {
+	memset(buffer, grid->inverted ? 0xFF : 0, row_words * sizeof *buffer);
+}
+
+/* The cells west and east of those of a word of a row buffer */
+static inline uint64_t _west(const uint64_t *buffer, size_t i) {
+	return buffer[i] >> 1 | buffer[i - 1] << (WORD_BITS - 1);
+}
+
+static inline uint64_t _east(const uint64_t *buffer, size_t i) {
+	return buffer[i] << 1 | buffer[i + 1] >> (WORD_BITS - 1);
+}
+
+/* Count the live neighbors of the cells of a word of the middle row. The
+   counts are bit-sliced: count[k] holds the bit k of the count of each cell */
+static inline void _count_neighbors(const uint64_t *above, const uint64_t *row,
+                                    const uint64_t *below, size_t i,
+                                    uint64_t count[4]) {
+	/* The three cells above, summed on two bits */
+	uint64_t west = _west(above, i);
+	uint64_t east = _east(above, i);
+	uint64_t above0 = west ^ above[i] ^ east;
+	uint64_t above1 = (west & above[i]) | (east & (west ^ above[i]));
+	/* The three cells below */
+	west = _west(below, i);
+	east = _east(below, i);
+	uint64_t below0 = west ^ below[i] ^ east;
+	uint64_t below1 = (west & below[i]) | (east & (west ^ below[i]));
+	/* The two cells on the sides */
+	west = _west(row, i);
+	east = _east(row, i);
+	uint64_t sides0 = west ^ east;
+	uint64_t sides1 = west & east;
+	/* Above plus below, on three bits */
+	uint64_t carry = above0 & below0;
+	uint64_t sum0 = above0 ^ below0;
+	uint64_t sum1 = above1 ^ below1 ^ carry;
+	uint64_t sum2 = (above1 & below1) | (carry & (above1 ^ below1));
+	/* Plus the sides, on four bits */
+	carry = sum0 & sides0;
+	count[0] = sum0 ^ sides0;
+	count[1] = sum1 ^ sides1 ^ carry;
+	carry = (sum1 & sides1) | (carry & (sum1 ^ sides1));
+	count[2] = sum2 ^ carry;
+	count[3] = sum2 & carry;
+}
+
+/* Count the live neighbors of the cells of a word in the von Neumann
+   neighborhood, on three bits */
+static inline void _count_von_neumann(const uint64_t *above,
+                                      const uint64_t *row,
+                                      const uint64_t *below, size_t i,
+                                      uint64_t count[4]) {
+	/* The cells above and below, summed on two bits */
+	uint64_t vertical0 = above[i] ^ below[i];
+	uint64_t vertical1 = above[i] & below[i];
+	/* The two cells on the sides */
+	uint64_t west = _west(row, i);
+	uint64_t east = _east(row, i);
+	uint64_t sides0 = west ^ east;
+	uint64_t sides1 = west & east;
+	uint64_t carry = vertical0 & sides0;
+	count[0] = vertical0 ^ sides0;
+	count[1] = vertical1 ^ sides1 ^ carry;
+	count[2] = (vertical1 & sides1) | (carry & (vertical1 ^ sides1));
+	count[3] = 0;
+}
+
+/* Count the live neighbors of the cells of a word in the hexagonal
+   neighborhood, on three bits: the north-east and south-west cells of the
+   Moore neighborhood are left out */
+static inline void _count_hexagonal(const uint64_t *above, const uint64_t *row,
+                                    const uint64_t *below, size_t i,
+                                    uint64_t count[4]) {
+	/* The two cells above, summed on two bits */
+	uint64_t west = _west(above, i);
+	uint64_t above0 = west ^ above[i];
+	uint64_t above1 = west & above[i];
+	/* The two cells below */
+	uint64_t east = _east(below, i);
+	uint64_t below0 = below[i] ^ east;
+	uint64_t below1 = below[i] & east;
+	/* The two cells on the sides */
+	west = _west(row, i);
+	east = _east(row, i);
+	uint64_t sides0 = west ^ east;
+	uint64_t sides1 = west & east;
+	/* Above plus below, on three bits */
+	uint64_t carry = above0 & below0;
+	uint64_t sum0 = above0 ^ below0;
+	uint64_t sum1 = above1 ^ below1 ^ carry;
+	uint64_t sum2 = (above1 & below1) | (carry & (above1 ^ below1));
+	/* Plus the sides, still on three bits since there are six neighbors */
+	carry = sum0 & sides0;
+	count[0] = sum0 ^ sides0;
+	count[1] = sum1 ^ sides1 ^ carry;
+	carry = (sum1 & sides1) | (carry & (sum1 ^ sides1));
+	count[2] = sum2 ^ carry;
+	count[3] = 0;
+}
+
+/* Select the cells whose count of neighbors is one of those of a transition */
+static inline uint64_t _match_counts(const uint64_t count[4], uint16_t mask) {
+	uint64_t match = 0;
+	for (unsigned int n = 0; n <= 8; ++n) {
+		if ((mask >> n & 1) != 0) {
+			match |= (n & 1 ? count[0] : ~count[0])
+			         & (n & 2 ? count[1] : ~count[1])
+			         & (n & 4 ? count[2] : ~count[2])
+			         & (n & 8 ? count[3] : ~count[3]);
+		}
+	}
+	return match;
+}
+
+/* Advance the dying cells of a word to their next state, and the cells that
+   just died to the first dying state. The ages (the states minus one) are
+   bit-sliced over the planes, and are incremented as a binary adder would */
+static inline void _advance_ages(uint64_t *const *ages, unsigned int planes,
+                                 size_t i, uint64_t dying, uint64_t died,
+                                 unsigned int last_age) {
+	/* The cells in the last dying state are dead at the next generation */
+	uint64_t last = dying;
+	for (unsigned int plane = 0; plane < planes; ++plane) {
+		last &= last_age >> plane & 1 ? ages[plane][i] : ~ages[plane][i];
+	}
+	uint64_t carry = dying & ~last;
+	for (unsigned int plane = 0; plane < planes; ++plane) {
+		uint64_t age = ages[plane][i] & ~last;
+		ages[plane][i] = age ^ carry;
+		carry &= age;
+	}
+	ages[0][i] |= died;
+}
+
+/* Shift the column east of a cell in the index of the neighborhood of its west
+   neighbor, giving the index of the neighborhood of the cell */
+static inline unsigned int _slide_index(unsigned int index, uint64_t above,
+                                        uint64_t row, uint64_t below) {
+	return (index << 1 & 0666) | (unsigned int) (above << 6 | row << 3 | below);
+}
+
+/* Look up the next state of the cells of a word in the transition table of a
+   non-totalistic rule. The index of the neighborhood of each cell is slid
+   from that of the previous cell rather than gathered from its nine bits */
+static inline uint64_t _look_up_cells(const uint8_t *table,
+                                      const uint64_t *above,
+                                      const uint64_t *row,
+                                      const uint64_t *below, size_t i) {
+	uint64_t east_above = _east(above, i);
+	uint64_t east_row = _east(row, i);
+	uint64_t east_below = _east(below, i);
+	/* Start with the columns west of the first cell and of the cell */
+	unsigned int index = _slide_index(0, _west(above, i) >> (WORD_BITS - 1),
+	                                  _west(row, i) >> (WORD_BITS - 1),
+	                                  _west(below, i) >> (WORD_BITS - 1));
+	index = _slide_index(index, above[i] >> (WORD_BITS - 1),
+	                     row[i] >> (WORD_BITS - 1),
+	                     below[i] >> (WORD_BITS - 1));
+	/* The east columns are shifted out from their MSB, one per cell */
+	uint64_t next = 0;
+	for (unsigned int j = 0; j < WORD_BITS; ++j) {
+		index = _slide_index(index, east_above >> (WORD_BITS - 1),
+		                     east_row >> (WORD_BITS - 1),
+		                     east_below >> (WORD_BITS - 1));
+		east_above <<= 1;
+		east_row <<= 1;
+		east_below <<= 1;
+		next = next << 1 | table[index];
+	}
+	return next;
+}
+
+/* Apply the transitions to the cells of a word of a row, given the cells that
+   would survive if alive and be born if dead, and give their next states */
+static WORD_INLINE uint64_t _set_next_cells(const struct rule *rule,
+                                            unsigned int planes,
+                                            const uint64_t *row,
+                                            uint64_t *const *ages, size_t i,
+                                            uint64_t survive, uint64_t born) {
+	uint64_t dying = 0;
+	for (unsigned int plane = 0; plane < planes; ++plane) {
+		dying |= ages[plane][i];
+	}
+	survive &= row[i];
+	born &= ~row[i] & ~dying;
+	if (planes > 0) {
+		_advance_ages(ages, planes, i, dying, row[i] & ~survive,
+		              rule->states - 2);
+	}
+	return survive | born;
+}
+
+/* Give the next states of the cells of a word of a row under any rule but the
+   Larger than Life ones */
+static WORD_INLINE uint64_t _update_word(const struct rule *rule,
+                                         unsigned int planes,
+                                         const uint64_t *above,
+                                         const uint64_t *row,
+                                         const uint64_t *below,
+                                         uint64_t *const *ages, size_t i) {
+	uint64_t survive;
+	uint64_t born;
+	if (rule->totalistic) {
+		uint64_t count[4];
+		switch (rule->neighborhood) {
+		case RULE_NEIGHBORHOOD_VON_NEUMANN:
+			_count_von_neumann(above, row, below, i, count);
+			break;
+		case RULE_NEIGHBORHOOD_HEXAGONAL:
+			_count_hexagonal(above, row, below, i, count);
+			break;
+		default:
+			_count_neighbors(above, row, below, i, count);
+			break;
+		}
+		survive = _match_counts(count, rule->survival);
+		born = _match_counts(count, rule->birth);
+	} else {
+		survive = _look_up_cells(rule->table, above, row, below, i);
+		born = survive;
+	}
+	return _set_next_cells(rule, planes, row, ages, i, survive, born);
+}
+
+static void _update_row(const struct rule *rule, size_t nb_words,
+                        const uint64_t *above, const uint64_t *row,
+                        const uint64_t *below, uint64_t *const *ages,
+                        uint64_t *next) {
+	unsigned int planes = get_state_planes(rule->states);
+	for (size_t i = 1; i <= nb_words; ++i) {
+		next[i] = _update_word(rule, planes, above, row, below, ages, i);
+	}
+}
+
+
+/* The counts of the cells of a row in the statistics of its update, summed
+   word by word as the row is updated, from the words of its previous and
+   next states, stored inverted or not as given by the flips */
+struct _row_counts {
+	uint64_t before_flip; /* Set if the previous states are inverted */
+	uint64_t after_flip; /* Set if the next states are inverted */
+	uint64_t last_mask; /* The cells of the last word, without its neighbors */
+	uint64_t population_before; /* The live cells before the update */
+	uint64_t population; /* The live cells after the update */
+	uint64_t births;
+};
+
+/* Count the cells of the words of a row, the next state of the word i being
+   given by the expression: the counts are kept in registers, the words
+   written and counted in the same pass. The loop has no branch, the words
+   changed or not and blank or not following each other at random in a busy
+   grid; the bits past the end of the row, which hold the neighbors, are
+   counted then taken back once out of it */
+#define COUNT_ROW_WORDS(nb_words, row, next, counts, popcount, word) \
+	do { \
+		uint64_t before_flip = (counts)->before_flip; \
+		uint64_t after_flip = (counts)->after_flip; \
+		uint64_t population_before = 0; \
+		uint64_t population = 0; \
+		uint64_t births = 0; \
+		for (size_t i = 1; i <= (nb_words); ++i) { \
+			uint64_t after = (word); \
+			(next)[i] = after; \
+			uint64_t before = (row)[i] ^ before_flip; \
+			after ^= after_flip; \
+			population_before += popcount(before); \
+			population += popcount(after); \
+			births += popcount(after & ~before); \
+		} \
+		uint64_t beyond = ~(counts)->last_mask; \
+		uint64_t before = ((row)[nb_words] ^ before_flip) & beyond; \
+		uint64_t after = ((next)[nb_words] ^ after_flip) & beyond; \
+		(counts)->population_before = population_before - popcount(before); \
+		(counts)->population = population - popcount(after); \
+		(counts)->births = births - popcount(after & ~before); \
+	} while (0)
+
+#if defined(__GNUC__) && !defined(__POPCNT__) \
+    && (defined(__x86_64__) || defined(__i386__))
+/* The compiler may not use the popcnt instruction everywhere, but it may in
+   the functions with this attribute, called if the processor has it */
+# define POPCNT_TARGET __attribute__((target("popcnt")))
+#endif
+
+static inline uint64_t _count_set_bits(uint64_t word) {
+	return count_set_bits(word);
+}
+
+/* Whether the functions using the popcnt instruction are to be called */
+static bool _use_popcnt(void) {
+#ifdef POPCNT_TARGET
+	return __builtin_cpu_supports("popcnt");
+#else
+	return false;
+#endif
+}
+
+/* Prepare the counts of a row of the given width */
+static void _init_row_counts(struct _row_counts *counts, size_t width,
+                             bool before_inverted, bool after_inverted) {
+	counts->before_flip = before_inverted ? UINT64_MAX : 0;
+	counts->after_flip = after_inverted ? UINT64_MAX : 0;
+	counts->last_mask = UINT64_MAX;
+	if (width % WORD_BITS != 0) {
+		counts->last_mask = ~(UINT64_MAX >> width % WORD_BITS);
 	}
-	_update_cell(grid, row_offset, row_buffer, grid->width - 1, neighbors);
+}
+
+/* Add the counts of the row r to the statistics of the update, along with
+   the bounds of its live cells */
+static void _add_row_counts(size_t r, size_t nb_words, const uint64_t *next,
+                            const struct _row_counts *counts,
+                            struct grid_stats *stats) {
+	stats->population += counts->population;
+	stats->births += counts->births;
+	stats->deaths += counts->population_before + counts->births
+	                 - counts->population;
+	if (counts->population == 0) {
+		return;
+	}
+	size_t first = 1;
+	uint64_t first_word;
+	while ((first_word = (next[first] ^ counts->after_flip)
+	                     & (first == nb_words ? counts->last_mask
+	                                          : UINT64_MAX)) == 0) {
+		++first;
+	}
+	size_t last = nb_words;
+	uint64_t last_word;
+	while ((last_word = (next[last] ^ counts->after_flip)
+	                    & (last == nb_words ? counts->last_mask
+	                                        : UINT64_MAX)) == 0) {
+		--last;
+	}
+	unsigned int min_x = (unsigned int) ((first - 1) * WORD_BITS)
+	                     + count_leading_zeros(first_word);
+	unsigned int max_x = (unsigned int) (last * WORD_BITS - 1)
+	                     - count_trailing_zeros(last_word);
+	stats->min_x = MIN(stats->min_x, min_x);
+	stats->max_x = MAX(stats->max_x, max_x);
+	stats->min_y = MIN(stats->min_y, (unsigned int) r);
+	stats->max_y = MAX(stats->max_y, (unsigned int) r);
+}
+
+/* Update a row as _update_row does, counting its cells as it is updated */
+static void _update_row_counting(const struct rule *rule, size_t nb_words,
+                                 const uint64_t *above, const uint64_t *row,
+                                 const uint64_t *below,
+                                 uint64_t *const *ages, uint64_t *next,
+                                 struct _row_counts *counts) {
+	unsigned int planes = get_state_planes(rule->states);
+	COUNT_ROW_WORDS(nb_words, row, next, counts, _count_set_bits,
+	                _update_word(rule, planes, above, row, below, ages, i));
+}
+
+#ifdef POPCNT_TARGET
+POPCNT_TARGET
+static void _update_row_counting_popcnt(const struct rule *rule,
+                                        size_t nb_words,
+                                        const uint64_t *above,
+                                        const uint64_t *row,
+                                        const uint64_t *below,
+                                        uint64_t *const *ages, uint64_t *next,
+                                        struct _row_counts *counts) {
+	unsigned int planes = get_state_planes(rule->states);
+	COUNT_ROW_WORDS(nb_words, row, next, counts, __builtin_popcountll,
+	                _update_word(rule, planes, above, row, below, ages, i));
+}
+#else
+# define _update_row_counting_popcnt _update_row_counting
+#endif
+
+
+/* The update of a row of a rule with a kernel of its own, given the row, its
+   neighbors, and the buffer of the next states */
+typedef void (*_row_kernel)(size_t nb_words, const uint64_t *above,
+                            const uint64_t *row, const uint64_t *below,
+                            uint64_t *next);
+
+/* The same, counting the cells of the row as it is updated */
+typedef void (*_counting_kernel)(size_t nb_words, const uint64_t *above,
+                                 const uint64_t *row, const uint64_t *below,
+                                 uint64_t *next, struct _row_counts *counts);
+
+#ifdef POPCNT_TARGET
+# define DEFINE_POPCNT_KERNEL(name) \
+	POPCNT_TARGET \
+	static void name##_counting_popcnt(size_t nb_words, \
+	                                   const uint64_t *above, \
+	                                   const uint64_t *row, \
+	                                   const uint64_t *below, uint64_t *next, \
+	                                   struct _row_counts *counts) { \
+		COUNT_ROW_WORDS(nb_words, row, next, counts, __builtin_popcountll, \
+		                name##_word(above, row, below, i)); \
+	}
+#else
+# define DEFINE_POPCNT_KERNEL(name)
+#endif
+
+/* Define the kernel of a two-state totalistic rule in the Moore neighborhood,
+   whose next states are given by the expression of the bits of the neighbor
+   count c0 to c3 and of the cells a. Being known at compile time, the
+   transitions are reduced to a few bitwise operations instead of the generic
+   comparisons of the counts with every count of the rule */
+#define DEFINE_ROW_KERNEL(name, expr) \
+	static inline uint64_t name##_word(const uint64_t *above, \
+	                                   const uint64_t *row, \
+	                                   const uint64_t *below, size_t i) { \
+		uint64_t count[4]; \
+		_count_neighbors(above, row, below, i, count); \
+		uint64_t c0 = count[0], c1 = count[1], c2 = count[2]; \
+		uint64_t c3 = count[3], a = row[i]; \
+		(void) c0; (void) c2; (void) c3; (void) a; \
+		return (expr); \
+	} \
+	static void name(size_t nb_words, const uint64_t *above, \
+	                 const uint64_t *row, const uint64_t *below, \
+	                 uint64_t *next) { \
+		for (size_t i = 1; i <= nb_words; ++i) { \
+			next[i] = name##_word(above, row, below, i); \
+		} \
+	} \
+	static void name##_counting(size_t nb_words, const uint64_t *above, \
+	                            const uint64_t *row, const uint64_t *below, \
+	                            uint64_t *next, struct _row_counts *counts) { \
+		COUNT_ROW_WORDS(nb_words, row, next, counts, _count_set_bits, \
+		                name##_word(above, row, below, i)); \
+	} \
+	DEFINE_POPCNT_KERNEL(name)
+
+/* B3/S23: 2 or 3, and 3 or alive (the count 8 has c1 clear) */
+DEFINE_ROW_KERNEL(_update_row_life, c1 & ~c2 & (c0 | a))
+/* B36/S23: Life, or born with 6 */
+DEFINE_ROW_KERNEL(_update_row_highlife,
+                  (c1 & ~c2 & (c0 | a)) | (~a & ~c0 & c1 & c2))
+/* B2/S: dead with 2 */
+DEFINE_ROW_KERNEL(_update_row_seeds, ~a & ~c0 & c1 & ~c2)
+/* B3678/S34678: 3, 6, 7 or 8, or alive with 4 */
+DEFINE_ROW_KERNEL(_update_row_day_and_night,
+                  c3 | (c1 & (c0 | c2)) | (a & ~c0 & ~c1 & c2))
+/* B3/S012345678: 3, or alive */
+DEFINE_ROW_KERNEL(_update_row_life_without_death, a | (c0 & c1 & ~c2))
+
+#ifdef POPCNT_TARGET
+# define ROW_KERNEL(name) name, name##_counting, name##_counting_popcnt
+#else
+# define ROW_KERNEL(name) name, name##_counting
+#endif
+
+/* The rules with a kernel of their own, by their transitions */
+static const struct _row_kernels {
+	uint16_t birth;
+	uint16_t survival;
+	_row_kernel kernel;
+	_counting_kernel counting;
+#ifdef POPCNT_TARGET
+	_counting_kernel counting_popcnt;
+#endif
+} ROW_KERNELS[] = {
+	{0x008, 0x00C, ROW_KERNEL(_update_row_life)},
+	{0x048, 0x00C, ROW_KERNEL(_update_row_highlife)},
+	{0x004, 0x000, ROW_KERNEL(_update_row_seeds)},
+	{0x1C8, 0x1D8, ROW_KERNEL(_update_row_day_and_night)},
+	{0x008, 0x1FF, ROW_KERNEL(_update_row_life_without_death)}
+};
+
+/* Give the kernels of the rule, or NULL if it has none or the grid is to be
+   updated with the generic one */
+static const struct _row_kernels *_get_row_kernels(const struct grid *grid,
+                                                   const struct rule *rule) {
+	if (grid->generic || !rule->totalistic || rule->states != 2
+	    || rule->neighborhood != RULE_NEIGHBORHOOD_MOORE) {
+		return NULL;
+	}
+	for (size_t i = 0; i < sizeof ROW_KERNELS / sizeof *ROW_KERNELS; ++i) {
+		if (ROW_KERNELS[i].birth == rule->birth
+		    && ROW_KERNELS[i].survival == rule->survival) {
+			return &ROW_KERNELS[i];
+		}
+	}
+	return NULL;
+}
+
+static _row_kernel _get_row_kernel(const struct grid *grid,
+                                   const struct rule *rule) {
+	const struct _row_kernels *kernels = _get_row_kernels(grid, rule);
+	return kernels != NULL ? kernels->kernel : NULL;
+}
+
+/* Give the kernel of the rule counting the cells, or NULL */
+static _counting_kernel _get_counting_kernel(const struct grid *grid,
+                                             const struct rule *rule,
+                                             bool popcnt) {
+	const struct _row_kernels *kernels = _get_row_kernels(grid, rule);
+	if (kernels == NULL) {
+		return NULL;
+	}
+#ifdef POPCNT_TARGET
+	if (popcnt) {
+		return kernels->counting_popcnt;
+	}
+#else
+	(void) popcnt;
+#endif
+	return kernels->counting;
+}
+
+
+/* Add delta to the counts of the columns of the live cells of a row, NULL
+   standing for a row of dead cells */
+static void _slide_columns(size_t nb_words, const uint64_t *words,
+                           uint32_t delta, uint32_t *columns) {
+	if (words == NULL) {
+		return;
+	}
+	for (size_t i = 0; i < nb_words; ++i) {
+		/* Only visit the live cells, the ranged rules being mostly sparse */
+		for (uint64_t word = words[i]; word != 0;) {
+			unsigned int bit = count_leading_zeros(word);
+			columns[i * WORD_BITS + bit] += delta;
+			word &= ~(UINT64_C(1) << (WORD_BITS - 1 - bit));
+		}
+	}
+}
+
+/* Select the cells of a word whose number of live cells in the neighborhood is
+   within the given bounds, the numbers being slid from a cell to the next */
+static inline uint64_t _match_sums(const uint32_t *sums, size_t length,
+                                   uint32_t min, uint32_t max) {
+	uint64_t match = 0;
+	for (size_t j = 0; j < length; ++j) {
+		/* min <= sum <= max in a single comparison */
+		match |= (uint64_t) (sums[j] - min <= max - min)
+		         << (WORD_BITS - 1 - j);
+	}
+	return match;
+}
+
+/* Give the next states of the cells of a word of a row under a Larger than
+   Life rule, from the counts of the live cells of the columns within the
+   range. The number of live cells in the neighborhood of a cell is slid from
+   that of the previous cell: sum holds that of the cell before the word, less
+   the column leaving the neighborhood */
+static WORD_INLINE uint64_t _update_ranged_word(const struct rule *rule,
+                                                unsigned int planes,
+                                                size_t width,
+                                                const uint32_t *columns,
+                                                uint32_t *sum,
+                                                const uint64_t *row,
+                                                uint64_t *const *ages,
+                                                size_t i) {
+	int range = (int) rule->range;
+	/* The numbers of live cells in the neighborhoods of the cells */
+	uint32_t sums[WORD_BITS];
+	uint32_t slid = *sum;
+	size_t start = (i - 1) * WORD_BITS;
+	size_t length = width - start < WORD_BITS ? width - start : WORD_BITS;
+	for (size_t j = 0; j < length; ++j) {
+		int col = (int) (start + j);
+		slid += columns[col + range];
+		sums[j] = slid;
+		slid -= columns[col - range];
+	}
+	*sum = slid;
+	uint64_t survive;
+	if (rule->middle) {
+		survive = _match_sums(sums, length, rule->survival_min,
+		                      rule->survival_max);
+	} else {
+		/* The live cells are counted in their own neighborhood */
+		survive = _match_sums(sums, length, rule->survival_min + 1,
+		                      rule->survival_max + 1);
+	}
+	uint64_t born = _match_sums(sums, length, rule->birth_min,
+	                            rule->birth_max);
+	return _set_next_cells(rule, planes, row, ages, i, survive, born);
+}
+
+/* Give the number of live cells in the columns west of the first cell of a
+   row within the range, the sum the first word is slid from */
+static uint32_t _start_ranged_sum(const struct rule *rule,
+                                  const uint32_t *columns) {
+	uint32_t sum = 0;
+	for (int col = -(int) rule->range; col < (int) rule->range; ++col) {
+		sum += columns[col];
+	}
+	return sum;
+}
+
+/* Update a row under a Larger than Life rule, given the counts of the live
+   cells of the columns within the range */
+static void _update_ranged_row(const struct rule *rule, size_t width,
+                               const uint32_t *columns, const uint64_t *row,
+                               uint64_t *const *ages, uint64_t *next) {
+	unsigned int planes = get_state_planes(rule->states);
+	size_t nb_words = (width + WORD_BITS - 1) / WORD_BITS;
+	uint32_t sum = _start_ranged_sum(rule, columns);
+	for (size_t i = 1; i <= nb_words; ++i) {
+		next[i] = _update_ranged_word(rule, planes, width, columns, &sum, row,
+		                              ages, i);
+	}
+}
+
+/* The same, counting the cells of the row as it is updated */
+static void _update_ranged_row_counting(const struct rule *rule, size_t width,
+                                        const uint32_t *columns,
+                                        const uint64_t *row,
+                                        uint64_t *const *ages, uint64_t *next,
+                                        struct _row_counts *counts) {
+	unsigned int planes = get_state_planes(rule->states);
+	size_t nb_words = (width + WORD_BITS - 1) / WORD_BITS;
+	uint32_t sum = _start_ranged_sum(rule, columns);
+	COUNT_ROW_WORDS(nb_words, row, next, counts, _count_set_bits,
+	                _update_ranged_word(rule, planes, width, columns, &sum,
+	                                    row, ages, i));
+}
+
+#ifdef POPCNT_TARGET
+POPCNT_TARGET
+static void _update_ranged_row_counting_popcnt(const struct rule *rule,
+                                               size_t width,
+                                               const uint32_t *columns,
+                                               const uint64_t *row,
+                                               uint64_t *const *ages,
+                                               uint64_t *next,
+                                               struct _row_counts *counts) {
+	unsigned int planes = get_state_planes(rule->states);
+	size_t nb_words = (width + WORD_BITS - 1) / WORD_BITS;
+	uint32_t sum = _start_ranged_sum(rule, columns);
+	COUNT_ROW_WORDS(nb_words, row, next, counts, __builtin_popcountll,
+	                _update_ranged_word(rule, planes, width, columns, &sum,
+	                                    row, ages, i));
+}
+#else
+# define _update_ranged_row_counting_popcnt _update_ranged_row_counting
+#endif
+
+/* Clear the counts of the cells of the statistics, the bounds being set so
+   that any live cell widens them */
+static void _init_stats_counts(struct grid_stats *stats) {
+	stats->population = 0;
+	stats->births = 0;
+	stats->deaths = 0;
+	stats->min_x = UINT_MAX;
+	stats->min_y = UINT_MAX;
+	stats->max_x = 0;
+	stats->max_y = 0;
+}
+
+/* Add the counts of the cells of a part of the grid to those of the grid */
+static void _add_stats_counts(struct grid_stats *stats,
+                              const struct grid_stats *part) {
+	stats->population += part->population;
+	stats->births += part->births;
+	stats->deaths += part->deaths;
+	stats->min_x = MIN(stats->min_x, part->min_x);
+	stats->min_y = MIN(stats->min_y, part->min_y);
+	stats->max_x = MAX(stats->max_x, part->max_x);
+	stats->max_y = MAX(stats->max_y, part->max_y);
+}
+
+/* The rows of the grid updated by a worker thread, along with the rows above
+   and below them, loaded before any row of the grid is updated */
+struct _stripe {
+	struct grid *grid;
+	const struct rule *rule;
+	size_t first; /* The first row */
+	size_t end; /* The row after the last one */
+	/* The rows above the first one, from the farthest, and below the last one,
+	   from the nearest: one of each, or under a Larger than Life rule, as many
+	   as the range above and one more below, that of the last column counts */
+	const uint64_t *above;
+	const uint64_t *below;
+	bool next_inverted; /* Whether the next states are stored inverted */
+	bool count; /* Whether to count the cells of the stripe */
+	struct grid_stats counts; /* The counts of the cells, if any */
+	int rc; /* The result of the update */
+};
+
+/* Give the previous state of a row under a Larger than Life rule, numbered
+   from the first row of the grid and beyond it when the grid wraps: one of
+   the rows around the stripe, or one of the stripe not updated yet, loaded in
+   the buffer. Return NULL if the row is out of a walled grid */
+static const uint64_t *_get_ranged_row(const struct _stripe *stripe,
+                                       long long row, size_t row_words,
+                                       uint64_t *buffer) {
+	const struct grid *grid = stripe->grid;
+	long long first = (long long) stripe->first;
+	long long end = (long long) stripe->end;
+	if (!grid->wrap && (row < 0 || row >= (long long) grid->height)) {
+		return NULL;
+	}
+	if (row < first) {
+		return &stripe->above[(size_t) (row - first + stripe->rule->range)
+		                      * row_words + 1];
+	}
+	if (row >= end) {
+		return &stripe->below[(size_t) (row - end) * row_words + 1];
+	}
+	_load_row(grid->cells, _get_plane_size(grid), (size_t) row * grid->stride,
+	          grid->width, &buffer[1]);
+	return &buffer[1];
+}
+
+/* Update a stripe under a Larger than Life rule. The live cells of each column
+   within the range of the row are counted, and the counts are updated from a
+   row to the next by adding the row entering the range and removing the one
+   leaving it; the number of live cells in the neighborhood of a cell is then
+   slid along the row in the same way. The cost per cell does not depend on the
+   range. The rows are updated in place, the previous states of those still in
+   the range being kept in a ring of as many rows as the range, plus one */
+static void _update_ranged_stripe(void *arg, struct _scratch *scratch) {
+	struct _stripe *stripe = arg;
+	struct grid *grid = stripe->grid;
+	const struct rule *rule = stripe->rule;
+	trace_begin("stripe");
+	unsigned int planes = get_state_planes(rule->states);
+	size_t width = grid->width;
+	size_t stride = grid->stride;
+	size_t plane_size = _get_plane_size(grid);
+	size_t nb_words = (width + WORD_BITS - 1) / WORD_BITS;
+	size_t range = rule->range;
+	bool popcnt = stripe->count && _use_popcnt();
+	/* The buffers are laid out as those of the neighbor rows, although the
+	   words at both ends are left blank: the ring, the next states, the rows
+	   entering and leaving the range, and the dying cells */
+	size_t row_words = nb_words + 2;
+	size_t nb_rows = range + 3 + planes;
+	/* The counts of the columns, with room for the range on both sides */
+	size_t nb_columns = width + 2 * range;
+	uint64_t *buffer = _get_scratch(scratch, nb_rows * row_words
+	                                         * sizeof *buffer
+	                                         + nb_columns * sizeof(uint32_t));
+	if (buffer == NULL) {
+		stripe->rc = -__LINE__;
+		trace_end("stripe");
+		return;
+	}
+	uint64_t *ring = buffer;
+	uint64_t *next = &buffer[(range + 1) * row_words];
+	uint64_t *edge = &next[row_words];
+	uint64_t *ages[MAX_STATE_PLANES];
+	for (unsigned int plane = 0; plane < planes; ++plane) {
+		ages[plane] = &edge[(1 + plane) * row_words];
+	}
+	uint32_t *columns = (uint32_t*) &buffer[nb_rows * row_words];
+	memset(columns, 0, nb_columns * sizeof *columns);
+	uint32_t *counts = &columns[range];
+	struct grid_stats stats;
+	_init_stats_counts(&stats);
+	struct _row_counts row_counts;
+	_init_row_counts(&row_counts, width, grid->inverted, grid->inverted);
+
+	long long first = (long long) stripe->first;
+	for (long long row = first - (long long) range;
+	     row <= first + (long long) range; ++row) {
+		_slide_columns(nb_words,
+		               _get_ranged_row(stripe, row, row_words, edge), 1,
+		               counts);
+	}
+	for (size_t r = stripe->first; r < stripe->end; ++r) {
+		/* The columns beyond the sides: the other side of a wrapped grid,
+		   otherwise dead cells */
+		if (grid->wrap) {
+			for (int col = 1; col <= (int) range; ++col) {
+				counts[-col] = counts[pos_mod(-col, (int) width)];
+				counts[(int) width - 1 + col] =
+					counts[pos_mod((int) width - 1 + col, (int) width)];
+			}
+		}
+		uint64_t *row = &ring[(r - stripe->first) % (range + 1) * row_words];
+		_load_row(grid->cells, plane_size, r * stride, width, &row[1]);
+		for (unsigned int plane = 0; plane < planes; ++plane) {
+			_load_row(&grid->cells[(1 + plane) * plane_size], plane_size,
+			          r * stride, width, &ages[plane][1]);
+		}
+		if (!stripe->count) {
+			_update_ranged_row(rule, width, counts, row, ages, next);
+		} else {
+			/* Counted while the words are at hand */
+			if (popcnt) {
+				_update_ranged_row_counting_popcnt(rule, width, counts, row,
+				                                   ages, next, &row_counts);
+			} else {
+				_update_ranged_row_counting(rule, width, counts, row, ages,
+				                            next, &row_counts);
+			}
+			_add_row_counts(r, nb_words, next, &row_counts, &stats);
+		}
+		_store_row(grid->cells, r * stride, width, &next[1]);
+		for (unsigned int plane = 0; plane < planes; ++plane) {
+			_store_row(&grid->cells[(1 + plane) * plane_size], r * stride,
+			           width, &ages[plane][1]);
+		}
+		/* Unsigned arithmetic: removing is adding the opposite */
+		long long entering = (long long) (r + range + 1);
+		_slide_columns(nb_words,
+		               _get_ranged_row(stripe, entering, row_words, edge), 1,
+		               counts);
+		long long leaving = (long long) r - (long long) range;
+		const uint64_t *left = leaving >= first
+		                       ? &ring[(size_t) (leaving - first) % (range + 1)
+		                               * row_words + 1]
+		                       : _get_ranged_row(stripe, leaving, row_words,
+		                                         edge);
+		_slide_columns(nb_words, left, UINT32_MAX, counts);
+	}
+
+	stripe->counts = stats;
+	stripe->rc = 0;
+	trace_end("stripe");
+}
+
+static void _update_stripe(void *arg, struct _scratch *scratch) {
+	/* The rows are loaded in turn in a buffer of three rows, that of the row
+	   being updated and its two neighbors, so that the rows can be updated in
+	   place: the previous state of a row is still in the buffer when its
+	   neighbors are updated */
+	struct _stripe *stripe = arg;
+	struct grid *grid = stripe->grid;
+	const struct rule *rule = stripe->rule;
+	trace_begin("stripe");
+	unsigned int planes = get_state_planes(rule->states);
+	_row_kernel kernel = _get_row_kernel(grid, rule);
+	bool popcnt = stripe->count && _use_popcnt();
+	_counting_kernel counting = stripe->count
+	                            ? _get_counting_kernel(grid, rule, popcnt)
+	                            : NULL;
+	size_t width = grid->width;
+	size_t stride = grid->stride;
+	size_t plane_size = _get_plane_size(grid);
+	size_t nb_words = (width + WORD_BITS - 1) / WORD_BITS;
+	/* Room for the neighbors at both ends of the row */
+	size_t row_words = nb_words + 2;
+	uint64_t *buffer = _get_scratch(scratch, (4 + planes) * row_words
+	                                         * sizeof *buffer);
+	if (buffer == NULL) {
+		stripe->rc = -__LINE__;
+		trace_end("stripe");
+		return;
+	}
+	uint64_t *above = buffer;
+	uint64_t *row = &buffer[row_words];
+	uint64_t *below = &buffer[2 * row_words];
+	uint64_t *next = &buffer[3 * row_words];
+	uint64_t *ages[MAX_STATE_PLANES];
+	for (unsigned int plane = 0; plane < planes; ++plane) {
+		ages[plane] = &buffer[(4 + plane) * row_words];
+	}
+	/* Counted apart from those of the other stripes, on another cache line */
+	struct grid_stats counts;
+	_init_stats_counts(&counts);
+	struct _row_counts row_counts;
+	_init_row_counts(&row_counts, width, grid->inverted,
+	                 stripe->next_inverted);
+
+	memcpy(above, stripe->above, row_words * sizeof *above);
+	_load_neighbor_row(grid, stripe->first, nb_words, row);
+	for (size_t r = stripe->first; r < stripe->end; ++r) {
+		if (r + 1 < stripe->end) {
+			_load_neighbor_row(grid, r + 1, nb_words, below);
+		} else {
+			memcpy(below, stripe->below, row_words * sizeof *below);
+		}
+		for (unsigned int plane = 0; plane < planes; ++plane) {
+			_load_row(&grid->cells[(1 + plane) * plane_size], plane_size,
+			          r * stride, width, &ages[plane][1]);
+		}
+		if (!stripe->count) {
+			if (kernel != NULL) {
+				kernel(nb_words, above, row, below, next);
+			} else {
+				_update_row(rule, nb_words, above, row, below, ages, next);
+			}
+		} else {
+			/* Counted while the words are at hand */
+			if (counting != NULL) {
+				counting(nb_words, above, row, below, next, &row_counts);
+			} else if (popcnt) {
+				_update_row_counting_popcnt(rule, nb_words, above, row, below,
+				                            ages, next, &row_counts);
+			} else {
+				_update_row_counting(rule, nb_words, above, row, below, ages,
+				                     next, &row_counts);
+			}
+			_add_row_counts(r, nb_words, next, &row_counts, &counts);
+		}
+		_store_row(grid->cells, r * stride, width, &next[1]);
+		for (unsigned int plane = 0; plane < planes; ++plane) {
+			_store_row(&grid->cells[(1 + plane) * plane_size], r * stride,
+			           width, &ages[plane][1]);
+		}
+		uint64_t *previous = above;
+		above = row;
+		row = below;
+		below = previous;
+	}
+
+	stripe->counts = counts;
+	stripe->rc = 0;
+	trace_end("stripe");
+}
+
+/* Update the stripes with the given function, by the workers of the grid if
+   there are several of them */
+static int _update_stripes(struct grid *grid, _worker_task update,
+                           struct _stripe *stripes, size_t nb_stripes) {
+	if (nb_stripes == 1) {
+		/* The buffers are only kept by the workers */
+		struct _scratch scratch = {NULL, 0};
+		update(stripes, &scratch);
+		free(scratch.memory);
+		return stripes->rc;
+	}
+	_run_workers(grid->pool, update, stripes, sizeof *stripes, nb_stripes);
+	int rc = 0;
+	for (size_t i = 0; i < nb_stripes; ++i) {
+		if (stripes[i].rc < 0) {
+			rc = stripes[i].rc;
+		}
+	}
+	return rc;
+}
+
+/* Load a row around a stripe, numbered from the first row of the grid and
+   beyond it when the grid wraps: as a neighbor row, or as the rows of a
+   Larger than Life rule, which only hold the cells */
+static void _load_halo_row(const struct grid *grid, long long row, bool ranged,
+                           size_t row_words, uint64_t *buffer) {
+	long long height = grid->height;
+	if (!grid->wrap && (row < 0 || row >= height)) {
+		_load_wall_row(grid, row_words, buffer);
+		return;
+	}
+	size_t wrapped = (size_t) ((row % height + height) % height);
+	if (ranged) {
+		_load_row(grid->cells, _get_plane_size(grid), wrapped * grid->stride,
+		          grid->width, &buffer[1]);
+	} else {
+		_load_neighbor_row(grid, wrapped, row_words - 2, buffer);
+	}
+}
+
+static int _update_grid(struct grid *grid, struct grid_stats *stats) {
+	const struct rule *cached = get_compiled_rule(grid->rule);
+	CHECK_NULL(cached);
+	/* A copy, that invert_rule may modify */
+	struct rule rule = *cached;
+	if (grid->inverted && !can_invert_rule(&rule)) {
+		set_grid_inverted(grid, false);
+	}
+	if (rule.states != grid->states) {
+		CHECK_RC(_set_grid_states(grid, rule.states));
+	}
+	/* The rule is applied to the cells as stored, so that a B0 rule does not
+	   fill the memory with the cells born around the pattern */
+	bool next_inverted = can_invert_rule(&rule)
+	                     && invert_rule(&rule, grid->inverted);
+	bool ranged = rule.family == RULE_FAMILY_LARGER_THAN_LIFE;
+	size_t nb_words = (grid->width + WORD_BITS - 1) / WORD_BITS;
+	size_t row_words = nb_words + 2;
+	size_t nb_stripes = _get_stripes(grid);
+	/* The rows around each stripe, loaded before they are updated by the
+	   neighboring stripes: the first rows of the grid are thus saved for the
+	   update of the last ones when the grid wraps */
+	size_t nb_above = ranged ? rule.range : 1;
+	size_t nb_below = ranged ? rule.range + 1 : 1;
+	size_t halo_words = (nb_above + nb_below) * row_words;
+	uint64_t *halos = malloc(nb_stripes * halo_words * sizeof *halos);
+	CHECK_NULL(halos);
+	struct _stripe *stripes = malloc(nb_stripes * sizeof *stripes);
+	if (stripes == NULL) {
+		free(halos);
+		return -__LINE__;
+	}
+	for (size_t i = 0; i < nb_stripes; ++i) {
+		struct _stripe *stripe = &stripes[i];
+		uint64_t *above = &halos[i * halo_words];
+		uint64_t *below = &above[nb_above * row_words];
+		_get_stripe_rows(grid, i, nb_stripes, &stripe->first, &stripe->end);
+		for (size_t k = 0; k < nb_above; ++k) {
+			_load_halo_row(grid, (long long) (stripe->first + k)
+			                     - (long long) nb_above, ranged, row_words,
+			               &above[k * row_words]);
+		}
+		for (size_t k = 0; k < nb_below; ++k) {
+			_load_halo_row(grid, (long long) (stripe->end + k), ranged,
+			               row_words, &below[k * row_words]);
+		}
+		stripe->grid = grid;
+		stripe->rule = &rule;
+		stripe->above = above;
+		stripe->below = below;
+		stripe->next_inverted = next_inverted;
+		stripe->count = stats != NULL;
+	}
+	int rc = _update_stripes(grid, ranged ? _update_ranged_stripe
+	                                      : _update_stripe,
+	                         stripes, nb_stripes);
+	if (rc == 0 && stats != NULL) {
+		for (size_t i = 0; i < nb_stripes; ++i) {
+			_add_stats_counts(stats, &stripes[i].counts);
+		}
+	}
+	free(stripes);
+	free(halos);
+	CHECK_RC(rc);
+	grid->inverted = next_inverted;
+	++grid->generation;
+	return 0;
+}
+
+/* Update the grid, counting its cells for the metrics if asked to */
+static int _update_grid_counting(struct grid *grid, bool count) {
+	if (!count) {
+		return _update_grid(grid, NULL);
+	}
+	struct grid_stats stats;
+	_init_stats_counts(&stats);
+	CHECK_RC(_update_grid(grid, &stats));
+	count_population(grid->generation, stats.population);
+	return 0;
 }
 
 int update_grid(struct grid *grid) {
-	/* The most memory-efficient way of updating the grid is to use a buffer
-	   of 3 rows to update the state of each row, where one row is the one being
-	   updated and the other is a backup of the adjacent row that was updated
-	   just before. The third row of the buffer is only used on the last row of
-	   the grid.
-	   This method also works on columns, however rows are usually wider than
-	   columns are high so going with the rows mitigates time complexity (the
-	   number of passes) by allowing a higher memory consumption (by allocating
-	   a bigger buffer). */
-	char *cells_buffer = calloc(num_octets(3 * grid->width), 1);
-	CHECK_NULL(cells_buffer);
-	/* First row */
-	if (grid->wrap) {
-		copy_bits(grid->cells, (grid->height - 1) * grid->width, cells_buffer,
-		          0, grid->width);
-		/* Save the first row's previous state for the last grid row */
-		copy_bits(grid->cells, 0, cells_buffer, grid->width * 2, grid->width);
-	} /* otherwise, buffer already cleared */
-	copy_bits(grid->cells, 0, cells_buffer, grid->width, grid->width);
-	_update_row(grid, 0, cells_buffer, grid->cells, grid->width);
-
-	/* Middle rows */
-	for (size_t row = grid->width; row < (grid->height - 1) * grid->width;
-	     row += grid->width) {
-		/* Move second buffer row to first; blit current grid row to second
-		   buffer row then perform update on grid row */
-		copy_bits(cells_buffer, grid->width, cells_buffer, 0, grid->width);
-		copy_bits(grid->cells, row, cells_buffer, grid->width, grid->width);
-		_update_row(grid, row, cells_buffer, grid->cells, row + grid->width);
-	}
-
-	/* Last row */
-	copy_bits(cells_buffer, grid->width, cells_buffer, 0, grid->width);
-	copy_bits(grid->cells, (grid->height - 1) * grid->width, cells_buffer,
-	          grid->width, grid->width);
-	_update_row(grid, (grid->height - 1) * grid->width, cells_buffer, cells_buffer,
-	            grid->width * 2);
-
-	free(cells_buffer);
+	return _update_grid_counting(grid, needs_population());
+}
+
+int update_grid_with_stats(struct grid *grid, struct grid_stats *stats) {
+	START_TIMER(timer);
+	trace_begin("generation");
+	uint64_t start = read_timer();
+	_init_stats_counts(stats);
+	int rc = _update_grid(grid, stats);
+	uint64_t end = read_timer();
+	/* The clock is not monotonic */
+	stats->duration = end > start ? end - start : 0;
+	trace_end("generation");
+	STOP_TIMER(timer, PHASE_UPDATE);
+	CHECK_RC(rc);
+	count_update(1, start);
+	count_population(grid->generation, stats->population);
+	stats->generation = grid->generation;
+	if (stats->population == 0) {
+		stats->min_x = 0;
+		stats->min_y = 0;
+	}
 	return 0;
 }
 
 
+/* Load the rows of a band of the grid and of its halos in a buffer, and save
+   the rows of the band that its neighbors will need once it is updated. The
+   rows of the grid before the band are already updated: their previous states
+   are taken from the saved rows instead, the last rows of the previous band
+   and, when the grid wraps, its first rows */
+static void _load_band(const struct grid *grid, size_t top, size_t rows,
+                       size_t halo, size_t row_words, uint64_t *buffer,
+                       uint64_t *previous, uint64_t *first) {
+	size_t nb_words = row_words - 2;
+	size_t row_size = row_words * sizeof *buffer;
+	for (size_t l = 0; l < rows + 2 * halo; ++l) {
+		uint64_t *dst = &buffer[l * row_words];
+		/* The row of the grid, possibly beyond the walls */
+		long long g = (long long) top + (long long) l - (long long) halo;
+		if (!grid->wrap && (g < 0 || g >= grid->height)) {
+			_load_wall_row(grid, row_words, dst);
+			continue;
+		}
+		size_t r = pos_mod((int) g, (int) grid->height);
+		if (r < top && r + halo >= top) {
+			memcpy(dst, &previous[r % halo * row_words], row_size);
+		} else if (r < top) {
+			memcpy(dst, &first[r * row_words], row_size);
+		} else {
+			_load_neighbor_row(grid, r, nb_words, dst);
+		}
+		if (l >= halo && l < halo + rows) {
+			memcpy(&previous[r % halo * row_words], dst, row_size);
+			if (top == 0 && r < halo) {
+				memcpy(&first[r * row_words], dst, row_size);
+			}
+		}
+	}
+}
+
+/* Advance a band of rows, loaded with their halos, through a generation.
+   The rows at both ends are left out, their neighbors being unknown: the
+   valid rows shrink by one on each side at each generation */
+static void _update_band(const struct grid *grid, const struct rule *rule,
+                         bool inverted, size_t top, size_t halo,
+                         size_t first_row, size_t last_row, size_t row_words,
+                         const uint64_t *buffer, uint64_t *next) {
+	_row_kernel kernel = _get_row_kernel(grid, rule);
+	size_t nb_words = row_words - 2;
+	for (size_t l = first_row; l <= last_row; ++l) {
+		long long g = (long long) top + (long long) l - (long long) halo;
+		uint64_t *row = &next[l * row_words];
+		if (!grid->wrap && (g < 0 || g >= grid->height)) {
+			memset(row, inverted ? 0xFF : 0, row_words * sizeof *row);
+			continue;
+		}
+		const uint64_t *above = &buffer[(l - 1) * row_words];
+		const uint64_t *below = &buffer[(l + 1) * row_words];
+		if (kernel != NULL) {
+			kernel(nb_words, above, &buffer[l * row_words], below, row);
+		} else {
+			_update_row(rule, nb_words, above, &buffer[l * row_words], below,
+			            NULL, row);
+		}
+		_set_neighbor_cells(grid, inverted, nb_words, row);
+	}
+}
+
+/* Advance the grid through generations generations with the rows processed
+   by bands, or return 1 if the bands would not fit in the cache */
+static int _update_grid_by_bands(struct grid *grid, const struct rule *rule,
+                                 unsigned int generations) {
+	size_t width = grid->width;
+	size_t stride = grid->stride;
+	size_t height = grid->height;
+	size_t nb_words = (width + WORD_BITS - 1) / WORD_BITS;
+	size_t row_words = nb_words + 2;
+	/* The halo of a band is as high as the number of generations. Both
+	   buffers of a band, along with its halos, are to fit in the cache, and
+	   the halos are not to be larger than the band itself */
+	size_t halo = generations;
+	size_t capacity = BAND_BYTES / (2 * row_words * sizeof(uint64_t));
+	if (capacity < 4 * halo) {
+		return 1;
+	}
+	size_t band = capacity - 2 * halo;
+	if (band > height) {
+		band = height;
+	}
+	/* The rules of the generations, which alternate when the cells are
+	   stored inverted */
+	struct rule rules[MAX_BAND_GENERATIONS];
+	bool inverted[MAX_BAND_GENERATIONS + 1];
+	inverted[0] = grid->inverted;
+	for (unsigned int j = 0; j < generations; ++j) {
+		rules[j] = *rule;
+		inverted[j + 1] = can_invert_rule(rule)
+		                  && invert_rule(&rules[j], inverted[j]);
+	}
+	size_t band_words = (band + 2 * halo) * row_words;
+	uint64_t *buffer = malloc((2 * band_words + 2 * halo * row_words)
+	                          * sizeof *buffer);
+	CHECK_NULL(buffer);
+	uint64_t *previous = &buffer[2 * band_words];
+	uint64_t *first = &previous[halo * row_words];
+
+	for (size_t top = 0; top < height; top += band) {
+		size_t rows = band < height - top ? band : height - top;
+		uint64_t *current = buffer;
+		uint64_t *next = &buffer[band_words];
+		_load_band(grid, top, rows, halo, row_words, current, previous,
+		           first);
+		for (unsigned int j = 0; j < generations; ++j) {
+			_update_band(grid, &rules[j], inverted[j + 1], top, halo, j + 1,
+			             rows + 2 * halo - 2 - j, row_words, current, next);
+			uint64_t *updated = next;
+			next = current;
+			current = updated;
+		}
+		for (size_t l = 0; l < rows; ++l) {
+			_store_row(grid->cells, (top + l) * stride, width,
+			           &current[(halo + l) * row_words + 1]);
+		}
+	}
+
+	free(buffer);
+	grid->inverted = inverted[generations];
+	grid->generation += generations;
+	return 0;
+}
+
+int update_grid_generations(struct grid *grid, unsigned long generations) {
+	START_TIMER(timer);
+	uint64_t start = read_timer();
+	unsigned long total = generations;
+	/* Only the last generation is counted for the metrics */
+	bool count = needs_population();
+	while (generations > 0) {
+		const struct rule *rule = get_compiled_rule(grid->rule);
+		CHECK_NULL(rule);
+		unsigned int block = generations < MAX_BAND_GENERATIONS
+		                     ? (unsigned int) generations
+		                     : MAX_BAND_GENERATIONS;
+		if (count && block == generations && block > 1) {
+			--block;
+		}
+		/* The bands only pay off on grids larger than the cache, and do not
+		   handle the dying cells, the ranged neighborhoods, nor the workers */
+		int rc = 1;
+		if (block > 1 && grid->workers <= 1
+		    && _get_plane_size(grid) > BAND_BYTES
+		    && rule->family == RULE_FAMILY_LIFE_LIKE && rule->states == 2
+		    && grid->states == 2
+		    && (!grid->inverted || can_invert_rule(rule))) {
+			trace_begin("generations");
+			rc = _update_grid_by_bands(grid, rule, block);
+			trace_end("generations");
+			CHECK_RC(rc);
+		}
+		if (rc > 0) {
+			trace_begin("generation");
+			rc = _update_grid_counting(grid, count && generations == 1);
+			trace_end("generation");
+			CHECK_RC(rc);
+			block = 1;
+		}
+		generations -= block;
+	}
+	STOP_TIMER(timer, PHASE_UPDATE);
+	count_update(total, start);
+	return 0;
+}
+
+
+void set_grid_inverted(struct grid *grid, bool inverted) {
+	if (inverted == grid->inverted) {
+		return;
+	}
+	size_t width = grid->width;
+	for (size_t row = 0; row < grid->height; ++row) {
+		size_t start = row * grid->stride;
+		size_t end = start + width;
+		/* The bits after the last cell of the row stay blank */
+		for (; start < end && start % 8 != 0; ++start) {
+			toggle_bit(grid->cells, start);
+		}
+		for (; start + 8 <= end; start += 8) {
+			grid->cells[start / 8] = (char) ~grid->cells[start / 8];
+		}
+		for (; start < end; ++start) {
+			toggle_bit(grid->cells, start);
+		}
+	}
+	grid->inverted = inverted;
+}
+
+
 void clear_grid(struct grid *grid) {
-	memset(grid->cells, DEAD, num_octets(grid->width * grid->height));
+	memset(grid->cells, DEAD, get_grid_data_size(grid));
+	grid->inverted = false;
+}
+
+
+/* Give the next run of cells of a range of a rectangle along a dimension of
+   the grid: the cells from the offset in the range, moved past the walls if
+   needed, up to the edge of the grid, and the position of the first one in
+   the grid. Give 0 past the end of the range */
+static size_t _next_run(size_t size, bool wrap, long long start,
+                        size_t length, size_t *offset, size_t *pos) {
+	if (wrap) {
+		long long first = start % (long long) size;
+		if (first < 0) {
+			first += (long long) size;
+		}
+		*pos = ((size_t) first + *offset % size) % size;
+	} else {
+		if (start >= (long long) size) {
+			return 0;
+		}
+		/* Negated so as not to overflow */
+		if (start < 0 && *offset <= (size_t) -(start + 1)) {
+			*offset = (size_t) -(start + 1) + 1;
+		}
+		*pos = (size_t) (start + (long long) *offset);
+	}
+	if (*offset >= length || *pos >= size) {
+		return 0;
+	}
+	return MIN(length - *offset, size - *pos);
+}
+
+/* The function applied to a run of cells of a rectangle, from the bit start
+   of the plane of the grid, at the given row and column of the rectangle */
+typedef void (*_run_function)(void *context, size_t row, size_t col,
+                              size_t start, size_t length);
+
+/* Apply the function to the runs of each row of a rectangle within the grid:
+   a row of a rectangle wrapped around a toroidal grid is split in two runs at
+   the edge, or more if it is wider than the grid */
+static void _walk_region(const struct grid *grid, long long row, long long col,
+                         size_t width, size_t height, _run_function function,
+                         void *context) {
+	size_t to_row;
+	size_t rows;
+	for (size_t r = 0; (rows = _next_run(grid->height, grid->wrap, row, height,
+	                                     &r, &to_row)) > 0; r += rows) {
+		for (size_t i = 0; i < rows; ++i) {
+			size_t to_col;
+			size_t length;
+			for (size_t c = 0; (length = _next_run(grid->width, grid->wrap,
+			                                       col, width, &c, &to_col))
+			                   > 0; c += length) {
+				function(context, r + i, c,
+				         (to_row + i) * grid->stride + to_col, length);
+			}
+		}
+	}
+}
+
+
+struct _blit {
+	struct grid *grid;
+	const struct grid *pattern;
+	enum blit_mode mode;
+};
+
+static inline uint64_t _blit_word(uint64_t cells, uint64_t pattern,
+                                  enum blit_mode mode) {
+	switch (mode) {
+		case BLIT_OR:
+			return cells | pattern;
+		case BLIT_XOR:
+			return cells ^ pattern;
+		default:
+			return pattern;
+	}
+}
+
+static void _blit_run(void *context, size_t row, size_t col, size_t start,
+                      size_t length) {
+	const struct _blit *blit = context;
+	struct grid *grid = blit->grid;
+	const struct grid *pattern = blit->pattern;
+	size_t plane_size = _get_plane_size(grid);
+	size_t pattern_size = _get_plane_size(pattern);
+	unsigned int planes = get_state_planes(grid->states);
+	uint64_t inverted = grid->inverted ? UINT64_MAX : 0;
+	uint64_t pattern_inverted = pattern->inverted ? UINT64_MAX : 0;
+	/* The word after the last one is read by _store_row */
+	uint64_t cells[REGION_CHUNK_WORDS + 1];
+	uint64_t changed[REGION_CHUNK_WORDS];
+	for (size_t done = 0; done < length;) {
+		size_t bits = MIN(length - done, REGION_CHUNK_WORDS * WORD_BITS);
+		size_t nb_words = (bits + WORD_BITS - 1) / WORD_BITS;
+		_load_row(pattern->cells, pattern_size,
+		          row * pattern->stride + col + done, bits, changed);
+		_load_row(grid->cells, plane_size, start + done, bits, cells);
+		cells[nb_words] = 0;
+		for (size_t i = 0; i < nb_words; ++i) {
+			uint64_t live = changed[i] ^ pattern_inverted;
+			cells[i] = _blit_word(cells[i] ^ inverted, live, blit->mode)
+			           ^ inverted;
+			/* The cells brought to life or overwritten lose their dying
+			   state */
+			changed[i] = blit->mode == BLIT_COPY ? UINT64_MAX : live;
+		}
+		_store_row(grid->cells, start + done, bits, cells);
+		for (unsigned int plane = 1; plane <= planes; ++plane) {
+			char *ages = &grid->cells[plane * plane_size];
+			_load_row(ages, plane_size, start + done, bits, cells);
+			for (size_t i = 0; i < nb_words; ++i) {
+				cells[i] &= ~changed[i];
+			}
+			_store_row(ages, start + done, bits, cells);
+		}
+		done += bits;
+	}
+}
+
+void blit_grid(struct grid *grid, const struct grid *pattern, long long row,
+               long long col, enum blit_mode mode) {
+	size_t width = pattern->width;
+	size_t height = pattern->height;
+	if (grid->wrap) {
+		/* The pattern would overlap itself */
+		width = MIN(width, grid->width);
+		height = MIN(height, grid->height);
+	}
+	struct _blit blit = {grid, pattern, mode};
+	_walk_region(grid, row, col, width, height, _blit_run, &blit);
+}
+
+
+struct _extraction {
+	const struct grid *grid;
+	char *bits;
+	size_t width;
+};
+
+static void _extract_run(void *context, size_t row, size_t col, size_t start,
+                         size_t length) {
+	const struct _extraction *extraction = context;
+	const struct grid *grid = extraction->grid;
+	size_t plane_size = _get_plane_size(grid);
+	uint64_t inverted = grid->inverted ? UINT64_MAX : 0;
+	uint64_t cells[REGION_CHUNK_WORDS + 1];
+	size_t to = row * extraction->width + col;
+	for (size_t done = 0; done < length;) {
+		size_t bits = MIN(length - done, REGION_CHUNK_WORDS * WORD_BITS);
+		size_t nb_words = (bits + WORD_BITS - 1) / WORD_BITS;
+		_load_row(grid->cells, plane_size, start + done, bits, cells);
+		for (size_t i = 0; i < nb_words; ++i) {
+			cells[i] ^= inverted;
+		}
+		cells[nb_words] = 0;
+		_store_row(extraction->bits, to + done, bits, cells);
+		done += bits;
+	}
+}
+
+void extract_grid_region(const struct grid *grid, long long row,
+                         long long col, unsigned int width,
+                         unsigned int height, char *bits) {
+	/* The cells beyond the walls are dead */
+	memset(bits, 0, num_octets((size_t) width * height));
+	struct _extraction extraction = {grid, bits, width};
+	_walk_region(grid, row, col, width, height, _extract_run, &extraction);
+}
+
+
+struct _count {
+	const struct grid *grid;
+	uint64_t count;
+};
+
+static void _count_run(void *context, size_t row, size_t col, size_t start,
+                       size_t length) {
+	(void) row;
+	(void) col;
+	struct _count *count = context;
+	const struct grid *grid = count->grid;
+	size_t plane_size = _get_plane_size(grid);
+	uint64_t cells[REGION_CHUNK_WORDS];
+	uint64_t set = 0;
+	for (size_t done = 0; done < length;) {
+		size_t bits = MIN(length - done, REGION_CHUNK_WORDS * WORD_BITS);
+		size_t nb_words = (bits + WORD_BITS - 1) / WORD_BITS;
+		/* The bits after the last cell are cleared */
+		_load_row(grid->cells, plane_size, start + done, bits, cells);
+		for (size_t i = 0; i < nb_words; ++i) {
+			set += count_set_bits(cells[i]);
+		}
+		done += bits;
+	}
+	count->count += grid->inverted ? length - set : set;
+}
+
+uint64_t count_grid_region(const struct grid *grid, long long row,
+                           long long col, unsigned int width,
+                           unsigned int height) {
+	size_t region_width = width;
+	size_t region_height = height;
+	if (grid->wrap) {
+		/* No cell is counted twice */
+		region_width = MIN(region_width, grid->width);
+		region_height = MIN(region_height, grid->height);
+	}
+	struct _count count = {grid, 0};
+	_walk_region(grid, row, col, region_width, region_height, _count_run,
+	             &count);
+	return count.count;
 }
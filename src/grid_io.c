@@ -3,30 +3,56 @@
 
 #include <ctype.h> /* for isspace */
 #include <stddef.h> /* for size_t */
+#include <stdint.h> /* for uint64_t, UINT64_C, SIZE_MAX */
 #include <stdio.h> /* for sscanf */
-#include <stdlib.h> /* for malloc */
-#include <string.h> /* for strlen, strcpy */
+#include <stdlib.h> /* for malloc, strtoll, strtoul */
+#include <string.h> /* for strlen, strcpy, strncmp */
 
-#include "bits.h" /* for SET_BIT */
-#include "utils.h" /* for CHECK_NULL */
+#include "bits.h" /* for SET_BIT, load_word, count_leading_zeros */
+#include "macrocell.h" /* for load_grid_macrocell, get_grid_macrocell */
+#include "mathutils.h" /* for mul_size */
+#include "stringutils.h" /* for struct string_builder, append_format */
+#include "trace.h" /* for trace_begin, trace_end */
+#include "utils.h" /* for CHECK_NULL, CHECK_RC */
 
 
 
-static inline int _set_run_length(struct grid *grid, unsigned int *row,
-                                  unsigned int col, const char **repr) {
-	char *end = NULL;
-	long length = strtol(*repr, &end, 10);
-	*repr = end;
-	if (*row + length > grid->width) {
+static const char LIFE106_HEADER[] = "#Life 1.06";
+
+
+
+/* Read the character(s) of the state of a run of cells: b and o in the
+   two-state patterns; ., A to X, and A to X preceded by one of p to y for the
+   states above 24, in the multi-state ones */
+static int _read_rle_state(const struct grid *grid, const char **repr) {
+	char state_char = (*repr)[0];
+	if (state_char == 'b' || state_char == '.') {
+		return DEAD;
+	} else if (state_char == 'o') {
+		return ALIVE;
+	}
+	unsigned int state = 0;
+	if ('p' <= state_char && state_char <= 'y') {
+		state = (unsigned int) (state_char - 'p' + 1) * 24;
+		state_char = *++*repr;
+	}
+	if (state_char < 'A' || state_char > 'X') { /* Invalid character */
+		return -__LINE__;
+	}
+	state += (unsigned int) (state_char - 'A' + 1);
+	return state < grid->states ? (int) state : -__LINE__;
+}
+
+static inline int _set_run(struct grid *grid, unsigned int *row,
+                           unsigned int col, long length, const char **repr) {
+	int state = _read_rle_state(grid, repr);
+	if (state < 0 || *row + length > grid->width) {
 		return -__LINE__;
 	}
-	char state = (*repr)[0];
-	if (state == 'o') {
+	if (state != DEAD) {
 		for (int n = 0; n < length; ++n) {
-			set_bit(grid->cells, col * grid->width + *row + n, 1);
+			set_grid_cell_state(grid, col, *row + n, state);
 		}
-	} else if (state != 'b') { /* Invalid character */
-		return -__LINE__;
 	}
 	*row += length;
 	return 0;
@@ -36,6 +62,8 @@ static inline int _init_cells_from_rle(struct grid *grid, const char *repr) {
 	unsigned int row = 0;
 	unsigned int col = 0;
 	int rc;
+	char *end;
+	long length;
 	for (; repr[0] != '\0'; ++repr) {
 		switch (repr[0]) {
 			case '!': /* End of repr */
@@ -49,18 +77,12 @@ static inline int _init_cells_from_rle(struct grid *grid, const char *repr) {
 			case '7':
 			case '8':
 			case '9':
-				if ((rc = _set_run_length(grid, &row, col, &repr)) < 0) {
+				length = strtol(repr, &end, 10);
+				repr = end;
+				if ((rc = _set_run(grid, &row, col, length, &repr)) < 0) {
 					return rc;
 				}
 				break;
-			case 'o':
-				set_bit(grid->cells, col * grid->width + row, 1);
-			/* Fall-through intended */
-			case 'b':
-				if (++row > grid->width) {
-					return -__LINE__;
-				}
-				break;
 			case '$':
 				/* No grid width checking because end of row can be omitted if
 				   all cells are blank */
@@ -79,10 +101,12 @@ static inline int _init_cells_from_rle(struct grid *grid, const char *repr) {
 					   readability */
 					break;
 				}
-				/* Unexpected character, may be a 0 starting a run length, NUL
-				   byte, anything that is not handled in the cases is considered
-				   invalid. */
-				return -__LINE__;
+				/* A single cell. Any unexpected character, may be a 0 starting
+				   a run length, NUL byte, anything that is not a state, is
+				   considered invalid. */
+				if ((rc = _set_run(grid, &row, col, 1, &repr)) < 0) {
+					return rc;
+				}
 		}
 	}
 	return 0;
@@ -90,7 +114,7 @@ static inline int _init_cells_from_rle(struct grid *grid, const char *repr) {
 
 static inline int _init_grid_from_rle(struct grid *grid, const char *repr,
                                       bool wrap) {
-	char rule_buffer[22] = {0};
+	char rule_buffer[64] = {0};
 	unsigned int width;
 	unsigned int height;
 
@@ -100,7 +124,7 @@ static inline int _init_grid_from_rle(struct grid *grid, const char *repr,
 	}
 	/* grid->rule cannot be passed directly to sscanf, because it will be
 	   cleared in init_grid */
-	int rc = sscanf(repr, "x = %u, y = %u, rule = %22s", &width, &height,
+	int rc = sscanf(repr, "x = %u, y = %u, rule = %63s", &width, &height,
 	                rule_buffer);
 	if (rc < 2) {
 		/* No proper RLE header line, probably not RLE at all */
@@ -112,7 +136,9 @@ static inline int _init_grid_from_rle(struct grid *grid, const char *repr,
 	if (rc < 0) {
 		return rc;
 	}
-	if (add_rule) {
+	/* The rule gives the number of states of the cells. An unknown rule is
+	   kept as is, it may be overridden */
+	if (add_rule && set_grid_rule(grid, rule_buffer) < 0) {
 		memcpy(grid->rule, rule_buffer, sizeof grid->rule);
 	}
 
@@ -170,15 +196,18 @@ static int _init_cells_from_plain(struct grid *grid, const char *repr) {
 	/* Memorized "on" character, to detect when both @ and O are mixed within a
 	   same file. Blank means uninitialized, ! means warning already output */
 	char saved_alive_char = ' ';
-	for (size_t bit_index = 0; repr[0] != '\0'; ++repr) {
+	size_t row_index = 0;
+	for (size_t col = 0; repr[0] != '\0'; ++repr) {
 		if (repr[0] == '@') {
-			set_bit(grid->cells, bit_index, 1);
+			set_bit(grid->cells, row_index + col, 1);
 			_check_alive_char(&saved_alive_char, '@', 'O');
 		} else if (repr[0] == 'O') {
-			set_bit(grid->cells, bit_index, 1);
+			set_bit(grid->cells, row_index + col, 1);
 			_check_alive_char(&saved_alive_char, 'O', '@');
 		} else if (repr[0] == '\n'
 		           || (repr[0] == '\r' && (++repr)[0] == '\n')) {
+			row_index += grid->stride;
+			col = 0;
 			if (repr[1] == '!') {
 				repr = strchr(&repr[2], '\n');
 				if (repr == NULL) { /* No more comments, reached end of file */
@@ -189,14 +218,107 @@ static int _init_cells_from_plain(struct grid *grid, const char *repr) {
 		} else if (repr[0] != '.') {
 			return -__LINE__;
 		}
-		++bit_index;
+		++col;
 	}
 	return 0;
 }
 
-int load_grid(struct grid *grid, const char *repr, enum grid_format format,
-              bool wrap) {
+/* Read the coordinates on the next line of a Life 1.06 representation that is
+   not a comment. Return 1 if there are no more coordinates */
+static int _read_life106_cell(const char **repr, long long *x, long long *y) {
+	for (;;) {
+		const char *line = *repr;
+		while (isspace(line[0])) { /* Also skips blank lines */
+			++line;
+		}
+		if (line[0] == '\0') {
+			return 1;
+		}
+		const char *eol = strchr(line, '\n');
+		*repr = eol == NULL ? line + strlen(line) : eol + 1;
+		if (line[0] == '#') {
+			continue;
+		}
+		char *end;
+		*x = strtoll(line, &end, 10);
+		const char *start = end;
+		*y = strtoll(start, &end, 10);
+		if (end == line || end == start) {
+			return -__LINE__;
+		}
+		return 0;
+	}
+}
+
+static int _init_grid_from_life106(struct grid *grid, const char *repr,
+                                   bool wrap) {
+	if (strncmp(repr, LIFE106_HEADER, sizeof LIFE106_HEADER - 1) != 0) {
+		return 1;
+	}
+	/* First pass to find the bounding box of the live cells, which gives the
+	   dimensions of the grid */
+	long long x;
+	long long y;
+	long long min_x = 0;
+	long long min_y = 0;
+	long long max_x = 0;
+	long long max_y = 0;
+	bool empty = true;
+	const char *cursor = repr;
 	int rc;
+	while ((rc = _read_life106_cell(&cursor, &x, &y)) == 0) {
+		if (empty || x < min_x) {
+			min_x = x;
+		}
+		if (empty || y < min_y) {
+			min_y = y;
+		}
+		if (empty || x > max_x) {
+			max_x = x;
+		}
+		if (empty || y > max_y) {
+			max_y = y;
+		}
+		empty = false;
+	}
+	if (rc < 0) {
+		return rc;
+	}
+	uint64_t width = (uint64_t) max_x - (uint64_t) min_x + 1;
+	uint64_t height = (uint64_t) max_y - (uint64_t) min_y + 1;
+	if (width == 0 || width > MAX_GRID_SIZE || height == 0
+	    || height > MAX_GRID_SIZE) {
+		return -__LINE__;
+	}
+	CHECK_RC(init_grid(grid, (unsigned int) width, (unsigned int) height,
+	                   wrap));
+	cursor = repr;
+	while (_read_life106_cell(&cursor, &x, &y) == 0) {
+		set_bit(grid->cells, (size_t) (y - min_y) * grid->stride + (x - min_x),
+		        1);
+	}
+	return 0;
+}
+
+static int _load_grid(struct grid *grid, const char *repr,
+                      enum grid_format format, bool wrap) {
+	int rc;
+	if (format == GRID_FORMAT_MACROCELL || format == GRID_FORMAT_UNKNOWN) {
+		rc = load_grid_macrocell(grid, repr, wrap);
+		if (rc <= 0) { /* > 0 means not Macrocell */
+			return rc;
+		} else if (format == GRID_FORMAT_MACROCELL) {
+			return -__LINE__;
+		}
+	}
+	if (format == GRID_FORMAT_LIFE106 || format == GRID_FORMAT_UNKNOWN) {
+		rc = _init_grid_from_life106(grid, repr, wrap);
+		if (rc <= 0) { /* > 0 means not Life 1.06 */
+			return rc;
+		} else if (format == GRID_FORMAT_LIFE106) {
+			return -__LINE__;
+		}
+	}
 	if (format == GRID_FORMAT_RLE || format == GRID_FORMAT_UNKNOWN) {
 		rc = _init_grid_from_rle(grid, repr, wrap);
 		if (rc <= 0) { /* > 0 means not RLE */
@@ -219,16 +341,31 @@ int load_grid(struct grid *grid, const char *repr, enum grid_format format,
 	return _init_cells_from_plain(grid, repr);
 }
 
+int load_grid(struct grid *grid, const char *repr, enum grid_format format,
+              bool wrap) {
+	trace_begin("parse");
+	int rc = _load_grid(grid, repr, format, wrap);
+	trace_end("parse");
+	return rc;
+}
+
 
 static inline char *_get_rle_header(const struct grid *grid,
-                                    size_t *repr_start, size_t *allocated) {
-	char header[64] = {0};
+                                    size_t *repr_start, size_t *allocated,
+                                    unsigned int state_size) {
+	char header[128] = {0};
 	int header_size = sprintf(header, "x = %u, y = %u, rule = %s\n",
 	                          grid->width, grid->height, grid->rule);
 	if (header_size < 0) {
 		return NULL;
 	}
-	*allocated = header_size + (grid->width + 1) * grid->height + 1;
+	/* At worst one run per cell, and a newline per row */
+	size_t row_size = (size_t) state_size * grid->width + 1;
+	if (!mul_size(row_size, grid->height, allocated)
+	    || *allocated > SIZE_MAX - header_size - 1) {
+		return NULL;
+	}
+	*allocated += header_size + 1;
 	char *repr = malloc(*allocated);
 	if (repr == NULL) {
 		return NULL;
@@ -238,14 +375,30 @@ static inline char *_get_rle_header(const struct grid *grid,
 	return repr;
 }
 
+/* Write the character(s) of the state of a run, as read by _read_rle_state */
+static size_t _put_rle_state(char *repr, unsigned int state,
+                             unsigned int states) {
+	if (states <= 2) {
+		repr[0] = state == DEAD ? 'b' : 'o';
+		return 1;
+	} else if (state == DEAD) {
+		repr[0] = '.';
+		return 1;
+	}
+	size_t size = 0;
+	if (state > 24) {
+		repr[size++] = (char) ('p' + (state - 1) / 24 - 1);
+	}
+	repr[size++] = (char) ('A' + (state - 1) % 24);
+	return size;
+}
+
 static inline char *_get_grid_rle(const struct grid *grid) {
-	char cell_repr[] = {
-		[DEAD] = 'b',
-		[ALIVE] = 'o'
-	};
 	size_t repr_index = 0;
 	size_t allocated;
-	char *repr = _get_rle_header(grid, &repr_index, &allocated);
+	/* The states above 24 are written with two characters */
+	char *repr = _get_rle_header(grid, &repr_index, &allocated,
+	                             grid->states > 25 ? 2 : 1);
 	if (repr == NULL) {
 		return NULL;
 	}
@@ -253,11 +406,12 @@ static inline char *_get_grid_rle(const struct grid *grid) {
 		unsigned int run_length;
 		for (unsigned int col = 0; col < grid->width; col += run_length) {
 			run_length = 1;
-			enum cell_state run_state = get_grid_cell(grid, row, col);
+			unsigned int run_state = get_grid_cell_state(grid, row, col);
 			/* Get length of run: stop at either a different cell or the end
 			   of the row */
 			while (col + run_length < grid->width
-			       && get_grid_cell(grid, row, col + run_length) == run_state) {
+			       && get_grid_cell_state(grid, row, col + run_length)
+			          == run_state) {
 				++run_length;
 			}
 			/* Skip blank row endings (i.e. blank runs that reach the end of
@@ -273,7 +427,8 @@ static inline char *_get_grid_rle(const struct grid *grid) {
 				}
 				repr_index += nb_written;
 			}
-			repr[repr_index++] = cell_repr[run_state];
+			repr_index += _put_rle_state(&repr[repr_index], run_state,
+			                             grid->states);
 		}
 		repr[repr_index++] = '$';
 	}
@@ -291,22 +446,97 @@ static inline void _get_grid_plain(const struct grid *grid, char *repr) {
 		[DEAD] = '.',
 		[ALIVE] = '@'
 	};
+	size_t line_size = (size_t) grid->width + 1;
 	for (unsigned int row = 0; row < grid->height; ++row) {
+		char *line = &repr[row * line_size];
 		for (unsigned int col = 0; col < grid->width; ++col) {
-			repr[row * (grid->width + 1) + col] = cell_repr[get_grid_cell(grid, row, col)];
+			line[col] = cell_repr[get_grid_cell(grid, row, col)];
 		}
-		repr[row * (grid->width + 1) + grid->width] = '\n';
+		line[grid->width] = '\n';
 	}
-	repr[(grid->width + 1) * grid->height - 1] = '\0';
+	repr[line_size * grid->height - 1] = '\0';
 }
 
-char *get_grid_repr(const struct grid *grid, enum grid_format format) {
+/* Load the word starting at the given octet of the plane, padded with zeros
+   past its end */
+static uint64_t _load_plane_word(const char *plane, size_t plane_size,
+                                 size_t octet) {
+	if (octet + 8 <= plane_size) {
+		return load_word(plane, octet);
+	}
+	uint64_t word = 0;
+	for (size_t i = octet; i < plane_size; ++i) {
+		word |= (uint64_t) (unsigned char) plane[i] << 8 * (7 - (i - octet));
+	}
+	return word;
+}
+
+static char *_get_grid_life106(const struct grid *grid) {
+	struct string_builder builder;
+	if (init_string_builder(&builder, 64) < 0) {
+		return NULL;
+	}
+	int rc = append_format(&builder, "%s\n", LIFE106_HEADER);
+	size_t plane_size = num_octets(grid->stride * grid->height);
+	for (size_t row = 0; rc == 0 && row < grid->height; ++row) {
+		size_t start = row * grid->stride;
+		size_t end = start + grid->width;
+		for (size_t octet = start / 8; rc == 0 && octet * 8 < end;
+		     octet += 8) {
+			uint64_t word = _load_plane_word(grid->cells, plane_size, octet);
+			/* Leave out the cells of the neighboring rows */
+			if (octet * 8 < start) {
+				word &= UINT64_MAX >> (start - octet * 8);
+			}
+			if (octet * 8 + 64 > end) {
+				word &= ~(UINT64_MAX >> (end - octet * 8));
+			}
+			/* Skip 64 dead cells at once, and find the live cells in a word
+			   by scanning its set bits rather than testing each cell */
+			while (rc == 0 && word != 0) {
+				unsigned int bit = count_leading_zeros(word);
+				rc = append_format(&builder, "%u %u\n",
+				                   (unsigned int) (octet * 8 + bit - start),
+				                   (unsigned int) row);
+				word ^= UINT64_C(1) << (63 - bit);
+			}
+		}
+	}
+	if (rc < 0) {
+		free(builder.data);
+		return NULL;
+	}
+	return builder.data;
+}
+
+static char *_get_grid_repr(const struct grid *grid,
+                            enum grid_format format) {
 	char *repr;
+	if (grid->inverted && (format == GRID_FORMAT_MACROCELL
+	                       || format == GRID_FORMAT_LIFE106)) {
+		/* These formats read the bit plane of the live cells directly */
+		struct grid copy;
+		if (copy_grid(&copy, grid) < 0) {
+			return NULL;
+		}
+		set_grid_inverted(&copy, false);
+		repr = _get_grid_repr(&copy, format);
+		free_grid(&copy);
+		return repr;
+	}
 	if (format == GRID_FORMAT_RLE) {
 		repr = _get_grid_rle(grid);
+	} else if (format == GRID_FORMAT_MACROCELL) {
+		repr = get_grid_macrocell(grid);
+	} else if (format == GRID_FORMAT_LIFE106) {
+		repr = _get_grid_life106(grid);
 	} else {
-	/* Additional height characters for newlines and null terminator */
-		repr = malloc((grid->width + 1) * grid->height);
+		/* Additional height characters for newlines and null terminator */
+		size_t size;
+		if (!mul_size((size_t) grid->width + 1, grid->height, &size)) {
+			return NULL;
+		}
+		repr = malloc(size);
 		if (repr == NULL) {
 			return NULL;
 		}
@@ -314,3 +544,78 @@ char *get_grid_repr(const struct grid *grid, enum grid_format format) {
 	}
 	return repr;
 }
+
+char *get_grid_repr(const struct grid *grid, enum grid_format format) {
+	trace_begin("format");
+	char *repr = _get_grid_repr(grid, format);
+	trace_end("format");
+	return repr;
+}
+
+
+/* Measure a fragment of an RLE pattern without a header line: its width is
+   that of its longest row, its height the number of its rows */
+static int _measure_rle(const char *repr, unsigned int *width,
+                        unsigned int *height) {
+	unsigned long row_width = 0;
+	unsigned long max_width = 0;
+	unsigned long rows = 1;
+	char *end;
+	for (; repr[0] != '\0' && repr[0] != '!'; ++repr) {
+		if (repr[0] == '#') {
+			CHECK_NULL(repr = strchr(repr + 1, '\n'));
+		} else if (repr[0] == '$') {
+			++rows;
+			row_width = 0;
+		} else if (!isspace(repr[0])) {
+			unsigned long length = 1;
+			if ('1' <= repr[0] && repr[0] <= '9') {
+				length = strtoul(repr, &end, 10);
+				repr = end;
+			}
+			if ('p' <= repr[0] && repr[0] <= 'y') {
+				++repr;
+			}
+			if (repr[0] == '\0' || length > MAX_GRID_SIZE) {
+				return -__LINE__;
+			}
+			row_width += length;
+			max_width = row_width > max_width ? row_width : max_width;
+		}
+		if (max_width > MAX_GRID_SIZE || rows > MAX_GRID_SIZE) {
+			return -__LINE__;
+		}
+	}
+	*width = (unsigned int) max_width;
+	*height = (unsigned int) rows;
+	return 0;
+}
+
+int blit_grid_rle(struct grid *grid, const char *rle, long long row,
+                  long long col, enum blit_mode mode) {
+	struct grid pattern;
+	const char *body = rle;
+	while (body[0] == '#') {
+		CHECK_NULL(body = strchr(body + 1, '\n'));
+		++body;
+	}
+	unsigned int width;
+	unsigned int height;
+	if (sscanf(body, "x = %u, y = %u", &width, &height) == 2) {
+		CHECK_RC(load_grid(&pattern, rle, GRID_FORMAT_RLE, false));
+	} else {
+		CHECK_RC(_measure_rle(body, &width, &height));
+		CHECK_RC(init_grid(&pattern, width, height, false));
+		/* The states of the cells are those of the grid; an unknown rule
+		   leaves the pattern with two */
+		set_grid_rule(&pattern, grid->rule);
+		int rc = _init_cells_from_rle(&pattern, body);
+		if (rc < 0) {
+			free_grid(&pattern);
+			return rc;
+		}
+	}
+	blit_grid(grid, &pattern, row, col, mode);
+	free_grid(&pattern);
+	return 0;
+}
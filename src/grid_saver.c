@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "grid_saver.h"
+
+#include <stdlib.h> /* for free */
+
+#include "file_io.h" /* for write_file */
+#include "snapshot.h" /* for save_grid_snapshot, save_grid_checkpoint */
+#include "stringutils.h" /* for endswith */
+#include "timing.h" /* for START_TIMER, STOP_TIMER */
+#include "trace.h" /* for trace_begin, trace_end */
+#include "utils.h" /* for CHECK_NULL */
+
+
+
+enum grid_format guess_grid_format(const char *path) {
+	if (endswith(path, ".rle")) {
+		return GRID_FORMAT_RLE;
+	}
+	if (endswith(path, ".cells")) {
+		return GRID_FORMAT_PLAIN;
+	}
+	if (endswith(path, ".lif") || endswith(path, ".life")) {
+		return GRID_FORMAT_LIFE106;
+	}
+	if (endswith(path, ".mc")) {
+		return GRID_FORMAT_MACROCELL;
+	}
+	if (endswith(path, ".cysnap")) {
+		return GRID_FORMAT_SNAPSHOT;
+	}
+	if (endswith(path, ".cyckpt")) {
+		return GRID_FORMAT_CHECKPOINT;
+	}
+	return GRID_FORMAT_UNKNOWN;
+}
+
+
+static int _write_grid_file(const struct grid *grid, const char *path,
+                            enum grid_format format) {
+	if (format == GRID_FORMAT_SNAPSHOT) {
+		return save_grid_snapshot(grid, path);
+	}
+	if (format == GRID_FORMAT_CHECKPOINT) {
+		return save_grid_checkpoint(grid, path);
+	}
+	char *repr = get_grid_repr(grid, format);
+	CHECK_NULL(repr);
+	int rc = write_file(path, repr);
+	free(repr);
+	return rc;
+}
+
+int write_grid_file(const struct grid *grid, const char *path,
+                    enum grid_format format) {
+	START_TIMER(timer);
+	trace_begin("save");
+	int rc = _write_grid_file(grid, path, format);
+	trace_end("save");
+	STOP_TIMER(timer, PHASE_SAVE);
+	return rc;
+}
+
+
+void init_grid_saver(struct grid_saver *saver) {
+	saver->path = NULL;
+	saver->format = GRID_FORMAT_UNKNOWN;
+	saver->started = false;
+	atomic_init(&saver->status, SAVE_IDLE);
+}
+
+
+static int _save_grid(void *arg) {
+	struct grid_saver *saver = arg;
+	int rc = write_grid_file(&saver->snapshot, saver->path, saver->format);
+	free_grid(&saver->snapshot);
+	atomic_store(&saver->status, rc < 0 ? SAVE_FAILED : SAVE_DONE);
+	return rc;
+}
+
+static void _join_worker(struct grid_saver *saver) {
+	if (saver->started) {
+		thrd_join(saver->worker, NULL);
+		saver->started = false;
+	}
+}
+
+int start_grid_save(struct grid_saver *saver, const struct grid *grid,
+                    const char *path, enum grid_format format) {
+	if (atomic_load(&saver->status) == SAVE_RUNNING) {
+		return 1;
+	}
+	/* The previous worker, if any, is finished: reclaim its resources */
+	_join_worker(saver);
+	if (copy_grid(&saver->snapshot, grid) < 0) {
+		return -__LINE__;
+	}
+	saver->path = path;
+	saver->format = format;
+	atomic_store(&saver->status, SAVE_RUNNING);
+	if (thrd_create(&saver->worker, _save_grid, saver) != thrd_success) {
+		free_grid(&saver->snapshot);
+		atomic_store(&saver->status, SAVE_FAILED);
+		return -__LINE__;
+	}
+	saver->started = true;
+	return 0;
+}
+
+
+enum save_status poll_grid_save(struct grid_saver *saver) {
+	int status = SAVE_DONE;
+	/* Reset a finished state to idle so that it is reported only once */
+	if (atomic_compare_exchange_strong(&saver->status, &status, SAVE_IDLE)) {
+		return SAVE_DONE;
+	}
+	status = SAVE_FAILED;
+	if (atomic_compare_exchange_strong(&saver->status, &status, SAVE_IDLE)) {
+		return SAVE_FAILED;
+	}
+	return status;
+}
+
+
+enum save_status free_grid_saver(struct grid_saver *saver) {
+	_join_worker(saver);
+	return poll_grid_save(saver);
+}
@@ -1,10 +1,14 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
 #include "gridwindow.h"
 
-#include <stdint.h> /* for uint32_t */
+#include <limits.h> /* for INT_MAX */
+#include <stdint.h> /* for uint32_t, uint64_t */
+#include <stdio.h> /* for snprintf */
 #include <string.h> /* for strncpy */
 #include <SDL2/SDL_mouse.h> /* for SDL_GetMouseState */
 
+#include "timing.h" /* for get_phase_stats, get_phase_name */
+
 
 
 #ifdef USE_VSYNC
@@ -29,13 +33,23 @@ int init_grid_window(struct grid_window *grid_win, struct grid *grid,
 	grid_win->grid = grid;
 	grid_win->cell_pixels = cell_pixels;
 	grid_win->border_width = border_width;
-	unsigned int win_width = GRID_SIZE_TO_WIN_SIZE(grid_win, grid->width);
-	unsigned int win_height = GRID_SIZE_TO_WIN_SIZE(grid_win, grid->height);
+	grid_win->title = title;
+	uint64_t win_width = GRID_SIZE_TO_WIN_SIZE(grid_win,
+	                                           (uint64_t) grid->width);
+	uint64_t win_height = GRID_SIZE_TO_WIN_SIZE(grid_win,
+	                                            (uint64_t) grid->height);
+	if (win_width > INT_MAX || win_height > INT_MAX) {
+		/* The sizes of SDL are int: the grid can only be run headless */
+		strncpy(grid_win->error_msg, "The grid is too large to be displayed",
+		        sizeof grid_win->error_msg);
+		return -__LINE__;
+	}
 
 	Uint32 win_flags = SDL_WINDOW_SHOWN | SDL_WINDOW_MOUSE_FOCUS
 	                                    | SDL_WINDOW_INPUT_FOCUS;
 	grid_win->win = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED,
-	                           SDL_WINDOWPOS_CENTERED, win_width, win_height,
+	                           SDL_WINDOWPOS_CENTERED, (int) win_width,
+	                           (int) win_height,
 	                           win_flags);
 	if (grid_win->win == NULL) {
 		strncpy(grid_win->error_msg, SDL_GetError(),
@@ -50,6 +64,9 @@ int init_grid_window(struct grid_window *grid_win, struct grid *grid,
 	}
 	grid_win->sel_col = grid_win->sel_row = -1;
 	grid_win->error_msg[0] = '\0';
+#ifdef USE_TIMING
+	grid_win->show_timers = false;
+#endif
 
 	SDL_Surface *icon = SDL_CreateRGBSurfaceFrom(icon_data, ICONSIZE, ICONSIZE,
 	                                             32,
@@ -71,6 +88,18 @@ void free_grid_window(struct grid_window *grid_win) {
 }
 
 
+void set_grid_window_status(const struct grid_window *grid_win,
+                            const char *status) {
+	if (status == NULL) {
+		SDL_SetWindowTitle(grid_win->win, grid_win->title);
+		return;
+	}
+	char title[128];
+	snprintf(title, sizeof title, "%s [%s]", grid_win->title, status);
+	SDL_SetWindowTitle(grid_win->win, title);
+}
+
+
 static inline void _draw_cell(SDL_Renderer *ren, SDL_Rect *rect,
                              unsigned int row, unsigned int col,
                              unsigned int cell_width,
@@ -81,6 +110,91 @@ static inline void _draw_cell(SDL_Renderer *ren, SDL_Rect *rect,
 	SDL_RenderFillRect(ren, rect);
 }
 
+#ifdef USE_TIMING
+/* The size in pixels of the side of a pixel of the glyphs of the overlay */
+#define OVERLAY_SCALE 2
+
+/* The number of characters of a line of the overlay */
+#define OVERLAY_COLUMNS 32
+
+/* The glyphs of the characters of the overlay, three pixels wide and five
+   high, each row of pixels an octal digit from the top, the left pixel the
+   highest bit */
+static const unsigned int DIGIT_GLYPHS[] = {
+	075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757,
+	075717
+};
+static const unsigned int LETTER_GLYPHS[] = {
+	025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227,
+	011152, 055655, 044447, 057755, 065555, 025552, 065644, 025563, 065655,
+	034216, 072222, 055557, 055552, 055775, 055255, 055222, 071247
+};
+
+static unsigned int _get_glyph(char ch) {
+	if (ch >= '0' && ch <= '9') {
+		return DIGIT_GLYPHS[ch - '0'];
+	} else if (ch >= 'A' && ch <= 'Z') {
+		return LETTER_GLYPHS[ch - 'A'];
+	} else if (ch >= 'a' && ch <= 'z') {
+		return LETTER_GLYPHS[ch - 'a'];
+	} else if (ch == '.') {
+		return 000002;
+	}
+	return 0;
+}
+
+static void _draw_text(SDL_Renderer *ren, const char *text, int x, int y) {
+	SDL_Rect pixel = {0, 0, OVERLAY_SCALE, OVERLAY_SCALE};
+	for (; *text != '\0'; ++text, x += 4 * OVERLAY_SCALE) {
+		unsigned int glyph = _get_glyph(*text);
+		for (int i = 0; i < 15; ++i) {
+			if ((glyph >> (14 - i) & 1) != 0) {
+				pixel.x = x + i % 3 * OVERLAY_SCALE;
+				pixel.y = y + i / 3 * OVERLAY_SCALE;
+				SDL_RenderFillRect(ren, &pixel);
+			}
+		}
+	}
+}
+
+/* Write a duration given in nanoseconds with its unit */
+static void _format_duration(char *buffer, size_t size, uint64_t duration) {
+	if (duration < 1000) {
+		snprintf(buffer, size, "%uns", (unsigned int) duration);
+	} else if (duration < 1000000) {
+		snprintf(buffer, size, "%.1fus", duration / 1e3);
+	} else if (duration < 1000000000) {
+		snprintf(buffer, size, "%.1fms", duration / 1e6);
+	} else {
+		snprintf(buffer, size, "%.2fs", duration / 1e9);
+	}
+}
+
+/* Draw the median and 99th percentile of the durations of each phase in the
+   top left corner of the window */
+static void _draw_timers(SDL_Renderer *ren) {
+	SDL_Rect panel = {0, 0, (4 * OVERLAY_COLUMNS + 3) * OVERLAY_SCALE,
+	                  (7 * NB_PHASES + 3) * OVERLAY_SCALE};
+	SDL_SetRenderDrawColor(ren, 0, 0, 0, 191);
+	SDL_RenderFillRect(ren, &panel);
+	SDL_SetRenderDrawColor(ren, 255, 255, 0, 255);
+	for (int phase = 0; phase < NB_PHASES; ++phase) {
+		struct phase_stats stats;
+		get_phase_stats(phase, &stats);
+		char p50[16];
+		char p99[16];
+		_format_duration(p50, sizeof p50, stats.p50);
+		_format_duration(p99, sizeof p99, stats.p99);
+		/* The fields are bounded to fill the columns at most */
+		char line[OVERLAY_COLUMNS + 1];
+		snprintf(line, sizeof line, "%-6.6s p50 %-8.8s p99 %.8s",
+		         get_phase_name(phase), p50, p99);
+		_draw_text(ren, line, 2 * OVERLAY_SCALE,
+		           (2 + 7 * phase) * OVERLAY_SCALE);
+	}
+}
+#endif
+
 void render_grid_window(const struct grid_window *grid_win) {
 	unsigned int grid_width = grid_win->grid->width;
 	unsigned int grid_height = grid_win->grid->height;
@@ -99,7 +213,15 @@ void render_grid_window(const struct grid_window *grid_win) {
 	};
 	for (unsigned int row = 0; row < grid_height; ++row) {
 		for (unsigned int col = 0; col < grid_width; ++col) {
-			uint8_t ch = cell_color[get_grid_cell(grid_win->grid, row, col)];
+			unsigned int state = get_grid_cell_state(grid_win->grid, row, col);
+			uint8_t ch;
+			if (state <= ALIVE) {
+				ch = cell_color[state];
+			} else {
+				/* The dying cells fade out from black to white */
+				ch = (uint8_t) (255 * (state - 1)
+				                / (grid_win->grid->states - 1));
+			}
 			_draw_cell(grid_win->ren, &rect, row, col, cell_width,
 					   border_width, (SDL_Color) {ch, ch, ch, 255});
 		}
@@ -109,6 +231,11 @@ void render_grid_window(const struct grid_window *grid_win) {
 		_draw_cell(grid_win->ren, &rect, grid_win->sel_row, grid_win->sel_col,
 		           cell_width, border_width, (SDL_Color) {127, 127, 127, 127});
 	}
+#ifdef USE_TIMING
+	if (grid_win->show_timers) {
+		_draw_timers(grid_win->ren);
+	}
+#endif
 	SDL_RenderPresent(grid_win->ren);
 }
 
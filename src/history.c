@@ -0,0 +1,347 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "history.h"
+
+#include <stdlib.h> /* for malloc, realloc, free */
+#include <stdint.h> /* for uint64_t */
+#include <string.h> /* for memcpy, memset, strcmp */
+
+#include "bits.h" /* for is_blank, pack_bits, unpack_bits, PACKED_SIZE_MAX */
+#include "mathutils.h" /* for MIN */
+#include "utils.h" /* for CHECK_NULL, CHECK_RC */
+
+
+
+/* The size of the header of a compressed tile: its index and the size of its
+   compressed bytes */
+#define TILE_HEADER_SIZE (2 * sizeof(size_t))
+
+
+void init_history(struct history *history, size_t budget) {
+	history->budget = budget;
+	history->used = 0;
+	history->entries = NULL;
+	history->capacity = 0;
+	history->first = 0;
+	history->count = 0;
+	history->position = 0;
+	history->recorded = 0;
+}
+
+
+static struct history_entry *_get_entry(const struct history *history,
+                                        size_t index) {
+	return &history->entries[(history->first + index) % history->capacity];
+}
+
+/* Whether the bit planes of the grids can be compared, and the grids evolve
+   alike. The live cells may be stored inverted in one and not in the other,
+   as the B0 rules alternate between both */
+static bool _same_layout(const struct grid *grid1, const struct grid *grid2) {
+	return grid1->width == grid2->width && grid1->height == grid2->height
+	       && grid1->stride == grid2->stride && grid1->states == grid2->states
+	       && grid1->wrap == grid2->wrap
+	       && strcmp(grid1->rule, grid2->rule) == 0;
+}
+
+/* Write the difference of a tile of the cells with that of the base, and
+   bring the tile of the base up to date, all in one pass: give whether the
+   tile changed */
+static bool _diff_tile(const char *cells, char *base, size_t size,
+                       unsigned char *diff) {
+	uint64_t changed = 0;
+	size_t i = 0;
+	for (; i + sizeof changed <= size; i += sizeof changed) {
+		uint64_t word;
+		uint64_t base_word;
+		memcpy(&word, &cells[i], sizeof word);
+		memcpy(&base_word, &base[i], sizeof base_word);
+		memcpy(&base[i], &word, sizeof word);
+		word ^= base_word;
+		memcpy(&diff[i], &word, sizeof word);
+		changed |= word;
+	}
+	for (; i < size; ++i) {
+		diff[i] = (unsigned char) (cells[i] ^ base[i]);
+		base[i] = cells[i];
+		changed |= diff[i];
+	}
+	return changed != 0;
+}
+
+/* Compress the tiles of the cells as the difference with those of the base,
+   skipping the unchanged ones, and copy the cells to the base; or if there is
+   no base, compress the cells themselves, skipping the blank ones. Each tile
+   is stored as its header followed by its compressed bytes */
+static int _pack_tiles(const char *cells, char *base, size_t size,
+                       unsigned char **data, size_t *data_size) {
+	unsigned char diff[HISTORY_TILE_SIZE];
+	unsigned char *packed = NULL;
+	size_t capacity = 0;
+	size_t pos = 0;
+	for (size_t offset = 0; offset < size; offset += HISTORY_TILE_SIZE) {
+		size_t tile_size = MIN(HISTORY_TILE_SIZE, size - offset);
+		const unsigned char *tile = (const unsigned char*) &cells[offset];
+		if (base == NULL) {
+			if (is_blank(&cells[offset], tile_size)) {
+				continue;
+			}
+		} else {
+			if (!_diff_tile(&cells[offset], &base[offset], tile_size, diff)) {
+				continue;
+			}
+			tile = diff;
+		}
+		if (pos + TILE_HEADER_SIZE + PACKED_SIZE_MAX(tile_size) > capacity) {
+			capacity = 2 * capacity + TILE_HEADER_SIZE
+			           + PACKED_SIZE_MAX(HISTORY_TILE_SIZE);
+			unsigned char *grown = realloc(packed, capacity);
+			if (grown == NULL) {
+				free(packed);
+				return -__LINE__;
+			}
+			packed = grown;
+		}
+		size_t index = offset / HISTORY_TILE_SIZE;
+		size_t packed_size = pack_bits(tile, tile_size,
+		                               &packed[pos + TILE_HEADER_SIZE]);
+		memcpy(&packed[pos], &index, sizeof index);
+		memcpy(&packed[pos + sizeof index], &packed_size, sizeof packed_size);
+		pos += TILE_HEADER_SIZE + packed_size;
+	}
+	if (pos > 0 && pos < capacity) {
+		/* Give back the room left for the incompressible tiles */
+		unsigned char *shrunk = realloc(packed, pos);
+		if (shrunk != NULL) {
+			packed = shrunk;
+		}
+	}
+	*data = packed;
+	*data_size = pos;
+	return 0;
+}
+
+/* Decompress the tiles of a difference into the cells, or of a whole state
+   if diff is false */
+static int _unpack_tiles(const unsigned char *data, size_t data_size,
+                         char *cells, size_t size, bool diff) {
+	unsigned char tile[HISTORY_TILE_SIZE];
+	if (!diff) {
+		memset(cells, 0, size);
+	}
+	for (size_t pos = 0; pos < data_size;) {
+		size_t index;
+		size_t packed_size;
+		memcpy(&index, &data[pos], sizeof index);
+		memcpy(&packed_size, &data[pos + sizeof index], sizeof packed_size);
+		pos += TILE_HEADER_SIZE;
+		size_t offset = index * HISTORY_TILE_SIZE;
+		size_t tile_size = MIN(HISTORY_TILE_SIZE, size - offset);
+		unsigned char *dest = diff ? tile : (unsigned char*) &cells[offset];
+		CHECK_RC(unpack_bits(&data[pos], packed_size, dest, tile_size));
+		pos += packed_size;
+		if (diff) {
+			for (size_t i = 0; i < tile_size; ++i) {
+				cells[offset + i] ^= tile[i];
+			}
+		}
+	}
+	return 0;
+}
+
+/* Write the bit planes of the recorded state of the given index in the
+   cells, which may be those of the copy of the latest state. The live cells
+   are written as they were stored, inverted or not as in the entry */
+static int _rebuild_state(const struct history *history, size_t index,
+                          char *cells) {
+	size_t size = get_grid_data_size(&history->latest);
+	size_t latest = history->count - 1;
+	/* Start from the nearest keyframe before the state, if it is nearer than
+	   the latest state */
+	size_t keyframe = index;
+	while (!_get_entry(history, keyframe)->keyframe && keyframe > 0
+	       && index - keyframe < latest - index) {
+		--keyframe;
+	}
+	const struct history_entry *entry = _get_entry(history, keyframe);
+	if (entry->keyframe && index - keyframe < latest - index) {
+		CHECK_RC(_unpack_tiles(entry->state, entry->state_size, cells, size,
+		                       false));
+		for (size_t i = keyframe + 1; i <= index; ++i) {
+			entry = _get_entry(history, i);
+			CHECK_RC(_unpack_tiles(entry->delta, entry->delta_size, cells,
+			                       size, true));
+		}
+		return 0;
+	}
+	if (cells != history->latest.cells) {
+		memcpy(cells, history->latest.cells, size);
+	}
+	for (size_t i = latest; i > index; --i) {
+		entry = _get_entry(history, i);
+		CHECK_RC(_unpack_tiles(entry->delta, entry->delta_size, cells, size,
+		                       true));
+	}
+	return 0;
+}
+
+
+static void _drop_delta(struct history *history,
+                        struct history_entry *entry) {
+	history->used -= entry->delta_size;
+	free(entry->delta);
+	entry->delta = NULL;
+	entry->delta_size = 0;
+}
+
+static void _drop_entry(struct history *history,
+                        struct history_entry *entry) {
+	_drop_delta(history, entry);
+	history->used -= sizeof *entry + entry->state_size;
+	free(entry->state);
+}
+
+static void _clear_history(struct history *history) {
+	if (history->count == 0) {
+		return;
+	}
+	for (size_t i = 0; i < history->count; ++i) {
+		_drop_entry(history, _get_entry(history, i));
+	}
+	free_grid(&history->latest);
+	history->first = 0;
+	history->count = 0;
+	history->position = 0;
+}
+
+/* Make room for one more entry in the ring, unrolling it at the start of the
+   new array */
+static int _grow_entries(struct history *history) {
+	size_t capacity = history->capacity > 0 ? 2 * history->capacity : 64;
+	struct history_entry *entries = malloc(capacity * sizeof *entries);
+	CHECK_NULL(entries);
+	for (size_t i = 0; i < history->count; ++i) {
+		entries[i] = *_get_entry(history, i);
+	}
+	free(history->entries);
+	history->entries = entries;
+	history->capacity = capacity;
+	history->first = 0;
+	return 0;
+}
+
+/* Add the entry of the grid, as the difference with the latest state if
+   there is one, then make it the latest state */
+static int _add_entry(struct history *history, const struct grid *grid) {
+	if (history->count == history->capacity) {
+		CHECK_RC(_grow_entries(history));
+	}
+	struct history_entry entry = {grid->generation, grid->inverted, NULL, 0,
+	                              false, NULL, 0};
+	size_t size = get_grid_data_size(grid);
+	if (history->count > 0) {
+		/* The copy of the latest state is brought up to date as well */
+		CHECK_RC(_pack_tiles(grid->cells, history->latest.cells, size,
+		                     &entry.delta, &entry.delta_size));
+		history->latest.generation = grid->generation;
+		history->latest.inverted = grid->inverted;
+	}
+	if (history->recorded % HISTORY_KEYFRAME_INTERVAL == 0) {
+		entry.keyframe = true;
+		if (_pack_tiles(grid->cells, NULL, size, &entry.state,
+		                &entry.state_size) < 0) {
+			free(entry.delta);
+			return -__LINE__;
+		}
+	}
+	*_get_entry(history, history->count) = entry;
+	history->position = history->count++;
+	history->used += sizeof entry + entry.delta_size + entry.state_size;
+	++history->recorded;
+	return 0;
+}
+
+int record_history(struct history *history, const struct grid *grid) {
+	if (history->budget == 0) {
+		return 0;
+	}
+	if (history->count > 0 && !_same_layout(&history->latest, grid)) {
+		_clear_history(history);
+	}
+	if (history->count == 0) {
+		CHECK_RC(copy_grid(&history->latest, grid));
+		/* The copy is never updated */
+		history->latest.workers = 0;
+		history->recorded = 0;
+		int rc = _add_entry(history, grid);
+		if (rc < 0) {
+			free_grid(&history->latest);
+		}
+		return rc;
+	}
+	int rc = 0;
+	if (history->position < history->count - 1) {
+		/* Drop the states after the one stepped back to, from which the new
+		   one follows */
+		rc = _rebuild_state(history, history->position,
+		                    history->latest.cells);
+		history->latest.inverted = _get_entry(history,
+		                                      history->position)->inverted;
+		while (history->count - 1 > history->position) {
+			_drop_entry(history, _get_entry(history, --history->count));
+		}
+	}
+	if (rc == 0) {
+		rc = _add_entry(history, grid);
+	}
+	if (rc < 0) {
+		_clear_history(history);
+		return rc;
+	}
+	/* Drop the oldest states, the difference from which to the next one is
+	   then useless */
+	while (history->used > history->budget && history->count > 1) {
+		_drop_entry(history, _get_entry(history, 0));
+		history->first = (history->first + 1) % history->capacity;
+		--history->count;
+		--history->position;
+		_drop_delta(history, _get_entry(history, 0));
+	}
+	return 0;
+}
+
+
+int seek_history(struct history *history, long offset, struct grid *grid) {
+	if (history->count == 0) {
+		return 1;
+	}
+	size_t target = history->position;
+	unsigned long steps = offset < 0 ? 0UL - (unsigned long) offset
+	                                 : (unsigned long) offset;
+	if (offset < 0) {
+		target -= MIN(steps, history->position);
+	} else {
+		target += MIN(steps, history->count - 1 - history->position);
+	}
+	if (target == history->position) {
+		return 1;
+	}
+	if (!_same_layout(grid, &history->latest)) {
+		CHECK_RC(restore_grid(grid, &history->latest));
+	}
+	bool inverted = grid->inverted;
+	CHECK_RC(_rebuild_state(history, target, grid->cells));
+	/* The state was stored inverted or not regardless of the grid */
+	grid->inverted = _get_entry(history, target)->inverted;
+	set_grid_inverted(grid, inverted);
+	grid->generation = _get_entry(history, target)->generation;
+	history->position = target;
+	return 0;
+}
+
+
+void free_history(struct history *history) {
+	_clear_history(history);
+	free(history->entries);
+	history->entries = NULL;
+	history->capacity = 0;
+}
@@ -0,0 +1,473 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "macrocell.h"
+
+#include <stdint.h> /* for uint32_t, uint64_t */
+#include <stdio.h> /* for sscanf */
+#include <stdlib.h> /* for malloc, calloc, realloc, free */
+#include <string.h> /* for memcmp, memcpy, memset, strchr, strcspn, strncmp */
+
+#include "bits.h" /* for get_bit, set_bit */
+#include "mathutils.h" /* for MIN */
+#include "stringutils.h" /* for struct string_builder, append_format */
+#include "utils.h" /* for CHECK_RC */
+
+
+
+/* The level of the leaves, squares of 8 by 8 cells */
+#define LEAF_LEVEL 3
+
+/* The highest level of a node, so that the coordinates fit in 64 bits */
+#define MAX_LEVEL 63
+
+static const char HEADER[] = "[M2]";
+
+
+/* A node of the quadtree. The empty node, of any level, has index 0 */
+struct _node {
+	unsigned int level;
+	/* The north-west, north-east, south-west and south-east children, for a
+	   node above LEAF_LEVEL */
+	uint32_t children[4];
+	/* The cells of a leaf, the row r and column c at bit 63 - (8 * r + c) */
+	uint64_t leaf;
+	/* The bounding box of the live cells, relative to the node */
+	uint64_t min_x;
+	uint64_t min_y;
+	uint64_t max_x;
+	uint64_t max_y;
+};
+
+/* A hash-consed set of nodes */
+struct _tree {
+	struct _node *nodes;
+	uint32_t nb_nodes;
+	uint32_t capacity;
+	/* The open-addressing hash table of the nodes, 0 marks a free slot */
+	uint32_t *table;
+	uint32_t table_size;
+};
+
+
+static int _init_tree(struct _tree *tree) {
+	tree->capacity = 64;
+	tree->nodes = calloc(tree->capacity, sizeof *tree->nodes);
+	CHECK_NULL(tree->nodes);
+	tree->nb_nodes = 1; /* The empty node */
+	tree->table_size = 2 * tree->capacity;
+	tree->table = calloc(tree->table_size, sizeof *tree->table);
+	if (tree->table == NULL) {
+		free(tree->nodes);
+		return -__LINE__;
+	}
+	return 0;
+}
+
+static void _free_tree(struct _tree *tree) {
+	free(tree->nodes);
+	free(tree->table);
+}
+
+static uint32_t _hash_node(const struct _node *node) {
+	uint64_t hash = node->level ^ node->leaf;
+	for (int i = 0; i < 4; ++i) {
+		hash = (hash ^ node->children[i]) * UINT64_C(0x9E3779B97F4A7C15);
+		hash ^= hash >> 32;
+	}
+	return (uint32_t) hash;
+}
+
+static bool _same_node(const struct _node *node1, const struct _node *node2) {
+	return node1->level == node2->level && node1->leaf == node2->leaf
+	       && memcmp(node1->children, node2->children,
+	                 sizeof node1->children) == 0;
+}
+
+static void _insert_in_table(struct _tree *tree, uint32_t index) {
+	uint32_t mask = tree->table_size - 1;
+	uint32_t slot = _hash_node(&tree->nodes[index]) & mask;
+	while (tree->table[slot] != 0) {
+		slot = (slot + 1) & mask;
+	}
+	tree->table[slot] = index;
+}
+
+static int _grow_tree(struct _tree *tree) {
+	if (tree->capacity > UINT32_MAX / 4) {
+		return -__LINE__;
+	}
+	struct _node *nodes = realloc(tree->nodes,
+	                              2 * tree->capacity * sizeof *nodes);
+	CHECK_NULL(nodes);
+	tree->nodes = nodes;
+	tree->capacity *= 2;
+	uint32_t *table = calloc(2 * tree->capacity, sizeof *table);
+	CHECK_NULL(table);
+	free(tree->table);
+	tree->table = table;
+	tree->table_size = 2 * tree->capacity;
+	for (uint32_t i = 1; i < tree->nb_nodes; ++i) {
+		_insert_in_table(tree, i);
+	}
+	return 0;
+}
+
+static void _set_leaf_bounds(struct _node *node) {
+	node->min_x = node->min_y = 7;
+	node->max_x = node->max_y = 0;
+	for (unsigned int i = 0; i < 64; ++i) {
+		if ((node->leaf >> (63 - i) & 1) != 0) {
+			uint64_t row = i / 8;
+			uint64_t col = i % 8;
+			node->min_x = MIN(node->min_x, col);
+			node->min_y = MIN(node->min_y, row);
+			if (col > node->max_x) {
+				node->max_x = col;
+			}
+			if (row > node->max_y) {
+				node->max_y = row;
+			}
+		}
+	}
+}
+
+static void _set_node_bounds(const struct _tree *tree, struct _node *node) {
+	uint64_t half = (uint64_t) 1 << (node->level - 1);
+	bool first = true;
+	for (int i = 0; i < 4; ++i) {
+		if (node->children[i] == 0) {
+			continue;
+		}
+		const struct _node *child = &tree->nodes[node->children[i]];
+		uint64_t x = (i & 1) * half;
+		uint64_t y = (i >> 1) * half;
+		if (first || child->min_x + x < node->min_x) {
+			node->min_x = child->min_x + x;
+		}
+		if (first || child->min_y + y < node->min_y) {
+			node->min_y = child->min_y + y;
+		}
+		if (first || child->max_x + x > node->max_x) {
+			node->max_x = child->max_x + x;
+		}
+		if (first || child->max_y + y > node->max_y) {
+			node->max_y = child->max_y + y;
+		}
+		first = false;
+	}
+}
+
+/* Find the node identical to the given one, or add it to the tree. The index
+   of the node is stored in index; an empty node always has index 0 */
+static int _intern_node(struct _tree *tree, struct _node *node,
+                        uint32_t *index) {
+	if (node->leaf == 0 && node->children[0] == 0 && node->children[1] == 0
+	    && node->children[2] == 0 && node->children[3] == 0) {
+		*index = 0;
+		return 0;
+	}
+	uint32_t mask = tree->table_size - 1;
+	uint32_t slot = _hash_node(node) & mask;
+	for (; tree->table[slot] != 0; slot = (slot + 1) & mask) {
+		if (_same_node(&tree->nodes[tree->table[slot]], node)) {
+			*index = tree->table[slot];
+			return 0;
+		}
+	}
+	if (node->level == LEAF_LEVEL) {
+		_set_leaf_bounds(node);
+	} else {
+		_set_node_bounds(tree, node);
+	}
+	if (tree->nb_nodes == tree->capacity) {
+		CHECK_RC(_grow_tree(tree));
+	}
+	*index = tree->nb_nodes++;
+	tree->nodes[*index] = *node;
+	_insert_in_table(tree, *index);
+	return 0;
+}
+
+
+static int _parse_leaf(const char *line, size_t length, struct _node *node) {
+	unsigned int row = 0;
+	unsigned int col = 0;
+	node->level = LEAF_LEVEL;
+	for (size_t i = 0; i < length; ++i) {
+		switch (line[i]) {
+			case '*':
+				if (row >= 8 || col >= 8) {
+					return -__LINE__;
+				}
+				node->leaf |= UINT64_C(1) << (63 - (8 * row + col));
+			/* fall through */
+			case '.':
+				++col;
+				break;
+			case '$':
+				++row;
+				col = 0;
+				break;
+			case '\r':
+				break;
+			default:
+				return -__LINE__;
+		}
+	}
+	return 0;
+}
+
+static int _parse_node(const char *line, const uint32_t *indices,
+                       uint32_t nb_indices, const struct _tree *tree,
+                       struct _node *node) {
+	unsigned long children[4];
+	if (sscanf(line, "%u %lu %lu %lu %lu", &node->level, &children[0],
+	           &children[1], &children[2], &children[3]) != 5
+	    || node->level <= LEAF_LEVEL || node->level > MAX_LEVEL) {
+		return -__LINE__;
+	}
+	for (int i = 0; i < 4; ++i) {
+		/* A node can only refer to the nodes defined before it */
+		if (children[i] >= nb_indices) {
+			return -__LINE__;
+		}
+		node->children[i] = indices[children[i]];
+		if (node->children[i] != 0
+		    && tree->nodes[node->children[i]].level != node->level - 1) {
+			return -__LINE__;
+		}
+	}
+	return 0;
+}
+
+/* Read the node definitions; the index in the tree of the node numbered n in
+   the file is stored in (*indices)[n] */
+static int _parse_nodes(const char *repr, struct grid *grid,
+                        struct _tree *tree, uint32_t **indices,
+                        uint32_t *nb_indices) {
+	uint32_t capacity = 64;
+	*indices = malloc(capacity * sizeof **indices);
+	CHECK_NULL(*indices);
+	(*indices)[0] = 0;
+	*nb_indices = 1;
+	for (; repr != NULL && repr[0] != '\0'; repr = strchr(repr, '\n')) {
+		if (repr[0] == '\n') {
+			++repr;
+		}
+		size_t length = strcspn(repr, "\n");
+		struct _node node = {0};
+		if (strncmp(repr, "#R", 2) == 0) {
+			sscanf(repr + 2, "%63s", grid->rule);
+			continue;
+		} else if (strncmp(repr, "#G", 2) == 0) {
+			unsigned long long generation;
+			if (sscanf(repr + 2, "%llu", &generation) == 1) {
+				grid->generation = generation;
+			}
+			continue;
+		} else if (repr[0] == '#' || length == 0
+		           || (length == 1 && repr[0] == '\r')) {
+			continue;
+		} else if (repr[0] == '.' || repr[0] == '*' || repr[0] == '$') {
+			CHECK_RC(_parse_leaf(repr, length, &node));
+		} else {
+			CHECK_RC(_parse_node(repr, *indices, *nb_indices, tree, &node));
+		}
+		if (*nb_indices == capacity) {
+			uint32_t *new_indices = realloc(*indices,
+			                                2 * capacity * sizeof **indices);
+			CHECK_NULL(new_indices);
+			*indices = new_indices;
+			capacity *= 2;
+		}
+		CHECK_RC(_intern_node(tree, &node, &(*indices)[*nb_indices]));
+		++*nb_indices;
+	}
+	return 0;
+}
+
+static void _paint_node(const struct _tree *tree, uint32_t index, uint64_t x,
+                        uint64_t y, struct grid *grid, uint64_t origin_x,
+                        uint64_t origin_y) {
+	if (index == 0) {
+		return;
+	}
+	const struct _node *node = &tree->nodes[index];
+	if (node->level == LEAF_LEVEL) {
+		for (unsigned int i = 0; i < 64; ++i) {
+			if ((node->leaf >> (63 - i) & 1) != 0) {
+				size_t row = y + i / 8 - origin_y;
+				size_t col = x + i % 8 - origin_x;
+				set_bit(grid->cells, row * grid->stride + col, 1);
+			}
+		}
+		return;
+	}
+	uint64_t half = (uint64_t) 1 << (node->level - 1);
+	for (int i = 0; i < 4; ++i) {
+		_paint_node(tree, node->children[i], x + (i & 1) * half,
+		            y + (i >> 1) * half, grid, origin_x, origin_y);
+	}
+}
+
+static int _build_grid(struct grid *grid, const struct _tree *tree,
+                       uint32_t root, bool wrap) {
+	char rule[sizeof grid->rule];
+	uint64_t generation = grid->generation;
+	memcpy(rule, grid->rule, sizeof rule);
+	if (root == 0) {
+		CHECK_RC(init_grid(grid, 1, 1, wrap));
+	} else {
+		const struct _node *node = &tree->nodes[root];
+		uint64_t width = node->max_x - node->min_x + 1;
+		uint64_t height = node->max_y - node->min_y + 1;
+		/* The pattern must fit in the flat storage of the grid */
+		if (width > MAX_GRID_SIZE || height > MAX_GRID_SIZE) {
+			return -__LINE__;
+		}
+		CHECK_RC(init_grid(grid, (unsigned int) width, (unsigned int) height,
+		                   wrap));
+		_paint_node(tree, root, 0, 0, grid, node->min_x, node->min_y);
+	}
+	memcpy(grid->rule, rule, sizeof rule);
+	grid->generation = generation;
+	return 0;
+}
+
+int load_grid_macrocell(struct grid *grid, const char *repr, bool wrap) {
+	if (strncmp(repr, HEADER, sizeof HEADER - 1) != 0) {
+		return 1;
+	}
+	struct _tree tree;
+	CHECK_RC(_init_tree(&tree));
+	uint32_t *indices = NULL;
+	uint32_t nb_indices = 0;
+	memset(grid->rule, 0, sizeof grid->rule);
+	grid->generation = 0;
+	int rc = _parse_nodes(strchr(repr, '\n'), grid, &tree, &indices,
+	                      &nb_indices);
+	if (rc == 0) {
+		/* The root is the last node defined */
+		rc = _build_grid(grid, &tree, indices[nb_indices - 1], wrap);
+	}
+	free(indices);
+	_free_tree(&tree);
+	return rc;
+}
+
+
+static int _append_leaf(struct string_builder *builder, uint64_t leaf) {
+	char line[8 * 9 + 2];
+	size_t length = 0;
+	/* Omit the empty rows at the end of the leaf */
+	for (unsigned int row = 0; row < 8 && leaf << 8 * row != 0; ++row) {
+		unsigned int bits = leaf >> (56 - 8 * row) & 0xFF;
+		/* Omit the dead cells at the end of the row */
+		for (unsigned int col = 0; bits << col & 0xFF; ++col) {
+			line[length++] = (bits << col & 0x80) != 0 ? '*' : '.';
+		}
+		line[length++] = '$';
+	}
+	line[length++] = '\n';
+	line[length] = '\0';
+	return append_format(builder, "%s", line);
+}
+
+static uint64_t _get_leaf(const struct grid *grid, unsigned int x,
+                          unsigned int y) {
+	uint64_t leaf = 0;
+	for (unsigned int row = 0; row < 8 && y + row < grid->height; ++row) {
+		size_t offset = (y + row) * grid->stride;
+		for (unsigned int col = 0; col < 8 && x + col < grid->width; ++col) {
+			if (get_bit(grid->cells, offset + x + col)) {
+				leaf |= UINT64_C(1) << (63 - (8 * row + col));
+			}
+		}
+	}
+	return leaf;
+}
+
+/* Build the quadtree of the grid, from the leaves to the root */
+static int _build_tree(const struct grid *grid, struct _tree *tree,
+                       uint32_t *root) {
+	size_t cols = (grid->width + 7) / 8;
+	size_t rows = (grid->height + 7) / 8;
+	uint32_t *blocks = malloc(cols * rows * sizeof *blocks);
+	CHECK_NULL(blocks);
+	int rc = 0;
+	for (size_t i = 0; rc == 0 && i < cols * rows; ++i) {
+		struct _node node = {.level = LEAF_LEVEL};
+		node.leaf = _get_leaf(grid, (i % cols) * 8, (i / cols) * 8);
+		rc = _intern_node(tree, &node, &blocks[i]);
+	}
+	/* Group the blocks by squares of two by two to build the next level. The
+	   blocks array can be updated in place, since the parent of a block is
+	   always stored before it */
+	unsigned int level = LEAF_LEVEL;
+	while (rc == 0 && (cols > 1 || rows > 1)) {
+		++level;
+		size_t parent_cols = (cols + 1) / 2;
+		size_t parent_rows = (rows + 1) / 2;
+		for (size_t i = 0; rc == 0 && i < parent_cols * parent_rows; ++i) {
+			size_t col = (i % parent_cols) * 2;
+			size_t row = (i / parent_cols) * 2;
+			struct _node node = {.level = level};
+			for (int j = 0; j < 4; ++j) {
+				size_t child_col = col + (j & 1);
+				size_t child_row = row + (j >> 1);
+				if (child_col < cols && child_row < rows) {
+					node.children[j] = blocks[child_row * cols + child_col];
+				}
+			}
+			rc = _intern_node(tree, &node, &blocks[i]);
+		}
+		cols = parent_cols;
+		rows = parent_rows;
+	}
+	*root = blocks[0];
+	free(blocks);
+	return rc;
+}
+
+char *get_grid_macrocell(const struct grid *grid) {
+	struct _tree tree;
+	if (_init_tree(&tree) < 0) {
+		return NULL;
+	}
+	uint32_t root;
+	struct string_builder builder;
+	int rc = init_string_builder(&builder, 256);
+	if (rc == 0) {
+		rc = _build_tree(grid, &tree, &root);
+	}
+	if (rc == 0) {
+		rc = append_format(&builder, "%s (cyano)\n", HEADER);
+	}
+	if (rc == 0 && grid->rule[0] != '\0') {
+		rc = append_format(&builder, "#R %s\n", grid->rule);
+	}
+	if (rc == 0 && grid->generation != 0) {
+		rc = append_format(&builder, "#G %llu\n",
+		                   (unsigned long long) grid->generation);
+	}
+	/* The nodes are numbered in their order of creation, in which children
+	   always precede their parents, and the root comes last */
+	for (uint32_t i = 1; rc == 0 && i < tree.nb_nodes; ++i) {
+		const struct _node *node = &tree.nodes[i];
+		if (node->level == LEAF_LEVEL) {
+			rc = _append_leaf(&builder, node->leaf);
+		} else {
+			rc = append_format(&builder, "%u %lu %lu %lu %lu\n",
+			                   node->level,
+			                   (unsigned long) node->children[0],
+			                   (unsigned long) node->children[1],
+			                   (unsigned long) node->children[2],
+			                   (unsigned long) node->children[3]);
+		}
+	}
+	_free_tree(&tree);
+	if (rc < 0) {
+		free(builder.data);
+		return NULL;
+	}
+	return builder.data;
+}
@@ -1,25 +1,27 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
+#include <stdint.h> /* for SIZE_MAX */
 #include <stdio.h> /* for fprintf, stderr, fputs */
 #include <stdlib.h> /* for EXIT_*, free */
-#include <string.h> /* for strlen, strnlen, memcmp */
 
 #include "app.h"
+#include "checkpoint.h"
+#include "control.h"
 #include "grid.h"
+#include "grid_saver.h" /* for write_grid_file, guess_grid_format */
 #include "gridwindow.h"
 #include "file_io.h"
+#include "history.h" /* for DEFAULT_HISTORY_BUDGET */
+#include "mathutils.h" /* for mul_size */
+#include "metrics.h"
+#include "rules.h" /* for free_rules */
+#include "snapshot.h"
+#include "stats_writer.h" /* for DEFAULT_STATS_EVERY */
 #include "stringutils.h"
+#include "timing.h" /* for START_TIMER, STOP_TIMER, PRINT_TIMERS */
+#include "trace.h"
 
 
 
-static inline enum grid_format _guess_format_from_ext(const char *fpath) {
-	if (endswith(fpath, ".rle")) {
-		return GRID_FORMAT_RLE;
-	}
-	if (endswith(fpath, ".cells")) {
-		return GRID_FORMAT_PLAIN;
-	}
-	return GRID_FORMAT_UNKNOWN;
-}
 const char WINDOW_TITLE[] = "Cyano - Game of Life";
 
 
@@ -31,14 +33,19 @@ int main(int argc, char **argv) {
 	unsigned int update_rate = DEFAULT_UPDATE_RATE;
 	unsigned int border_width = DEFAULT_BORDER_WIDTH;
 	bool wrap = false;
-	const char *game_rule = DEFAULT_GRID_RULE;
+	const char *game_rule = NULL;
 	const char *in_file = NULL;
 	const char *out_file = NULL;
 	enum grid_format format = GRID_FORMAT_UNKNOWN;
+	struct run_options options = {0};
+	options.history = DEFAULT_HISTORY_BUDGET;
+	options.stats_every = DEFAULT_STATS_EVERY;
+	options.metrics_interval = DEFAULT_METRICS_INTERVAL;
 
 	int rc = parse_cmdline(argc, argv, &grid_width, &grid_height, &wrap,
 	                       &game_rule, &cell_pixels, &border_width,
-	                       &update_rate, &in_file, &out_file, &format);
+	                       &update_rate, &in_file, &out_file, &format,
+	                       &options);
 	if (rc < 0) {
 		return EXIT_FAILURE;
 	} else if (rc > 0) {
@@ -46,23 +53,64 @@ int main(int argc, char **argv) {
 		return EXIT_SUCCESS;
 	}
 
-	if (init_app() < 0) {
+	if (!options.headless && init_app() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (options.trace != NULL && start_trace(options.trace) < 0) {
+		fputs("Failure in initialization of the trace\n", stderr);
+		return EXIT_FAILURE;
+	}
+	if (options.metrics != NULL
+	    && start_metrics(options.metrics, options.metrics_interval) < 0) {
+		fputs("Failure in initialization of the metrics\n", stderr);
 		return EXIT_FAILURE;
 	}
 
 	struct grid grid;
-	char *repr = NULL;
-	if (in_file != NULL) {
-		repr = read_file(in_file);
+	bool resumed = false;
+	START_TIMER(load_timer);
+	trace_begin("load");
+	if (options.resume) {
+		rc = resume_from_checkpoint(&grid, &options.checkpoint);
+		if (rc < 0) {
+			fputs("Failure in restoration of the checkpoint\n", stderr);
+			return EXIT_FAILURE;
+		}
+		resumed = rc == 0;
+		if (!resumed) {
+			fputs("No checkpoint found, starting from the beginning\n",
+			      stderr);
+		}
+	}
+	/* Override format on recognized file extension */
+	if (in_file != NULL && format == GRID_FORMAT_UNKNOWN) {
+		format = guess_grid_format(in_file);
+	}
+	if (resumed) {
+		grid.wrap = grid.wrap || wrap;
+	} else if (in_file != NULL && format == GRID_FORMAT_CHECKPOINT) {
+		if (load_grid_checkpoint(&grid, in_file) < 0) {
+			fprintf(stderr, "Could not load checkpoint file \"%s\"\n",
+			        in_file);
+			return EXIT_FAILURE;
+		}
+		grid.wrap = grid.wrap || wrap;
+	} else if (in_file != NULL && format == GRID_FORMAT_SNAPSHOT) {
+		/* The snapshot is mapped in memory, not read as text */
+		if (load_grid_snapshot(&grid, in_file) < 0) {
+			fprintf(stderr, "Could not load snapshot file \"%s\"\n", in_file);
+			return EXIT_FAILURE;
+		}
+		grid.wrap = grid.wrap || wrap;
+	} else if (in_file != NULL) {
+		char *repr = read_file(in_file);
 		if (repr == NULL) {
 			fprintf(stderr, "Could not read from file \"%s\"\n", in_file);
 			return EXIT_FAILURE;
 		}
-		/* Override format on recognized file extension */
-		if (format == GRID_FORMAT_UNKNOWN) {
-			format = _guess_format_from_ext(in_file);
-		}
 		rc = load_grid(&grid, repr, format, wrap);
+		free(repr);
 		if (rc < 0) {
 			fputs("Failure in creation of the game grid\n", stderr);
 			return EXIT_FAILURE;
@@ -71,28 +119,137 @@ int main(int argc, char **argv) {
 		fputs("Failure in creation of the game grid\n", stderr);
 		return EXIT_FAILURE;
 	}
-	memcpy(grid.rule, game_rule, sizeof grid.rule);
+	trace_end("load");
+	STOP_TIMER(load_timer, PHASE_LOAD);
+	/* The rule given on the command-line overrides the one from the input
+	   file, if any */
+	const char *rule = game_rule;
+	if (rule == NULL) {
+		rule = grid.rule[0] != '\0' ? grid.rule : DEFAULT_GRID_RULE;
+	}
+	if (set_grid_rule(&grid, rule) < 0) {
+		fprintf(stderr, "Invalid rule \"%s\"\n", rule);
+		return EXIT_FAILURE;
+	}
 
-	struct grid_window grid_win;
-	if (init_grid_window(&grid_win, &grid, cell_pixels, border_width,
-	                     WINDOW_TITLE) < 0) {
-		fprintf(stderr, "Failure in creation of the game window: %s\n",
-		        grid_win.error_msg);
+	if (options.threads > 1 && set_grid_workers(&grid, options.threads) < 0) {
+		fputs("Failure in placement of the game grid\n", stderr);
 		return EXIT_FAILURE;
 	}
 
 	enum grid_format out_fmt;
 	if (out_file != NULL) {
-		out_fmt = _guess_format_from_ext(out_file);
+		out_fmt = guess_grid_format(out_file);
 	} else {
 		out_fmt = GRID_FORMAT_UNKNOWN;
 	}
-	run_app(&grid_win, update_rate, repr, format, out_file, out_fmt);
 
-	free(repr);
+	struct checkpointer checkpointer;
+	struct checkpointer *checkpointer_ptr = NULL;
+	if (options.checkpoint.path != NULL) {
+		if (init_checkpointer(&checkpointer, &options.checkpoint, &grid) < 0) {
+			fputs("Failure in initialization of the checkpoints\n", stderr);
+			return EXIT_FAILURE;
+		}
+		checkpointer_ptr = &checkpointer;
+	}
+
+	/* The commands are answered on the standard output stream */
+	struct control control;
+	struct control *control_ptr = NULL;
+	if (options.control != NULL) {
+		if (open_control(&control, options.control, stdout) < 0) {
+			fputs("Failure in initialization of the control\n", stderr);
+			return EXIT_FAILURE;
+		}
+		control_ptr = &control;
+	}
+
+	int status = EXIT_SUCCESS;
+	if (options.headless && options.benchmark) {
+		if (run_benchmark(&grid, options.generations) < 0) {
+			fputs("Failure in evolution of the game grid\n", stderr);
+			status = EXIT_FAILURE;
+		}
+	} else if (options.headless) {
+		struct stats_writer stats;
+		struct stats_writer *stats_ptr = NULL;
+		if (options.stats != NULL) {
+			if (open_stats_writer(&stats, options.stats,
+			                      options.stats_every) < 0) {
+				fprintf(stderr, "Could not open the statistics file \"%s\"\n",
+				        options.stats);
+				return EXIT_FAILURE;
+			}
+			stats_ptr = &stats;
+		}
+		rc = run_headless(&grid, options.generations, checkpointer_ptr,
+		                  stats_ptr, control_ptr);
+		/* The statistics of the generations run are kept on error */
+		if (stats_ptr != NULL && close_stats_writer(stats_ptr) < 0) {
+			fprintf(stderr, "Could not write the statistics to \"%s\"\n",
+			        options.stats);
+			status = EXIT_FAILURE;
+		}
+		if (rc < 0) {
+			fputs("Failure in evolution of the game grid\n", stderr);
+			status = EXIT_FAILURE;
+		} else if (out_file != NULL
+		           && write_grid_file(&grid, out_file, out_fmt) < 0) {
+			fprintf(stderr, "Could not write the grid to \"%s\"\n",
+			        out_file);
+			status = EXIT_FAILURE;
+		}
+	} else {
+		struct grid_window grid_win;
+		if (init_grid_window(&grid_win, &grid, cell_pixels, border_width,
+		                     WINDOW_TITLE) < 0) {
+			fprintf(stderr, "Failure in creation of the game window: %s\n",
+			        grid_win.error_msg);
+			return EXIT_FAILURE;
+		}
+		/* The grid is reset to a copy of its initial state rather than by
+		   loading the input file again */
+		struct grid initial;
+		struct grid *initial_ptr = NULL;
+		if (in_file != NULL && !resumed) {
+			if (copy_grid(&initial, &grid) < 0) {
+				fputs("Not enough memory to keep the initial grid, reset "
+				      "disabled\n", stderr);
+			} else {
+				initial_ptr = &initial;
+			}
+		}
+		/* The budget is given in mebibytes */
+		size_t history_budget = SIZE_MAX;
+		mul_size(options.history, 1024 * 1024, &history_budget);
+		run_app(&grid_win, update_rate, initial_ptr, history_budget, out_file,
+		        out_fmt, checkpointer_ptr, control_ptr);
+		if (initial_ptr != NULL) {
+			free_grid(initial_ptr);
+		}
+		free_grid_window(&grid_win);
+		terminate_app();
+	}
+
+	if (control_ptr != NULL) {
+		close_control(control_ptr);
+	}
+	if (checkpointer_ptr != NULL) {
+		free_checkpointer(checkpointer_ptr);
+	}
 	free_grid(&grid);
-	free_grid_window(&grid_win);
-	terminate_app();
+	free_rules();
+	PRINT_TIMERS(stderr);
+	if (options.metrics != NULL) {
+		stop_metrics();
+	}
+	/* The threads that record events have all ended */
+	if (options.trace != NULL && stop_trace() < 0) {
+		fprintf(stderr, "Could not write the trace to \"%s\"\n",
+		        options.trace);
+		status = EXIT_FAILURE;
+	}
 
-	return EXIT_SUCCESS;
+	return status;
 }
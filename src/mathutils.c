@@ -3,3 +3,5 @@
 
 
 extern unsigned int pos_mod(int, int);
+
+extern bool mul_size(size_t, size_t, size_t*);
@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "metrics.h"
+
+#include <stdatomic.h> /* for atomic_*, memory_order_relaxed */
+#include <stdbool.h>
+#include <stdio.h> /* for FILE, fopen, fprintf, fclose, remove, rename */
+#include <stdlib.h> /* for malloc, free */
+#include <string.h> /* for strlen, memcpy */
+
+#include "timing.h" /* for read_timer */
+#include "utils.h" /* for CHECK_NULL */
+
+
+
+/* The upper bounds of the buckets of the durations of the updates, in
+   nanoseconds, the last bucket being unbounded */
+static const uint64_t STEP_BOUNDS[] = {
+	10000, 100000, 1000000, 10000000, 100000000, 1000000000, 10000000000
+};
+static const char *const STEP_BOUND_LABELS[] = {
+	"1e-05", "0.0001", "0.001", "0.01", "0.1", "1", "10"
+};
+#define NB_STEP_BOUNDS (sizeof STEP_BOUNDS / sizeof *STEP_BOUNDS)
+
+static const char TEMP_SUFFIX[] = ".tmp";
+
+
+static atomic_bool enabled;
+static atomic_uint_fast64_t generations_total;
+static atomic_uint_fast64_t steps_total;
+static atomic_uint_fast64_t step_nanoseconds_total;
+static atomic_uint_fast64_t step_buckets[NB_STEP_BOUNDS + 1];
+static atomic_uint_fast64_t frames_total;
+/* The population counted by the last update asked to, and its generation */
+static atomic_bool population_counted;
+static atomic_uint_fast64_t population;
+static atomic_uint_fast64_t population_generation;
+
+static const char *metrics_path;
+/* The path the metrics are written to before being renamed */
+static char *temp_path;
+static uint64_t interval_ns;
+static uint64_t last_write;
+static bool written;
+
+
+int start_metrics(const char *path, unsigned int interval) {
+	size_t length = strlen(path);
+	temp_path = malloc(length + sizeof TEMP_SUFFIX);
+	CHECK_NULL(temp_path);
+	memcpy(temp_path, path, length);
+	memcpy(&temp_path[length], TEMP_SUFFIX, sizeof TEMP_SUFFIX);
+	metrics_path = path;
+	interval_ns = (uint64_t) interval * 1000000000;
+	written = false;
+	atomic_store(&population_counted, false);
+	atomic_store(&enabled, true);
+	return 0;
+}
+
+
+void count_update(unsigned long generations, uint64_t start) {
+	if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+		return;
+	}
+	uint64_t end = read_timer();
+	/* The clock is not monotonic */
+	uint64_t duration = end > start ? end - start : 0;
+	size_t bucket = 0;
+	while (bucket < NB_STEP_BOUNDS && duration > STEP_BOUNDS[bucket]) {
+		++bucket;
+	}
+	atomic_fetch_add_explicit(&generations_total, generations,
+	                          memory_order_relaxed);
+	atomic_fetch_add_explicit(&steps_total, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&step_nanoseconds_total, duration,
+	                          memory_order_relaxed);
+	atomic_fetch_add_explicit(&step_buckets[bucket], 1, memory_order_relaxed);
+}
+
+void count_population(uint64_t generation, uint64_t count) {
+	if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+		return;
+	}
+	atomic_store_explicit(&population, count, memory_order_relaxed);
+	atomic_store_explicit(&population_generation, generation,
+	                      memory_order_relaxed);
+	atomic_store_explicit(&population_counted, true, memory_order_relaxed);
+}
+
+void count_frame(void) {
+	if (atomic_load_explicit(&enabled, memory_order_relaxed)) {
+		atomic_fetch_add_explicit(&frames_total, 1, memory_order_relaxed);
+	}
+}
+
+
+static unsigned long long _read_counter(atomic_uint_fast64_t *counter) {
+	return (unsigned long long) atomic_load_explicit(counter,
+	                                                 memory_order_relaxed);
+}
+
+/* Give the population of the grid, counted by its last update if it was of
+   its generation, or else by going through the grid */
+static uint64_t _get_population(const struct grid *grid) {
+	if (atomic_load_explicit(&population_counted, memory_order_relaxed)
+	    && atomic_load_explicit(&population_generation, memory_order_relaxed)
+	       == grid->generation) {
+		return atomic_load_explicit(&population, memory_order_relaxed);
+	}
+	return get_grid_population(grid);
+}
+
+static void _write_metric(FILE *file, const char *name, const char *type,
+                          const char *help) {
+	fprintf(file, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void _write_metrics(FILE *file, const struct grid *grid,
+                           size_t history_bytes) {
+	_write_metric(file, "cyano_generation", "gauge",
+	              "The generation of the grid.");
+	fprintf(file, "cyano_generation %llu\n",
+	        (unsigned long long) grid->generation);
+	_write_metric(file, "cyano_generations_total", "counter",
+	              "The number of generations computed.");
+	fprintf(file, "cyano_generations_total %llu\n",
+	        _read_counter(&generations_total));
+	_write_metric(file, "cyano_population", "gauge",
+	              "The number of live cells of the grid.");
+	fprintf(file, "cyano_population %llu\n",
+	        (unsigned long long) _get_population(grid));
+	_write_metric(file, "cyano_cells", "gauge",
+	              "The number of cells of the grid.");
+	fprintf(file, "cyano_cells %llu\n",
+	        (unsigned long long) grid->width * grid->height);
+	_write_metric(file, "cyano_memory_bytes", "gauge",
+	              "The memory taken by the cells of the grid and by the "
+	              "states kept to step backwards.");
+	fprintf(file, "cyano_memory_bytes{part=\"grid\"} %llu\n"
+	        "cyano_memory_bytes{part=\"history\"} %llu\n",
+	        (unsigned long long) get_grid_data_size(grid),
+	        (unsigned long long) history_bytes);
+	_write_metric(file, "cyano_step_duration_seconds", "histogram",
+	              "The durations of the updates of the grid by a step of one "
+	              "or more generations.");
+	unsigned long long cumulated = 0;
+	for (size_t i = 0; i < NB_STEP_BOUNDS; ++i) {
+		cumulated += _read_counter(&step_buckets[i]);
+		fprintf(file, "cyano_step_duration_seconds_bucket{le=\"%s\"} %llu\n",
+		        STEP_BOUND_LABELS[i], cumulated);
+	}
+	cumulated += _read_counter(&step_buckets[NB_STEP_BOUNDS]);
+	/* The steps counted meanwhile are left for the next write */
+	fprintf(file, "cyano_step_duration_seconds_bucket{le=\"+Inf\"} %llu\n"
+	        "cyano_step_duration_seconds_sum %.9f\n"
+	        "cyano_step_duration_seconds_count %llu\n", cumulated,
+	        _read_counter(&step_nanoseconds_total) / 1e9, cumulated);
+	_write_metric(file, "cyano_frames_total", "counter",
+	              "The number of frames displayed in the window.");
+	fprintf(file, "cyano_frames_total %llu\n", _read_counter(&frames_total));
+}
+
+int write_metrics(const struct grid *grid, size_t history_bytes) {
+	if (!atomic_load_explicit(&enabled, memory_order_relaxed)) {
+		return 0;
+	}
+	last_write = read_timer();
+	written = true;
+	FILE *file = fopen(temp_path, "w");
+	if (file == NULL) {
+		return -__LINE__;
+	}
+	_write_metrics(file, grid, history_bytes);
+	int rc = ferror(file) ? -__LINE__ : 0;
+	if (fclose(file) != 0) {
+		rc = -__LINE__;
+	}
+#ifdef _WIN32
+	/* The file is not replaced by the renaming there */
+	if (rc == 0) {
+		remove(metrics_path);
+	}
+#endif
+	if (rc == 0 && rename(temp_path, metrics_path) != 0) {
+		rc = -__LINE__;
+	}
+	if (rc < 0) {
+		remove(temp_path);
+	}
+	return rc;
+}
+
+/* Whether the interval has elapsed since the last write, or the metrics were
+   never written */
+static bool _is_due(void) {
+	uint64_t now = read_timer();
+	/* The clock is not monotonic */
+	return !written || now < last_write || now - last_write >= interval_ns;
+}
+
+bool needs_population(void) {
+	return atomic_load_explicit(&enabled, memory_order_relaxed) && _is_due();
+}
+
+int poll_metrics(const struct grid *grid, size_t history_bytes) {
+	if (!atomic_load_explicit(&enabled, memory_order_relaxed) || !_is_due()) {
+		return 0;
+	}
+	return write_metrics(grid, history_bytes);
+}
+
+
+void stop_metrics(void) {
+	atomic_store(&enabled, false);
+	free(temp_path);
+	temp_path = NULL;
+}
@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#ifdef __linux__
+# define _GNU_SOURCE /* to enable sched_setaffinity and CPU_SET in sched.h */
+# include <sched.h> /* for sched_setaffinity, cpu_set_t, CPU_SET */
+#endif
+#include "numa.h"
+
+#include <stdbool.h>
+#include <stdint.h> /* for uint64_t */
+#include <stdio.h> /* for FILE, fopen, fgets, fclose, snprintf, fprintf */
+#include <stdlib.h> /* for malloc, free, strtoul, strtoull */
+#include <string.h> /* for memset */
+#include <threads.h> /* for thrd_t, thrd_create, thrd_join, mtx_t, cnd_t */
+#include <time.h> /* for timespec_get */
+
+#include "mathutils.h" /* for MAX */
+#include "utils.h" /* for CHECK_RC, CHECK_NULL */
+
+
+
+/* The highest number of nodes and processors considered */
+#define MAX_NODES 64
+#define MAX_CPUS 1024
+
+/* The number of passes over the buffers of the benchmark, the best of which
+   is kept */
+#define BENCHMARK_PASSES 3
+
+/* The number of times the buffers of the benchmark are at least as large as
+   the largest cache, so that they are streamed from the memory */
+#define BENCHMARK_CACHES 4
+
+/* The size in bytes of the largest cache assumed when it is unknown */
+#define DEFAULT_CACHE_SIZE (64 * 1024 * 1024)
+
+
+/* The processors of the machine, grouped by node */
+static struct {
+	bool loaded;
+	unsigned int nb_nodes;
+	unsigned int nb_cpus;
+	/* The processors of the node n are from first_cpu[n] to
+	   first_cpu[n + 1] (exclusive) */
+	unsigned int first_cpu[MAX_NODES + 1];
+	int cpus[MAX_CPUS];
+} topology;
+
+
+/* Add the processors of a list such as "0-3,8,10-11" to the topology, and
+   return their number */
+static unsigned int _parse_cpu_list(const char *list) {
+	unsigned int count = 0;
+	char *end;
+	while (topology.nb_cpus < MAX_CPUS) {
+		unsigned long first = strtoul(list, &end, 10);
+		if (end == list) {
+			break;
+		}
+		unsigned long last = first;
+		if (*end == '-') {
+			list = end + 1;
+			last = strtoul(list, &end, 10);
+		}
+		for (unsigned long cpu = first;
+		     cpu <= last && topology.nb_cpus < MAX_CPUS; ++cpu) {
+			topology.cpus[topology.nb_cpus++] = (int) cpu;
+			++count;
+		}
+		if (*end != ',') {
+			break;
+		}
+		list = end + 1;
+	}
+	return count;
+}
+
+static void _load_topology(void) {
+	if (topology.loaded) {
+		return;
+	}
+	topology.loaded = true;
+#ifdef __linux__
+	/* The node numbers may have gaps */
+	for (unsigned int node = 0; node < MAX_NODES; ++node) {
+		char path[64];
+		snprintf(path, sizeof path, "/sys/devices/system/node/node%u/cpulist",
+		         node);
+		FILE *file = fopen(path, "r");
+		if (file == NULL) {
+			continue;
+		}
+		char list[1024];
+		unsigned int start = topology.nb_cpus;
+		if (fgets(list, sizeof list, file) != NULL
+		    && _parse_cpu_list(list) > 0) {
+			/* The nodes without processors have no workers */
+			topology.first_cpu[topology.nb_nodes++] = start;
+		}
+		fclose(file);
+	}
+#endif
+	if (topology.nb_nodes == 0) {
+		topology.nb_nodes = 1;
+		topology.nb_cpus = 0;
+	}
+	topology.first_cpu[topology.nb_nodes] = topology.nb_cpus;
+}
+
+
+unsigned int get_numa_nodes(void) {
+	_load_topology();
+	return topology.nb_nodes;
+}
+
+
+int get_worker_cpu(unsigned int worker, unsigned int workers,
+                   unsigned int *node) {
+	_load_topology();
+	unsigned int n = (unsigned int) ((unsigned long long) worker
+	                                 * topology.nb_nodes / workers);
+	if (node != NULL) {
+		*node = n;
+	}
+	if (topology.nb_cpus == 0) {
+		return -1;
+	}
+	/* The first worker of the node */
+	unsigned int first = (unsigned int) (((unsigned long long) n * workers
+	                                      + topology.nb_nodes - 1)
+	                                     / topology.nb_nodes);
+	unsigned int nb_cpus = topology.first_cpu[n + 1] - topology.first_cpu[n];
+	return topology.cpus[topology.first_cpu[n] + (worker - first) % nb_cpus];
+}
+
+
+int pin_thread(int cpu) {
+#ifdef __linux__
+	if (cpu < 0 || cpu >= CPU_SETSIZE) {
+		return -__LINE__;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	CHECK_RC(sched_setaffinity(0, sizeof set, &set));
+	return 0;
+#else
+	(void) cpu;
+	return -__LINE__;
+#endif
+}
+
+
+/* The size in bytes of the largest cache of the first processor */
+static size_t _get_cache_size(void) {
+	size_t largest = 0;
+#ifdef __linux__
+	for (unsigned int index = 0; index < 16; ++index) {
+		char path[64];
+		snprintf(path, sizeof path,
+		         "/sys/devices/system/cpu/cpu0/cache/index%u/size", index);
+		FILE *file = fopen(path, "r");
+		if (file == NULL) {
+			continue;
+		}
+		/* Such as "2048K" */
+		char line[32];
+		if (fgets(line, sizeof line, file) != NULL) {
+			char *end;
+			size_t size = (size_t) strtoull(line, &end, 10);
+			size *= *end == 'K' ? 1024 : *end == 'M' ? 1024 * 1024 : 1;
+			largest = MAX(largest, size);
+		}
+		fclose(file);
+	}
+#endif
+	return largest > 0 ? largest : DEFAULT_CACHE_SIZE;
+}
+
+
+/* The threads of a pass of the benchmark, which start streaming together once
+   all of them are pinned */
+struct _start {
+	mtx_t lock;
+	cnd_t ready;
+	cnd_t go;
+	unsigned int nb_ready;
+	bool started;
+};
+
+/* The share of a buffer of the benchmark of a thread, on a processor */
+struct _pass {
+	int cpu;
+	uint64_t *words;
+	size_t nb_words;
+	struct _start *start;
+	/* The time the thread was done with its share */
+	double end;
+};
+
+static double _get_time(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/* Allocate the buffer, from the processor so that its pages are on the node
+   of the processor */
+static int _allocate_buffer(void *arg) {
+	struct _pass *pass = arg;
+	pin_thread(pass->cpu);
+	pass->words = malloc(pass->nb_words * sizeof *pass->words);
+	if (pass->words != NULL) {
+		memset(pass->words, 0, pass->nb_words * sizeof *pass->words);
+	}
+	return 0;
+}
+
+/* Read and write back the share of the buffer, as an update of a grid does,
+   once all the threads are ready */
+static int _stream_buffer(void *arg) {
+	struct _pass *pass = arg;
+	pin_thread(pass->cpu);
+	mtx_lock(&pass->start->lock);
+	++pass->start->nb_ready;
+	cnd_signal(&pass->start->ready);
+	while (!pass->start->started) {
+		cnd_wait(&pass->start->go, &pass->start->lock);
+	}
+	mtx_unlock(&pass->start->lock);
+	for (size_t j = 0; j < pass->nb_words; ++j) {
+		pass->words[j] = ~pass->words[j];
+	}
+	pass->end = _get_time();
+	return 0;
+}
+
+/* Run the function in a thread, waiting for its completion */
+static int _run_thread(int (*func)(void*), struct _pass *pass) {
+	thrd_t thread;
+	if (thrd_create(&thread, func, pass) != thrd_success) {
+		return -__LINE__;
+	}
+	thrd_join(thread, NULL);
+	return 0;
+}
+
+/* Stream the buffer from all the processors of the node at once, each one
+   through its share, and give the time taken */
+static int _stream_from_node(unsigned int node, uint64_t *words,
+                             size_t nb_words, struct _pass *passes,
+                             thrd_t *threads, double *seconds) {
+	unsigned int first = topology.first_cpu[node];
+	unsigned int nb_threads = topology.first_cpu[node + 1] - first;
+	if (nb_threads == 0) {
+		/* The topology is unknown */
+		nb_threads = 1;
+	}
+	struct _start start;
+	if (mtx_init(&start.lock, mtx_plain) != thrd_success) {
+		return -__LINE__;
+	}
+	if (cnd_init(&start.ready) != thrd_success) {
+		mtx_destroy(&start.lock);
+		return -__LINE__;
+	}
+	if (cnd_init(&start.go) != thrd_success) {
+		cnd_destroy(&start.ready);
+		mtx_destroy(&start.lock);
+		return -__LINE__;
+	}
+	int rc = 0;
+	for (unsigned int i = 0; rc == 0 && i < BENCHMARK_PASSES; ++i) {
+		start.nb_ready = 0;
+		start.started = false;
+		unsigned int created = 0;
+		for (; created < nb_threads; ++created) {
+			size_t from = nb_words * created / nb_threads;
+			size_t to = nb_words * (created + 1) / nb_threads;
+			passes[created] = (struct _pass) {
+				topology.nb_cpus > 0 ? topology.cpus[first + created] : -1,
+				&words[from], to - from, &start, 0
+			};
+			if (thrd_create(&threads[created], _stream_buffer,
+			                &passes[created]) != thrd_success) {
+				rc = -__LINE__;
+				break;
+			}
+		}
+		mtx_lock(&start.lock);
+		while (start.nb_ready < created) {
+			cnd_wait(&start.ready, &start.lock);
+		}
+		double begin = _get_time();
+		start.started = true;
+		cnd_broadcast(&start.go);
+		mtx_unlock(&start.lock);
+		double end = begin;
+		for (unsigned int t = 0; t < created; ++t) {
+			thrd_join(threads[t], NULL);
+			end = MAX(end, passes[t].end);
+		}
+		if (rc == 0 && (i == 0 || end - begin < *seconds)) {
+			*seconds = end - begin;
+		}
+	}
+	cnd_destroy(&start.go);
+	cnd_destroy(&start.ready);
+	mtx_destroy(&start.lock);
+	return rc;
+}
+
+int benchmark_numa(size_t size, FILE *out) {
+	unsigned int nodes = get_numa_nodes();
+	uint64_t *buffers[MAX_NODES];
+	/* Not served from the caches */
+	size = MAX(size, BENCHMARK_CACHES * _get_cache_size());
+	size_t nb_words = size / sizeof(uint64_t) + 1;
+	struct _pass *passes = malloc(MAX(topology.nb_cpus, 1) * sizeof *passes);
+	CHECK_NULL(passes);
+	thrd_t *threads = malloc(MAX(topology.nb_cpus, 1) * sizeof *threads);
+	if (threads == NULL) {
+		free(passes);
+		return -__LINE__;
+	}
+	int rc = 0;
+	unsigned int allocated = 0;
+	for (; rc == 0 && allocated < nodes; ++allocated) {
+		/* The first processor of the node */
+		struct _pass pass = {get_worker_cpu(allocated, nodes, NULL), NULL,
+		                     nb_words, NULL, 0};
+		rc = _run_thread(_allocate_buffer, &pass);
+		buffers[allocated] = pass.words;
+		if (pass.words == NULL) {
+			rc = -__LINE__;
+		}
+	}
+	if (rc == 0) {
+		fprintf(out, "Bandwidth in MB/s over %zu MB, from all the processors "
+		        "of the node of each row\nto the memory of the node of each "
+		        "column:\n        ", size / 1000000);
+		for (unsigned int memory = 0; memory < nodes; ++memory) {
+			char label[16];
+			snprintf(label, sizeof label, "node %u", memory);
+			fprintf(out, " %9s", label);
+		}
+	}
+	for (unsigned int cpu_node = 0; rc == 0 && cpu_node < nodes; ++cpu_node) {
+		fprintf(out, "\nnode %-3u", cpu_node);
+		for (unsigned int memory = 0; rc == 0 && memory < nodes; ++memory) {
+			double seconds = 0;
+			rc = _stream_from_node(cpu_node, buffers[memory], nb_words,
+			                       passes, threads, &seconds);
+			if (rc == 0) {
+				/* The buffer is read and written */
+				fprintf(out, " %9.0f", 2.0 * (double) size / seconds / 1e6);
+			}
+		}
+	}
+	if (rc == 0) {
+		fputc('\n', out);
+	}
+	for (unsigned int node = 0; node < allocated; ++node) {
+		free(buffers[node]);
+	}
+	free(threads);
+	free(passes);
+	return rc;
+}
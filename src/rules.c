@@ -2,98 +2,634 @@
 #include "rules.h"
 
 
-#include <stddef.h> /* for NULL */
-#include <string.h> /* for strcmp */
-
-
-#define NB_NAMES 32
-
-
-
-static const char *names[] = {
-	"2x2",
-	"34 Life",
-	"Amoeba",
-	"Assimilation",
-	"Coagulations",
-	"Conway's Life",
-	"Coral",
-	"Corrosion of Conformity",
-	"Day & Night",
-	"Diamoeba",
-	"Flakes",
-	"Gnarl",
-	"HighLife",
-	"Highlife",
-	"InverseLife",
-	"Inverse life",
-	"Life 3-4",
-	"Life without Death",
-	"Long Life",
-	"Long life",
-	"LwoD",
-	"Maze",
-	"Mazectric",
-	"Move",
-	"Original",
-	"Pseudo Life",
-	"Pseudo life",
-	"Replicator",
-	"Seeds",
-	"Serviettes",
-	"Stains",
-	"WalledCities"
+#include <ctype.h> /* for isspace */
+#include <stdbool.h>
+#include <stddef.h> /* for NULL, size_t */
+#include <stdlib.h> /* for strtoul, malloc, calloc, free */
+#include <string.h> /* for strcmp, strncmp, strchr, strlen, memset, memcpy */
+
+#include "file_io.h" /* for read_file */
+#include "utils.h" /* for CHECK_RC, CHECK_NULL */
+
+
+/* The initial capacity of the tables of the registry, a power of two */
+#define TABLE_MIN_CAPACITY 64
+
+
+
+/* The rules known by name without any rules file */
+static const struct {
+	const char *name;
+	const char *rulestring;
+} BUILTIN_RULES[] = {
+	{"2x2", "B36/S125"},
+	{"34 Life", "B34/S34"},
+	{"Amoeba", "B357/S1358"},
+	{"Assimilation", "B345/S4567"},
+	{"Bosco's Rule", "R5,C0,M1,S34..58,B34..45,NM"},
+	{"Brian's Brain", "B2/S/C3"},
+	{"Coagulations", "B378/S235678"},
+	{"Conway's Life", "B3/S23"},
+	{"Coral", "B3/S45678"},
+	{"Corrosion of Conformity", "B3/S124"},
+	{"Day & Night", "B3678/S34678"},
+	{"Diamoeba", "B35678/S5678"},
+	{"Flakes", "B3/S012345678"},
+	{"Frogs", "B34/S12/C3"},
+	{"Gnarl", "B1/S1"},
+	{"HighLife", "B36/S23"},
+	{"Highlife", "B36/S23"},
+	{"Inverse life", "B0123478/S34678"},
+	{"InverseLife", "B0123478/S34678"},
+	{"Life 3-4", "B34/S34"},
+	{"Life without Death", "B3/S012345678"},
+	{"Long Life", "B345/S5"},
+	{"Long life", "B345/S5"},
+	{"LwoD", "B3/S012345678"},
+	{"Majority", "R4,C0,M1,S41..81,B41..81,NM"},
+	{"Maze", "B3/S12345"},
+	{"Mazectric", "B3/S1234"},
+	{"Move", "B368/S245"},
+	{"Original", "B3/S23"},
+	{"Pseudo Life", "B357/S238"},
+	{"Pseudo life", "B357/S238"},
+	{"Replicator", "B1357/S1357"},
+	{"Seeds", "B2/S"},
+	{"Serviettes", "B234/S"},
+	{"Stains", "B3678/S235678"},
+	{"Star Wars", "B2/S345/C4"},
+	{"Sticks", "B2/S3456/C6"},
+	{"WalledCities", "B45678/S2345"}
 };
 
-static const char *rules[] = {
-	"B36/S125",
-	"B34/S34",
-	"B357/S1358",
-	"B345/S4567",
-	"B378/S235678",
-	"B3/S23",
-	"B3/S45678",
-	"B3/S124",
-	"B3678/S34678",
-	"B35678/S5678",
-	"B3/S012345678",
-	"B1/S1",
-	"B36/S23",
-	"B36/S23",
-	"B0123478/S34678",
-	"B0123478/S34678",
-	"B34/S34",
-	"B3/S012345678",
-	"B345/S5",
-	"B345/S5",
-	"B3/S012345678",
-	"B3/S12345",
-	"B3/S1234",
-	"B368/S245",
-	"B3/S23",
-	"B357/S238",
-	"B357/S238",
-	"B1357/S1357",
-	"B2/S",
-	"B234/S",
-	"B3678/S235678",
-	"B45678/S2345"
+
+/* An entry of a table of the registry: a key, and the value associated with
+   it, both allocated on the heap. A NULL key marks a free slot */
+struct _entry {
+	char *key;
+	void *value;
 };
 
+/* A hash table with open addressing and linear probing */
+struct _table {
+	struct _entry *entries;
+	size_t capacity;
+	size_t count;
+};
+
+/* The rulestrings of the rule names */
+static struct _table names;
+/* The compiled rules of the rulestrings already met */
+static struct _table compiled;
+
+
+/* FNV-1a hash function */
+static uint64_t _hash(const char *key) {
+	uint64_t hash = UINT64_C(14695981039346656037);
+	for (; *key != '\0'; ++key) {
+		hash = (hash ^ (unsigned char) *key) * UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+/* Give the slot of the key in the table, or the free slot where it belongs */
+static struct _entry *_find_entry(const struct _table *table,
+                                  const char *key) {
+	size_t mask = table->capacity - 1;
+	size_t index = (size_t) _hash(key) & mask;
+	while (table->entries[index].key != NULL
+	       && strcmp(table->entries[index].key, key) != 0) {
+		index = (index + 1) & mask;
+	}
+	return &table->entries[index];
+}
+
+static const struct _entry *_look_up(const struct _table *table,
+                                     const char *key) {
+	if (table->count == 0) {
+		return NULL;
+	}
+	const struct _entry *entry = _find_entry(table, key);
+	return entry->key != NULL ? entry : NULL;
+}
+
+/* Double the capacity of the table, or allocate it if it is empty */
+static int _grow_table(struct _table *table) {
+	struct _table grown = {
+		.capacity = table->capacity > 0 ? 2 * table->capacity
+		                                : TABLE_MIN_CAPACITY,
+		.count = table->count
+	};
+	grown.entries = calloc(grown.capacity, sizeof *grown.entries);
+	CHECK_NULL(grown.entries);
+	for (size_t i = 0; i < table->capacity; ++i) {
+		if (table->entries[i].key != NULL) {
+			*_find_entry(&grown, table->entries[i].key) = table->entries[i];
+		}
+	}
+	free(table->entries);
+	*table = grown;
+	return 0;
+}
+
+/* Associate a value with a key in the table, replacing the previous one if
+   any. The table takes the ownership of both, even on error */
+static int _insert(struct _table *table, char *key, void *value) {
+	/* Keep the table at most half full, for short probe sequences */
+	if (2 * (table->count + 1) > table->capacity && _grow_table(table) < 0) {
+		free(key);
+		free(value);
+		return -__LINE__;
+	}
+	struct _entry *entry = _find_entry(table, key);
+	if (entry->key != NULL) {
+		free(key);
+		free(entry->value);
+	} else {
+		entry->key = key;
+		++table->count;
+	}
+	entry->value = value;
+	return 0;
+}
+
+static void _free_table(struct _table *table) {
+	for (size_t i = 0; i < table->capacity; ++i) {
+		free(table->entries[i].key);
+		free(table->entries[i].value);
+	}
+	free(table->entries);
+	table->entries = NULL;
+	table->capacity = 0;
+	table->count = 0;
+}
+
+static char *_copy_string(const char *string) {
+	size_t size = strlen(string) + 1;
+	char *copy = malloc(size);
+	if (copy != NULL) {
+		memcpy(copy, string, size);
+	}
+	return copy;
+}
+
+static int _add_name(const char *name, const char *rulestring) {
+	char *key = _copy_string(name);
+	char *value = _copy_string(rulestring);
+	if (key == NULL || value == NULL) {
+		free(key);
+		free(value);
+		return -__LINE__;
+	}
+	return _insert(&names, key, value);
+}
+
+/* Register the built-in rule names, on the first use of the registry */
+static int _init_names(void) {
+	if (names.count > 0) {
+		return 0;
+	}
+	size_t count = sizeof BUILTIN_RULES / sizeof *BUILTIN_RULES;
+	for (size_t i = 0; i < count; ++i) {
+		CHECK_RC(_add_name(BUILTIN_RULES[i].name,
+		                   BUILTIN_RULES[i].rulestring));
+	}
+	return 0;
+}
+
 
 const char *get_rule_from_name(const char *name) {
-	unsigned int start = 0;
-	unsigned int end = NB_NAMES;
-	while (end - start > 1) {
-		unsigned int middle = (start + end) / 2;
-		int relative_pos = strcmp(name, names[middle]);
-		if (relative_pos < 0) {
-			end = middle;
-		} else if (relative_pos > 0) {
-			start = middle;
-		} else {
-			return rules[middle];
+	if (_init_names() < 0) {
+		return NULL;
+	}
+	const struct _entry *entry = _look_up(&names, name);
+	return entry != NULL ? entry->value : NULL;
+}
+
+
+int register_rule(const char *name, const char *rulestring) {
+	if (name[0] == '\0' || get_compiled_rule(rulestring) == NULL) {
+		return -__LINE__;
+	}
+	CHECK_RC(_init_names());
+	return _add_name(name, rulestring);
+}
+
+
+/* Remove the whitespace at both ends of a string, in place */
+static char *_trim(char *string) {
+	while (isspace((unsigned char) string[0])) {
+		++string;
+	}
+	size_t length = strlen(string);
+	while (length > 0 && isspace((unsigned char) string[length - 1])) {
+		string[--length] = '\0';
+	}
+	return string;
+}
+
+int load_rules_file(const char *path) {
+	char *text = read_file(path);
+	CHECK_NULL(text);
+	int rc = 0;
+	unsigned int line_number = 0;
+	for (char *line = text; rc == 0 && line != NULL;) {
+		++line_number;
+		char *end = strchr(line, '\n');
+		if (end != NULL) {
+			*end++ = '\0';
 		}
+		line = _trim(line);
+		char *equal = strchr(line, '=');
+		if (line[0] != '\0' && line[0] != '#') {
+			if (equal == NULL) {
+				rc = (int) line_number;
+			} else {
+				*equal = '\0';
+				if (register_rule(_trim(line), _trim(equal + 1)) < 0) {
+					rc = (int) line_number;
+				}
+			}
+		}
+		line = end;
+	}
+	free(text);
+	return rc;
+}
+
+
+void free_rules(void) {
+	_free_table(&names);
+	_free_table(&compiled);
+}
+
+
+/* The letters of the Hensel notation for each number of neighbors up to 4.
+   Those of a number n above 4 stand for the complements of the arrangements of
+   8-n neighbors with the same letters */
+static const char *const HENSEL_LETTERS[] = {
+	"", "ce", "cekain", "cekainyqjr", "cekainyqjrtwz"
+};
+
+/* An arrangement of the neighbors for each of the letters above, the others
+   being its rotations and reflections. The neighbors are numbered clockwise
+   from the north one: bit 0 is north, bit 1 north-east, up to bit 7,
+   north-west */
+static const uint8_t HENSEL_NEIGHBORS[][13] = {
+	{0},
+	{0x02, 0x01},
+	{0x0A, 0x05, 0x09, 0x03, 0x11, 0x22},
+	{0x2A, 0x15, 0x25, 0x07, 0x83, 0x0B, 0x29, 0x23, 0x43, 0x13},
+	{0xAA, 0x55, 0x4B, 0x0F, 0x1B, 0x8B, 0x2B, 0x27, 0x53, 0x17, 0x93, 0x63,
+	 0x33}
+};
+
+/* The bit of each neighbor, in the order above, in the index of a
+   configuration in the transition table */
+static const unsigned int TABLE_BITS[8] = {7, 6, 3, 0, 1, 2, 5, 8};
+
+/* The bit of the cell itself in the index of a configuration */
+#define TABLE_CELL_BIT 4
+
+
+static inline uint8_t _rotate(uint8_t neighbors) {
+	return (uint8_t) (neighbors << 2 | neighbors >> 6);
+}
+
+static inline uint8_t _reflect(uint8_t neighbors) {
+	/* Across the north-south axis: the neighbor n goes to 8-n */
+	uint8_t reflected = neighbors & 0x11;
+	for (unsigned int n = 1; n < 4; ++n) {
+		reflected |= (neighbors >> n & 1) << (8 - n)
+		             | (neighbors >> (8 - n) & 1) << n;
+	}
+	return reflected;
+}
+
+/* Give the index of the letter of an arrangement of 1 to 4 neighbors */
+static unsigned int _get_letter(uint8_t neighbors, unsigned int count) {
+	unsigned int nb_letters = (unsigned int) strlen(HENSEL_LETTERS[count]);
+	for (unsigned int letter = 0; letter < nb_letters; ++letter) {
+		uint8_t image = HENSEL_NEIGHBORS[count][letter];
+		for (int i = 0; i < 4; ++i, image = _rotate(image)) {
+			if (image == neighbors || _reflect(image) == neighbors) {
+				return letter;
+			}
+		}
+	}
+	return 0; /* Not reached: the letters cover all the arrangements */
+}
+
+/* Give the mask of all the letters of a number of neighbors */
+static uint16_t _get_all_letters(unsigned int count) {
+	size_t nb_letters = strlen(HENSEL_LETTERS[count <= 4 ? count : 8 - count]);
+	return nb_letters > 0 ? (uint16_t) ((1 << nb_letters) - 1) : 1;
+}
+
+/* Read the digits of a transition, in ascending order, each with its Hensel
+   letters. The arrangements of neighbors selected for each number of neighbors
+   are stored as a mask of their letters (bit 0 if there are none) */
+static int _parse_transition(const char **rulestring, uint16_t letters[9]) {
+	memset(letters, 0, 9 * sizeof *letters);
+	int previous = -1;
+	while ('0' <= **rulestring && **rulestring <= '8') {
+		int digit = *(*rulestring)++ - '0';
+		if (digit <= previous) {
+			return -__LINE__;
+		}
+		previous = digit;
+		const char *alphabet = HENSEL_LETTERS[digit <= 4 ? digit : 8 - digit];
+		uint16_t all = _get_all_letters(digit);
+		bool exclude = **rulestring == '-';
+		if (exclude) {
+			++*rulestring;
+		}
+		uint16_t selected = 0;
+		const char *letter;
+		while (**rulestring != '\0'
+		       && (letter = strchr(alphabet, **rulestring)) != NULL) {
+			selected |= 1 << (letter - alphabet);
+			++*rulestring;
+		}
+		if (exclude && selected == 0) {
+			return -__LINE__;
+		}
+		letters[digit] = exclude ? all & ~selected
+		                         : selected != 0 ? selected : all;
+	}
+	return 0;
+}
+
+/* Build the masks of the numbers of neighbors, and the table of the
+   configurations, of a transition */
+static void _compile_transition(struct rule *rule, const uint16_t letters[9],
+                                unsigned int cell, uint16_t *mask) {
+	*mask = 0;
+	for (unsigned int index = 0; index < RULE_TABLE_SIZE; ++index) {
+		if ((index >> TABLE_CELL_BIT & 1) != cell) {
+			continue;
+		}
+		uint8_t neighbors = 0;
+		unsigned int count = 0;
+		for (unsigned int n = 0; n < 8; ++n) {
+			unsigned int bit = index >> TABLE_BITS[n] & 1;
+			neighbors |= bit << n;
+			count += bit;
+		}
+		unsigned int letter = 0;
+		if (0 < count && count <= 4) {
+			letter = _get_letter(neighbors, count);
+		} else if (4 < count && count < 8) {
+			letter = _get_letter((uint8_t) ~neighbors, 8 - count);
+		}
+		rule->table[index] = letters[count] >> letter & 1;
+		if (letters[count] != 0) {
+			*mask |= 1 << count;
+		}
+	}
+	for (unsigned int count = 0; count <= 8; ++count) {
+		/* Selecting all the letters of a number is the same as giving none */
+		if (letters[count] != 0 && letters[count] != _get_all_letters(count)) {
+			rule->totalistic = false;
+		}
+	}
+}
+
+/* Read a decimal number, at most max */
+static int _parse_number(const char **rulestring, unsigned long max,
+                         unsigned long *number) {
+	if (**rulestring < '0' || **rulestring > '9') {
+		return -__LINE__;
+	}
+	char *end;
+	*number = strtoul(*rulestring, &end, 10);
+	*rulestring = end;
+	return *number <= max ? 0 : -__LINE__;
+}
+
+/* Read a field of a Larger than Life rule, made of its letter and a number,
+   and the comma that follows it */
+static int _parse_field(const char **rulestring, char letter,
+                        unsigned long max, unsigned long *number) {
+	if (**rulestring != letter) {
+		return -__LINE__;
+	}
+	++*rulestring;
+	CHECK_RC(_parse_number(rulestring, max, number));
+	if (**rulestring != ',') {
+		return -__LINE__;
+	}
+	++*rulestring;
+	return 0;
+}
+
+/* The maximum number of cells in the neighborhood of a Larger than Life rule */
+#define MAX_RANGED_CELLS ((2 * MAX_RULE_RANGE + 1) * (2 * MAX_RULE_RANGE + 1))
+
+/* Read a transition of a Larger than Life rule, made of its letter and the
+   range of the numbers of live cells, and the comma that follows it */
+static int _parse_bounds(const char **rulestring, char letter,
+                         uint32_t *min, uint32_t *max) {
+	unsigned long number;
+	if (**rulestring != letter) {
+		return -__LINE__;
+	}
+	++*rulestring;
+	CHECK_RC(_parse_number(rulestring, MAX_RANGED_CELLS, &number));
+	*min = (uint32_t) number;
+	if (strncmp(*rulestring, "..", 2) != 0) {
+		return -__LINE__;
+	}
+	*rulestring += 2;
+	CHECK_RC(_parse_number(rulestring, MAX_RANGED_CELLS, &number));
+	*max = (uint32_t) number;
+	if (**rulestring != ',' || *min > *max) {
+		return -__LINE__;
+	}
+	++*rulestring;
+	return 0;
+}
+
+static int _parse_larger_than_life(const char *rulestring, struct rule *rule) {
+	unsigned long range;
+	unsigned long states;
+	unsigned long middle;
+	CHECK_RC(_parse_field(&rulestring, 'R', MAX_RULE_RANGE, &range));
+	CHECK_RC(_parse_field(&rulestring, 'C', MAX_RULE_STATES, &states));
+	CHECK_RC(_parse_field(&rulestring, 'M', 1, &middle));
+	CHECK_RC(_parse_bounds(&rulestring, 'S', &rule->survival_min,
+	                       &rule->survival_max));
+	CHECK_RC(_parse_bounds(&rulestring, 'B', &rule->birth_min,
+	                       &rule->birth_max));
+	/* Only the square neighborhood is supported */
+	if (range == 0 || strcmp(rulestring, "NM") != 0) {
+		return -__LINE__;
+	}
+	rule->family = RULE_FAMILY_LARGER_THAN_LIFE;
+	rule->neighborhood = RULE_NEIGHBORHOOD_MOORE;
+	rule->range = (unsigned int) range;
+	/* C0 and C1 stand for the two states of a Life-like rule */
+	rule->states = states < 2 ? 2 : (unsigned int) states;
+	rule->middle = middle == 1;
+	rule->totalistic = true;
+	rule->birth = 0;
+	rule->survival = 0;
+	return 0;
+}
+
+/* Give the number of cells of a neighborhood */
+static unsigned int _get_max_neighbors(enum rule_neighborhood neighborhood) {
+	switch (neighborhood) {
+	case RULE_NEIGHBORHOOD_VON_NEUMANN:
+		return 4;
+	case RULE_NEIGHBORHOOD_HEXAGONAL:
+		return 6;
+	default:
+		return 8;
+	}
+}
+
+/* Read the suffix of the neighborhood of a Life-like rule, which ends the
+   rulestring, and check the transitions against it */
+static int _parse_neighborhood(const char *rulestring, struct rule *rule) {
+	rule->neighborhood = RULE_NEIGHBORHOOD_MOORE;
+	if (rulestring[0] == 'V') {
+		rule->neighborhood = RULE_NEIGHBORHOOD_VON_NEUMANN;
+		++rulestring;
+	} else if (rulestring[0] == 'H') {
+		rule->neighborhood = RULE_NEIGHBORHOOD_HEXAGONAL;
+		++rulestring;
+	}
+	if (rulestring[0] != '\0') {
+		return -__LINE__;
+	}
+	unsigned int max_neighbors = _get_max_neighbors(rule->neighborhood);
+	if (rule->neighborhood != RULE_NEIGHBORHOOD_MOORE
+	    && (!rule->totalistic || (rule->birth | rule->survival)
+	                             >> (max_neighbors + 1) != 0)) {
+		/* The Hensel letters only describe the Moore neighborhood */
+		return -__LINE__;
+	}
+	return 0;
+}
+
+int parse_rule(const char *rulestring, struct rule *rule) {
+	uint16_t birth[9];
+	uint16_t survival[9];
+	if (rulestring[0] == 'R') {
+		return _parse_larger_than_life(rulestring, rule);
+	}
+	bool has_letters = rulestring[0] == 'B';
+	if (has_letters) {
+		++rulestring;
+	}
+	if (_parse_transition(&rulestring, birth) < 0) {
+		return -__LINE__;
+	}
+	bool has_slash = rulestring[0] == '/';
+	if (has_slash) {
+		++rulestring;
+	}
+	if (rulestring[0] == 'S' && has_letters) {
+		++rulestring;
+	} else if (!has_slash || rulestring[0] == 'S') {
+		/* Either the letters or the slash are needed to tell the
+		   transitions apart */
+		return -__LINE__;
+	}
+	if (_parse_transition(&rulestring, survival) < 0) {
+		return -__LINE__;
+	}
+	rule->states = 2;
+	if (rulestring[0] == '/') {
+		++rulestring;
+	}
+	if (rulestring[0] == 'C') {
+		char *end;
+		unsigned long states = strtoul(rulestring + 1, &end, 10);
+		if (end == rulestring + 1 || states < 2 || states > MAX_RULE_STATES) {
+			return -__LINE__;
+		}
+		rule->states = (unsigned int) states;
+		rulestring = end;
+	}
+	rule->family = RULE_FAMILY_LIFE_LIKE;
+	rule->range = 1;
+	rule->totalistic = true;
+	_compile_transition(rule, birth, 0, &rule->birth);
+	_compile_transition(rule, survival, 1, &rule->survival);
+	return _parse_neighborhood(rulestring, rule);
+}
+
+
+const struct rule *get_compiled_rule(const char *rulestring) {
+	const struct _entry *entry = _look_up(&compiled, rulestring);
+	if (entry != NULL) {
+		return entry->value;
+	}
+	struct rule *rule = malloc(sizeof *rule);
+	if (rule == NULL || parse_rule(rulestring, rule) < 0) {
+		free(rule);
+		return NULL;
+	}
+	char *key = _copy_string(rulestring);
+	if (key == NULL) {
+		free(rule);
+		return NULL;
+	}
+	return _insert(&compiled, key, rule) == 0 ? rule : NULL;
+}
+
+
+unsigned int get_state_planes(unsigned int states) {
+	unsigned int planes = 0;
+	/* The dying states are numbered from 1 to states - 2 */
+	for (unsigned int max = states - 2; max > 0; max >>= 1) {
+		++planes;
+	}
+	return states > 2 ? planes : 0;
+}
+
+
+bool can_invert_rule(const struct rule *rule) {
+	return rule->family == RULE_FAMILY_LIFE_LIKE && rule->states == 2;
+}
+
+
+/* Give the mask of the numbers of neighbors n such that max-n is in a mask */
+static uint16_t _reverse_mask(uint16_t mask, unsigned int max) {
+	uint16_t reversed = 0;
+	for (unsigned int n = 0; n <= max; ++n) {
+		reversed |= (uint16_t) ((mask >> (max - n) & 1) << n);
+	}
+	return reversed;
+}
+
+bool invert_rule(struct rule *rule, bool inverted) {
+	if (!can_invert_rule(rule)) {
+		return false;
+	}
+	unsigned int max = _get_max_neighbors(rule->neighborhood);
+	/* The state of a cell whose neighborhood is blank in memory, i.e. dead
+	   if the cells are stored as is, and alive otherwise */
+	bool next_inverted = inverted ? rule->survival >> max & 1
+	                              : rule->birth & 1;
+	uint16_t all = (uint16_t) ((1 << (max + 1)) - 1);
+	uint16_t birth = rule->birth;
+	uint16_t survival = rule->survival;
+	if (inverted) {
+		/* A cell blank in memory is alive, and its neighbors blank in memory
+		   are its dead ones */
+		birth = _reverse_mask(rule->survival, max);
+		survival = _reverse_mask(rule->birth, max);
+	}
+	rule->birth = next_inverted ? all & ~birth : birth;
+	rule->survival = next_inverted ? all & ~survival : survival;
+	uint8_t table[RULE_TABLE_SIZE];
+	memcpy(table, rule->table, sizeof table);
+	for (unsigned int index = 0; index < RULE_TABLE_SIZE; ++index) {
+		rule->table[index] = table[inverted ? index ^ (RULE_TABLE_SIZE - 1)
+		                                    : index] ^ next_inverted;
 	}
-	return NULL;
+	return next_inverted;
 }
@@ -0,0 +1,317 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#ifndef _MSC_VER
+# define _POSIX_C_SOURCE 200809L /* to enable mmap and fstat */
+#endif
+#include "snapshot.h"
+
+#include <stdint.h> /* for uint64_t, SIZE_MAX */
+#include <stdio.h> /* for FILE, fopen, fread, fclose */
+#include <stdlib.h> /* for calloc, free */
+#include <string.h> /* for memcmp, memcpy, memset, strncpy */
+#ifndef _MSC_VER
+# include <fcntl.h> /* for open, O_RDONLY */
+# include <sys/mman.h> /* for mmap, munmap */
+# include <sys/stat.h> /* for struct stat, fstat */
+# include <unistd.h> /* for close */
+#endif
+
+#include "bits.h" /* for num_octets, is_blank, pack_bits, unpack_bits */
+#include "file_io.h" /* for write_binary_file */
+#include "mathutils.h" /* for MIN */
+#include "rules.h" /* for struct rule, parse_rule */
+#include "utils.h" /* for CHECK_NULL */
+
+
+
+#define SNAPSHOT_VERSION 1
+
+/* Bit flags of the header flags field */
+#define SNAPSHOT_FLAG_WRAP 1
+#define SNAPSHOT_FLAG_INVERTED 2
+
+/* The offsets of the fields in the header */
+enum {
+	OFFSET_MAGIC = 0,
+	OFFSET_VERSION = 8,
+	OFFSET_HEADER_SIZE = 12,
+	OFFSET_WIDTH = 16,
+	OFFSET_HEIGHT = 24,
+	OFFSET_STRIDE = 32,
+	OFFSET_GENERATION = 40,
+	OFFSET_FLAGS = 48,
+	OFFSET_TILE_SIZE = 52,
+	OFFSET_RULE = 56
+};
+
+#define RULE_FIELD_SIZE 64
+
+/* The number of bytes of cells data in a tile of a checkpoint */
+#define CHECKPOINT_TILE_SIZE 4096
+
+static const char MAGIC[8] = "CYANOGRD";
+static const char CHECKPOINT_MAGIC[8] = "CYANOCKP";
+
+
+static void _put_le(unsigned char *dest, uint64_t value, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		dest[i] = (unsigned char) (value >> 8 * i);
+	}
+}
+
+static uint64_t _get_le(const unsigned char *src, size_t size) {
+	uint64_t value = 0;
+	for (size_t i = 0; i < size; ++i) {
+		value |= (uint64_t) src[i] << 8 * i;
+	}
+	return value;
+}
+
+/* Check the header and initialize the grid metadata from it. On success, the
+   offset of the cells data is stored in data_offset */
+static int _read_header(struct grid *grid, const unsigned char *header,
+                        const char *magic, uint64_t file_size,
+                        size_t *data_offset) {
+	if (memcmp(&header[OFFSET_MAGIC], magic, sizeof MAGIC) != 0
+	    || _get_le(&header[OFFSET_VERSION], 4) != SNAPSHOT_VERSION) {
+		return -__LINE__;
+	}
+	uint64_t header_size = _get_le(&header[OFFSET_HEADER_SIZE], 4);
+	uint64_t width = _get_le(&header[OFFSET_WIDTH], 8);
+	uint64_t height = _get_le(&header[OFFSET_HEIGHT], 8);
+	uint64_t stride = _get_le(&header[OFFSET_STRIDE], 8);
+	if (header_size < SNAPSHOT_HEADER_SIZE || width == 0 || height == 0
+	    || width > MAX_GRID_SIZE || height > MAX_GRID_SIZE || stride < width
+	    || stride > SIZE_MAX / 16 / height) {
+		/* The rows overlap, or all the bit planes cannot be addressed */
+		return -__LINE__;
+	}
+	if (file_size < header_size) {
+		/* Truncated file */
+		return -__LINE__;
+	}
+	grid->width = (unsigned int) width;
+	grid->height = (unsigned int) height;
+	/* The stride of the file is kept, the rows of the older versions being
+	   packed without padding */
+	grid->stride = (size_t) stride;
+	uint64_t flags = _get_le(&header[OFFSET_FLAGS], 4);
+	grid->wrap = (flags & SNAPSHOT_FLAG_WRAP) != 0;
+	grid->inverted = (flags & SNAPSHOT_FLAG_INVERTED) != 0;
+	grid->generic = false;
+	grid->workers = 0;
+	grid->pool = NULL;
+	grid->generation = _get_le(&header[OFFSET_GENERATION], 8);
+	grid->mapping = NULL;
+	grid->mapping_size = 0;
+	memset(grid->rule, 0, sizeof grid->rule);
+	/* Keep the last byte for the NUL terminator */
+	strncpy(grid->rule, (const char*) &header[OFFSET_RULE],
+	        sizeof grid->rule - 1);
+	/* The rule gives the number of bit planes stored */
+	struct rule rule;
+	grid->states = parse_rule(grid->rule, &rule) == 0 ? rule.states : 2;
+	*data_offset = (size_t) header_size;
+	return 0;
+}
+
+#ifdef _MSC_VER
+
+int load_grid_snapshot(struct grid *grid, const char *path) {
+	/* No mmap: read the cells in memory */
+	unsigned char header[SNAPSHOT_HEADER_SIZE];
+	FILE *file = fopen(path, "rb");
+	CHECK_NULL(file);
+	if (fread(header, 1, sizeof header, file) < sizeof header
+	    || _fseeki64(file, 0, SEEK_END) != 0) {
+		fclose(file);
+		return -__LINE__;
+	}
+	size_t offset;
+	uint64_t file_size = _ftelli64(file);
+	if (_read_header(grid, header, MAGIC, file_size, &offset) < 0
+	    || file_size - offset < get_grid_data_size(grid)) {
+		fclose(file);
+		return -__LINE__;
+	}
+	size_t size = get_grid_data_size(grid);
+	if (allocate_grid_cells(grid) < 0) {
+		fclose(file);
+		return -__LINE__;
+	}
+	if (_fseeki64(file, offset, SEEK_SET) != 0
+	    || fread(grid->cells, 1, size, file) < size) {
+		free_grid(grid);
+		fclose(file);
+		return -__LINE__;
+	}
+	fclose(file);
+	return 0;
+}
+
+#else
+
+int load_grid_snapshot(struct grid *grid, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -__LINE__;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0 || file_stat.st_size < SNAPSHOT_HEADER_SIZE) {
+		close(fd);
+		return -__LINE__;
+	}
+	size_t size = (size_t) file_stat.st_size;
+	/* The mapping is private: modifications of the cells are copied on write
+	   and never reach the file */
+	unsigned char *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+	                              MAP_PRIVATE, fd, 0);
+	/* The mapping holds its own reference on the file */
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		return -__LINE__;
+	}
+	size_t offset;
+	if (_read_header(grid, mapping, MAGIC, size, &offset) < 0
+	    || size - offset < get_grid_data_size(grid)) {
+		munmap(mapping, size);
+		return -__LINE__;
+	}
+	grid->cells = (char*) &mapping[offset];
+	grid->mapping = mapping;
+	grid->mapping_size = size;
+	return 0;
+}
+
+#endif
+
+
+static void _write_header(const struct grid *grid, unsigned char *header,
+                          const char *magic) {
+	memset(header, 0, SNAPSHOT_HEADER_SIZE);
+	memcpy(&header[OFFSET_MAGIC], magic, sizeof MAGIC);
+	_put_le(&header[OFFSET_VERSION], SNAPSHOT_VERSION, 4);
+	_put_le(&header[OFFSET_HEADER_SIZE], SNAPSHOT_HEADER_SIZE, 4);
+	_put_le(&header[OFFSET_WIDTH], grid->width, 8);
+	_put_le(&header[OFFSET_HEIGHT], grid->height, 8);
+	_put_le(&header[OFFSET_STRIDE], grid->stride, 8);
+	_put_le(&header[OFFSET_GENERATION], grid->generation, 8);
+	_put_le(&header[OFFSET_FLAGS],
+	        (grid->wrap ? SNAPSHOT_FLAG_WRAP : 0)
+	        | (grid->inverted ? SNAPSHOT_FLAG_INVERTED : 0), 4);
+	strncpy((char*) &header[OFFSET_RULE], grid->rule,
+	        MIN(sizeof grid->rule, RULE_FIELD_SIZE));
+}
+
+int save_grid_snapshot(const struct grid *grid, const char *path) {
+	unsigned char header[SNAPSHOT_HEADER_SIZE];
+	_write_header(grid, header, MAGIC);
+	struct file_chunk chunks[] = {
+		{header, sizeof header},
+		{grid->cells, get_grid_data_size(grid)}
+	};
+	return write_binary_file(path, chunks, sizeof chunks / sizeof *chunks);
+}
+
+
+int save_grid_checkpoint(const struct grid *grid, const char *path) {
+	size_t cells_size = get_grid_data_size(grid);
+	size_t nb_tiles = (cells_size + CHECKPOINT_TILE_SIZE - 1)
+	                  / CHECKPOINT_TILE_SIZE;
+	size_t bitmap_size = num_octets(nb_tiles);
+	/* Worst case: all tiles present and incompressible */
+	unsigned char *data = calloc(bitmap_size + nb_tiles
+	                             * (4 + PACKED_SIZE_MAX(CHECKPOINT_TILE_SIZE)),
+	                             1);
+	CHECK_NULL(data);
+	unsigned char *end = &data[bitmap_size];
+	for (size_t tile = 0; tile < nb_tiles; ++tile) {
+		size_t offset = tile * CHECKPOINT_TILE_SIZE;
+		size_t size = MIN(CHECKPOINT_TILE_SIZE, cells_size - offset);
+		/* Blank tiles are elided, only marked absent in the bitmap */
+		if (is_blank(&grid->cells[offset], size)) {
+			continue;
+		}
+		set_bit((char*) data, tile, 1);
+		size_t packed_size = pack_bits((unsigned char*) &grid->cells[offset],
+		                               size, &end[4]);
+		_put_le(end, packed_size, 4);
+		end += 4 + packed_size;
+	}
+	unsigned char header[SNAPSHOT_HEADER_SIZE];
+	_write_header(grid, header, CHECKPOINT_MAGIC);
+	_put_le(&header[OFFSET_TILE_SIZE], CHECKPOINT_TILE_SIZE, 4);
+	struct file_chunk chunks[] = {
+		{header, sizeof header},
+		{data, end - data}
+	};
+	int rc = write_binary_file(path, chunks, sizeof chunks / sizeof *chunks);
+	free(data);
+	return rc;
+}
+
+static int _load_tiles(struct grid *grid, const unsigned char *data,
+                       size_t size, size_t tile_size) {
+	size_t cells_size = get_grid_data_size(grid);
+	size_t nb_tiles = (cells_size + tile_size - 1) / tile_size;
+	size_t bitmap_size = num_octets(nb_tiles);
+	if (size < bitmap_size) {
+		return -__LINE__;
+	}
+	size_t pos = bitmap_size;
+	for (size_t tile = 0; tile < nb_tiles; ++tile) {
+		if (get_bit((const char*) data, tile) == 0) {
+			continue; /* Blank tile, already cleared */
+		}
+		if (size - pos < 4) {
+			return -__LINE__;
+		}
+		size_t packed_size = _get_le(&data[pos], 4);
+		pos += 4;
+		size_t offset = tile * tile_size;
+		if (size - pos < packed_size
+		    || unpack_bits(&data[pos], packed_size,
+		                   (unsigned char*) &grid->cells[offset],
+		                   MIN(tile_size, cells_size - offset)) < 0) {
+			return -__LINE__;
+		}
+		pos += packed_size;
+	}
+	return 0;
+}
+
+int load_grid_checkpoint(struct grid *grid, const char *path) {
+	size_t size;
+	unsigned char *data = read_binary_file(path, &size);
+	CHECK_NULL(data);
+	size_t offset = 0;
+	size_t tile_size = 0;
+	int rc = -__LINE__;
+	if (size >= SNAPSHOT_HEADER_SIZE
+	    && _read_header(grid, data, CHECKPOINT_MAGIC, size, &offset) == 0) {
+		tile_size = _get_le(&data[OFFSET_TILE_SIZE], 4);
+	}
+	if (tile_size > 0) {
+		if (allocate_grid_cells(grid) == 0) {
+			rc = _load_tiles(grid, &data[offset], size - offset, tile_size);
+			if (rc < 0) {
+				free_grid(grid);
+			}
+		}
+	}
+	free(data);
+	return rc;
+}
+
+int get_checkpoint_generation(const char *path, uint64_t *generation) {
+	unsigned char header[SNAPSHOT_HEADER_SIZE];
+	FILE *file = fopen(path, "rb");
+	CHECK_NULL(file);
+	size_t read = fread(header, 1, sizeof header, file);
+	fclose(file);
+	if (read < sizeof header
+	    || memcmp(&header[OFFSET_MAGIC], CHECKPOINT_MAGIC, sizeof MAGIC) != 0) {
+		return -__LINE__;
+	}
+	*generation = _get_le(&header[OFFSET_GENERATION], 8);
+	return 0;
+}
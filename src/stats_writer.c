@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "stats_writer.h"
+
+#include <stdint.h> /* for uint64_t */
+#include <stdlib.h> /* for malloc, free */
+#include <string.h> /* for memcpy, strcmp */
+
+#include "utils.h" /* for CHECK_NULL, CHECK_RC */
+
+
+
+/* The longest line: nine numbers of up to 20 digits, each followed by a
+   separator */
+#define MAX_LINE_SIZE (9 * 21)
+
+
+static const char HEADER[] = "generation,population,births,deaths,min_x,"
+                             "min_y,max_x,max_y,nanoseconds\n";
+
+
+int open_stats_writer(struct stats_writer *writer, const char *path,
+                      unsigned long every) {
+	writer->buffer = malloc(STATS_BUFFER_SIZE);
+	CHECK_NULL(writer->buffer);
+	if (strcmp(path, "-") == 0) {
+		writer->file = stdout;
+	} else {
+		writer->file = fopen(path, "w");
+	}
+	if (writer->file == NULL) {
+		free(writer->buffer);
+		return -__LINE__;
+	}
+	writer->every = every;
+	memcpy(writer->buffer, HEADER, sizeof HEADER - 1);
+	writer->used = sizeof HEADER - 1;
+	return 0;
+}
+
+
+static int _flush_stats(struct stats_writer *writer) {
+	if (writer->used > 0 && fwrite(writer->buffer, 1, writer->used,
+	                               writer->file) != writer->used) {
+		return -__LINE__;
+	}
+	writer->used = 0;
+	return 0;
+}
+
+/* Write the decimal digits of the number followed by the separator, and give
+   the position after them */
+static char *_put_number(char *pos, uint64_t number, char separator) {
+	char digits[20];
+	unsigned int count = 0;
+	do {
+		digits[count++] = (char) ('0' + number % 10);
+		number /= 10;
+	} while (number > 0);
+	while (count > 0) {
+		*pos++ = digits[--count];
+	}
+	*pos++ = separator;
+	return pos;
+}
+
+int write_grid_stats(struct stats_writer *writer,
+                     const struct grid_stats *stats) {
+	if (writer->used + MAX_LINE_SIZE > STATS_BUFFER_SIZE) {
+		CHECK_RC(_flush_stats(writer));
+	}
+	char *pos = &writer->buffer[writer->used];
+	pos = _put_number(pos, stats->generation, ',');
+	pos = _put_number(pos, stats->population, ',');
+	pos = _put_number(pos, stats->births, ',');
+	pos = _put_number(pos, stats->deaths, ',');
+	if (stats->population > 0) {
+		pos = _put_number(pos, stats->min_x, ',');
+		pos = _put_number(pos, stats->min_y, ',');
+		pos = _put_number(pos, stats->max_x, ',');
+		pos = _put_number(pos, stats->max_y, ',');
+	} else {
+		memcpy(pos, ",,,,", 4);
+		pos += 4;
+	}
+	pos = _put_number(pos, stats->duration, '\n');
+	writer->used = (size_t) (pos - writer->buffer);
+	return 0;
+}
+
+
+int update_grid_recording(struct stats_writer *writer, struct grid *grid,
+                          unsigned long generations) {
+	if (writer == NULL) {
+		return update_grid_generations(grid, generations);
+	}
+	while (generations > 0) {
+		/* The generations before the next one to record */
+		uint64_t skipped = writer->every - 1 - grid->generation % writer->every;
+		if (skipped >= generations) {
+			return update_grid_generations(grid, generations);
+		}
+		if (skipped > 0) {
+			CHECK_RC(update_grid_generations(grid, (unsigned long) skipped));
+		}
+		struct grid_stats stats;
+		CHECK_RC(update_grid_with_stats(grid, &stats));
+		CHECK_RC(write_grid_stats(writer, &stats));
+		generations -= (unsigned long) skipped + 1;
+	}
+	return 0;
+}
+
+
+int close_stats_writer(struct stats_writer *writer) {
+	int rc = _flush_stats(writer);
+	if (writer->file == stdout) {
+		if (fflush(stdout) != 0) {
+			rc = -__LINE__;
+		}
+	} else if (fclose(writer->file) != 0) {
+		rc = -__LINE__;
+	}
+	free(writer->buffer);
+	return rc;
+}
@@ -1,11 +1,16 @@
 /* SPDX-License-Identifier: CECILL-2.1 */
+#define _POSIX_C_SOURCE 200809L /* to enable strnlen in string.h */
 #include "stringutils.h"
 
 
+#include <stdarg.h> /* for va_list, va_start, va_end */
 #include <stddef.h> /* for size_t */
-#define _POSIX_C_SOURCE 200809L /* to enable strnlen in string.h */
+#include <stdio.h> /* for vsnprintf */
+#include <stdlib.h> /* for malloc, realloc */
 #include <string.h> /* for strlen, strnlen, memcmp */
 
+#include "utils.h" /* for CHECK_NULL */
+
 
 
 bool endswith(const char *string, const char *suffix) {
@@ -13,3 +18,37 @@ bool endswith(const char *string, const char *suffix) {
 	size_t l2 = strnlen(suffix, l1 + 1);
 	return l1 >= l2 && memcmp(&string[l1 - l2], suffix, l2) == 0;
 }
+
+
+int init_string_builder(struct string_builder *builder, size_t capacity) {
+	builder->data = malloc(capacity);
+	CHECK_NULL(builder->data);
+	builder->data[0] = '\0';
+	builder->size = 0;
+	builder->capacity = capacity;
+	return 0;
+}
+
+
+int append_format(struct string_builder *builder, const char *format, ...) {
+	va_list args;
+	for (;;) {
+		va_start(args, format);
+		int length = vsnprintf(builder->data + builder->size,
+		                       builder->capacity - builder->size, format, args);
+		va_end(args);
+		if (length < 0) {
+			return -__LINE__;
+		}
+		if (builder->size + length < builder->capacity) {
+			builder->size += length;
+			return 0;
+		}
+		/* Not enough room: grow the buffer and format again */
+		size_t capacity = 2 * builder->capacity + length;
+		char *data = realloc(builder->data, capacity);
+		CHECK_NULL(data);
+		builder->data = data;
+		builder->capacity = capacity;
+	}
+}
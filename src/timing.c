@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "timing.h"
+
+#include <threads.h> /* for mtx_t, mtx_lock, mtx_unlock, call_once */
+#include <time.h> /* for timespec_get */
+
+#include "bits.h" /* for count_leading_zeros */
+#include "mathutils.h" /* for MIN */
+
+
+
+/* The durations are counted in buckets of an eighth of a power of two, as
+   a floating-point number with three bits of mantissa: the first 16 buckets
+   hold a single value, then eight per power of two up to 2^63 */
+#define BUCKET_BITS 3
+#define NB_BUCKETS (16 + (64 - 4) * (1 << BUCKET_BITS))
+
+
+static struct {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	/* The latest durations, from which the oldest one is removed from the
+	   histogram when a new one is recorded */
+	uint64_t latest[TIMING_WINDOW];
+	uint32_t histogram[NB_BUCKETS];
+} phases[NB_PHASES];
+
+/* The phases are recorded by the thread of the window and by those saving
+   the grid */
+static mtx_t lock;
+static once_flag lock_once = ONCE_FLAG_INIT;
+
+static const char *const PHASE_NAMES[] = {
+	[PHASE_UPDATE] = "update",
+	[PHASE_RENDER] = "render",
+	[PHASE_EVENTS] = "events",
+	[PHASE_LOAD] = "load",
+	[PHASE_SAVE] = "save"
+};
+
+
+static void _init_lock(void) {
+	mtx_init(&lock, mtx_plain);
+}
+
+
+uint64_t read_timer(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+
+static unsigned int _get_bucket(uint64_t duration) {
+	if (duration < 16) {
+		return (unsigned int) duration;
+	}
+	unsigned int exponent = 63 - count_leading_zeros(duration);
+	unsigned int mantissa = (duration >> (exponent - BUCKET_BITS))
+	                        & ((1 << BUCKET_BITS) - 1);
+	return 16 + ((exponent - 4) << BUCKET_BITS) + mantissa;
+}
+
+/* The middle of the durations counted in the bucket */
+static uint64_t _get_bucket_value(unsigned int bucket) {
+	if (bucket < 16) {
+		return bucket;
+	}
+	unsigned int exponent = ((bucket - 16) >> BUCKET_BITS) + 4;
+	uint64_t mantissa = (1 << BUCKET_BITS) + ((bucket - 16)
+	                                          & ((1 << BUCKET_BITS) - 1));
+	uint64_t width = (uint64_t) 1 << (exponent - BUCKET_BITS);
+	return mantissa * width + width / 2;
+}
+
+void record_phase(enum timing_phase phase, uint64_t start) {
+	uint64_t end = read_timer();
+	/* The clock is not monotonic */
+	uint64_t duration = end > start ? end - start : 0;
+	call_once(&lock_once, _init_lock);
+	mtx_lock(&lock);
+	if (phases[phase].count >= TIMING_WINDOW) {
+		uint64_t oldest = phases[phase].latest[phases[phase].count
+		                                       % TIMING_WINDOW];
+		--phases[phase].histogram[_get_bucket(oldest)];
+	}
+	phases[phase].latest[phases[phase].count % TIMING_WINDOW] = duration;
+	++phases[phase].histogram[_get_bucket(duration)];
+	++phases[phase].count;
+	phases[phase].total += duration;
+	if (duration > phases[phase].max) {
+		phases[phase].max = duration;
+	}
+	mtx_unlock(&lock);
+}
+
+
+/* The duration below which the given share of the latest durations are */
+static uint64_t _get_percentile(const uint32_t *histogram, uint64_t count,
+                                unsigned int percent) {
+	/* The rank of the duration, from 1 */
+	uint64_t rank = (count * percent + 99) / 100;
+	uint64_t seen = 0;
+	for (unsigned int bucket = 0; bucket < NB_BUCKETS; ++bucket) {
+		seen += histogram[bucket];
+		if (seen >= rank && seen > 0) {
+			return _get_bucket_value(bucket);
+		}
+	}
+	return 0;
+}
+
+void get_phase_stats(enum timing_phase phase, struct phase_stats *stats) {
+	call_once(&lock_once, _init_lock);
+	mtx_lock(&lock);
+	stats->count = phases[phase].count;
+	stats->total = phases[phase].total;
+	stats->max = phases[phase].max;
+	uint64_t window = stats->count < TIMING_WINDOW ? stats->count
+	                                               : TIMING_WINDOW;
+	/* The middle of a bucket may be past the longest duration */
+	stats->p50 = MIN(_get_percentile(phases[phase].histogram, window, 50),
+	                 stats->max);
+	stats->p99 = MIN(_get_percentile(phases[phase].histogram, window, 99),
+	                 stats->max);
+	mtx_unlock(&lock);
+}
+
+
+const char *get_phase_name(enum timing_phase phase) {
+	return PHASE_NAMES[phase];
+}
+
+
+void print_phase_stats(FILE *file) {
+	fprintf(file, "Durations of the phases, in microseconds (median and 99th "
+	        "percentile of the\nlatest %u):\n%-8s %10s %12s %10s %10s %10s\n",
+	        TIMING_WINDOW, "phase", "count", "total", "p50", "p99", "max");
+	for (int phase = 0; phase < NB_PHASES; ++phase) {
+		struct phase_stats stats;
+		get_phase_stats(phase, &stats);
+		if (stats.count == 0) {
+			continue;
+		}
+		fprintf(file, "%-8s %10llu %12.0f %10.1f %10.1f %10.1f\n",
+		        get_phase_name(phase), (unsigned long long) stats.count,
+		        stats.total / 1e3, stats.p50 / 1e3, stats.p99 / 1e3,
+		        stats.max / 1e3);
+	}
+}
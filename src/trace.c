@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: CECILL-2.1 */
+#include "trace.h"
+
+#include <signal.h> /* for signal, sig_atomic_t, SIGUSR1, SIG_DFL */
+#include <stdatomic.h> /* for atomic_*, memory_order_* */
+#include <stdbool.h>
+#include <stdint.h> /* for uint64_t */
+#include <stdio.h> /* for FILE, fopen, fprintf, fputs, ferror, fclose */
+#include <stdlib.h> /* for malloc, free */
+#include <threads.h> /* for tss_t, tss_create, tss_get, tss_set, call_once */
+
+#include "timing.h" /* for read_timer */
+#include "utils.h" /* for CHECK_NULL */
+
+
+
+struct _trace_event {
+	const char *name;
+	uint64_t time; /* The time from the start of the trace, in nanoseconds */
+	char phase; /* 'B' for the beginning of the event, 'E' for its end */
+};
+
+struct _trace_buffer {
+	struct _trace_buffer *next; /* The buffer created before this one */
+	unsigned int lane; /* The number of the thread shown in the trace */
+	atomic_bool owned; /* Whether a running thread records in the buffer */
+	/* The number of events recorded, the latest of which are in the ring */
+	atomic_uint_fast64_t count;
+	struct _trace_event events[TRACE_BUFFER_EVENTS];
+};
+
+
+static atomic_bool tracing;
+/* The buffers, from the latest created: they are only ever added to while
+   the trace is recorded */
+static _Atomic(struct _trace_buffer*) buffers;
+static atomic_uint nb_lanes;
+static const char *trace_path;
+static uint64_t trace_start;
+
+/* The buffer of each thread, given back when the thread ends */
+static tss_t buffer_key;
+static bool key_created = false;
+static once_flag key_once = ONCE_FLAG_INIT;
+
+#ifdef SIGUSR1
+static volatile sig_atomic_t trace_requested = 0;
+
+static void _handle_signal(int sig) {
+	(void) sig;
+	trace_requested = 1;
+	/* Some systems reset the handler when the signal is received */
+	signal(SIGUSR1, _handle_signal);
+}
+#endif
+
+
+static void _release_buffer(void *buffer) {
+	atomic_store(&((struct _trace_buffer*) buffer)->owned, false);
+}
+
+static void _create_key(void) {
+	key_created = tss_create(&buffer_key, _release_buffer) == thrd_success;
+}
+
+
+/* The buffer of the calling thread: one given back by an ended thread if
+   there is one, or a new one */
+static struct _trace_buffer *_get_buffer(void) {
+	struct _trace_buffer *buffer = tss_get(buffer_key);
+	if (buffer != NULL) {
+		return buffer;
+	}
+	for (buffer = atomic_load(&buffers); buffer != NULL;
+	     buffer = buffer->next) {
+		bool owned = false;
+		if (atomic_compare_exchange_strong(&buffer->owned, &owned, true)) {
+			break;
+		}
+	}
+	if (buffer == NULL) {
+		buffer = malloc(sizeof *buffer);
+		if (buffer == NULL) {
+			return NULL;
+		}
+		buffer->lane = atomic_fetch_add(&nb_lanes, 1);
+		atomic_init(&buffer->owned, true);
+		atomic_init(&buffer->count, 0);
+		buffer->next = atomic_load(&buffers);
+		while (!atomic_compare_exchange_weak(&buffers, &buffer->next,
+		                                     buffer)) {
+			/* Another thread added its buffer meanwhile */
+		}
+	}
+	if (tss_set(buffer_key, buffer) != thrd_success) {
+		atomic_store(&buffer->owned, false);
+		return NULL;
+	}
+	return buffer;
+}
+
+
+int start_trace(const char *path) {
+	if (atomic_load(&tracing)) {
+		return -__LINE__;
+	}
+	call_once(&key_once, _create_key);
+	if (!key_created) {
+		return -__LINE__;
+	}
+	trace_path = path;
+	trace_start = read_timer();
+	atomic_store(&tracing, true);
+	/* The calling thread is shown first */
+	if (_get_buffer() == NULL) {
+		atomic_store(&tracing, false);
+		return -__LINE__;
+	}
+#ifdef SIGUSR1
+	signal(SIGUSR1, _handle_signal);
+#endif
+	return 0;
+}
+
+
+static void _record_event(const char *name, char phase) {
+	if (!atomic_load_explicit(&tracing, memory_order_relaxed)) {
+		return;
+	}
+	struct _trace_buffer *buffer = _get_buffer();
+	if (buffer == NULL) {
+		/* The event is lost */
+		return;
+	}
+	uint64_t time = read_timer();
+	uint_fast64_t count = atomic_load_explicit(&buffer->count,
+	                                           memory_order_relaxed);
+	struct _trace_event *event = &buffer->events[count % TRACE_BUFFER_EVENTS];
+	event->name = name;
+	/* The clock is not monotonic */
+	event->time = time > trace_start ? time - trace_start : 0;
+	event->phase = phase;
+	/* The event is written before it is counted */
+	atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+void trace_begin(const char *name) {
+	_record_event(name, 'B');
+}
+
+void trace_end(const char *name) {
+	_record_event(name, 'E');
+}
+
+
+/* Write the events of a buffer, copied first since they may be overwritten
+   while they are read */
+static void _write_buffer(FILE *file, const struct _trace_buffer *buffer,
+                          struct _trace_event *events) {
+	fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+	        "\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}", buffer->lane,
+	        buffer->lane == 0 ? "main" : "thread", buffer->lane);
+	uint64_t end = atomic_load_explicit(&buffer->count, memory_order_acquire);
+	uint64_t copied = end > TRACE_BUFFER_EVENTS ? end - TRACE_BUFFER_EVENTS
+	                                            : 0;
+	for (uint64_t i = copied; i < end; ++i) {
+		events[i - copied] = buffer->events[i % TRACE_BUFFER_EVENTS];
+	}
+	/* The events copied before those recorded meanwhile are read, and the
+	   one being recorded overwrites the oldest event left */
+	atomic_thread_fence(memory_order_acquire);
+	uint64_t recorded = atomic_load_explicit(&buffer->count,
+	                                         memory_order_relaxed);
+	uint64_t start = copied;
+	if (recorded + 1 > start + TRACE_BUFFER_EVENTS) {
+		start = recorded + 1 - TRACE_BUFFER_EVENTS;
+	}
+	/* The number of events begun and not ended */
+	unsigned long depth = 0;
+	for (uint64_t i = start; i < end; ++i) {
+		const struct _trace_event *event = &events[i - copied];
+		if (event->phase == 'E') {
+			if (depth == 0) {
+				/* Its beginning was overwritten */
+				continue;
+			}
+			--depth;
+		} else {
+			++depth;
+		}
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,"
+		        "\"pid\":1,\"tid\":%u}", event->name, event->phase,
+		        (unsigned long long) (event->time / 1000),
+		        (unsigned int) (event->time % 1000), buffer->lane);
+	}
+}
+
+int write_trace(void) {
+	if (!atomic_load(&tracing)) {
+		return 1;
+	}
+	struct _trace_event *events = malloc(TRACE_BUFFER_EVENTS
+	                                     * sizeof *events);
+	CHECK_NULL(events);
+	FILE *file = fopen(trace_path, "w");
+	if (file == NULL) {
+		free(events);
+		return -__LINE__;
+	}
+	/* The entries are each written after a comma, which this one needs not */
+	fputs("{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\","
+	      "\"pid\":1,\"args\":{\"name\":\"cyano\"}}", file);
+	for (const struct _trace_buffer *buffer = atomic_load(&buffers);
+	     buffer != NULL; buffer = buffer->next) {
+		_write_buffer(file, buffer, events);
+	}
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+	free(events);
+	int rc = ferror(file) ? -__LINE__ : 0;
+	if (fclose(file) != 0) {
+		rc = -__LINE__;
+	}
+	return rc;
+}
+
+
+int poll_trace(void) {
+#ifdef SIGUSR1
+	if (trace_requested) {
+		trace_requested = 0;
+		int rc = write_trace();
+		return rc < 0 ? rc : 0;
+	}
+#endif
+	return 0;
+}
+
+
+int stop_trace(void) {
+	int rc = write_trace();
+	if (rc == 1) {
+		return 1;
+	}
+#ifdef SIGUSR1
+	signal(SIGUSR1, SIG_DFL);
+	trace_requested = 0;
+#endif
+	atomic_store(&tracing, false);
+	struct _trace_buffer *buffer = atomic_exchange(&buffers, NULL);
+	while (buffer != NULL) {
+		struct _trace_buffer *next = buffer->next;
+		free(buffer);
+		buffer = next;
+	}
+	atomic_store(&nb_lanes, 0);
+	/* The buffer of the calling thread is gone */
+	tss_set(buffer_key, NULL);
+	return rc;
+}
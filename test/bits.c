@@ -171,11 +171,32 @@ void test_copy_bits(void) {
 	fputc('\n', stderr);
 }
 
+void test_count_leading_zeros(void) {
+	fputs("Testing count_leading_zeros(load_word(arr, i))\n", stderr);
+	/* The first set bit of each word is at index 0, 7, 8, 33 and 63 */
+	static const char bits[] = {
+		'\x80', 0, 0, 0, 0, 0, 0, '\xff',
+		1, 0, 0, 0, 0, 0, 0, 0,
+		0, '\x80', 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, '\x40', 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 1
+	};
+	static const unsigned int expected[] = {0, 7, 8, 33, 63};
+	for (unsigned int i = 0; i < (sizeof expected / sizeof expected[0]); ++i) {
+		unsigned int count = count_leading_zeros(load_word(bits, 8 * i));
+		fprintf(stderr, "word %u: expected %u, got %u\n", i, expected[i],
+		        count);
+		CUTE_assertEquals(count, expected[i]);
+	}
+	fputc('\n', stderr);
+}
+
 void build_case_bits(void) {
-	case_bits = CUTE_newTestCase("Tests for bit manipulation functions", 5);
+	case_bits = CUTE_newTestCase("Tests for bit manipulation functions", 6);
 	CUTE_addCaseTest(case_bits, CUTE_makeTest(test_num_octets));
 	CUTE_addCaseTest(case_bits, CUTE_makeTest(test_get_bit));
 	CUTE_addCaseTest(case_bits, CUTE_makeTest(test_set_bit));
 	CUTE_addCaseTest(case_bits, CUTE_makeTest(test_toggle_bit));
 	CUTE_addCaseTest(case_bits, CUTE_makeTest(test_copy_bits));
+	CUTE_addCaseTest(case_bits, CUTE_makeTest(test_count_leading_zeros));
 }
@@ -2,9 +2,25 @@
 #include "grid.h"
 
 #include <CUTE/cute.h>
-#include <stdio.h> /* for fprintf, stderr, fputs */
-#include <stdlib.h> /* for free */
-#include <string.h> /* for memcpy */
+#include <limits.h> /* for LONG_MAX */
+#include <stdint.h> /* for uintptr_t, UINT32_MAX, SIZE_MAX */
+#include <stdio.h> /* for fprintf, stderr, fputs, remove */
+#include <stdlib.h> /* for free, abs, rand, srand */
+#include <string.h> /* for memcpy, strchr, strcmp, strlen, strncmp, strstr */
+
+#include "bits.h" /* for bits_equal, get_bit, set_bit */
+#include "bookmarks.h"
+#include "control.h"
+#include "file_io.h" /* for write_file, write_binary_file */
+#include "history.h"
+#include "macrocell.h"
+#include "mathutils.h" /* for MIN */
+#include "metrics.h"
+#include "rules.h" /* for load_rules_file, get_rule_from_name */
+#include "snapshot.h"
+#include "stats_writer.h"
+#include "timing.h"
+#include "trace.h"
 
 
 
@@ -105,11 +121,1215 @@ void test_glider_rle_repr(void) {
 	CUTE_assertEquals(cmp, 0);
 }
 
+void test_copy_grid(void) {
+	struct grid copy;
+	fputs("-- Test for the independence of a grid copy\n", stderr);
+	toggle_cell(&grid, 1, 1);
+	CUTE_assertEquals(copy_grid(&copy, &grid), 0);
+	fputs("Toggle a cell in the original grid\n", stderr);
+	toggle_cell(&grid, 0, 0);
+	CUTE_assertEquals(get_grid_cell(&copy, 1, 1), ALIVE);
+	CUTE_assertEquals(get_grid_cell(&copy, 0, 0), DEAD);
+	CUTE_assertEquals(strcmp(copy.rule, grid.rule), 0);
+	free_grid(&copy);
+	fputs("OK\n", stderr);
+}
+
+void test_snapshot_round_trip(void) {
+	static const char path[] = "test_grid.cysnap";
+	struct grid loaded;
+	fputs("-- Test for the writing and loading of a snapshot\n", stderr);
+	toggle_cell(&grid, 0, 1);
+	toggle_cell(&grid, 2, 2);
+	CUTE_assertEquals(save_grid_snapshot(&grid, path), 0);
+	CUTE_assertEquals(load_grid_snapshot(&loaded, path), 0);
+	CUTE_assertEquals(loaded.width, grid.width);
+	CUTE_assertEquals(loaded.height, grid.height);
+	CUTE_assertEquals(loaded.wrap, grid.wrap);
+	CUTE_assertEquals(strcmp(loaded.rule, grid.rule), 0);
+	for (unsigned int row = 0; row < HEIGHT; ++row) {
+		for (unsigned int col = 0; col < WIDTH; ++col) {
+			CUTE_assertEquals(get_grid_cell(&loaded, row, col),
+			                  get_grid_cell(&grid, row, col));
+		}
+	}
+	fputs("Modify the loaded grid, then reload the snapshot\n", stderr);
+	toggle_cell(&loaded, 1, 1);
+	free_grid(&loaded);
+	CUTE_assertEquals(load_grid_snapshot(&loaded, path), 0);
+	CUTE_assertEquals(get_grid_cell(&loaded, 1, 1), DEAD);
+	free_grid(&loaded);
+	remove(path);
+	fputs("OK\n", stderr);
+}
+
+void test_checkpoint_round_trip(void) {
+	static const char path[] = "test_grid.cyckpt";
+	struct grid large;
+	struct grid loaded;
+	fputs("-- Test for the writing and loading of a checkpoint\n", stderr);
+	/* Large enough to span several tiles, some of which are blank */
+	CUTE_assertEquals(init_grid(&large, 300, 200, true), 0);
+	toggle_cell(&large, 150, 10);
+	toggle_cell(&large, 150, 11);
+	toggle_cell(&large, 150, 12);
+	toggle_cell(&large, 199, 299);
+	large.generation = 1234567890123;
+	CUTE_assertEquals(save_grid_checkpoint(&large, path), 0);
+	uint64_t generation;
+	CUTE_assertEquals(get_checkpoint_generation(path, &generation), 0);
+	CUTE_assertEquals(generation, large.generation);
+	CUTE_assertEquals(load_grid_checkpoint(&loaded, path), 0);
+	CUTE_assertEquals(loaded.width, large.width);
+	CUTE_assertEquals(loaded.height, large.height);
+	CUTE_assertEquals(loaded.wrap, large.wrap);
+	CUTE_assertEquals(loaded.generation, large.generation);
+	for (unsigned int row = 0; row < large.height; ++row) {
+		for (unsigned int col = 0; col < large.width; ++col) {
+			CUTE_assertEquals(get_grid_cell(&loaded, row, col),
+			                  get_grid_cell(&large, row, col));
+		}
+	}
+	free_grid(&loaded);
+	free_grid(&large);
+	remove(path);
+	fputs("OK\n", stderr);
+}
+
+void test_macrocell_round_trip(void) {
+	struct grid tiled;
+	struct grid loaded;
+	fputs("-- Test for the writing and loading of a Macrocell pattern\n",
+	      stderr);
+	/* A blinker in each 8x8 tile, plus a cell in each corner so that the
+	   bounding box covers the whole grid */
+	CUTE_assertEquals(init_grid(&tiled, 64, 64, false), 0);
+	for (unsigned int row = 0; row < 64; row += 8) {
+		for (unsigned int col = 0; col < 64; col += 8) {
+			toggle_cell(&tiled, row + 3, col + 2);
+			toggle_cell(&tiled, row + 3, col + 3);
+			toggle_cell(&tiled, row + 3, col + 4);
+		}
+	}
+	toggle_cell(&tiled, 0, 0);
+	toggle_cell(&tiled, 63, 63);
+	char *repr = get_grid_macrocell(&tiled);
+	CUTE_runTimeAssert(repr != NULL);
+	fprintf(stderr, "Macrocell repr:\n%s", repr);
+	/* Identical subtrees are written once: 3 distinct leaves and 7 other
+	   nodes, after the header line */
+	unsigned int nb_lines = 0;
+	for (const char *c = repr; *c != '\0'; ++c) {
+		nb_lines += *c == '\n';
+	}
+	CUTE_assertEquals(nb_lines, 11);
+	CUTE_assertEquals(load_grid_macrocell(&loaded, repr, false), 0);
+	free(repr);
+	CUTE_assertEquals(loaded.width, tiled.width);
+	CUTE_assertEquals(loaded.height, tiled.height);
+	for (unsigned int row = 0; row < tiled.height; ++row) {
+		for (unsigned int col = 0; col < tiled.width; ++col) {
+			CUTE_assertEquals(get_grid_cell(&loaded, row, col),
+			                  get_grid_cell(&tiled, row, col));
+		}
+	}
+	free_grid(&loaded);
+	free_grid(&tiled);
+	fputs("OK\n", stderr);
+}
+
+void test_life106_round_trip(void) {
+	static const char expected[] = "#Life 1.06\n0 0\n69 0\n5 1\n2 3\n";
+	struct grid sparse;
+	struct grid loaded;
+	fputs("-- Test for the writing and loading of a Life 1.06 pattern\n",
+	      stderr);
+	/* Cells before and after a word boundary, and in the last partial word */
+	CUTE_assertEquals(init_grid(&sparse, 70, 4, false), 0);
+	toggle_cell(&sparse, 0, 0);
+	toggle_cell(&sparse, 0, 69);
+	toggle_cell(&sparse, 1, 5);
+	toggle_cell(&sparse, 3, 2);
+	char *repr = get_grid_repr(&sparse, GRID_FORMAT_LIFE106);
+	fprintf(stderr, "Life 1.06 repr expected: \"%s\"\n", expected);
+	fprintf(stderr, "Life 1.06 repr got:      \"%s\"\n", repr);
+	CUTE_assertEquals(strcmp(repr, expected), 0);
+	CUTE_assertEquals(load_grid(&loaded, repr, GRID_FORMAT_UNKNOWN, false), 0);
+	free(repr);
+	CUTE_assertEquals(loaded.width, sparse.width);
+	CUTE_assertEquals(loaded.height, sparse.height);
+	CUTE_assertEquals(bits_equal(loaded.cells, 0, sparse.cells, 0,
+	                             8 * get_grid_data_size(&sparse)), 1);
+	free_grid(&loaded);
+	free_grid(&sparse);
+	fputs("OK\n", stderr);
+}
+
+void test_generations_rle(void) {
+	static const char expected[] = "x = 4, y = 3, rule = B2/S/C3\n"
+	                               ".2A$.2B$.2A!";
+	struct grid brain;
+	struct grid loaded;
+	fputs("-- Test for the evolution of a Generations rule and its RLE\n",
+	      stderr);
+	CUTE_assertEquals(init_grid(&brain, 4, 3, false), 0);
+	CUTE_assertEquals(set_grid_rule(&brain, "B2/S/C3"), 0);
+	toggle_cell(&brain, 1, 1);
+	toggle_cell(&brain, 1, 2);
+	fputs("Next generation: the live cells start dying, four are born\n",
+	      stderr);
+	CUTE_assertEquals(update_grid(&brain), 0);
+	char *repr = get_grid_repr(&brain, GRID_FORMAT_RLE);
+	fprintf(stderr, "RLE repr expected: \"%s\"\n", expected);
+	fprintf(stderr, "RLE repr got:      \"%s\"\n", repr);
+	CUTE_assertEquals(strcmp(repr, expected), 0);
+	CUTE_assertEquals(load_grid(&loaded, repr, GRID_FORMAT_RLE, false), 0);
+	free(repr);
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 4; ++col) {
+			CUTE_assertEquals(get_grid_cell_state(&loaded, row, col),
+			                  get_grid_cell_state(&brain, row, col));
+		}
+	}
+	free_grid(&loaded);
+	fputs("Next generation: the dying cells are dead\n", stderr);
+	CUTE_assertEquals(update_grid(&brain), 0);
+	CUTE_assertEquals(get_grid_cell_state(&brain, 1, 1), DEAD);
+	CUTE_assertEquals(get_grid_cell_state(&brain, 0, 1), 2);
+	free_grid(&brain);
+	fputs("OK\n", stderr);
+}
+
+void test_hensel_rule(void) {
+	struct grid hensel;
+	fputs("-- Test for the evolution of a non-totalistic rule\n", stderr);
+	CUTE_assertEquals(init_grid(&hensel, 5, 3, false), 0);
+	CUTE_assertEquals(set_grid_rule(&hensel, "B2a/S"), 0);
+	fputs("Adjacent cells: births above and below the pair\n", stderr);
+	toggle_cell(&hensel, 1, 1);
+	toggle_cell(&hensel, 1, 2);
+	CUTE_assertEquals(update_grid(&hensel), 0);
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 5; ++col) {
+			bool born = row != 1 && (col == 1 || col == 2);
+			CUTE_assertEquals(get_grid_cell(&hensel, row, col),
+			                  born ? ALIVE : DEAD);
+		}
+	}
+	fputs("Separated cells: no birth, unlike with B2/S\n", stderr);
+	clear_grid(&hensel);
+	toggle_cell(&hensel, 1, 1);
+	toggle_cell(&hensel, 1, 3);
+	CUTE_assertEquals(update_grid(&hensel), 0);
+	for (int row = 0; row < 3; ++row) {
+		for (int col = 0; col < 5; ++col) {
+			CUTE_assertEquals(get_grid_cell(&hensel, row, col), DEAD);
+		}
+	}
+	free_grid(&hensel);
+	fputs("OK\n", stderr);
+}
+
+void test_larger_than_life(void) {
+	struct grid ranged;
+	fputs("-- Test for the evolution of a Larger than Life rule\n", stderr);
+	CUTE_assertEquals(init_grid(&ranged, 7, 7, false), 0);
+	CUTE_assertEquals(set_grid_rule(&ranged, "R2,C0,M0,S0..0,B1..1,NM"), 0);
+	toggle_cell(&ranged, 3, 3);
+	fputs("Next generation: the square of range 2 around the cell\n", stderr);
+	CUTE_assertEquals(update_grid(&ranged), 0);
+	for (int row = 0; row < 7; ++row) {
+		for (int col = 0; col < 7; ++col) {
+			bool in_range = abs(row - 3) <= 2 && abs(col - 3) <= 2;
+			CUTE_assertEquals(get_grid_cell(&ranged, row, col),
+			                  in_range ? ALIVE : DEAD);
+		}
+	}
+	free_grid(&ranged);
+	fputs("OK\n", stderr);
+}
+
+void test_neighborhoods(void) {
+	/* The next generation of a single cell under B1/S1, row by row */
+	static const char *const expected[] = {
+		"B1/S1V", ".x.x.x.x.",
+		"B1/S1H", "xx.x.x.xx"
+	};
+	struct grid other;
+	fputs("-- Test for the von Neumann and hexagonal neighborhoods\n", stderr);
+	for (int rule = 0; rule < 2; ++rule) {
+		fprintf(stderr, "Next generation of a single cell with %s\n",
+		        expected[2 * rule]);
+		CUTE_assertEquals(init_grid(&other, 3, 3, true), 0);
+		CUTE_assertEquals(set_grid_rule(&other, expected[2 * rule]), 0);
+		toggle_cell(&other, 1, 1);
+		CUTE_assertEquals(update_grid(&other), 0);
+		for (int cell = 0; cell < 9; ++cell) {
+			bool alive = expected[2 * rule + 1][cell] == 'x';
+			CUTE_assertEquals(get_grid_cell(&other, cell / 3, cell % 3),
+			                  alive ? ALIVE : DEAD);
+		}
+		free_grid(&other);
+	}
+	fputs("OK\n", stderr);
+}
+
+void test_b0_rule(void) {
+	struct grid inverse;
+	fputs("-- Test for the evolution of a B0 rule\n", stderr);
+	CUTE_assertEquals(init_grid(&inverse, 6, 6, false), 0);
+	CUTE_assertEquals(set_grid_rule(&inverse, "B0/S"), 0);
+	toggle_cell(&inverse, 2, 2);
+	fputs("Next generation: all the cells but those around the cell are born\n",
+	      stderr);
+	CUTE_assertEquals(update_grid(&inverse), 0);
+	for (int row = 0; row < 6; ++row) {
+		for (int col = 0; col < 6; ++col) {
+			bool around = abs(row - 2) <= 1 && abs(col - 2) <= 1;
+			CUTE_assertEquals(get_grid_cell(&inverse, row, col),
+			                  around ? DEAD : ALIVE);
+		}
+	}
+	free_grid(&inverse);
+	fputs("Empty torus under InverseLife: all alive, but blank in memory\n",
+	      stderr);
+	CUTE_assertEquals(init_grid(&inverse, 6, 6, true), 0);
+	CUTE_assertEquals(set_grid_rule(&inverse, "B0123478/S34678"), 0);
+	for (int gen = 0; gen < 3; ++gen) {
+		CUTE_assertEquals(update_grid(&inverse), 0);
+		for (int cell = 0; cell < 36; ++cell) {
+			CUTE_assertEquals(get_grid_cell(&inverse, cell / 6, cell % 6),
+			                  ALIVE);
+			CUTE_assertEquals(get_bit(inverse.cells,
+			                          cell / 6 * inverse.stride + cell % 6),
+			                  0);
+		}
+	}
+	free_grid(&inverse);
+	fputs("OK\n", stderr);
+}
+
+void test_row_kernels(void) {
+	static const char *const rules[] = {"B3/S23", "B36/S23", "B2/S",
+	                                    "B3678/S34678", "B3/S012345678"};
+	fputs("-- Test for the kernels of the common rules\n", stderr);
+	for (size_t r = 0; r < sizeof rules / sizeof *rules; ++r) {
+		fprintf(stderr, "%s: same generations as the generic kernel\n",
+		        rules[r]);
+		struct grid fast;
+		struct grid generic;
+		/* Both a wall and a torus, on a width that is not a multiple of 64 */
+		CUTE_assertEquals(init_grid(&fast, 100, 37, r % 2 == 0), 0);
+		CUTE_assertEquals(set_grid_rule(&fast, rules[r]), 0);
+		srand(42);
+		for (int cell = 0; cell < 100 * 37; ++cell) {
+			if (rand() % 3 == 0) {
+				toggle_cell(&fast, cell / 100, cell % 100);
+			}
+		}
+		CUTE_assertEquals(copy_grid(&generic, &fast), 0);
+		generic.generic = true;
+		for (int gen = 0; gen < 20; ++gen) {
+			CUTE_assertEquals(update_grid(&fast), 0);
+			CUTE_assertEquals(update_grid(&generic), 0);
+			CUTE_assertEquals(bits_equal(fast.cells, 0, generic.cells, 0,
+			                             8 * get_grid_data_size(&fast)), 1);
+		}
+		free_grid(&generic);
+		free_grid(&fast);
+	}
+	fputs("OK\n", stderr);
+}
+
+void test_update_generations(void) {
+	static const char *const rules[] = {"B3/S23", "B0/S8", "B2-a3/S23",
+	                                    "B36/S23", "B2/S/C3"};
+	fputs("-- Test for the update of several generations at once\n", stderr);
+	for (size_t r = 0; r < sizeof rules / sizeof *rules; ++r) {
+		fprintf(stderr, "%s: same as one generation at a time\n", rules[r]);
+		struct grid banded;
+		struct grid stepped;
+		/* Three bands of 894 rows, and a last one shorter than the halos */
+		CUTE_assertEquals(init_grid(&banded, 1000, 2687, r % 2 == 0), 0);
+		CUTE_assertEquals(set_grid_rule(&banded, rules[r]), 0);
+		srand(42);
+		for (int cell = 0; cell < 1000 * 2687; ++cell) {
+			if (rand() % 3 == 0) {
+				toggle_cell(&banded, cell / 1000, cell % 1000);
+			}
+		}
+		CUTE_assertEquals(copy_grid(&stepped, &banded), 0);
+		CUTE_assertEquals(update_grid_generations(&banded, 11), 0);
+		for (int gen = 0; gen < 11; ++gen) {
+			CUTE_assertEquals(update_grid(&stepped), 0);
+		}
+		CUTE_assertEquals(banded.generation, 11);
+		CUTE_assertEquals(banded.inverted, stepped.inverted);
+		CUTE_assertEquals(bits_equal(banded.cells, 0, stepped.cells, 0,
+		                             8 * get_grid_data_size(&banded)), 1);
+		free_grid(&stepped);
+		free_grid(&banded);
+	}
+	fputs("OK\n", stderr);
+}
+
+void test_workers(void) {
+	static const char *const rules[] = {"B3/S23", "B0/S8", "B2-a3/S23",
+	                                    "B2/S/C4", "R2,C0,M1,S5..9,B7..8,NM",
+	                                    "R10,C3,M0,S6..40,B7..30,NM"};
+	fputs("-- Test for the update of a grid by several threads\n", stderr);
+	for (size_t r = 0; r < sizeof rules / sizeof *rules; ++r) {
+		fprintf(stderr, "%s: same as a single thread\n", rules[r]);
+		struct grid parallel;
+		struct grid single;
+		/* The stripes hold 8 rows or a multiple, the last one fewer */
+		CUTE_assertEquals(init_grid(&parallel, 77, 61, r % 2 == 0), 0);
+		CUTE_assertEquals(set_grid_rule(&parallel, rules[r]), 0);
+		srand(42);
+		for (int cell = 0; cell < 77 * 61; ++cell) {
+			if (rand() % 3 == 0) {
+				toggle_cell(&parallel, cell / 77, cell % 77);
+			}
+		}
+		CUTE_assertEquals(copy_grid(&single, &parallel), 0);
+		CUTE_assertEquals(set_grid_workers(&parallel, 3), 0);
+		for (int gen = 0; gen < 20; ++gen) {
+			if (gen == 10) {
+				/* The workers are ended and others started */
+				CUTE_assertEquals(set_grid_workers(&parallel, 2), 0);
+			}
+			CUTE_assertEquals(update_grid(&parallel), 0);
+			CUTE_assertEquals(update_grid(&single), 0);
+			CUTE_assertEquals(bits_equal(parallel.cells, 0, single.cells, 0,
+			                             8 * get_grid_data_size(&single)), 1);
+		}
+		free_grid(&single);
+		free_grid(&parallel);
+	}
+	fputs("OK\n", stderr);
+}
+
+void test_rules_file(void) {
+	static const char path[] = "test_grid.rules";
+	static const char rules[] = "# Test rules\n"
+	                            "\n"
+	                            "  Two Neighbors = B2/S2  \n"
+	                            "Life = B36/S23\n"
+	                            "Broken = B9/S23\n"
+	                            "Never read = B3/S23\n";
+	fputs("-- Test for the loading of a rules file\n", stderr);
+	CUTE_assertEquals(write_file(path, rules), 0);
+	fputs("The line of the invalid rule is reported\n", stderr);
+	CUTE_assertEquals(load_rules_file(path), 5);
+	remove(path);
+	CUTE_assertEquals(strcmp(get_rule_from_name("Two Neighbors"), "B2/S2"), 0);
+	CUTE_assertEquals(strcmp(get_rule_from_name("Life"), "B36/S23"), 0);
+	CUTE_assertEquals(get_rule_from_name("Broken"), NULL);
+	CUTE_assertEquals(get_rule_from_name("Never read"), NULL);
+	fputs("The built-in names are still known\n", stderr);
+	CUTE_assertEquals(strcmp(get_rule_from_name("HighLife"), "B36/S23"), 0);
+	fputs("The compiled rules are cached\n", stderr);
+	CUTE_assertEquals(get_compiled_rule("B2/S2"), get_compiled_rule("B2/S2"));
+	free_rules();
+	CUTE_assertEquals(get_rule_from_name("Life"), NULL);
+	fputs("OK\n", stderr);
+}
+
+void test_row_stride(void) {
+	static const char path[] = "test_grid_packed.cysnap";
+	struct grid padded;
+	struct grid packed;
+	fputs("-- Test for the padding of the rows\n", stderr);
+	CUTE_assertEquals(init_grid(&padded, 70, 5, true), 0);
+	CUTE_assertEquals(padded.stride % GRID_ROW_ALIGNMENT, 0);
+	CUTE_assertEquals((uintptr_t) padded.cells % (GRID_ROW_ALIGNMENT / 8), 0);
+	/* A glider crossing the east edge */
+	toggle_cell(&padded, 0, 69);
+	toggle_cell(&padded, 1, 0);
+	toggle_cell(&padded, 2, 68);
+	toggle_cell(&padded, 2, 69);
+	toggle_cell(&padded, 2, 0);
+	fputs("The padding stays blank when the cells are inverted\n", stderr);
+	set_grid_inverted(&padded, true);
+	CUTE_assertEquals(get_grid_cell(&padded, 0, 69), ALIVE);
+	CUTE_assertEquals(get_grid_cell(&padded, 0, 0), DEAD);
+	for (size_t row = 0; row < padded.height; ++row) {
+		for (size_t col = padded.width; col < padded.stride; ++col) {
+			CUTE_assertEquals(get_bit(padded.cells,
+			                          row * padded.stride + col), 0);
+		}
+	}
+	set_grid_inverted(&padded, false);
+	fputs("Snapshot with unpadded rows, as written by the previous versions\n",
+	      stderr);
+	/* 70 x 5 cells on 44 octets */
+	unsigned char data[SNAPSHOT_HEADER_SIZE + 44] = "CYANOGRD";
+	data[8] = 1; /* Version */
+	data[12] = SNAPSHOT_HEADER_SIZE;
+	data[16] = 70; /* Width */
+	data[24] = 5; /* Height */
+	data[32] = 70; /* Stride */
+	data[48] = 1; /* Wraps */
+	memcpy(&data[56], "B3/S23", 6);
+	for (unsigned int row = 0; row < padded.height; ++row) {
+		for (unsigned int col = 0; col < padded.width; ++col) {
+			set_bit((char*) &data[SNAPSHOT_HEADER_SIZE], row * 70 + col,
+			        get_grid_cell(&padded, row, col));
+		}
+	}
+	struct file_chunk chunk = {data, sizeof data};
+	CUTE_assertEquals(write_binary_file(path, &chunk, 1), 0);
+	CUTE_assertEquals(load_grid_snapshot(&packed, path), 0);
+	remove(path);
+	CUTE_assertEquals(packed.stride, 70);
+	CUTE_assertEquals(set_grid_rule(&padded, "B3/S23"), 0);
+	for (int gen = 0; gen < 12; ++gen) {
+		CUTE_assertEquals(update_grid(&padded), 0);
+		CUTE_assertEquals(update_grid(&packed), 0);
+		for (unsigned int row = 0; row < padded.height; ++row) {
+			for (unsigned int col = 0; col < padded.width; ++col) {
+				CUTE_assertEquals(get_grid_cell(&packed, row, col),
+				                  get_grid_cell(&padded, row, col));
+			}
+		}
+	}
+	free_grid(&packed);
+	free_grid(&padded);
+	fputs("OK\n", stderr);
+}
+
+void test_huge_grid(void) {
+	static const char expected[] = "#Life 1.06\n65999 0\n0 65999\n"
+	                               "65999 65999\n";
+	struct grid huge;
+	struct grid loaded;
+	fputs("-- Test for a grid of more than 2^32 cells\n", stderr);
+	CUTE_assertEquals(init_grid(&huge, MAX_GRID_SIZE, MAX_GRID_SIZE, false) < 0,
+	                  1);
+	CUTE_assertEquals(init_grid(&huge, (unsigned int) MAX_GRID_SIZE + 1, 1,
+	                            false) < 0, 1);
+	if (SIZE_MAX >> 32 == 0) {
+		fputs("Skipped: no room for such a grid in a 32-bit address space\n",
+		      stderr);
+		return;
+	}
+	/* The cells untouched are never backed by memory on most systems */
+	CUTE_assertEquals(init_grid(&huge, 66000, 66000, true), 0);
+	CUTE_assertEquals(get_grid_data_size(&huge) > UINT32_MAX / 8, 1);
+	toggle_cell(&huge, 0, 65999);
+	toggle_cell(&huge, 65999, 0);
+	toggle_cell(&huge, 65999, 65999);
+	fputs("The last cell is past the 2^32th bit\n", stderr);
+	CUTE_assertEquals(get_bit(huge.cells, 65999 * huge.stride + 65999), 1);
+	CUTE_assertEquals(get_bit(huge.cells,
+	                          (65999 * huge.stride + 65999) & UINT32_MAX), 0);
+	CUTE_assertEquals(get_grid_cell(&huge, -1, -1), ALIVE);
+	CUTE_assertEquals(get_grid_cell(&huge, 65998, 65999), DEAD);
+	char *repr = get_grid_repr(&huge, GRID_FORMAT_LIFE106);
+	fprintf(stderr, "Life 1.06 repr expected: \"%s\"\n", expected);
+	fprintf(stderr, "Life 1.06 repr got:      \"%s\"\n", repr);
+	CUTE_assertEquals(strcmp(repr, expected), 0);
+	free_grid(&huge);
+	fputs("The pattern is loaded back on a grid as large\n", stderr);
+	CUTE_assertEquals(load_grid(&loaded, repr, GRID_FORMAT_UNKNOWN, true), 0);
+	free(repr);
+	CUTE_assertEquals(loaded.width, 66000);
+	CUTE_assertEquals(loaded.height, 66000);
+	CUTE_assertEquals(get_grid_cell(&loaded, 65999, 65999), ALIVE);
+	CUTE_assertEquals(get_grid_cell(&loaded, 65999, 65998), DEAD);
+	free_grid(&loaded);
+	fputs("OK\n", stderr);
+}
+
+void test_bookmarks(void) {
+	struct grid glider;
+	struct bookmarks bookmarks;
+	fputs("-- Test for the restoration of a grid and its bookmarks\n", stderr);
+	CUTE_assertEquals(init_grid(&glider, 20, 20, true), 0);
+	CUTE_assertEquals(set_grid_rule(&glider, "B3/S23"), 0);
+	toggle_cell(&glider, 0, 1);
+	toggle_cell(&glider, 1, 2);
+	toggle_cell(&glider, 2, 0);
+	toggle_cell(&glider, 2, 1);
+	toggle_cell(&glider, 2, 2);
+	init_bookmarks(&bookmarks);
+	CUTE_assertEquals(set_bookmark(&bookmarks, "start", &glider), 0);
+	CUTE_assertEquals(update_grid_generations(&glider, 8), 0);
+	CUTE_assertEquals(set_bookmark(&bookmarks, "eight", &glider), 0);
+	char *eight = get_grid_repr(&glider, GRID_FORMAT_RLE);
+	fputs("The cells are restored in place, with the generation\n", stderr);
+	char *cells = glider.cells;
+	CUTE_assertEquals(goto_bookmark(&bookmarks, "start", &glider), 0);
+	CUTE_assertEquals(glider.cells, cells);
+	CUTE_assertEquals(glider.generation, 0);
+	CUTE_assertEquals(get_grid_cell(&glider, 2, 0), ALIVE);
+	CUTE_assertEquals(goto_bookmark(&bookmarks, "missing", &glider), 1);
+	CUTE_assertEquals(update_grid_generations(&glider, 8), 0);
+	char *replayed = get_grid_repr(&glider, GRID_FORMAT_RLE);
+	CUTE_assertEquals(strcmp(replayed, eight), 0);
+	free(replayed);
+	fputs("A bookmark is replaced, and may change the number of states\n",
+	      stderr);
+	CUTE_assertEquals(set_grid_rule(&glider, "B2/S/C3"), 0);
+	CUTE_assertEquals(update_grid(&glider), 0);
+	CUTE_assertEquals(set_bookmark(&bookmarks, "start", &glider), 0);
+	CUTE_assertEquals(bookmarks.count, 2);
+	CUTE_assertEquals(goto_bookmark(&bookmarks, "eight", &glider), 0);
+	CUTE_assertEquals(glider.states, 2);
+	CUTE_assertEquals(strcmp(glider.rule, "B3/S23"), 0);
+	replayed = get_grid_repr(&glider, GRID_FORMAT_RLE);
+	CUTE_assertEquals(strcmp(replayed, eight), 0);
+	free(replayed);
+	free(eight);
+	CUTE_assertEquals(goto_bookmark(&bookmarks, "start", &glider), 0);
+	CUTE_assertEquals(glider.states, 3);
+	CUTE_assertEquals(glider.generation, 9);
+	free_bookmarks(&bookmarks);
+	free_grid(&glider);
+	fputs("OK\n", stderr);
+}
+
+/* The number of generations recorded in the history */
+#define HISTORY_GENERATIONS 150
+
+static bool _same_cells(const struct grid *grid1, const struct grid *grid2) {
+	return grid1->generation == grid2->generation
+	       && bits_equal(grid1->cells, 0, grid2->cells, 0,
+	                     8 * get_grid_data_size(grid1));
+}
+
+void test_history(void) {
+	struct grid soup;
+	struct grid states[HISTORY_GENERATIONS + 1];
+	struct history history;
+	fputs("-- Test for the history of the generations of a grid\n", stderr);
+	/* Several tiles of bit planes */
+	CUTE_assertEquals(init_grid(&soup, 300, 300, true), 0);
+	CUTE_assertEquals(set_grid_rule(&soup, "B3/S23"), 0);
+	srand(42);
+	for (int cell = 0; cell < 300 * 300; ++cell) {
+		if (rand() % 3 == 0) {
+			toggle_cell(&soup, cell / 300, cell % 300);
+		}
+	}
+	init_history(&history, 8 << 20);
+	for (int gen = 0; gen <= HISTORY_GENERATIONS; ++gen) {
+		if (gen > 0) {
+			CUTE_assertEquals(update_grid(&soup), 0);
+		}
+		CUTE_assertEquals(record_history(&history, &soup), 0);
+		CUTE_assertEquals(copy_grid(&states[gen], &soup), 0);
+	}
+	CUTE_assertEquals(history.count, HISTORY_GENERATIONS + 1);
+	fputs("The states are rebuilt backwards and forwards\n", stderr);
+	CUTE_assertEquals(seek_history(&history, -1, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[149]), true);
+	CUTE_assertEquals(seek_history(&history, -100, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[49]), true);
+	CUTE_assertEquals(seek_history(&history, -1000, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[0]), true);
+	CUTE_assertEquals(seek_history(&history, -1, &soup), 1);
+	CUTE_assertEquals(seek_history(&history, 75, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[75]), true);
+	CUTE_assertEquals(seek_history(&history, LONG_MAX, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[150]), true);
+	CUTE_assertEquals(seek_history(&history, 1, &soup), 1);
+	fputs("The states after the one stepped back to are dropped\n", stderr);
+	CUTE_assertEquals(seek_history(&history, -50, &soup), 0);
+	CUTE_assertEquals(update_grid(&soup), 0);
+	CUTE_assertEquals(record_history(&history, &soup), 0);
+	CUTE_assertEquals(history.count, 102);
+	CUTE_assertEquals(_same_cells(&soup, &states[101]), true);
+	CUTE_assertEquals(seek_history(&history, 1, &soup), 1);
+	CUTE_assertEquals(seek_history(&history, -2, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[99]), true);
+	free_history(&history);
+	fputs("The oldest states are dropped to fit in the budget\n", stderr);
+	init_history(&history, 100000);
+	for (int gen = 0; gen <= HISTORY_GENERATIONS; ++gen) {
+		CUTE_assertEquals(record_history(&history, &states[gen]), 0);
+		CUTE_assertEquals(history.used <= history.budget, true);
+	}
+	CUTE_assertEquals(history.count > 1, true);
+	CUTE_assertEquals(history.count < HISTORY_GENERATIONS, true);
+	CUTE_assertEquals(seek_history(&history, -LONG_MAX, &soup), 0);
+	CUTE_assertEquals(_same_cells(&soup, &states[HISTORY_GENERATIONS + 1
+	                                             - history.count]), true);
+	fputs("The history starts over with another rule\n", stderr);
+	CUTE_assertEquals(set_grid_rule(&soup, "B36/S23"), 0);
+	CUTE_assertEquals(record_history(&history, &soup), 0);
+	CUTE_assertEquals(history.count, 1);
+	CUTE_assertEquals(seek_history(&history, -1, &soup), 1);
+	fputs("The B0 rules alternate between inverted states\n", stderr);
+	struct grid b0_states[11];
+	CUTE_assertEquals(set_grid_rule(&soup, "B01/S012"), 0);
+	for (int gen = 0; gen <= 10; ++gen) {
+		if (gen > 0) {
+			CUTE_assertEquals(update_grid(&soup), 0);
+		}
+		CUTE_assertEquals(record_history(&history, &soup), 0);
+		CUTE_assertEquals(copy_grid(&b0_states[gen], &soup), 0);
+		set_grid_inverted(&b0_states[gen], false);
+	}
+	CUTE_assertEquals(history.count, 11);
+	for (int gen = 9; gen >= 0; gen -= 3) {
+		/* Rebuilt as the grid stores its cells */
+		bool inverted = soup.inverted;
+		CUTE_assertEquals(seek_history(&history, gen - (int) history.position,
+		                               &soup), 0);
+		CUTE_assertEquals(soup.inverted, inverted);
+		set_grid_inverted(&soup, false);
+		CUTE_assertEquals(_same_cells(&soup, &b0_states[gen]), true);
+	}
+	for (int gen = 0; gen <= 10; ++gen) {
+		free_grid(&b0_states[gen]);
+	}
+	free_history(&history);
+	for (int gen = 0; gen <= HISTORY_GENERATIONS; ++gen) {
+		free_grid(&states[gen]);
+	}
+	free_grid(&soup);
+	fputs("OK\n", stderr);
+}
+
+void test_phase_timers(void) {
+	struct phase_stats stats;
+	fputs("-- Test for the percentiles of the timers of the phases\n", stderr);
+	get_phase_stats(PHASE_EVENTS, &stats);
+	CUTE_assertEquals(stats.count, 0);
+	CUTE_assertEquals(stats.p99, 0);
+	/* The durations from 10 to 2000 microseconds, and as many again */
+	for (uint64_t i = 1; i <= 2 * TIMING_WINDOW; ++i) {
+		record_phase(PHASE_EVENTS, read_timer() - 10000 * (i % 200 + 1));
+	}
+	get_phase_stats(PHASE_EVENTS, &stats);
+	CUTE_assertEquals(stats.count, 2 * TIMING_WINDOW);
+	fprintf(stderr, "p50: %llu ns, p99: %llu ns, max: %llu ns\n",
+	        (unsigned long long) stats.p50, (unsigned long long) stats.p99,
+	        (unsigned long long) stats.max);
+	/* Within an eighth, besides the time of the calls */
+	CUTE_assertEquals(stats.p50 > 870000 && stats.p50 < 1150000, true);
+	CUTE_assertEquals(stats.p99 > 1730000 && stats.p99 <= stats.max, true);
+	CUTE_assertEquals(stats.max >= 2000000, true);
+	fputs("OK\n", stderr);
+}
+
+static unsigned int _count_occurrences(const char *str, const char *sub) {
+	unsigned int count = 0;
+	while ((str = strstr(str, sub)) != NULL) {
+		++count;
+		++str;
+	}
+	return count;
+}
+
+void test_trace(void) {
+	static const char path[] = "test_grid.json";
+	fputs("-- Test for the trace of the generations and of the workers\n",
+	      stderr);
+	CUTE_assertEquals(write_trace(), 1);
+	CUTE_assertEquals(start_trace(path), 0);
+	CUTE_assertEquals(start_trace(path) < 0, true);
+	/* An end without its beginning is left out */
+	trace_end("lost");
+	struct grid grid;
+	CUTE_assertEquals(init_grid(&grid, 77, 61, true), 0);
+	CUTE_assertEquals(set_grid_rule(&grid, "B3/S23"), 0);
+	CUTE_assertEquals(set_grid_workers(&grid, 3), 0);
+	CUTE_assertEquals(update_grid_generations(&grid, 5), 0);
+	free_grid(&grid);
+	CUTE_assertEquals(stop_trace(), 0);
+	CUTE_assertEquals(stop_trace(), 1);
+	char *trace = read_file(path);
+	CUTE_runTimeAssert(trace != NULL);
+	fputs("Events recorded by each worker\n", stderr);
+	CUTE_assertEquals(strncmp(trace, "{\"traceEvents\":[", 16), 0);
+	CUTE_assertEquals(_count_occurrences(trace, "\"name\":\"generation\","
+	                                            "\"ph\":\"B\",\"ts\""), 5);
+	CUTE_assertEquals(_count_occurrences(trace, "\"name\":\"generation\","
+	                                            "\"ph\":\"E\",\"ts\""), 5);
+	CUTE_assertEquals(_count_occurrences(trace, "\"name\":\"stripe\","
+	                                            "\"ph\":\"B\",\"ts\""), 15);
+	CUTE_assertEquals(_count_occurrences(trace, "\"name\":\"stripe\","
+	                                            "\"ph\":\"E\",\"ts\""), 15);
+	CUTE_assertEquals(strstr(trace, "\"args\":{\"name\":\"main 0\"}")
+	                  != NULL, true);
+	CUTE_assertEquals(strstr(trace, "\"args\":{\"name\":\"thread 1\"}")
+	                  != NULL, true);
+	CUTE_assertEquals(strstr(trace, "lost"), NULL);
+	free(trace);
+	remove(path);
+	fputs("OK\n", stderr);
+}
+
+void test_grid_stats(void) {
+	static const char *const rules[] = {"B3/S23", "B0/S8", "B2/S/C4",
+	                                    "R2,C0,M1,S5..9,B7..8,NM"};
+	static const char path[] = "test_grid.csv";
+	fputs("-- Test for the statistics of the generations\n", stderr);
+	for (size_t r = 0; r < sizeof rules / sizeof *rules; ++r) {
+		fprintf(stderr, "%s: same counts as cell by cell\n", rules[r]);
+		struct grid stats_grid;
+		/* The rows end in the middle of a word */
+		CUTE_assertEquals(init_grid(&stats_grid, 77, 61, r % 2 == 0), 0);
+		CUTE_assertEquals(set_grid_rule(&stats_grid, rules[r]), 0);
+		CUTE_assertEquals(set_grid_workers(&stats_grid, r < 2 ? 3 : 1), 0);
+		srand(42);
+		for (int cell = 0; cell < 77 * 61; ++cell) {
+			if (rand() % 3 == 0) {
+				toggle_cell(&stats_grid, cell / 77, cell % 77);
+			}
+		}
+		static bool alive[61][77];
+		for (int gen = 0; gen < 10; ++gen) {
+			for (int row = 0; row < 61; ++row) {
+				for (int col = 0; col < 77; ++col) {
+					alive[row][col] = get_grid_cell(&stats_grid, row, col)
+					                  == ALIVE;
+				}
+			}
+			struct grid_stats stats;
+			CUTE_assertEquals(update_grid_with_stats(&stats_grid, &stats), 0);
+			struct grid_stats counted = {gen + 1, 0, 0, 0, 77, 61, 0, 0, 0};
+			for (unsigned int row = 0; row < 61; ++row) {
+				for (unsigned int col = 0; col < 77; ++col) {
+					bool now = get_grid_cell(&stats_grid, row, col) == ALIVE;
+					counted.births += now && !alive[row][col];
+					counted.deaths += !now && alive[row][col];
+					if (now) {
+						++counted.population;
+						counted.min_x = MIN(counted.min_x, col);
+						counted.min_y = MIN(counted.min_y, row);
+						counted.max_x = col > counted.max_x ? col
+						                                    : counted.max_x;
+						counted.max_y = row;
+					}
+				}
+			}
+			CUTE_assertEquals(stats.generation, counted.generation);
+			CUTE_assertEquals(stats.population, counted.population);
+			CUTE_assertEquals(stats.births, counted.births);
+			CUTE_assertEquals(stats.deaths, counted.deaths);
+			if (counted.population > 0) {
+				CUTE_assertEquals(stats.min_x, counted.min_x);
+				CUTE_assertEquals(stats.min_y, counted.min_y);
+				CUTE_assertEquals(stats.max_x, counted.max_x);
+				CUTE_assertEquals(stats.max_y, counted.max_y);
+			}
+		}
+		free_grid(&stats_grid);
+	}
+
+	fputs("Every third generation written to a file\n", stderr);
+	struct stats_writer writer;
+	CUTE_assertEquals(open_stats_writer(&writer, path, 3), 0);
+	struct grid blinker;
+	CUTE_assertEquals(init_grid(&blinker, 5, 5, false), 0);
+	CUTE_assertEquals(set_grid_rule(&blinker, "B3/S23"), 0);
+	toggle_cell(&blinker, 2, 1);
+	toggle_cell(&blinker, 2, 2);
+	toggle_cell(&blinker, 2, 3);
+	CUTE_assertEquals(update_grid_recording(&writer, &blinker, 7), 0);
+	CUTE_assertEquals(blinker.generation, 7);
+	clear_grid(&blinker);
+	CUTE_assertEquals(update_grid_recording(&writer, &blinker, 2), 0);
+	CUTE_assertEquals(close_stats_writer(&writer), 0);
+	free_grid(&blinker);
+	char *lines = read_file(path);
+	CUTE_runTimeAssert(lines != NULL);
+	/* The durations are left out */
+	char *line = lines;
+	static const char *const expected[] = {
+		"generation,population,births,deaths,min_x,min_y,max_x,max_y,",
+		"3,3,2,2,2,1,2,3,", "6,3,2,2,1,2,3,2,", "9,0,0,0,,,,,"
+	};
+	for (size_t i = 0; i < sizeof expected / sizeof *expected; ++i) {
+		CUTE_runTimeAssert(line != NULL);
+		CUTE_assertEquals(strncmp(line, expected[i], strlen(expected[i])),
+		                  0);
+		line = strchr(line, '\n');
+		line = line != NULL ? line + 1 : NULL;
+	}
+	/* Nothing after the last line, whose newline read_file drops */
+	CUTE_assertEquals(line == NULL, true);
+	free(lines);
+	remove(path);
+	fputs("OK\n", stderr);
+}
+
+void test_metrics(void) {
+	static const char path[] = "test_grid.prom";
+	fputs("-- Test for the metrics of the run\n", stderr);
+	struct grid metrics_grid;
+	CUTE_assertEquals(init_grid(&metrics_grid, 100, 10, false), 0);
+	CUTE_assertEquals(set_grid_rule(&metrics_grid, "B3/S23"), 0);
+	toggle_cell(&metrics_grid, 2, 1);
+	toggle_cell(&metrics_grid, 2, 2);
+	toggle_cell(&metrics_grid, 2, 3);
+	/* Not counted before the metrics are started */
+	CUTE_assertEquals(update_grid_generations(&metrics_grid, 2), 0);
+	CUTE_assertEquals(start_metrics(path, 3600), 0);
+	CUTE_assertEquals(update_grid_generations(&metrics_grid, 5), 0);
+	struct grid_stats stats;
+	CUTE_assertEquals(update_grid_with_stats(&metrics_grid, &stats), 0);
+	count_frame();
+	fputs("Written at once, then after the interval\n", stderr);
+	CUTE_assertEquals(poll_metrics(&metrics_grid, 1234), 0);
+	char *metrics = read_file(path);
+	CUTE_runTimeAssert(metrics != NULL);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_generation 8\n") != NULL,
+	                  true);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_generations_total 6\n")
+	                  != NULL, true);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_population 3\n") != NULL,
+	                  true);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_cells 1000\n") != NULL, true);
+	CUTE_assertEquals(strstr(metrics, "{part=\"history\"} 1234\n") != NULL,
+	                  true);
+	CUTE_assertEquals(strstr(metrics, "_bucket{le=\"+Inf\"} 2\n") != NULL,
+	                  true);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_step_duration_seconds_count "
+	                                  "2\n") != NULL, true);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_frames_total 1") != NULL,
+	                  true);
+	free(metrics);
+	CUTE_assertEquals(update_grid_generations(&metrics_grid, 1), 0);
+	CUTE_assertEquals(poll_metrics(&metrics_grid, 0), 0);
+	metrics = read_file(path);
+	CUTE_runTimeAssert(metrics != NULL);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_generation 8\n") != NULL,
+	                  true);
+	free(metrics);
+	CUTE_assertEquals(write_metrics(&metrics_grid, 0), 0);
+	metrics = read_file(path);
+	CUTE_runTimeAssert(metrics != NULL);
+	CUTE_assertEquals(strstr(metrics, "\ncyano_generation 9\n") != NULL,
+	                  true);
+	free(metrics);
+	stop_metrics();
+
+	fputs("Population of an inverted grid\n", stderr);
+	CUTE_assertEquals(set_grid_rule(&metrics_grid, "B0/S8"), 0);
+	CUTE_assertEquals(update_grid(&metrics_grid), 0);
+	CUTE_assertEquals(metrics_grid.inverted, true);
+	uint64_t population = 0;
+	for (int row = 0; row < 10; ++row) {
+		for (int col = 0; col < 100; ++col) {
+			population += get_grid_cell(&metrics_grid, row, col) == ALIVE;
+		}
+	}
+	CUTE_assertEquals(get_grid_population(&metrics_grid), population);
+	free_grid(&metrics_grid);
+
+	fputs("Population counted by the update through bands\n", stderr);
+	CUTE_assertEquals(init_grid(&metrics_grid, 4096, 1024, true), 0);
+	CUTE_assertEquals(set_grid_rule(&metrics_grid, "B3/S23"), 0);
+	for (int col = 0; col < 4096; col += 8) {
+		toggle_cell(&metrics_grid, 500, col);
+		toggle_cell(&metrics_grid, 500, col + 1);
+		toggle_cell(&metrics_grid, 500, col + 2);
+	}
+	CUTE_assertEquals(start_metrics(path, 3600), 0);
+	CUTE_assertEquals(update_grid_generations(&metrics_grid, 16), 0);
+	population = get_grid_population(&metrics_grid);
+	CUTE_runTimeAssert(population > 0);
+	/* Set by hand, at the same generation: not counted by the writer */
+	toggle_cell(&metrics_grid, 0, 0);
+	CUTE_assertEquals(write_metrics(&metrics_grid, 0), 0);
+	metrics = read_file(path);
+	CUTE_runTimeAssert(metrics != NULL);
+	char line[64];
+	sprintf(line, "\ncyano_population %llu\n", (unsigned long long) population);
+	CUTE_assertEquals(strstr(metrics, line) != NULL, true);
+	free(metrics);
+	stop_metrics();
+	free_grid(&metrics_grid);
+	remove(path);
+	fputs("OK\n", stderr);
+}
+
+void test_control(void) {
+	static const char path[] = "test_grid.commands";
+	static const char replies_path[] = "test_grid.replies";
+	static const char saved_path[] = "test_grid_control.rle";
+	fputs("-- Test for the commands driving a grid\n", stderr);
+	CUTE_assertEquals(write_file(path, "set 1 0 1 1 1 2\n"
+	                                   "status\n"
+	                                   "step\n"
+	                                   "query 0 0 3 3\n"
+	                                   "\n"
+	                                   "# Added at the bottom right\n"
+	                                   "rle 5 6\n"
+	                                   "x = 3, y = 2, rule = B3/S23\n"
+	                                   "bo$\n"
+	                                   "3o!\n"
+	                                   "status\n"
+	                                   "unset 6 6 9 9\n"
+	                                   "unset 6 10\n"
+	                                   "query 7 7 3 3\n"
+	                                   "query 8 8 3 3\n"
+	                                   "save test_grid_control.rle\n"
+	                                   "resume\n"
+	                                   "status\n"
+	                                   "bogus 1\n"
+	                                   "quit\n"
+	                                   "status\n"), 0);
+	FILE *replies = fopen(replies_path, "w");
+	CUTE_runTimeAssert(replies != NULL);
+	struct grid control_grid;
+	CUTE_assertEquals(init_grid(&control_grid, 10, 10, false), 0);
+	CUTE_assertEquals(set_grid_rule(&control_grid, "B3/S23"), 0);
+	struct control control;
+	struct control_state state = {false, 0, false};
+	CUTE_assertEquals(open_control(&control, path, replies), 0);
+	/* The steps are advanced through before the next commands are applied */
+	while (!state.quit && wait_control(&control, 1000)) {
+		int rc = apply_control(&control, &control_grid, &state);
+		CUTE_runTimeAssert(rc >= 0);
+		if (state.steps > 0) {
+			CUTE_assertEquals(update_grid_generations(&control_grid,
+			                                          state.steps), 0);
+			state.steps = 0;
+		}
+	}
+	close_control(&control);
+	CUTE_assertEquals(fclose(replies), 0);
+	CUTE_assertEquals(state.play, true);
+	char *answers = read_file(replies_path);
+	CUTE_runTimeAssert(answers != NULL);
+	/* The last line feed is not read */
+	CUTE_assertEquals(strcmp(answers, "ok\n"
+	                                  "ok generation 0 population 3 paused\n"
+	                                  "ok\n"
+	                                  "ok 3 3\n"
+	                                  "...\n"
+	                                  "@@@\n"
+	                                  "...\n"
+	                                  "ok\n"
+	                                  "ok generation 1 population 7 paused\n"
+	                                  "ok\n"
+	                                  "error invalid coordinates\n"
+	                                  "ok 3 3\n"
+	                                  "@..\n"
+	                                  "...\n"
+	                                  "...\n"
+	                                  "error invalid rectangle\n"
+	                                  "ok\n"
+	                                  "ok\n"
+	                                  "ok generation 1 population 6 running\n"
+	                                  "error unknown command bogus\n"
+	                                  "ok"), 0);
+	free(answers);
+	char *saved = read_file(saved_path);
+	CUTE_runTimeAssert(saved != NULL);
+	CUTE_assertEquals(strncmp(saved, "x = 10, y = 10", 14), 0);
+	free(saved);
+
+	fputs("Patterns wrapped around a toroidal grid\n", stderr);
+	CUTE_assertEquals(write_file(path, "rle 9 9\n"
+	                                   "x = 2, y = 2\n"
+	                                   "2o$bo!\n"
+	                                   "query 9 9 2 2\n"), 0);
+	CUTE_runTimeAssert((replies = fopen(replies_path, "w")) != NULL);
+	clear_grid(&control_grid);
+	control_grid.wrap = true;
+	CUTE_assertEquals(open_control(&control, path, replies), 0);
+	while (wait_control(&control, 1000)) {
+		CUTE_assertEquals(apply_control(&control, &control_grid, &state), 0);
+	}
+	close_control(&control);
+	CUTE_assertEquals(fclose(replies), 0);
+	CUTE_assertEquals(get_grid_cell(&control_grid, 9, 9), ALIVE);
+	CUTE_assertEquals(get_grid_cell(&control_grid, 9, 0), ALIVE);
+	CUTE_assertEquals(get_grid_cell(&control_grid, 0, 0), ALIVE);
+	CUTE_assertEquals(get_grid_population(&control_grid), 3);
+	answers = read_file(replies_path);
+	CUTE_runTimeAssert(answers != NULL);
+	CUTE_assertEquals(strcmp(answers, "ok\nok 2 2\n@@\n.@"), 0);
+	free(answers);
+	free_grid(&control_grid);
+	remove(path);
+	remove(replies_path);
+	remove(saved_path);
+	fputs("OK\n", stderr);
+}
+
+/* Give the row or column of a grid of the given size at an offset from a
+   position, or -1 beyond its walls */
+static long long _region_cell(long long start, long long offset,
+                              unsigned int size, bool wrap) {
+	long long cell = start + offset;
+	if (wrap) {
+		return (cell % size + size) % size;
+	}
+	return cell >= 0 && cell < size ? cell : -1;
+}
+
+void test_grid_regions(void) {
+	static const char *const rules[] = {"B3/S23", "B0/S8", "B2/S/C4"};
+	static const long long offsets[][2] = {
+		{0, 0}, {-3, -70}, {5, 630}, {2, 699}, {-1000000007LL, 3}
+	};
+	static const enum blit_mode modes[] = {BLIT_COPY, BLIT_OR, BLIT_XOR};
+	/* The rows cross words and end in the middle of one; the pattern is
+	   taller than the grid */
+	enum {WIDTH = 700, HEIGHT = 9, PATTERN_WIDTH = 150, PATTERN_HEIGHT = 12};
+	fputs("-- Test for the blits, extractions and counts of rectangles\n",
+	      stderr);
+	struct grid pattern;
+	CUTE_assertEquals(init_grid(&pattern, PATTERN_WIDTH, PATTERN_HEIGHT,
+	                            false), 0);
+	srand(42);
+	for (int cell = 0; cell < PATTERN_WIDTH * PATTERN_HEIGHT; ++cell) {
+		if (rand() % 3 == 0) {
+			toggle_cell(&pattern, cell / PATTERN_WIDTH, cell % PATTERN_WIDTH);
+		}
+	}
+	static unsigned int before[HEIGHT][WIDTH];
+	static char bits[(200 * 20 + 7) / 8];
+	for (size_t r = 0; r < sizeof rules / sizeof *rules; ++r) {
+		for (int wrap = 0; wrap < 2; ++wrap) {
+			fprintf(stderr, "%s, %s: same cells as cell by cell\n", rules[r],
+			        wrap ? "toroidal" : "walls");
+			for (size_t o = 0; o < sizeof offsets / sizeof *offsets; ++o) {
+				long long row = offsets[o][0];
+				long long col = offsets[o][1];
+				struct grid region_grid;
+				CUTE_assertEquals(init_grid(&region_grid, WIDTH, HEIGHT, wrap),
+				                  0);
+				CUTE_assertEquals(set_grid_rule(&region_grid, rules[r]), 0);
+				for (int cell = 0; cell < WIDTH * HEIGHT; ++cell) {
+					if (rand() % 2 == 0) {
+						toggle_cell(&region_grid, cell / WIDTH, cell % WIDTH);
+					}
+				}
+				/* Some cells are dying */
+				CUTE_assertEquals(update_grid(&region_grid), 0);
+				set_grid_inverted(&region_grid, r == 1);
+
+				/* The rectangle is cut to the size of a toroidal grid */
+				long long height = wrap ? MIN(PATTERN_HEIGHT, HEIGHT)
+				                        : PATTERN_HEIGHT;
+				uint64_t population = 0;
+				for (long long i = 0; i < height; ++i) {
+					long long to_row = _region_cell(row, i, HEIGHT, wrap);
+					for (long long j = 0; j < PATTERN_WIDTH; ++j) {
+						long long to_col = _region_cell(col, j, WIDTH, wrap);
+						population += to_row >= 0 && to_col >= 0
+						              && get_grid_cell(&region_grid, to_row,
+						                               to_col) == ALIVE;
+					}
+				}
+				CUTE_assertEquals(count_grid_region(&region_grid, row, col,
+				                                    PATTERN_WIDTH,
+				                                    PATTERN_HEIGHT),
+				                  population);
+
+				/* The extracted rectangle is not cut */
+				extract_grid_region(&region_grid, row, col, 200, 20, bits);
+				for (long long i = 0; i < 20; ++i) {
+					long long to_row = _region_cell(row, i, HEIGHT, wrap);
+					for (long long j = 0; j < 200; ++j) {
+						long long to_col = _region_cell(col, j, WIDTH, wrap);
+						bool alive = to_row >= 0 && to_col >= 0
+						             && get_grid_cell(&region_grid, to_row,
+						                              to_col) == ALIVE;
+						CUTE_assertEquals(get_bit(bits, i * 200 + j), alive);
+					}
+				}
+
+				enum blit_mode mode = modes[o % 3];
+				for (int i = 0; i < HEIGHT; ++i) {
+					for (int j = 0; j < WIDTH; ++j) {
+						before[i][j] = get_grid_cell_state(&region_grid, i, j);
+					}
+				}
+				blit_grid(&region_grid, &pattern, row, col, mode);
+				for (long long i = 0; i < height; ++i) {
+					long long to_row = _region_cell(row, i, HEIGHT, wrap);
+					for (long long j = 0; to_row >= 0 && j < PATTERN_WIDTH;
+					     ++j) {
+						long long to_col = _region_cell(col, j, WIDTH, wrap);
+						if (to_col < 0) {
+							continue;
+						}
+						unsigned int *state = &before[to_row][to_col];
+						bool live = get_grid_cell(&pattern, i, j) == ALIVE;
+						if (mode == BLIT_COPY || (live && mode == BLIT_OR)) {
+							*state = live ? ALIVE : DEAD;
+						} else if (live) {
+							*state = *state == ALIVE ? DEAD : ALIVE;
+						}
+					}
+				}
+				for (int i = 0; i < HEIGHT; ++i) {
+					for (int j = 0; j < WIDTH; ++j) {
+						CUTE_assertEquals(get_grid_cell_state(&region_grid, i,
+						                                      j),
+						                  before[i][j]);
+					}
+				}
+				/* The padding stays blank */
+				CUTE_assertEquals(get_bit(region_grid.cells, WIDTH), 0);
+				free_grid(&region_grid);
+			}
+		}
+	}
+	free_grid(&pattern);
+
+	fputs("Fragment of an RLE pattern\n", stderr);
+	struct grid region_grid;
+	CUTE_assertEquals(init_grid(&region_grid, 10, 10, true), 0);
+	CUTE_assertEquals(set_grid_rule(&region_grid, "B2/S/C4"), 0);
+	toggle_cell(&region_grid, 9, 9);
+	CUTE_assertEquals(blit_grid_rle(&region_grid, "# A comment\n"
+	                                              "2oA$\n"
+	                                              "3bB!", 9, 8, BLIT_XOR),
+	                  0);
+	CUTE_assertEquals(get_grid_cell_state(&region_grid, 9, 8), ALIVE);
+	CUTE_assertEquals(get_grid_cell_state(&region_grid, 9, 9), DEAD);
+	CUTE_assertEquals(get_grid_cell_state(&region_grid, 9, 0), ALIVE);
+	/* The dying cells of the pattern count as dead */
+	CUTE_assertEquals(get_grid_cell_state(&region_grid, 0, 1), DEAD);
+	CUTE_assertEquals(get_grid_population(&region_grid), 2);
+	CUTE_assertEquals(blit_grid_rle(&region_grid, "x = 2, y = 1\n2o!", 0, 0,
+	                                BLIT_OR), 0);
+	CUTE_assertEquals(count_grid_region(&region_grid, -1, -2, 4, 2), 4);
+	CUTE_runTimeAssert(blit_grid_rle(&region_grid, "2o$z!", 0, 0, BLIT_OR)
+	                   < 0);
+	free_grid(&region_grid);
+	fputs("OK\n", stderr);
+}
+
 void build_case_grid(void) {
-	case_grid = CUTE_newTestCase("Tests for the grid structure", 3);
+	case_grid = CUTE_newTestCase("Tests for the grid structure", 27);
 	CUTE_setCaseBefore(case_grid, setUp);
 	CUTE_setCaseAfter(case_grid, tearDown);
 	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_blinker_after_one_gen));
 	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_blinker_after_two_gens));
 	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_glider_rle_repr));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_copy_grid));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_snapshot_round_trip));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_checkpoint_round_trip));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_macrocell_round_trip));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_life106_round_trip));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_generations_rle));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_hensel_rule));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_larger_than_life));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_neighborhoods));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_b0_rule));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_row_kernels));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_update_generations));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_workers));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_rules_file));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_row_stride));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_huge_grid));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_bookmarks));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_history));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_phase_timers));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_trace));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_grid_stats));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_metrics));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_control));
+	CUTE_addCaseTest(case_grid, CUTE_makeTest(test_grid_regions));
 }